@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ip {
+
+enum class SampleFormat { kS16, kS32, kFloat };  // native endianness
+
+struct AudioFormat {
+  SampleFormat format;
+  uint32_t rate;
+  uint16_t channels;
+
+  size_t BytesPerSample() const {
+    return format == SampleFormat::kS16 ? 2 : 4;
+  }
+  size_t BytesPerFrame() const { return BytesPerSample() * channels; }
+};
+
+inline bool operator==(const AudioFormat& lhs, const AudioFormat& rhs) {
+  return lhs.format == rhs.format && lhs.rate == rhs.rate &&
+         lhs.channels == rhs.channels;
+}
+
+inline bool operator!=(const AudioFormat& lhs, const AudioFormat& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace ip
@@ -0,0 +1,462 @@
+#include "iplayer/audio_output.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "iplayer/pcm_mix.h"
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+struct AudioOutput::Lane {
+  Lane(size_t capacity)
+      : ring(capacity),
+        interrupted(false),
+        active(false),
+        fade_out(false),
+        cut(false) {}
+
+  SpscRing ring;
+  bool interrupted;
+  bool active;    // a track is being written, empty ring is an underrun
+  bool fade_out;  // mixed out as soon as the other lane starts a stream
+  bool cut;       // end of its fade is over, late writes are dropped
+};
+
+struct AudioOutput::Shared {
+  Shared(IAudioSinkPtr sink_, Options options_)
+      : sink(std::move(sink_)),
+        options(options_),
+        lanes{{options_.buffer_size}, {options_.buffer_size}},
+        configured(false),
+        format{SampleFormat::kS16, 0, 0},
+        frame_size(1),
+        paused(false),
+        stop(false),
+        writing(false),
+        underruns(0),
+        overruns(0),
+        front(0),
+        crossfade(0),
+        fading(false),
+        fade_position(0),
+        fade_length(0),
+        dsp_version(0) {}
+
+  // all of the following expect mutex to be locked
+  Lane& Front() { return lanes[front]; }
+  Lane& Back() { return lanes[1 - front]; }
+  bool Readable(const Lane& lane) const {
+    return lane.ring.Size() >= frame_size;
+  }
+  size_t Frames(const Lane& lane) const {
+    return lane.ring.Size() / frame_size;
+  }
+  size_t FadeFrames() const;
+  bool Playable();  // output thread has something to do
+  void Prepare();   // output thread: switch lanes, start/end fades
+  void EndFade();
+  std::error_code ProducerError(const Lane& lane) const;
+
+  IAudioSinkPtr sink;  // only used by output thread once configured
+  Options options;
+  Lane lanes[2];
+
+  mutable std::mutex mutex;  // only protects sleeping/waking, not the data
+  std::condition_variable cv;
+  bool configured;
+  AudioFormat format;
+  size_t frame_size;  // sink writes are aligned on it
+  bool paused;
+  bool stop;
+  bool writing;  // output thread is in sink->Write()
+  std::error_code sink_error;
+  std::atomic<uint64_t> underruns;
+  std::atomic<uint64_t> overruns;
+
+  size_t front;  // lane being played
+  std::chrono::milliseconds crossfade;
+  bool fading;           // front lane is mixed with the back one
+  size_t fade_position;  // in frames
+  size_t fade_length;
+
+  mutable std::mutex dsp_mutex;
+  DspSettingsPtr dsp_settings;
+  std::atomic<uint64_t> dsp_version;
+};
+
+size_t AudioOutput::Shared::FadeFrames() const {
+  if (!configured) {
+    return 0;
+  }
+  auto frames = static_cast<size_t>(crossfade.count()) * format.rate / 1000;
+  return std::min(frames, options.buffer_size / frame_size);
+}
+
+bool AudioOutput::Shared::Playable() {
+  if (fading) {
+    return fade_position == fade_length || Readable(Back());
+  }
+  auto& current = Front();
+  return Readable(current) ||
+         ((!current.active || current.fade_out) && Readable(Back()));
+}
+
+void AudioOutput::Shared::Prepare() {
+  if (Back().cut) {
+    Back().ring.Clear();
+  }
+  if (fading && fade_position == fade_length) {
+    EndFade();
+  }
+  auto& current = Front();
+  if (!fading && current.fade_out && Readable(Back())) {
+    // a stream being written fades right now, an ended one over its last
+    // frames
+    auto fade_frames = FadeFrames();
+    if (current.active || Frames(current) <= fade_frames) {
+      fading = true;
+      fade_position = 0;
+      fade_length = current.active ? fade_frames : Frames(current);
+      if (fade_length == 0) {
+        EndFade();
+      }
+    }
+  }
+  if (!fading && !Readable(Front()) && !Front().active && Readable(Back())) {
+    Front().fade_out = false;
+    front = 1 - front;  // previous stream is over
+  }
+}
+
+void AudioOutput::Shared::EndFade() {
+  auto& current = Front();
+  if (current.active) {
+    current.interrupted = true;  // its producer is told to stop
+    current.cut = true;
+  }
+  current.active = false;
+  current.fade_out = false;
+  current.ring.Clear();
+  fading = false;
+  front = 1 - front;
+  cv.notify_all();
+}
+
+std::error_code AudioOutput::Shared::ProducerError(const Lane& lane) const {
+  if (stop || lane.interrupted) {
+    return std::make_error_code(std::errc::operation_canceled);
+  }
+  return sink_error;
+}
+
+AudioOutput::AudioOutput(IAudioSinkPtr sink)
+    : AudioOutput(std::move(sink), Options()) {}
+
+AudioOutput::AudioOutput(IAudioSinkPtr sink, Options options)
+    : shared_(std::make_shared<Shared>(std::move(sink), options)),
+      lane_(0),
+      owned_partner_(new AudioOutput(shared_, 1, this)),
+      partner_(owned_partner_.get()) {
+  output_future_ =
+      std::async(std::launch::async, &AudioOutput::OutputThread, this);
+}
+
+AudioOutput::AudioOutput(std::shared_ptr<Shared> shared, size_t lane,
+                         AudioOutput* partner)
+    : shared_(std::move(shared)), lane_(lane), partner_(partner) {}
+
+AudioOutput::~AudioOutput() {
+  if (lane_ != 0) {
+    return;  // first lane stops everything
+  }
+  Stop();
+  if (shared_->sink) {
+    shared_->sink->Close();
+  }
+}
+
+std::error_code AudioOutput::Configure(const AudioFormat& format) {
+  auto& s = *shared_;
+  auto& lane = s.lanes[lane_];
+  std::unique_lock<std::mutex> lock(s.mutex);
+  lane.interrupted = false;
+  lane.cut = false;
+  s.cv.notify_all();
+  if (s.configured && !s.sink_error && format == s.format) {
+    return {};
+  }
+
+  // output thread must be done with previous format, on both lanes: no
+  // crossfade, a stream still being written would never end
+  lane.active = false;
+  auto& other = s.lanes[1 - lane_];
+  if (other.fade_out && other.active) {
+    other.interrupted = true;
+    other.active = false;
+  }
+  other.fade_out = false;
+  s.cv.wait(lock, [&]() {
+    return s.stop || (lane.ring.Size() == 0 && other.ring.Size() == 0 &&
+                      !s.writing);
+  });
+  if (s.stop) {
+    return std::make_error_code(std::errc::operation_canceled);
+  }
+  if (s.sink_error) {
+    // give a failing sink a chance to recover
+    s.sink->Close();
+    s.sink_error.clear();
+  }
+  s.configured = false;
+  auto ec = s.sink->Open(format);
+  if (ec) {
+    return ec;
+  }
+  s.configured = true;
+  s.format = format;
+  s.frame_size = format.BytesPerFrame();
+  return {};
+}
+
+std::error_code AudioOutput::Write(const uint8_t* data, size_t len) {
+  auto& s = *shared_;
+  auto& lane = s.lanes[lane_];
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto ec = s.ProducerError(lane);
+    if (ec) {
+      return ec;
+    }
+  }
+  while (len > 0) {
+    auto written = lane.ring.Write(data, len);
+    data += written;
+    len -= written;
+    if (written) {
+      {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.ProducerError(lane)) {
+          lane.active = true;  // a cut stream must not look alive
+        }
+      }
+      s.cv.notify_all();
+    }
+    if (len == 0) {
+      break;
+    }
+    // ring is full: sleep until the output thread made room for a period
+    std::unique_lock<std::mutex> lock(s.mutex);
+    if (!s.paused) {
+      ++s.overruns;
+    }
+    auto wanted = std::min({len, s.options.period_size, lane.ring.Capacity()});
+    s.cv.wait(lock, [&]() {
+      return s.ProducerError(lane) || lane.ring.Free() >= wanted;
+    });
+    auto ec = s.ProducerError(lane);
+    if (ec) {
+      return ec;
+    }
+  }
+  return {};
+}
+
+void AudioOutput::EndOfStream() {
+  auto& s = *shared_;
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.lanes[lane_].active = false;
+  s.cv.notify_all();  // a fade might start
+}
+
+std::error_code AudioOutput::Drain() {
+  auto& s = *shared_;
+  auto& lane = s.lanes[lane_];
+  std::unique_lock<std::mutex> lock(s.mutex);
+  lane.active = false;
+  s.cv.notify_all();
+  s.cv.wait(lock, [&]() {
+    return s.ProducerError(lane) || (lane.ring.Size() == 0 && !s.writing);
+  });
+  return s.ProducerError(lane);
+}
+
+void AudioOutput::Interrupt() {
+  auto& s = *shared_;
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.lanes[lane_].interrupted = true;
+  s.cv.notify_all();
+}
+
+void AudioOutput::Flush() {
+  auto& s = *shared_;
+  auto& lane = s.lanes[lane_];
+  std::unique_lock<std::mutex> lock(s.mutex);
+  lane.active = false;
+  s.cv.wait(lock, [&]() { return s.stop || !s.writing; });
+  // output thread can't read while mutex is locked and not writing
+  lane.ring.Clear();
+  // a fade involving this lane is over, the other one goes on alone
+  s.fading = false;
+  bool playing = &lane == &s.Front();
+  if (playing) {
+    lane.fade_out = false;
+    if (s.configured && !s.stop) {
+      s.sink->Flush();
+    }
+  }
+  s.cv.notify_all();
+}
+
+void AudioOutput::Pause() {
+  std::lock_guard<std::mutex> lock(shared_->mutex);
+  shared_->paused = true;
+}
+
+void AudioOutput::Unpause() {
+  std::lock_guard<std::mutex> lock(shared_->mutex);
+  shared_->paused = false;
+  shared_->cv.notify_all();
+}
+
+void AudioOutput::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    shared_->stop = true;
+    shared_->cv.notify_all();
+  }
+  if (output_future_.valid()) {
+    output_future_.wait();
+  }
+}
+
+AudioOutputStats AudioOutput::GetStats() const {
+  const auto& ring = shared_->lanes[lane_].ring;
+  AudioOutputStats stats;
+  stats.fill = ring.Size();
+  stats.capacity = ring.Capacity();
+  stats.underruns = shared_->underruns;
+  stats.overruns = shared_->overruns;
+  return stats;
+}
+
+size_t AudioOutput::BytesPerSecond() const {
+  const auto& s = *shared_;
+  std::lock_guard<std::mutex> lock(s.mutex);
+  return s.configured ? s.format.rate * s.format.BytesPerFrame() : 0;
+}
+
+void AudioOutput::SetDspSettings(DspSettingsPtr settings) {
+  std::lock_guard<std::mutex> lock(shared_->dsp_mutex);
+  shared_->dsp_settings = std::move(settings);
+  ++shared_->dsp_version;
+}
+
+DspSettingsPtr AudioOutput::GetDspSettings() const {
+  std::lock_guard<std::mutex> lock(shared_->dsp_mutex);
+  return shared_->dsp_settings;
+}
+
+uint64_t AudioOutput::DspVersion() const {
+  return shared_->dsp_version;
+}
+
+void AudioOutput::SetCrossfade(std::chrono::milliseconds overlap) {
+  std::lock_guard<std::mutex> lock(shared_->mutex);
+  shared_->crossfade = std::max(overlap, std::chrono::milliseconds(0));
+}
+
+std::chrono::milliseconds AudioOutput::GetCrossfade() const {
+  std::lock_guard<std::mutex> lock(shared_->mutex);
+  return shared_->crossfade;
+}
+
+void AudioOutput::FadeOut() {
+  auto& s = *shared_;
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.lanes[lane_].fade_out = true;
+  s.cv.notify_all();
+}
+
+void AudioOutput::OutputThread() {
+  auto& s = *shared_;
+  // both allocated once, mixing happens in place in 'period'
+  std::vector<uint8_t> period(s.options.period_size);
+  std::vector<uint8_t> incoming(s.options.period_size);
+  while (true) {
+    size_t len = 0;
+    size_t out_len = 0;  // fading out stream may end before the fade
+    bool discard = false;
+    bool mix = false;
+    size_t position = 0;
+    size_t length = 0;
+    SpscRing* ring = nullptr;
+    SpscRing* in_ring = nullptr;
+    AudioFormat format;
+    {
+      std::unique_lock<std::mutex> lock(s.mutex);
+      s.writing = false;
+      if (!s.Playable() && s.Front().active && !s.paused) {
+        ++s.underruns;
+      }
+      s.cv.notify_all();  // Drain(), Flush()... might wait for writing
+      s.cv.wait(lock, [&]() { return s.stop || (!s.paused && s.Playable()); });
+      if (s.stop) {
+        return;
+      }
+      s.writing = true;
+      s.Prepare();
+
+      auto& current = s.Front();
+      auto& next = s.Back();
+      auto period_frames = period.size() / s.frame_size;
+      auto frames = std::min(s.Frames(current), period_frames);
+      if (s.fading) {
+        mix = true;
+        position = s.fade_position;
+        length = s.fade_length;
+        frames = std::min({period_frames, length - position, s.Frames(next)});
+        out_len = std::min(frames, s.Frames(current)) * s.frame_size;
+        s.fade_position += frames;
+      } else if (current.fade_out && !current.active && s.Readable(next)) {
+        // stop exactly where the fade has to start
+        frames = std::min(frames, s.Frames(current) - s.FadeFrames());
+      }
+      len = frames * s.frame_size;
+      ring = &current.ring;
+      in_ring = &next.ring;
+      format = s.format;
+      discard = s.sink_error || !s.configured;
+    }
+    if (len == 0) {
+      continue;  // lanes changed, look again
+    }
+
+    if (mix) {
+      in_ring->Read(incoming.data(), len);
+      ring->Read(period.data(), out_len);
+      memset(period.data() + out_len, 0, len - out_len);
+      CrossfadePcm(format, period.data(), incoming.data(),
+                   len / format.BytesPerFrame(), position, length,
+                   period.data());
+    } else {
+      len = ring->Read(period.data(), len);
+    }
+    // producer might wait for room, taking the mutex makes sure it either
+    // sees the new ring state or is already sleeping
+    { std::lock_guard<std::mutex> lock(s.mutex); }
+    s.cv.notify_all();
+    if (discard) {
+      continue;  // producer is told about the error, don't insist
+    }
+
+    auto ec = s.sink->Write(period.data(), len);
+    if (ec) {
+      LOG("[E] audio output failed: %s", ec.message().c_str());
+      std::lock_guard<std::mutex> lock(s.mutex);
+      s.sink_error = ec;
+    }
+  }
+}
+
+}  // namespace ip
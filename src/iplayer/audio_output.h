@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#include "iplayer/audio_format.h"
+#include "iplayer/dsp_chain.h"
+#include "iplayer/i_audio_sink.h"
+#include "iplayer/utils/spsc_ring.h"
+
+namespace ip {
+
+struct AudioOutputStats {
+  size_t fill = 0;  // bytes buffered, not yet given to the sink
+  size_t capacity = 0;
+  uint64_t underruns = 0;  // sink starved while a track was playing
+  uint64_t overruns = 0;   // producer had to wait for room in the ring
+};
+
+// Long-lived output session owned by Core and borrowed by decoders one after
+// the other: the decoder thread writes PCM to a lock-free ring, a dedicated
+// output thread forwards it to the sink by periods. Both threads only sleep
+// on a condition variable when the ring is full/empty, never spin.
+//
+// A track ending doesn't drain anything so the next one follows without gap,
+// the sink is only reopened when the format changes and buffered audio is
+// only dropped by an explicit Flush().
+//
+// For crossfades the session has a second lane, its Partner(): an
+// AudioOutput of its own (ring, producer state) sharing the sink and output
+// thread. Streams of both lanes are played one after the other, unless the
+// playing one is told to FadeOut(): then it is mixed with the first frames
+// of the partner's next stream (equal power, sample accurate). A stream
+// already written up to its end fades over its last frames, one still
+// being written is cut once the overlap is over.
+
+class AudioOutput {
+ public:
+  struct Options {
+    size_t buffer_size = 256 * 1024;  // ring depth, ~1.5s of CD audio
+    size_t period_size = 16 * 1024;   // max bytes per sink write
+  };
+
+  explicit AudioOutput(IAudioSinkPtr sink);
+  AudioOutput(IAudioSinkPtr sink, Options options);
+  ~AudioOutput();
+
+  // Producer side, a stream starts with Configure() which also ends an
+  // interruption (pause state is kept, a seek doesn't resume playback).
+  // When 'format' differs from the current one, it waits for buffered audio
+  // to be played before reopening the sink.
+  std::error_code Configure(const AudioFormat& format);
+
+  // Block while the ring is full. Returns the sink error if it failed,
+  // operation_canceled after Interrupt() or Stop().
+  std::error_code Write(const uint8_t* data, size_t len);
+  void EndOfStream();       // running out of data is expected now
+  std::error_code Drain();  // EndOfStream() and wait until all is played
+
+  void Interrupt();  // make producer's pending and next writes fail
+  void Flush();      // drop what's buffered (ring and sink), on stop/seek
+  void Pause();      // stop feeding the sink (producer blocks when full)
+  void Unpause();
+  void Stop();  // end output thread and unblock producer, can't be undone
+
+  AudioOutputStats GetStats() const;
+  size_t BytesPerSecond() const;  // of the current format, 0 if none
+
+  // Processing decoders apply to what they write (nullptr for none), they
+  // poll the version to follow changes while playing. Shared by both lanes.
+  void SetDspSettings(DspSettingsPtr settings);
+  DspSettingsPtr GetDspSettings() const;
+  uint64_t DspVersion() const;
+
+  AudioOutput* Partner() { return partner_; }  // the other lane
+  // Overlap of crossfades (0 disables), shared by both lanes and limited by
+  // the buffer size: what fades out must fit in the ring
+  void SetCrossfade(std::chrono::milliseconds overlap);
+  std::chrono::milliseconds GetCrossfade() const;
+  void FadeOut();  // current stream is replaced by partner's next one
+
+ private:
+  struct Lane;
+  struct Shared;
+
+  AudioOutput(std::shared_ptr<Shared> shared, size_t lane,
+              AudioOutput* partner);  // partner lane
+
+  void OutputThread();
+
+  std::shared_ptr<Shared> shared_;  // sink, output thread state, both lanes
+  size_t lane_;
+  std::unique_ptr<AudioOutput> owned_partner_;  // first lane owns the second
+  AudioOutput* partner_;
+  std::future<void> output_future_;  // first lane only
+};
+
+}  // namespace ip
@@ -0,0 +1,31 @@
+#include "iplayer/audio_sink_factory.h"
+
+namespace ip {
+
+IAudioSinkPtr AudioSinkFactory::Create(const std::string& spec) const {
+  auto separator = spec.find(':');
+  auto name = spec.substr(0, separator);
+  std::string argument;
+  if (separator != std::string::npos) {
+    argument = spec.substr(separator + 1);
+  }
+
+  Builder builder;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sinks_.find(name);
+    if (it == std::cend(sinks_)) {
+      return nullptr;
+    }
+    builder = it->second;
+  }
+  // unlocked, a builder can create other sinks (fan-out)
+  return builder(argument);
+}
+
+void AudioSinkFactory::Register(const std::string& name, Builder builder) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sinks_[name] = builder;
+}
+
+}  // namespace ip
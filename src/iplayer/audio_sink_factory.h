@@ -0,0 +1,26 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "iplayer/i_audio_sink.h"
+
+namespace ip {
+
+// Sinks are selected by a "name[:argument]" spec, ex: "null", "pulse",
+// "file:/tmp/out.wav", "shm:/iplayer", "fanout:pulse,file:/tmp/out.wav"
+class AudioSinkFactory {
+ public:
+  using Builder = std::function<IAudioSinkPtr(const std::string& argument)>;
+
+  IAudioSinkPtr Create(const std::string& spec) const;
+  void Register(const std::string& name, Builder builder);
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<std::string, Builder> sinks_;
+};
+
+}  // namespace ip
@@ -0,0 +1,124 @@
+#include "iplayer/batch_verifier.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+double VerifyResult::Speed() const {
+  if (decode_time.count() == 0) {
+    return 0;
+  }
+  return static_cast<double>(stats.decoded.count()) / decode_time.count();
+}
+
+BatchVerifier::BatchVerifier(ProviderFactory get_provider,
+                             DecoderFactory create_decoder,
+                             SinkFactory create_sink)
+    : BatchVerifier(std::move(get_provider), std::move(create_decoder),
+                    std::move(create_sink), Options()) {}
+
+BatchVerifier::BatchVerifier(ProviderFactory get_provider,
+                             DecoderFactory create_decoder,
+                             SinkFactory create_sink, Options options)
+    : options_(options),
+      get_provider_(std::move(get_provider)),
+      create_decoder_(std::move(create_decoder)),
+      create_sink_(std::move(create_sink)) {}
+
+std::vector<VerifyResult> BatchVerifier::Run(
+    const std::vector<TrackLocation>& locations, ReportCb report) {
+  std::vector<VerifyResult> results(locations.size());
+  std::atomic<size_t> next(0);
+  std::mutex report_mutex;
+
+  // tracks are picked one at a time so a long one doesn't hold back others
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next++) < locations.size()) {
+      results[i] = Verify(locations[i]);
+      if (report) {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        report(results[i]);
+      }
+    }
+  };
+
+  size_t jobs = options_.jobs;
+  if (jobs == 0) {
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  jobs = std::min(jobs, locations.size());
+  std::vector<std::future<void>> workers;
+  for (size_t i = 0; i < jobs; ++i) {
+    workers.push_back(std::async(std::launch::async, worker));
+  }
+  for (auto& w : workers) {
+    w.get();
+  }
+  return results;
+}
+
+VerifyResult BatchVerifier::Verify(const TrackLocation& location) const {
+  VerifyResult result;
+  result.location = location;
+  auto start = std::chrono::steady_clock::now();
+  try {
+    result.ec = Decode(location, &result);
+  } catch (const std::system_error& ex) {
+    result.ec = ex.code();
+  } catch (const std::exception& ex) {
+    UNUSED(ex);
+    LOG("cannot verify %s: %s", location.c_str(), ex.what());
+    result.ec = std::make_error_code(std::errc::bad_message);
+  }
+  result.decode_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  return result;
+}
+
+std::error_code BatchVerifier::Decode(const TrackLocation& location,
+                                      VerifyResult* result) const {
+  auto provider = get_provider_(location);
+  if (!provider) {
+    return std::make_error_code(std::errc::protocol_not_supported);
+  }
+  auto info = provider->GetTrackInfo(location);
+  auto index = info.GetFrameIndex();
+  result->duration = index ? index->Duration() : info.Duration();
+
+  std::error_code ec;
+  auto io = provider->OpenTrack(location, ec);
+  if (ec) {
+    return ec;
+  }
+  auto sink = create_sink_(info);
+  if (!sink) {
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+
+  // output session is only alive for this track, it plays right away as the
+  // sink doesn't wait for anybody
+  AudioOutput output(std::move(sink), options_.output);
+  std::promise<std::error_code> completion;
+  auto decoder = create_decoder_(
+      info.Codec(), info, std::move(io), &output,
+      [&completion](const std::error_code& ec) { completion.set_value(ec); });
+  if (!decoder) {
+    LOG("no decoder for %s (%s)", location.c_str(), info.Codec().c_str());
+    return std::make_error_code(std::errc::not_supported);
+  }
+  ec = completion.get_future().get();
+  result->stats = decoder->GetStats();
+  if (ec) {
+    return ec;
+  }
+  return output.Drain();  // a file sink must get everything
+}
+
+}  // namespace ip
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "iplayer/audio_output.h"
+#include "iplayer/i_audio_sink.h"
+#include "iplayer/i_decoder.h"
+#include "iplayer/i_track_provider.h"
+#include "iplayer/track_info.h"
+#include "iplayer/track_location.h"
+
+// Decode many tracks at full speed without ui, to check a whole library:
+// each worker of the pool decodes one track at a time through its own output
+// session and sink (null or file), nothing is shared between workers but
+// the factories.
+
+namespace ip {
+
+struct VerifyResult {
+  TrackLocation location;
+  std::error_code ec;  // track couldn't be decoded until the end
+  DecoderStats stats;
+  std::chrono::milliseconds duration{0};     // expected from metadata
+  std::chrono::milliseconds decode_time{0};  // wall clock
+
+  double Speed() const;  // decoded audio per second of decoding
+};
+
+class BatchVerifier {
+ public:
+  using ProviderFactory =
+      std::function<ITrackProviderPtr(const TrackLocation&)>;
+  using DecoderFactory = std::function<IDecoderPtr(
+      const std::string& codec, const TrackInfo&, ITrackIOPtr, AudioOutput*,
+      IDecoder::CompletionCb)>;
+  using SinkFactory = std::function<IAudioSinkPtr(const TrackInfo&)>;
+  using ReportCb = std::function<void(const VerifyResult&)>;
+
+  struct Options {
+    size_t jobs = 0;  // worker count, 0 for one per core
+    AudioOutput::Options output;
+  };
+
+  BatchVerifier(ProviderFactory get_provider, DecoderFactory create_decoder,
+                SinkFactory create_sink);
+  BatchVerifier(ProviderFactory get_provider, DecoderFactory create_decoder,
+                SinkFactory create_sink, Options options);
+
+  // Block until every track is decoded. 'report' is called from workers as
+  // soon as a track is done, never concurrently. Results are in the order
+  // of 'locations'.
+  std::vector<VerifyResult> Run(const std::vector<TrackLocation>& locations,
+                                ReportCb report);
+
+ private:
+  VerifyResult Verify(const TrackLocation& location) const;
+  std::error_code Decode(const TrackLocation& location,
+                         VerifyResult* result) const;
+
+  const Options options_;
+  ProviderFactory get_provider_;
+  DecoderFactory create_decoder_;
+  SinkFactory create_sink_;
+};
+
+}  // namespace ip
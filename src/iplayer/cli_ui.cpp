@@ -1,7 +1,11 @@
 #include "iplayer/cli_ui.h"
 
 #include <assert.h>
+#include <ctype.h>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 
 #include "iplayer/track_location.h"
 #include "iplayer/utils/log.h"
@@ -17,10 +21,18 @@ void PrintHelp() {
             << "pause                       pause current track" << std::endl
             << "prev / b                    previous track (unpause)" << std::endl
             << "next / n                    next track (unpause)" << std::endl
+            << "seek [+/-]seconds           jump in current track, absolute or relative" << std::endl
             << "stop                        stop and return at start of playlist" << std::endl
             << "repeat_track on/off         current track will repeat" << std::endl
             << "repeat_playlist on/off      playlist will restart when finished"  << std::endl
             << "random_track on/off         play random tracks from playlist"  << std::endl
+            << "normalize on/off            adjust track loudness (from next track)" << std::endl
+            << "volume [dB]                 gain applied to playback, 0 to disable" << std::endl
+            << "eq peak/low/high Hz dB [q]  add an equalizer band, 'eq off' removes all" << std::endl
+            << "limiter on/off              soft limiter, avoids clipping after gain/eq" << std::endl
+            << "remix none/mono/swap        channel remix" << std::endl
+            << "crossfade [seconds]         overlap between tracks, 0 to disable" << std::endl
+            << "resampler fast/medium/best  quality of tracks not at the output rate" << std::endl
             << "add_track [track_name] / a  add track (metadata is dynamically created)" << std::endl
             << "show_track / s              display information about current track" << std::endl
             << "remove_track [track_name]   remove 'track_name" << std::endl
@@ -69,6 +81,44 @@ Cli::Cli(std::unique_ptr<IPlayerControl> player_ctl)
 
 Cli::~Cli() {}
 
+// "off" or "<type> <frequency> <gain_db> [q]"
+void ParseEq(const std::string& parameters, DspSettings* settings) {
+  if (parameters == "off") {
+    settings->eq.clear();
+    return;
+  }
+  std::istringstream stream(parameters);
+  std::string type;
+  EqBand band;
+  if (!(stream >> type >> band.frequency >> band.gain_db)) {
+    throw std::invalid_argument("eq: expected type, frequency and gain");
+  }
+  stream >> band.q;
+  if (type == "peak") {
+    band.type = EqBand::Type::kPeak;
+  } else if (type == "low") {
+    band.type = EqBand::Type::kLowShelf;
+  } else if (type == "high") {
+    band.type = EqBand::Type::kHighShelf;
+  } else {
+    throw std::invalid_argument("eq: unknown band type '" + type + "'");
+  }
+  settings->eq.push_back(band);
+}
+
+// seconds of a seek, '*relative' when they have a sign (+10, -5)
+std::chrono::seconds ParseSeek(const std::string& parameters, bool* relative) {
+  *relative =
+      !parameters.empty() && (parameters[0] == '+' || parameters[0] == '-');
+  auto digits = parameters.substr(*relative ? 1 : 0);
+  auto is_digit = [](char c) { return isdigit(static_cast<uint8_t>(c)); };
+  if (digits.empty() ||
+      !std::all_of(std::begin(digits), std::end(digits), is_digit)) {
+    throw std::invalid_argument("seek: expected [+/-]seconds");
+  }
+  return std::chrono::seconds(std::stol(parameters));
+}
+
 void Cli::Dispatch(const std::string& command, const std::string& parameters) {
   if (command.empty()) {
     return;
@@ -86,6 +136,15 @@ void Cli::Dispatch(const std::string& command, const std::string& parameters) {
       player_ctl_->Next();
     } else if (command == "prev" || command == "b") {
       player_ctl_->Previous();
+    } else if (command == "seek") {
+      bool relative = false;
+      auto position = ParseSeek(parameters, &relative);
+      if (relative) {
+        std::chrono::seconds elapsed;
+        player_ctl_->GetCurrentTrackInfo(&elapsed);
+        position += elapsed;
+      }
+      player_ctl_->Seek(std::max(position, std::chrono::seconds(0)));
     } else if (command == "stop") {
       player_ctl_->Stop();
     } else if (command == "repeat_track") {
@@ -94,6 +153,44 @@ void Cli::Dispatch(const std::string& command, const std::string& parameters) {
       player_ctl_->SetRepeatPlaylistEnabled(parameters == "on");
     } else if (command == "random_track") {
       player_ctl_->SetRandomTrackEnabled(parameters == "on");
+    } else if (command == "normalize") {
+      player_ctl_->SetNormalizeEnabled(parameters == "on");
+    } else if (command == "volume") {
+      auto settings = player_ctl_->GetDspSettings();
+      settings.gain_db = std::stof(parameters);
+      player_ctl_->SetDspSettings(settings);
+    } else if (command == "eq") {
+      auto settings = player_ctl_->GetDspSettings();
+      ParseEq(parameters, &settings);
+      player_ctl_->SetDspSettings(settings);
+    } else if (command == "limiter") {
+      auto settings = player_ctl_->GetDspSettings();
+      settings.limiter = parameters == "on";
+      player_ctl_->SetDspSettings(settings);
+    } else if (command == "remix") {
+      auto settings = player_ctl_->GetDspSettings();
+      if (parameters == "mono") {
+        settings.remix = Remix::kMono;
+      } else if (parameters == "swap") {
+        settings.remix = Remix::kSwap;
+      } else {
+        settings.remix = Remix::kNone;
+      }
+      player_ctl_->SetDspSettings(settings);
+    } else if (command == "resampler") {
+      auto settings = player_ctl_->GetDspSettings();
+      if (parameters == "fast") {
+        settings.resample_quality = ResampleQuality::kFast;
+      } else if (parameters == "best") {
+        settings.resample_quality = ResampleQuality::kBest;
+      } else {
+        settings.resample_quality = ResampleQuality::kMedium;
+      }
+      player_ctl_->SetDspSettings(settings);
+    } else if (command == "crossfade") {
+      auto overlap = std::chrono::milliseconds(
+          static_cast<int64_t>(std::stod(parameters) * 1000));
+      player_ctl_->SetCrossfade(overlap);
     } else if (command == "add_track" || command == "a") {
       TrackLocation track = parameters;
       player_ctl_->AddUri({parameters});
@@ -148,7 +245,10 @@ void Cli::UiThread() {
 
     const auto first_space_index = input.find(' ');
     const auto command = input.substr(0, first_space_index);
-    const auto parameters = input.substr(first_space_index + 1, input.size());
+    // no parameters for a bare command
+    const auto parameters = first_space_index == std::string::npos
+                                ? std::string()
+                                : input.substr(first_space_index + 1);
     LOG("[D] processing command='%s' with parameters='%s'", command.c_str(),
         parameters.c_str());
     if (command == "exit" || command == "quit") {
@@ -0,0 +1,52 @@
+#include "iplayer/codec_probe.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "iplayer/frame_index.h"
+#include "iplayer/id3_tag.h"
+
+namespace ip {
+
+// size of the leading ID3v2 tag, bigger than 'size' when it doesn't fit
+static size_t Id3v2Size(const uint8_t* data, size_t size) {
+  const size_t kHeaderSize = 10;
+  Id3Tag tag;
+  // frames are not needed, only the header is parsed
+  return ParseId3v2Tag(data, std::min(size, kHeaderSize), &tag);
+}
+
+static bool StartsWith(const uint8_t* data, size_t size, const char* magic) {
+  auto len = strlen(magic);
+  return size >= len && memcmp(data, magic, len) == 0;
+}
+
+bool ProbeMpegAudio(const uint8_t* data, size_t size) {
+  auto tag_size = Id3v2Size(data, size);
+  if (tag_size >= size) {
+    return tag_size > 0;
+  }
+  // frames are checked by indexing them, junk before them is skipped
+  FrameIndex index;
+  index.Scan(data + tag_size, size - tag_size, 0, false);
+  return index.FrameCount() > 0;
+}
+
+bool ProbeFlac(const uint8_t* data, size_t size) {
+  // some taggers put an ID3v2 tag before the stream marker
+  auto tag_size = Id3v2Size(data, size);
+  return tag_size < size &&
+         StartsWith(data + tag_size, size - tag_size, "fLaC");
+}
+
+bool ProbeOgg(const uint8_t* data, size_t size) {
+  // capture pattern then stream structure version 0
+  return size >= 5 && StartsWith(data, size, "OggS") && data[4] == 0;
+}
+
+bool ProbeWave(const uint8_t* data, size_t size) {
+  return size >= 12 && StartsWith(data, size, "RIFF") &&
+         memcmp(data + 8, "WAVE", 4) == 0;
+}
+
+}  // namespace ip
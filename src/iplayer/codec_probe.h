@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Tell a track's format from its first bytes (DecoderFactory::kProbeSize),
+// see DecoderFactory::RegisterProbe(). A leading ID3v2 tag is skipped when
+// it fits in 'data'.
+
+namespace ip {
+
+// MPEG audio: two consecutive frame headers, or an ID3v2 tag too big to see
+// what follows (only found in front of MPEG audio in practice)
+bool ProbeMpegAudio(const uint8_t* data, size_t size);
+bool ProbeFlac(const uint8_t* data, size_t size);  // "fLaC"
+bool ProbeOgg(const uint8_t* data, size_t size);   // "OggS" page
+bool ProbeWave(const uint8_t* data, size_t size);  // "RIFF" ... "WAVE"
+
+}  // namespace ip
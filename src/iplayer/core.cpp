@@ -1,25 +1,110 @@
 #include "iplayer/core.h"
 
+#include <stdio.h>
+#include <iomanip>
+#include <iostream>
 #include <memory>
+#include <unordered_map>
 
+#include "iplayer/batch_verifier.h"
 #include "iplayer/cli_ui.h"
+#include "iplayer/codec_probe.h"
 #include "iplayer/dummy_decoder.h"
+#include "iplayer/fanout_audio_sink.h"
+#include "iplayer/file_audio_sink.h"
 #include "iplayer/fs_track_provider.h"
+#include "iplayer/http_track_provider.h"
 #include "iplayer/mad_decoder.h"
+#include "iplayer/null_audio_sink.h"
+#include "iplayer/pack_track_provider.h"
 #include "iplayer/player_control.h"
 #include "iplayer/playlist.h"
+#include "iplayer/playlist_track_provider.h"
+#include "iplayer/pulse_audio_sink.h"
+#include "iplayer/shm_audio_sink.h"
 #include "iplayer/track_location.h"
 #include "iplayer/utils/log.h"
 
 namespace ip {
 
-Core::Core() : exec_queue_(std::this_thread::get_id()) {}
+static std::string FormatTime(std::chrono::milliseconds time) {
+  char buffer[32];
+  auto ms = static_cast<long long>(time.count());
+  snprintf(buffer, sizeof(buffer), "%lld:%02lld.%03lld", ms / 60000,
+           ms / 1000 % 60, ms % 1000);
+  return buffer;
+}
+
+static void PrintVerifyResult(const VerifyResult& result) {
+  std::cout << (result.ec ? "[FAIL] " : "[ OK ] ") << result.location << ": "
+            << FormatTime(result.stats.decoded) << " decoded ("
+            << FormatTime(result.duration) << " expected), "
+            << result.stats.frame_errors << " frame errors, " << std::fixed
+            << std::setprecision(1) << result.Speed() << "x realtime";
+  if (result.ec) {
+    std::cout << ", " << result.ec.message();
+  }
+  std::cout << std::endl;
+}
+
+// returns the number of tracks which failed
+static size_t PrintVerifySummary(const std::vector<VerifyResult>& results,
+                                 std::chrono::milliseconds elapsed) {
+  size_t failed = 0;
+  uint64_t frame_errors = 0;
+  std::chrono::milliseconds decoded(0);
+  for (const auto& result : results) {
+    failed += result.ec ? 1 : 0;
+    frame_errors += result.stats.frame_errors;
+    decoded += result.stats.decoded;
+  }
+  auto speed = elapsed.count()
+                   ? static_cast<double>(decoded.count()) / elapsed.count()
+                   : 0;
+  std::cout << results.size() << " tracks, " << failed << " failed, "
+            << frame_errors << " frame errors, " << FormatTime(decoded)
+            << " decoded in " << FormatTime(elapsed) << " (" << std::fixed
+            << std::setprecision(1) << speed << "x realtime)" << std::endl;
+  return failed;
+}
+
+#ifdef IPLAYER_DECODER_MAD
+static const char kDefaultAudioSink[] = "pulse";
+#else
+static const char kDefaultAudioSink[] = "null";
+#endif  // IPLAYER_DECODER_MAD
+
+Core::Core()
+    : exec_queue_(std::this_thread::get_id()),
+      sink_spec_(kDefaultAudioSink) {}
 
 void Core::Start() {
+  RegisterComponents();
+  auto sink = sinks_.Create(sink_spec_);
+  if (!sink) {
+    LOG("[E] unknown audio sink '%s', using null sink", sink_spec_.c_str());
+    sink = std::make_unique<NullAudioSink>();
+  }
+  output_ = std::make_unique<AudioOutput>(std::move(sink));
+
+  auto player_control = std::make_unique<PlayerControl>(this);
+  Cli cli(std::move(player_control));
+  cli.Run();
+  exec_queue_.Run();
+}
+
+void Core::RegisterComponents() {
   // this will allow to resolve which component should be used depending on uri,
   // this will fallback on DummyDecoder when codec is unknown
   provider_resolver_.Register(
       "file://", []() { return std::make_unique<FsTrackProvider>(); });
+  provider_resolver_.Register(
+      "http://", []() { return std::make_unique<HttpTrackProvider>(); });
+  provider_resolver_.Register(
+      "pack://", []() { return std::make_unique<PackTrackProvider>(); });
+  provider_resolver_.Register("playlist://", []() {
+    return std::make_unique<PlaylistTrackProvider>();
+  });
 
   // map decoder to codec name
   decoders_.Register("dummy", &DecoderBuilder<DummyDecoder>);
@@ -27,14 +112,106 @@ void Core::Start() {
   decoders_.Register("mp3", &DecoderBuilder<MadDecoder>);
 #endif  // IPLAYER_DECODER_MAD
 
-  auto player_control = std::make_unique<PlayerControl>(this);
-  Cli cli(std::move(player_control));
-  cli.Run();
-  exec_queue_.Run();
+  // formats are told from the first bytes of tracks, even those without a
+  // decoder: they are skipped instead of being given to the wrong one
+  decoders_.RegisterProbe("flac", &ProbeFlac);
+  decoders_.RegisterProbe("ogg", &ProbeOgg);
+  decoders_.RegisterProbe("wav", &ProbeWave);
+  decoders_.RegisterProbe("mp3", &ProbeMpegAudio);  // least specific
+
+  // decoders write to the selected sink through the output session
+  sinks_.Register("null", [](const std::string&) -> IAudioSinkPtr {
+    return std::make_unique<NullAudioSink>();
+  });
+  sinks_.Register("file", [](const std::string& path) -> IAudioSinkPtr {
+    return std::make_unique<FileAudioSink>(path);
+  });
+  sinks_.Register("shm", [](const std::string& name) -> IAudioSinkPtr {
+    return std::make_unique<ShmAudioSink>(name.empty() ? "/iplayer" : name);
+  });
+  sinks_.Register("fanout",
+                  [this](const std::string& specs) -> IAudioSinkPtr {
+                    return CreateFanoutAudioSink(sinks_, specs);
+                  });
+#ifdef IPLAYER_DECODER_MAD
+  sinks_.Register("pulse", [](const std::string&) -> IAudioSinkPtr {
+    return std::make_unique<PulseAudioSink>();
+  });
+#endif  // IPLAYER_DECODER_MAD
+}
+
+size_t Core::Verify(const std::vector<std::string>& uris,
+                    const std::string& sink_spec, size_t jobs) {
+  RegisterComponents();
+
+  // uris are directories or tracks
+  std::vector<TrackLocation> locations;
+  for (auto uri : uris) {
+    if (uri.find("://") == std::string::npos) {
+      uri = "file://" + uri;
+    }
+    auto provider = GetTrackProvider(uri);
+    if (!provider) {
+      std::cout << "Error: no provider for '" << uri << "'" << std::endl;
+      continue;
+    }
+    auto ec = provider->List(uri, &locations);
+    if (ec == std::errc::not_a_directory) {
+      locations.push_back(uri);
+    } else if (ec) {
+      std::cout << "Error: cannot list '" << uri << "': " << ec.message()
+                << std::endl;
+    }
+  }
+
+  // a track given twice would be decoded twice into the same file
+  std::unordered_map<TrackLocation, size_t> positions;
+  std::vector<TrackLocation> unique_locations;
+  for (auto& location : locations) {
+    if (positions.emplace(location, unique_locations.size()).second) {
+      unique_locations.push_back(std::move(location));
+    }
+  }
+  locations.swap(unique_locations);
+
+  // a file sink gets one WAV file per track in the given directory, numbered
+  // as listed since tracks of different directories can have the same name
+  const std::string kFileSink = "file:";
+  auto create_sink = [&](const TrackInfo& info) -> IAudioSinkPtr {
+    if (sink_spec.compare(0, kFileSink.size(), kFileSink) != 0) {
+      return sinks_.Create(sink_spec);
+    }
+    auto location = info.Location();
+    char number[32];  // 'positions' is only read by workers
+    snprintf(number, sizeof(number), "%04zu-", positions.at(location) + 1);
+    auto name = number + location.substr(location.rfind('/') + 1);
+    return std::make_unique<FileAudioSink>(sink_spec.substr(kFileSink.size()) +
+                                           "/" + name + ".wav");
+  };
+  BatchVerifier::Options options;
+  options.jobs = jobs;
+  BatchVerifier verifier(
+      [this](const TrackLocation& location) {
+        return GetTrackProvider(location);
+      },
+      [this](const std::string& codec, const TrackInfo& info, ITrackIOPtr io,
+             AudioOutput* output, IDecoder::CompletionCb completion_cb) {
+        return CreateDecoder(codec, info, std::move(io), output,
+                             std::move(completion_cb));
+      },
+      create_sink, options);
+
+  auto start = std::chrono::steady_clock::now();
+  auto results = verifier.Run(locations, &PrintVerifyResult);
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  return PrintVerifySummary(results, elapsed);
 }
 
 void Core::Stop() { exec_queue_.Exit(); }
 
+void Core::SetAudioSink(const std::string& spec) { sink_spec_ = spec; }
+
 void Core::QueueExecution(AsyncFunc func) { exec_queue_.Push(func); }
 
 ITrackProviderPtr Core::GetTrackProvider(const TrackLocation& location) const {
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
+#include "iplayer/audio_output.h"
+#include "iplayer/audio_sink_factory.h"
 #include "iplayer/decoder_factory.h"
 #include "iplayer/track_provider_resolver.h"
 #include "iplayer/utils/exec_queue.h"
@@ -14,6 +19,16 @@ class Core {
   void Start();  // instanciate everything and start execution queue
   void Stop();  // stop the exec queue
 
+  // Headless mode: decode tracks of 'uris' (directories or tracks) at full
+  // speed with 'jobs' workers (0 for one per core) and print a report.
+  // Returns the number of tracks which failed.
+  size_t Verify(const std::vector<std::string>& uris,
+                const std::string& sink_spec, size_t jobs);
+
+  // select the sink from its spec (see AudioSinkFactory), before Start()
+  void SetAudioSink(const std::string& spec);
+  AudioOutput* GetAudioOutput() const { return output_.get(); }
+
   void QueueExecution(AsyncFunc func);  // post 'func' to be executed later
   ITrackProviderPtr GetTrackProvider(const TrackLocation& location) const;
 
@@ -21,13 +36,19 @@ class Core {
   IDecoderPtr CreateDecoder(Args&&... args) {
     return decoders_.Create(std::forward<Args>(args)...);
   }
+  // codec of the track '*io' reads, see DecoderFactory::Probe()
+  std::string ProbeCodec(ITrackIOPtr* io) const { return decoders_.Probe(io); }
 
  private:
   void Run();
+  void RegisterComponents();
 
   ExecQueue exec_queue_;
   TrackProviderResolver provider_resolver_;
   DecoderFactory decoders_;
+  AudioSinkFactory sinks_;
+  std::string sink_spec_;
+  std::unique_ptr<AudioOutput> output_;  // borrowed by decoders in turn
 };
 
 }  // namespace ip
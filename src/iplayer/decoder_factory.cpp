@@ -1,16 +1,69 @@
 #include "iplayer/decoder_factory.h"
 
+#include <string.h>
+#include <algorithm>
+
 namespace ip {
+namespace {
+
+// Gives the probed bytes again before reading further from the track, so
+// probing needs no seek (which restarts streams such as http://)
+class ProbedTrackIO : public ITrackIO {
+ public:
+  ProbedTrackIO(ITrackIOPtr io, std::vector<uint8_t> head)
+      : io_(std::move(io)), head_(std::move(head)), position_(0) {}
+
+  std::error_code Open(const TrackLocation& track) override {
+    head_.clear();
+    position_ = 0;
+    return io_->Open(track);
+  }
+
+  size_t Read(uint8_t* buffer, size_t len, std::error_code& ec) override {
+    ec.clear();
+    auto count = std::min(len, head_.size() - position_);
+    memcpy(buffer, head_.data() + position_, count);
+    position_ += count;
+    if (count == len) {
+      return count;
+    }
+    return count + io_->Read(buffer + count, len - count, ec);
+  }
+
+  std::error_code Seek(uint64_t offset) override {
+    head_.clear();
+    position_ = 0;
+    return io_->Seek(offset);
+  }
+
+  void Close() override {
+    head_.clear();
+    position_ = 0;
+    io_->Close();
+  }
+
+ private:
+  ITrackIOPtr io_;
+  std::vector<uint8_t> head_;
+  size_t position_;  // in head_
+};
+
+}  // namespace
+
+const size_t DecoderFactory::kProbeSize;
 
 IDecoderPtr DecoderFactory::Create(const std::string& codec,
-                                   const TrackInfo& track,
-                                   CompletionCb completion_cb) const {
+                                   const TrackInfo& track, ITrackIOPtr io,
+                                   AudioOutput* output,
+                                   CompletionCb completion_cb,
+                                   const DecoderOptions& options) const {
   std::lock_guard<std::mutex> lock(mutex_);
   auto it = decoders_.find(codec);
   if (it == std::cend(decoders_)) {
     return nullptr;
   }
-  return it->second(track, std::move(completion_cb));
+  return it->second(track, std::move(io), output, std::move(completion_cb),
+                    options);
 }
 
 void DecoderFactory::Register(const std::string& codec, Builder builder) {
@@ -18,4 +71,29 @@ void DecoderFactory::Register(const std::string& codec, Builder builder) {
   decoders_[codec] = builder;
 }
 
+void DecoderFactory::RegisterProbe(const std::string& codec, Prober prober) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  probers_.emplace_back(codec, std::move(prober));
+}
+
+std::string DecoderFactory::Probe(const uint8_t* data, size_t size) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& prober : probers_) {
+    if (prober.second(data, size)) {
+      return prober.first;
+    }
+  }
+  return {};
+}
+
+std::string DecoderFactory::Probe(ITrackIOPtr* io) const {
+  std::vector<uint8_t> head(kProbeSize);
+  std::error_code ec;
+  head.resize((*io)->Read(head.data(), head.size(), ec));
+  // a read error is the decoder's to report
+  auto codec = Probe(head.data(), head.size());
+  *io = std::make_unique<ProbedTrackIO>(std::move(*io), std::move(head));
+  return codec;
+}
+
 }  // namespace ip
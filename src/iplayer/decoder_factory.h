@@ -1,35 +1,66 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "iplayer/audio_output.h"
 #include "iplayer/i_decoder.h"
+#include "iplayer/i_track_io.h"
 #include "iplayer/track_info.h"
 
 namespace ip {
 
 template <typename T>
-IDecoderPtr DecoderBuilder(const TrackInfo& track,
-                           IDecoder::CompletionCb completion_cb) {
-  return std::make_unique<T>(track, completion_cb);
+IDecoderPtr DecoderBuilder(const TrackInfo& track, ITrackIOPtr io,
+                           AudioOutput* output,
+                           IDecoder::CompletionCb completion_cb,
+                           const DecoderOptions& options) {
+  return std::make_unique<T>(track, std::move(io), output, completion_cb,
+                             options);
 }
 
 class DecoderFactory {
  public:
   using CompletionCb = std::function<void(const std::error_code&)>;
 
-  using Builder = std::function<IDecoderPtr(const TrackInfo&, CompletionCb)>;
+  using Builder =
+      std::function<IDecoderPtr(const TrackInfo&, ITrackIOPtr, AudioOutput*,
+                                CompletionCb, const DecoderOptions&)>;
+
+  // true when 'data', the first bytes of a track, are in the codec's format
+  using Prober = std::function<bool(const uint8_t* data, size_t size)>;
+
+  static const size_t kProbeSize = 4096;  // bytes given to probers
 
   IDecoderPtr Create(const std::string& codec, const TrackInfo& track,
-                     CompletionCb completion_cb) const;
+                     ITrackIOPtr io, AudioOutput* output,
+                     CompletionCb completion_cb,
+                     const DecoderOptions& options = DecoderOptions()) const;
 
   void Register(const std::string& codec, Builder builder);
 
+  // probers are tried in registration order, register the most specific
+  // formats first
+  void RegisterProbe(const std::string& codec, Prober prober);
+
+  // codec of the track starting with 'data', empty if unknown
+  std::string Probe(const uint8_t* data, size_t size) const;
+
+  // Probe the first bytes of '*io' without moving in the track: '*io' is
+  // replaced by one reading these bytes again. Costs a single read whatever
+  // the track's size, unlike extracting the TrackInfo.
+  std::string Probe(ITrackIOPtr* io) const;
+
  private:
   mutable std::mutex mutex_;
   std::map<std::string, Builder> decoders_;
+  std::vector<std::pair<std::string, Prober>> probers_;
 };
 
 }  // namespace ip
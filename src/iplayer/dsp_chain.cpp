@@ -0,0 +1,345 @@
+#include "iplayer/dsp_chain.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define IPLAYER_DSP_SSE2  // part of x86-64, no runtime check needed
+#endif
+
+namespace ip {
+namespace {
+
+// Kernels process a whole channel, the vectorized part gives exactly the
+// result of the scalar tail.
+
+// samples[i] *= start + step * (i + 1), 'step' is 0 for a constant gain
+void Scale(float* samples, size_t count, float start, float step) {
+  size_t i = 0;
+#ifdef IPLAYER_DSP_SSE2
+  const auto start4 = _mm_set1_ps(start);
+  const auto step4 = _mm_set1_ps(step);
+  auto index = _mm_set_ps(4, 3, 2, 1);
+  for (; i + 4 <= count; i += 4) {
+    auto gain = _mm_add_ps(start4, _mm_mul_ps(step4, index));
+    _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), gain));
+    index = _mm_add_ps(index, _mm_set1_ps(4));
+  }
+#endif
+  for (; i < count; ++i) {
+    samples[i] *= start + step * static_cast<float>(i + 1);
+  }
+}
+
+void Downmix(float* left, float* right, size_t count) {
+  size_t i = 0;
+#ifdef IPLAYER_DSP_SSE2
+  const auto half = _mm_set1_ps(0.5f);
+  for (; i + 4 <= count; i += 4) {
+    auto mono = _mm_mul_ps(
+        _mm_add_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(right + i)), half);
+    _mm_storeu_ps(left + i, mono);
+    _mm_storeu_ps(right + i, mono);
+  }
+#endif
+  for (; i < count; ++i) {
+    left[i] = right[i] = (left[i] + right[i]) * 0.5f;
+  }
+}
+
+// Above 'threshold' the gain decreases smoothly and the output tends to full
+// scale: no hard clipping whatever the input level.
+void Limit(float* samples, size_t count, float threshold) {
+  const float knee = 1 - threshold;
+  const float inverse_knee = 1 / knee;
+  size_t i = 0;
+#ifdef IPLAYER_DSP_SSE2
+  const auto sign_mask = _mm_set1_ps(-0.0f);
+  const auto threshold4 = _mm_set1_ps(threshold);
+  const auto knee4 = _mm_set1_ps(knee);
+  const auto inverse_knee4 = _mm_set1_ps(inverse_knee);
+  const auto one = _mm_set1_ps(1);
+  for (; i + 4 <= count; i += 4) {
+    auto x = _mm_loadu_ps(samples + i);
+    auto sign = _mm_and_ps(x, sign_mask);
+    auto a = _mm_andnot_ps(sign_mask, x);
+    auto over = _mm_mul_ps(
+        _mm_max_ps(_mm_sub_ps(a, threshold4), _mm_setzero_ps()),
+        inverse_knee4);
+    auto y = _mm_add_ps(_mm_min_ps(a, threshold4),
+                        _mm_div_ps(_mm_mul_ps(knee4, over),
+                                   _mm_add_ps(one, over)));
+    _mm_storeu_ps(samples + i, _mm_or_ps(y, sign));
+  }
+#endif
+  for (; i < count; ++i) {
+    float a = fabsf(samples[i]);
+    float over = std::max(a - threshold, 0.0f) * inverse_knee;
+    float y = std::min(a, threshold) + knee * over / (1 + over);
+    samples[i] = copysignf(y, samples[i]);
+  }
+}
+
+}  // namespace
+
+bool DspSettings::Neutral() const {
+  return gain_db == 0 && eq.empty() && !limiter && remix == Remix::kNone;
+}
+
+// Channel count adaptation comes first so that the following stages always
+// see the output layout, mono is duplicated whatever the remix mode.
+class DspChain::RemixStage : public IDspStage {
+ public:
+  explicit RemixStage(uint32_t output_channels)
+      : output_channels_(output_channels), mode_(Remix::kNone) {}
+
+  void SetMode(Remix mode) { mode_ = mode; }
+
+  void Process(DspBlock* block) override {
+    auto* left = block->channels[0];
+    auto* right = block->channels[1];
+    if (block->channel_count == 1 && output_channels_ == 2) {
+      memcpy(right, left, block->frames * sizeof(float));
+      block->channel_count = 2;
+      return;
+    }
+    if (block->channel_count == 2 && output_channels_ == 1) {
+      Downmix(left, right, block->frames);
+      block->channel_count = 1;
+      return;
+    }
+    if (block->channel_count != 2) {
+      return;
+    }
+    switch (mode_) {
+      case Remix::kNone:
+        break;
+      case Remix::kMono:
+        Downmix(left, right, block->frames);
+        break;
+      case Remix::kSwap:
+        std::swap(block->channels[0], block->channels[1]);
+        break;
+    }
+  }
+
+ private:
+  uint32_t output_channels_;
+  Remix mode_;
+};
+
+// Transposed direct form II, in double precision like the loudness meter:
+// low frequency filters have poles close to the unit circle.
+class DspChain::BiquadStage : public IDspStage {
+ public:
+  BiquadStage() : coefficients_{1, 0, 0, 0, 0}, state_{{0, 0}, {0, 0}} {}
+
+  // Audio EQ cookbook (R. Bristow-Johnson), the state is kept: coefficients
+  // can change while playing
+  void SetBand(const EqBand& band, uint32_t sample_rate) {
+    double rate = std::max<uint32_t>(sample_rate, 1);
+    double frequency =
+        std::min(std::max<double>(band.frequency, 1), 0.49 * rate);
+    double a = pow(10, band.gain_db / 40.0);
+    double w0 = 2 * M_PI * frequency / rate;
+    double cos_w0 = cos(w0);
+    double alpha = sin(w0) / (2 * std::max(band.q, 0.01f));
+    double b0, b1, b2, a0, a1, a2;
+    switch (band.type) {
+      case EqBand::Type::kPeak:
+        b0 = 1 + alpha * a;
+        b1 = -2 * cos_w0;
+        b2 = 1 - alpha * a;
+        a0 = 1 + alpha / a;
+        a1 = -2 * cos_w0;
+        a2 = 1 - alpha / a;
+        break;
+      case EqBand::Type::kLowShelf: {
+        double k = 2 * sqrt(a) * alpha;
+        b0 = a * ((a + 1) - (a - 1) * cos_w0 + k);
+        b1 = 2 * a * ((a - 1) - (a + 1) * cos_w0);
+        b2 = a * ((a + 1) - (a - 1) * cos_w0 - k);
+        a0 = (a + 1) + (a - 1) * cos_w0 + k;
+        a1 = -2 * ((a - 1) + (a + 1) * cos_w0);
+        a2 = (a + 1) + (a - 1) * cos_w0 - k;
+        break;
+      }
+      case EqBand::Type::kHighShelf:
+      default: {
+        double k = 2 * sqrt(a) * alpha;
+        b0 = a * ((a + 1) + (a - 1) * cos_w0 + k);
+        b1 = -2 * a * ((a - 1) + (a + 1) * cos_w0);
+        b2 = a * ((a + 1) + (a - 1) * cos_w0 - k);
+        a0 = (a + 1) - (a - 1) * cos_w0 + k;
+        a1 = 2 * ((a - 1) - (a + 1) * cos_w0);
+        a2 = (a + 1) - (a - 1) * cos_w0 - k;
+        break;
+      }
+    }
+    coefficients_ = {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+  }
+
+  void Process(DspBlock* block) override {
+    if (block->channel_count == 2) {
+      ProcessStereo(block->channels[0], block->channels[1], block->frames);
+      return;
+    }
+    for (uint32_t c = 0; c < block->channel_count; ++c) {
+      ProcessScalar(block->channels[c], block->frames, state_[c]);
+    }
+  }
+
+ private:
+  void ProcessScalar(float* samples, size_t count, double* s) {
+    const auto& k = coefficients_;
+    for (size_t i = 0; i < count; ++i) {
+      double x = samples[i];
+      double y = k.b0 * x + s[0];
+      s[0] = k.b1 * x - k.a1 * y + s[1];
+      s[1] = k.b2 * x - k.a2 * y;
+      samples[i] = static_cast<float>(y);
+    }
+  }
+
+  // samples of a channel depend on the previous ones, left and right go in
+  // the two lanes
+  void ProcessStereo(float* left, float* right, size_t count) {
+#ifdef IPLAYER_DSP_SSE2
+    const auto& k = coefficients_;
+    auto s0 = _mm_set_pd(state_[1][0], state_[0][0]);
+    auto s1 = _mm_set_pd(state_[1][1], state_[0][1]);
+    const auto b0 = _mm_set1_pd(k.b0);
+    const auto b1 = _mm_set1_pd(k.b1);
+    const auto b2 = _mm_set1_pd(k.b2);
+    const auto a1 = _mm_set1_pd(k.a1);
+    const auto a2 = _mm_set1_pd(k.a2);
+    for (size_t i = 0; i < count; ++i) {
+      auto x = _mm_cvtps_pd(
+          _mm_unpacklo_ps(_mm_load_ss(left + i), _mm_load_ss(right + i)));
+      auto y = _mm_add_pd(_mm_mul_pd(b0, x), s0);
+      s0 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, x), _mm_mul_pd(a1, y)), s1);
+      s1 = _mm_sub_pd(_mm_mul_pd(b2, x), _mm_mul_pd(a2, y));
+      auto out = _mm_cvtpd_ps(y);
+      _mm_store_ss(left + i, out);
+      _mm_store_ss(right + i, _mm_shuffle_ps(out, out, 1));
+    }
+    _mm_storel_pd(&state_[0][0], s0);
+    _mm_storeh_pd(&state_[1][0], s0);
+    _mm_storel_pd(&state_[0][1], s1);
+    _mm_storeh_pd(&state_[1][1], s1);
+#else
+    ProcessScalar(left, count, state_[0]);
+    ProcessScalar(right, count, state_[1]);
+#endif  // IPLAYER_DSP_SSE2
+  }
+
+  struct {
+    double b0, b1, b2, a1, a2;  // normalized by a0
+  } coefficients_;
+  double state_[DspBlock::kMaxChannels][2];
+};
+
+// A new gain is reached linearly over the next block (a MPEG frame is
+// ~26ms), a step would click.
+class DspChain::GainStage : public IDspStage {
+ public:
+  GainStage() : current_(1), target_(1) {}
+
+  void SetTarget(float gain) { target_ = gain; }
+  bool Settled() const { return current_ == target_; }
+  bool Unity() const { return current_ == 1 && target_ == 1; }
+
+  void Process(DspBlock* block) override {
+    if (block->frames == 0) {
+      return;
+    }
+    float step = (target_ - current_) / block->frames;  // 0 when settled
+    for (uint32_t c = 0; c < block->channel_count; ++c) {
+      Scale(block->channels[c], block->frames, current_, step);
+    }
+    current_ = target_;
+  }
+
+ private:
+  float current_;
+  float target_;
+};
+
+class DspChain::LimiterStage : public IDspStage {
+ public:
+  LimiterStage() : threshold_(0.8f) {}
+
+  void SetThreshold(float threshold) {
+    threshold_ = std::min(std::max(threshold, 0.01f), 0.99f);
+  }
+
+  void Process(DspBlock* block) override {
+    for (uint32_t c = 0; c < block->channel_count; ++c) {
+      Limit(block->channels[c], block->frames, threshold_);
+    }
+  }
+
+ private:
+  float threshold_;
+};
+
+DspChain::DspChain(uint32_t sample_rate, uint32_t output_channels)
+    : sample_rate_(sample_rate),
+      remix_(std::make_unique<RemixStage>(output_channels)),
+      gain_(std::make_unique<GainStage>()),
+      limiter_(std::make_unique<LimiterStage>()) {}
+
+DspChain::~DspChain() {}
+
+void DspChain::Configure(const DspSettings& settings) {
+  settings_ = settings;
+  remix_->SetMode(settings_.remix);
+  // existing bands keep their state, only the new ones start from silence
+  while (eq_.size() < settings_.eq.size()) {
+    eq_.push_back(std::make_unique<BiquadStage>());
+  }
+  eq_.resize(settings_.eq.size());
+  for (size_t i = 0; i < eq_.size(); ++i) {
+    eq_[i]->SetBand(settings_.eq[i], sample_rate_);
+  }
+  gain_->SetTarget(static_cast<float>(pow(10, settings_.gain_db / 20)));
+  limiter_->SetThreshold(settings_.limiter_threshold);
+  BuildStages();
+}
+
+bool DspChain::Active() const {
+  return !stages_.empty();
+}
+
+void DspChain::Process(DspBlock* block) {
+  bool ramping = !gain_->Settled();
+  for (auto* stage : stages_) {
+    stage->Process(block);
+  }
+  if (ramping) {
+    BuildStages();  // gain might be back to unity
+  }
+}
+
+// no allocation once the vector has grown
+void DspChain::BuildStages() {
+  stages_.clear();
+  if (settings_.Neutral() && gain_->Unity()) {
+    return;
+  }
+  stages_.push_back(remix_.get());
+  for (auto& band : eq_) {
+    stages_.push_back(band.get());
+  }
+  if (!gain_->Unity()) {
+    stages_.push_back(gain_.get());
+  }
+  if (settings_.limiter) {
+    stages_.push_back(limiter_.get());
+  }
+}
+
+}  // namespace ip
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "iplayer/resampler.h"
+
+// Processing applied by decoders between decoding and the conversion to the
+// output format: channel remix, parametric EQ, gain and soft limiter, in
+// that order, in place on planar float blocks (full scale is 1).
+//
+// Settings are immutable and shared by all streams, each stream owns a
+// DspChain holding the filters state. Reconfiguring keeps the memory of the
+// filters and ramps the gain over a block: changes don't click.
+
+namespace ip {
+
+struct EqBand {
+  enum class Type { kPeak, kLowShelf, kHighShelf };
+  Type type = Type::kPeak;
+  float frequency = 1000;  // Hz, center or corner
+  float q = 0.707f;
+  float gain_db = 0;
+};
+
+enum class Remix { kNone, kMono, kSwap };
+
+struct DspSettings {
+  float gain_db = 0;
+  std::vector<EqBand> eq;
+  bool limiter = false;
+  float limiter_threshold = 0.8f;  // linear, compression starts above it
+  Remix remix = Remix::kNone;
+  // tracks not at the output rate are resampled first, whatever the rest
+  ResampleQuality resample_quality = ResampleQuality::kMedium;
+
+  bool Neutral() const;  // output is the input, no need for a chain
+};
+
+using DspSettingsPtr = std::shared_ptr<const DspSettings>;
+
+struct DspBlock {
+  static const uint32_t kMaxChannels = 2;
+  float* channels[kMaxChannels];  // all have room for 'frames' samples
+  uint32_t channel_count;
+  size_t frames;
+};
+
+class IDspStage {
+ public:
+  virtual ~IDspStage() {}
+  virtual void Process(DspBlock* block) = 0;
+};
+
+class DspChain {
+ public:
+  DspChain(uint32_t sample_rate, uint32_t output_channels);
+  ~DspChain();
+
+  void Configure(const DspSettings& settings);
+  bool Active() const;  // false once neutral settings are fully applied
+  uint32_t SampleRate() const { return sample_rate_; }
+
+  // 'block' gets 'output_channels', it can be pointed to other buffers
+  void Process(DspBlock* block);
+
+ private:
+  class RemixStage;
+  class BiquadStage;
+  class GainStage;
+  class LimiterStage;
+
+  void BuildStages();
+
+  uint32_t sample_rate_;
+  DspSettings settings_;
+  std::unique_ptr<RemixStage> remix_;
+  std::vector<std::unique_ptr<BiquadStage>> eq_;  // kept across settings
+  std::unique_ptr<GainStage> gain_;
+  std::unique_ptr<LimiterStage> limiter_;
+  std::vector<IDspStage*> stages_;  // active ones, in order
+};
+
+}  // namespace ip
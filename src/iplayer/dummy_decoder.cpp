@@ -1,6 +1,7 @@
 #include "iplayer/dummy_decoder.h"
 
 #include <assert.h>
+#include <algorithm>
 
 #include "iplayer/track_info.h"
 #include "iplayer/utils/log.h"
@@ -8,10 +9,13 @@
 
 namespace ip {
 
-DummyDecoder::DummyDecoder(const TrackInfo& track, CompletionCb cb)
+DummyDecoder::DummyDecoder(const TrackInfo& track, ITrackIOPtr, AudioOutput*,
+                           CompletionCb cb, const DecoderOptions&)
     : paused_(false),
       exit_decoder_thread_(false),
-      played_time_(std::chrono::seconds(0)) {
+      played_time_(std::chrono::seconds(0)),
+      decoded_(std::chrono::milliseconds(0)),
+      seek_position_(-1) {
   decoder_future_ = std::async(std::launch::async, &DummyDecoder::DecoderThread,
                                this, track, cb);
 }
@@ -31,10 +35,20 @@ void DummyDecoder::Unpause() {
   }
 }
 
+void DummyDecoder::Seek(std::chrono::milliseconds position) {
+  seek_position_ = std::max<int64_t>(position.count(), 0);
+}
+
 std::chrono::seconds DummyDecoder::GetPlayedTime() const {
   return played_time_;
 }
 
+DecoderStats DummyDecoder::GetStats() const {
+  DecoderStats stats;
+  stats.decoded = decoded_;
+  return stats;
+}
+
 void DummyDecoder::DecoderThread(TrackInfo info, CompletionCb completion_cb) {
   LOG("[D] decoding %s", info.Location().c_str());
   auto ec = std::make_error_code(std::errc::interrupted);
@@ -61,6 +75,11 @@ void DummyDecoder::DecoderThread(TrackInfo info, CompletionCb completion_cb) {
       pause_cv_.wait(lock, [this]() { return paused_ == false; });
     }
 
+    auto seek_position = seek_position_.exchange(-1);
+    if (seek_position >= 0) {
+      elapsed = std::chrono::milliseconds(seek_position);
+    }
+
     // update time spent playing the track
     auto start = std::chrono::steady_clock::now();
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -69,6 +88,7 @@ void DummyDecoder::DecoderThread(TrackInfo info, CompletionCb completion_cb) {
 
     played_time_.store(
         std::chrono::duration_cast<std::chrono::seconds>(elapsed));
+    decoded_.store(elapsed);
 
     if (loop_count++ % 100 == 0) {
       using namespace std::chrono;
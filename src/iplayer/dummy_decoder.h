@@ -5,19 +5,26 @@
 #include <atomic>
 #include <future>
 #include <mutex>
+#include <thread>
 
+#include "iplayer/audio_output.h"
+#include "iplayer/i_track_io.h"
 #include "iplayer/track_info.h"
 
 namespace ip {
 
 class DummyDecoder : public IDecoder {
  public:
-  DummyDecoder(const TrackInfo& track, IDecoder::CompletionCb completion_cb);
+  DummyDecoder(const TrackInfo& track, ITrackIOPtr io, AudioOutput* output,
+               IDecoder::CompletionCb completion_cb,
+               const DecoderOptions& options);
   virtual ~DummyDecoder();
 
   void Pause() override;
   void Unpause() override;
+  void Seek(std::chrono::milliseconds position) override;
   std::chrono::seconds GetPlayedTime() const override;
+  DecoderStats GetStats() const override;
 
  private:
   void DecoderThread(TrackInfo track, CompletionCb completion_cb);
@@ -27,6 +34,8 @@ class DummyDecoder : public IDecoder {
   std::atomic<bool> paused_;
   std::atomic<bool> exit_decoder_thread_;
   std::atomic<std::chrono::seconds> played_time_;
+  std::atomic<std::chrono::milliseconds> decoded_;
+  std::atomic<int64_t> seek_position_;  // in ms, negative when none pending
   std::future<void> decoder_future_;
 };
 
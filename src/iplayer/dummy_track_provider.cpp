@@ -1,5 +1,6 @@
 #include "iplayer/dummy_track_provider.h"
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -8,7 +9,7 @@
 
 namespace ip {
 
-static uint32_t title_id = 0;
+static std::atomic<uint32_t> title_id{0};
 
 std::error_code DummyTrackProvider::List(
     const std::string& uri, std::vector<TrackLocation>* locations) const {
@@ -17,14 +18,15 @@ std::error_code DummyTrackProvider::List(
 }
 
 TrackInfo DummyTrackProvider::GetTrackInfo(const TrackLocation& location) {
-  TrackInfo track_info{location, "foobar_" + std::to_string(title_id), title_id,
+  // might be called concurrently by metadata extraction workers
+  uint32_t id = title_id++;
+  TrackInfo track_info{location, "foobar_" + std::to_string(id), id,
                        std::chrono::seconds(5 + std::rand() % 20), "dummy"};
-  ++title_id;
   return track_info;
 }
 
-std::unique_ptr<ITrackIO> DummyTrackProvider::OpenTrack(const TrackLocation&,
-                                                        std::error_code&) {
+ITrackIOPtr DummyTrackProvider::OpenTrack(const TrackLocation&,
+                                          std::error_code&) {
   return {};
 }
 
@@ -9,8 +9,8 @@ class DummyTrackProvider : public ITrackProvider {
   std::error_code List(const std::string& uri,
                        std::vector<TrackLocation>* locations) const override;
   TrackInfo GetTrackInfo(const TrackLocation& track) override;
-  std::unique_ptr<ITrackIO> OpenTrack(const TrackLocation& track,
-                                      std::error_code& ec) override;
+  ITrackIOPtr OpenTrack(const TrackLocation& track,
+                        std::error_code& ec) override;
 };
 
 }  // namespace ip
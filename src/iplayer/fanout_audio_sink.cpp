@@ -0,0 +1,269 @@
+#include "iplayer/fanout_audio_sink.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+struct FanoutAudioSink::BranchState {
+  IAudioSinkPtr sink;
+  std::chrono::milliseconds lag;
+  std::mutex mutex;
+  std::condition_variable cv;       // item posted or stop
+  std::condition_variable idle_cv;  // queue processed
+  std::deque<Item> queue;
+  size_t queued_bytes = 0;
+  size_t lag_bytes = 0;  // lag of the current format
+  bool busy = false;     // an item is being processed
+  bool stop = false;
+  bool failed = false;  // until next open
+  std::atomic<uint64_t> dropped{0};
+  std::future<void> future;
+};
+
+FanoutAudioSink::FanoutAudioSink(IAudioSinkPtr main,
+                                 std::vector<Branch> branches)
+    : main_(std::move(main)) {
+  for (auto& branch : branches) {
+    auto state = std::make_unique<BranchState>();
+    state->sink = std::move(branch.sink);
+    state->lag = branch.lag;
+    state->future = std::async(std::launch::async,
+                               &FanoutAudioSink::BranchThread, this,
+                               state.get());
+    branches_.push_back(std::move(state));
+  }
+}
+
+FanoutAudioSink::~FanoutAudioSink() {
+  for (auto& branch : branches_) {
+    {
+      std::lock_guard<std::mutex> lock(branch->mutex);
+      branch->stop = true;
+    }
+    branch->cv.notify_all();
+  }
+  // futures wait for the threads
+}
+
+std::error_code FanoutAudioSink::Open(const AudioFormat& format) {
+  for (auto& branch : branches_) {
+    Post(branch.get(), {Item::Kind::kOpen, format, nullptr});
+  }
+  return main_->Open(format);
+}
+
+std::error_code FanoutAudioSink::Write(const uint8_t* data, size_t len) {
+  if (branches_.empty()) {
+    return main_->Write(data, len);
+  }
+  auto block = AcquireBlock(data, len);
+  for (auto& branch : branches_) {
+    Post(branch.get(), {Item::Kind::kData, AudioFormat(), block});
+  }
+  return main_->Write(block->data(), block->size());
+}
+
+std::error_code FanoutAudioSink::Drain() {
+  for (auto& branch : branches_) {
+    Post(branch.get(), {Item::Kind::kDrain, AudioFormat(), nullptr});
+  }
+  auto ec = main_->Drain();
+  for (auto& branch : branches_) {
+    WaitIdle(branch.get());
+  }
+  return ec;
+}
+
+void FanoutAudioSink::Flush() {
+  for (auto& branch : branches_) {
+    Post(branch.get(), {Item::Kind::kFlush, AudioFormat(), nullptr});
+  }
+  main_->Flush();
+}
+
+void FanoutAudioSink::Close() {
+  for (auto& branch : branches_) {
+    Post(branch.get(), {Item::Kind::kClose, AudioFormat(), nullptr});
+  }
+  main_->Close();
+  for (auto& branch : branches_) {
+    WaitIdle(branch.get());
+    if (branch->dropped) {
+      LOG("[D] fan-out branch dropped %llu bytes",
+          static_cast<unsigned long long>(branch->dropped.load()));
+    }
+  }
+}
+
+uint64_t FanoutAudioSink::Dropped(size_t branch) const {
+  return branch < branches_.size() ? branches_[branch]->dropped.load() : 0;
+}
+
+PcmBlockPtr FanoutAudioSink::AcquireBlock(const uint8_t* data, size_t len) {
+  // a block only referenced by the pool was released by all the branches,
+  // its memory is reused: no allocation once the pool covers the lags
+  for (auto& block : pool_) {
+    if (block.use_count() == 1) {
+      // what the branches did with it happened before
+      std::atomic_thread_fence(std::memory_order_acquire);
+      block->assign(data, data + len);
+      return block;
+    }
+  }
+  pool_.push_back(std::make_shared<std::vector<uint8_t>>(data, data + len));
+  return pool_.back();
+}
+
+void FanoutAudioSink::Post(BranchState* branch, Item item) {
+  {
+    std::lock_guard<std::mutex> lock(branch->mutex);
+    auto& queue = branch->queue;
+    switch (item.kind) {
+      case Item::Kind::kOpen:
+        branch->lag_bytes = static_cast<size_t>(
+            branch->lag.count() * item.format.rate / 1000 *
+            item.format.BytesPerFrame());
+        break;
+      case Item::Kind::kData: {
+        // over the budget, the oldest data goes first. The newest block is
+        // always kept so a tiny budget still lets something through.
+        size_t len = item.block->size();
+        auto it = std::begin(queue);
+        while (branch->queued_bytes + len > branch->lag_bytes &&
+               it != std::end(queue)) {
+          if (it->kind != Item::Kind::kData) {
+            ++it;
+            continue;
+          }
+          branch->queued_bytes -= it->block->size();
+          branch->dropped += it->block->size();
+          it = queue.erase(it);
+        }
+        branch->queued_bytes += len;
+        break;
+      }
+      case Item::Kind::kFlush:
+        // what's still queued would have been flushed anyway
+        for (auto it = std::begin(queue); it != std::end(queue);) {
+          if (it->kind == Item::Kind::kData) {
+            branch->queued_bytes -= it->block->size();
+            it = queue.erase(it);
+          } else {
+            ++it;
+          }
+        }
+        break;
+      default:
+        break;
+    }
+    queue.push_back(std::move(item));
+  }
+  branch->cv.notify_one();
+}
+
+void FanoutAudioSink::WaitIdle(BranchState* branch) {
+  std::unique_lock<std::mutex> lock(branch->mutex);
+  branch->idle_cv.wait(lock, [branch]() {
+    return (branch->queue.empty() && !branch->busy) || branch->stop;
+  });
+}
+
+void FanoutAudioSink::BranchThread(BranchState* branch) {
+  while (true) {
+    Item item;
+    {
+      std::unique_lock<std::mutex> lock(branch->mutex);
+      branch->busy = false;
+      if (branch->queue.empty()) {
+        branch->idle_cv.notify_all();
+      }
+      branch->cv.wait(lock, [branch]() {
+        return !branch->queue.empty() || branch->stop;
+      });
+      if (branch->stop) {
+        return;
+      }
+      item = std::move(branch->queue.front());
+      branch->queue.pop_front();
+      if (item.kind == Item::Kind::kData) {
+        branch->queued_bytes -= item.block->size();
+      }
+      branch->busy = true;
+    }
+
+    // the sink is only used by this thread
+    std::error_code ec;
+    switch (item.kind) {
+      case Item::Kind::kOpen:
+        branch->failed = false;
+        ec = branch->sink->Open(item.format);
+        break;
+      case Item::Kind::kData:
+        if (!branch->failed) {
+          ec = branch->sink->Write(item.block->data(), item.block->size());
+        }
+        break;
+      case Item::Kind::kDrain:
+        if (!branch->failed) {
+          ec = branch->sink->Drain();
+        }
+        break;
+      case Item::Kind::kFlush:
+        branch->sink->Flush();
+        break;
+      case Item::Kind::kClose:
+        branch->sink->Close();
+        break;
+    }
+    item.block.reset();  // released before going idle
+    if (ec) {
+      LOG("[E] fan-out branch failed: %s", ec.message().c_str());
+      branch->failed = true;
+    }
+  }
+}
+
+IAudioSinkPtr CreateFanoutAudioSink(const AudioSinkFactory& factory,
+                                    const std::string& argument) {
+  IAudioSinkPtr main;
+  std::vector<FanoutAudioSink::Branch> branches;
+  size_t start = 0;
+  while (start <= argument.size()) {
+    auto end = argument.find(',', start);
+    if (end == std::string::npos) {
+      end = argument.size();
+    }
+    auto spec = argument.substr(start, end - start);
+    start = end + 1;
+
+    FanoutAudioSink::Branch branch;
+    // only a trailing '@<digits>' is a lag, '@' is fine in a file name
+    auto at = spec.rfind('@');
+    auto is_digit = [](char c) { return isdigit(static_cast<uint8_t>(c)); };
+    if (at != std::string::npos && at + 1 < spec.size() &&
+        std::all_of(spec.begin() + at + 1, spec.end(), is_digit)) {
+      branch.lag = std::chrono::milliseconds(
+          strtoul(spec.c_str() + at + 1, nullptr, 10));
+      spec.resize(at);
+    }
+    branch.sink = factory.Create(spec);
+    if (!branch.sink) {
+      LOG("[E] unknown audio sink '%s' in fan-out", spec.c_str());
+      return nullptr;
+    }
+    if (!main) {
+      main = std::move(branch.sink);
+    } else {
+      branches.push_back(std::move(branch));
+    }
+  }
+  return std::make_unique<FanoutAudioSink>(std::move(main),
+                                           std::move(branches));
+}
+
+}  // namespace ip
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "iplayer/i_audio_sink.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "iplayer/audio_sink_factory.h"
+
+namespace ip {
+
+// Immutable PCM shared by the branches of a fan-out, recycled once released
+using PcmBlockPtr = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Play the same stream to several sinks, decoded once. What's written is
+// copied once in a reference counted block which every branch reads.
+//
+// The main sink is written from the caller's thread and paces playback like
+// a single sink would. Each other branch has its own thread and a lag
+// budget: when it falls further behind, its oldest blocks are dropped
+// instead of stalling the main sink. A failing branch is skipped until the
+// next Open(), only the main sink's errors are reported.
+class FanoutAudioSink : public IAudioSink {
+ public:
+  struct Branch {
+    IAudioSinkPtr sink;
+    std::chrono::milliseconds lag{1000};  // of buffered audio at most
+  };
+
+  FanoutAudioSink(IAudioSinkPtr main, std::vector<Branch> branches);
+  virtual ~FanoutAudioSink();
+
+  std::error_code Open(const AudioFormat& format) override;
+  std::error_code Write(const uint8_t* data, size_t len) override;
+  std::error_code Drain() override;  // branches too, they are bounded
+  void Flush() override;
+  void Close() override;  // waits for branches to write what they hold
+
+  uint64_t Dropped(size_t branch) const;  // bytes, of 'branches' given
+
+ private:
+  struct Item {
+    enum class Kind { kOpen, kData, kDrain, kFlush, kClose };
+    Kind kind;
+    AudioFormat format;  // kOpen
+    PcmBlockPtr block;   // kData
+  };
+  struct BranchState;
+
+  PcmBlockPtr AcquireBlock(const uint8_t* data, size_t len);
+  void Post(BranchState* branch, Item item);
+  void WaitIdle(BranchState* branch);
+  void BranchThread(BranchState* branch);
+
+  IAudioSinkPtr main_;
+  std::vector<std::unique_ptr<BranchState>> branches_;
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> pool_;
+};
+
+// Builder for the "fanout" spec: sinks' specs separated by ',', each
+// optionally followed by '@' and its lag in ms (digits only, '@' is part of
+// the spec otherwise), the first one is the main sink.
+// Ex: "fanout:pulse,file:/tmp/out.wav@3000". nullptr if one of the sinks
+// can't be created.
+IAudioSinkPtr CreateFanoutAudioSink(const AudioSinkFactory& factory,
+                                    const std::string& argument);
+
+}  // namespace ip
@@ -0,0 +1,128 @@
+#include "iplayer/file_audio_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static const size_t kWavHeaderSize = 44;
+
+static bool EndsWith(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static void AppendLe(std::vector<uint8_t>* bytes, uint32_t value,
+                     size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    bytes->push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+static void AppendTag(std::vector<uint8_t>* bytes, const char* tag) {
+  bytes->insert(bytes->end(), tag, tag + 4);
+}
+
+FileAudioSink::FileAudioSink(const std::string& path)
+    : path_(path),
+      wav_(EndsWith(path, ".wav")),
+      fd_(-1),
+      format_{SampleFormat::kS16, 0, 0},
+      data_size_(0) {}
+
+FileAudioSink::~FileAudioSink() { Close(); }
+
+std::error_code FileAudioSink::Open(const AudioFormat& format) {
+  if (fd_ >= 0) {
+    if (format != format_) {
+      LOG("[E] %s: format can't change", path_.c_str());
+      return std::make_error_code(std::errc::not_supported);
+    }
+    return {};
+  }
+  fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    return {errno, std::generic_category()};
+  }
+  format_ = format;
+  data_size_ = 0;
+  // samples are written in native order, WAV expects little endian
+  return wav_ ? WriteWavHeader() : std::error_code();
+}
+
+std::error_code FileAudioSink::Write(const uint8_t* data, size_t len) {
+  if (fd_ < 0) {
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+  auto ec = WriteAll(data, len);
+  if (!ec) {
+    data_size_ += len;
+  }
+  return ec;
+}
+
+std::error_code FileAudioSink::Drain() { return {}; }
+
+void FileAudioSink::Flush() {}  // everything is already in the file
+
+void FileAudioSink::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  if (wav_) {
+    // sizes were unknown when the header was written first
+    if (lseek(fd_, 0, SEEK_SET) == 0) {
+      WriteWavHeader();
+    }
+  }
+  close(fd_);
+  fd_ = -1;
+}
+
+std::error_code FileAudioSink::WriteAll(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    auto count = write(fd_, data, len);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return {errno, std::generic_category()};
+    }
+    data += count;
+    len -= static_cast<size_t>(count);
+  }
+  return {};
+}
+
+std::error_code FileAudioSink::WriteWavHeader() {
+  const uint32_t kFormatPcm = 1;
+  const uint32_t kFormatFloat = 3;
+  auto data_size = static_cast<uint32_t>(
+      std::min<uint64_t>(data_size_, UINT32_MAX - kWavHeaderSize));
+  auto frame_size = static_cast<uint32_t>(format_.BytesPerFrame());
+
+  std::vector<uint8_t> header;
+  AppendTag(&header, "RIFF");
+  AppendLe(&header, static_cast<uint32_t>(kWavHeaderSize - 8) + data_size, 4);
+  AppendTag(&header, "WAVE");
+  AppendTag(&header, "fmt ");
+  AppendLe(&header, 16, 4);
+  AppendLe(&header,
+           format_.format == SampleFormat::kFloat ? kFormatFloat : kFormatPcm,
+           2);
+  AppendLe(&header, format_.channels, 2);
+  AppendLe(&header, format_.rate, 4);
+  AppendLe(&header, format_.rate * frame_size, 4);
+  AppendLe(&header, frame_size, 2);
+  AppendLe(&header, static_cast<uint32_t>(format_.BytesPerSample() * 8), 2);
+  AppendTag(&header, "data");
+  AppendLe(&header, data_size, 4);
+  return WriteAll(header.data(), header.size());
+}
+
+}  // namespace ip
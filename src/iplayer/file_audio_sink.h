@@ -0,0 +1,34 @@
+#pragma once
+
+#include "iplayer/i_audio_sink.h"
+
+#include <string>
+
+namespace ip {
+
+// Write PCM to a file: WAV when 'path' ends with ".wav" (header sizes are
+// updated on Close()), raw samples otherwise. A file holds a single format,
+// opening it again with another one fails.
+class FileAudioSink : public IAudioSink {
+ public:
+  explicit FileAudioSink(const std::string& path);
+  virtual ~FileAudioSink();
+
+  std::error_code Open(const AudioFormat& format) override;
+  std::error_code Write(const uint8_t* data, size_t len) override;
+  std::error_code Drain() override;
+  void Flush() override;
+  void Close() override;
+
+ private:
+  std::error_code WriteAll(const uint8_t* data, size_t len);
+  std::error_code WriteWavHeader();
+
+  std::string path_;
+  bool wav_;
+  int fd_;
+  AudioFormat format_;
+  uint64_t data_size_;
+};
+
+}  // namespace ip
@@ -0,0 +1,197 @@
+#include "iplayer/folder_watcher.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "iplayer/fs_track_provider.h"
+#include "iplayer/utils/directory_cache.h"
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static const uint32_t kWatchedEvents = IN_CLOSE_WRITE | IN_MOVED_TO |
+                                       IN_MOVED_FROM | IN_DELETE |
+                                       IN_DELETE_SELF | IN_MOVE_SELF |
+                                       IN_ONLYDIR;
+static const size_t kEventBufferSize = 64 * 1024;
+
+FolderWatcher::FolderWatcher()
+    : inotify_fd_(-1), stop_fd_(-1), rescan_count_(0) {}
+
+FolderWatcher::~FolderWatcher() { Stop(); }
+
+std::error_code FolderWatcher::Start(const std::string& dir,
+                                     TrackChanges on_change) {
+  Stop();
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) {
+    std::error_code ec{errno, std::generic_category()};
+    LOG("inotify: %s", ec.message().c_str());
+    return ec;
+  }
+  // watch is added before listing: nothing happening in between is missed
+  if (inotify_add_watch(inotify_fd_, dir.c_str(), kWatchedEvents) < 0 ||
+      (stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    std::error_code ec{errno, std::generic_category()};
+    LOG("cannot watch '%s': %s", dir.c_str(), ec.message().c_str());
+    Stop();
+    return ec;
+  }
+  dir_ = dir;
+  on_change_ = std::move(on_change);
+  thread_ = std::async(std::launch::async, &FolderWatcher::Run, this);
+  return {};
+}
+
+void FolderWatcher::Stop() {
+  if (thread_.valid()) {
+    uint64_t value = 1;
+    if (write(stop_fd_, &value, sizeof(value)) < 0) {
+      LOG("cannot stop watching '%s'", dir_.c_str());
+    }
+    thread_.wait();
+  }
+  for (auto* fd : {&inotify_fd_, &stop_fd_}) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+  known_.clear();
+  touched_.clear();
+}
+
+size_t FolderWatcher::RescanCount() const { return rescan_count_; }
+
+void FolderWatcher::Run() {
+  // files already there, in directory order like FsTrackProvider::List()
+  DirectoryCache::Names names;
+  std::vector<TrackLocation> existing;
+  if (!DirectoryCache::Instance().List(dir_, &names)) {
+    for (const auto& name : *names) {
+      if (IsTrackFileName(name) && known_.insert(name).second) {
+        existing.push_back("file://" + dir_ + "/" + name);
+      }
+    }
+  }
+  if (!existing.empty()) {
+    on_change_(std::move(existing), {});
+  }
+
+  pollfd fds[] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG("stop watching '%s': %s", dir_.c_str(), strerror(errno));
+      return;
+    }
+    if (fds[1].revents) {
+      return;
+    }
+    if (fds[0].revents && !ReadEvents()) {
+      LOG("'%s' is gone, stop watching", dir_.c_str());
+      return;
+    }
+  }
+}
+
+bool FolderWatcher::ReadEvents() {
+  alignas(inotify_event) char buffer[kEventBufferSize];
+  bool overflow = false;
+  bool gone = false;
+  for (;;) {
+    auto len = read(inotify_fd_, buffer, sizeof(buffer));
+    if (len <= 0) {
+      break;  // EAGAIN, everything was read
+    }
+    for (char* it = buffer; it < buffer + len;) {
+      auto* event = reinterpret_cast<inotify_event*>(it);
+      it += sizeof(inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        overflow = true;
+      }
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        gone = true;
+      }
+      if (!event->len || (event->mask & IN_ISDIR)) {
+        continue;
+      }
+      std::string name(event->name);
+      if (!IsTrackFileName(name)) {
+        continue;
+      }
+      Touch(name);
+      if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        known_.insert(std::move(name));
+      } else if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
+        known_.erase(name);
+      }
+    }
+  }
+  if (gone) {
+    for (const auto& name : known_) {
+      touched_.emplace(name, true);
+    }
+    known_.clear();
+  } else if (overflow) {
+    Rescan();
+  }
+  Publish();
+  return !gone;
+}
+
+void FolderWatcher::Rescan() {
+  ++rescan_count_;
+  DirectoryCache::Names names;
+  auto ec = DirectoryCache::Instance().List(dir_, &names);
+  if (ec) {
+    return;  // the directory being gone is notified by its own event
+  }
+  std::unordered_set<std::string> current;
+  for (const auto& name : *names) {
+    if (IsTrackFileName(name)) {
+      current.insert(name);
+    }
+  }
+  for (const auto& name : current) {
+    if (known_.find(name) == std::end(known_)) {
+      touched_.emplace(name, false);
+    }
+  }
+  for (const auto& name : known_) {
+    if (current.find(name) == std::end(current)) {
+      touched_.emplace(name, true);
+    }
+  }
+  known_ = std::move(current);
+}
+
+void FolderWatcher::Touch(const std::string& name) {
+  // state before the first event of the batch, changes undone within the
+  // batch (file written then deleted) are not notified
+  touched_.emplace(name, known_.find(name) != std::end(known_));
+}
+
+void FolderWatcher::Publish() {
+  std::vector<TrackLocation> added;
+  std::vector<TrackLocation> removed;
+  auto prefix = "file://" + dir_ + "/";
+  for (const auto& entry : touched_) {
+    bool known = known_.find(entry.first) != std::end(known_);
+    if (known != entry.second) {
+      (known ? added : removed).push_back(prefix + entry.first);
+    }
+  }
+  touched_.clear();
+  if (!added.empty() || !removed.empty()) {
+    on_change_(std::move(added), std::move(removed));
+  }
+}
+
+}  // namespace ip
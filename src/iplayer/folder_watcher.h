@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "iplayer/i_track_provider.h"
+
+// Watch a directory's mp3 files with inotify. Only what changed is
+// notified: files appear once completely written (or moved in) and
+// disappear when deleted or moved out. When the kernel's event queue
+// overflows, changes are found by listing the directory again and
+// comparing it with the known files.
+
+namespace ip {
+
+class FolderWatcher : public ITrackWatch {
+ public:
+  FolderWatcher();
+  ~FolderWatcher() override;  // stop watching, waits for 'on_change'
+
+  // 'on_change' is first called with the files already there
+  std::error_code Start(const std::string& dir, TrackChanges on_change);
+  void Stop();
+
+  size_t RescanCount() const;  // after event queue overflows
+
+ private:
+  void Run();
+  bool ReadEvents();  // false when the directory is gone
+  void Rescan();
+  void Touch(const std::string& name);
+  void Publish();
+
+  std::string dir_;
+  TrackChanges on_change_;
+  int inotify_fd_;
+  int stop_fd_;  // eventfd waking up Run() to exit
+  std::future<void> thread_;
+  std::atomic<size_t> rescan_count_;
+
+  // only used from Run()
+  std::unordered_set<std::string> known_;  // names of the files notified
+  std::unordered_map<std::string, bool> touched_;  // name -> was known
+};
+
+}  // namespace ip
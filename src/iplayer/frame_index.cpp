@@ -0,0 +1,150 @@
+#include "iplayer/frame_index.h"
+
+#include <algorithm>
+
+namespace ip {
+namespace {
+
+// see: http://www.mp3-tech.org/programmer/frame_header.html
+struct FrameHeader {
+  uint32_t version;  // 0: MPEG 2.5, 2: MPEG 2, 3: MPEG 1
+  uint32_t layer;    // 1, 2 or 3
+  uint32_t sample_rate;
+  uint32_t samples;  // per channel
+  size_t size;       // bytes, header included
+};
+
+const uint16_t kBitrates[2][3][15] = {
+    // MPEG 1, layers 1 to 3
+    {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+     {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+     {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}},
+    // MPEG 2 and 2.5, layers 1 to 3
+    {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}}};
+
+const uint32_t kSampleRates[3] = {44100, 48000, 32000};  // MPEG 1
+
+// 'data' must have at least 4 bytes. Free format frames (no bitrate) aren't
+// supported, their size can't be known from the header.
+bool ParseFrameHeader(const uint8_t* data, FrameHeader* header) {
+  if (data[0] != 0xff || (data[1] & 0xe0) != 0xe0) {
+    return false;
+  }
+  uint32_t version = (data[1] >> 3) & 0x03;
+  uint32_t layer_bits = (data[1] >> 1) & 0x03;
+  uint32_t bitrate_index = data[2] >> 4;
+  uint32_t sample_rate_index = (data[2] >> 2) & 0x03;
+  uint32_t padding = (data[2] >> 1) & 0x01;
+  if (version == 1 || layer_bits == 0 || bitrate_index == 0 ||
+      bitrate_index == 15 || sample_rate_index == 3) {
+    return false;
+  }
+
+  bool mpeg1 = version == 3;
+  header->version = version;
+  header->layer = 4 - layer_bits;
+  header->sample_rate = kSampleRates[sample_rate_index];
+  if (!mpeg1) {
+    // halved for MPEG 2, quartered for MPEG 2.5
+    header->sample_rate /= version == 2 ? 2 : 4;
+  }
+  uint32_t bitrate =
+      kBitrates[mpeg1 ? 0 : 1][header->layer - 1][bitrate_index] * 1000;
+  if (header->layer == 1) {
+    header->samples = 384;
+    header->size = (12 * bitrate / header->sample_rate + padding) * 4;
+  } else if (header->layer == 3 && !mpeg1) {
+    header->samples = 576;
+    header->size = 72 * bitrate / header->sample_rate + padding;
+  } else {
+    header->samples = 1152;
+    header->size = 144 * bitrate / header->sample_rate + padding;
+  }
+  return header->size > 4;
+}
+
+bool SameStream(const FrameHeader& lhs, const FrameHeader& rhs) {
+  return lhs.version == rhs.version && lhs.layer == rhs.layer &&
+         lhs.sample_rate == rhs.sample_rate;
+}
+
+}  // namespace
+
+FrameIndex::FrameIndex() : sample_rate_(0), frame_count_(0), sample_count_(0) {}
+
+size_t FrameIndex::Scan(const uint8_t* data, size_t size, uint64_t offset,
+                        bool end_of_audio) {
+  size_t pos = 0;
+  FrameHeader header;
+  FrameHeader next;
+  while (pos + 4 <= size) {
+    if (!ParseFrameHeader(data + pos, &header)) {
+      ++pos;
+      continue;
+    }
+    // a valid header might just be audio data looking like one: the next
+    // frame must follow, unless it's the last one
+    auto next_pos = pos + header.size;
+    if (next_pos + 4 > size) {
+      if (!end_of_audio) {
+        break;  // can't tell yet
+      }
+      if (next_pos > size) {
+        ++pos;  // truncated
+        continue;
+      }
+    } else if (!ParseFrameHeader(data + next_pos, &next) ||
+               !SameStream(header, next)) {
+      ++pos;
+      continue;
+    }
+    if (sample_rate_ == 0) {
+      sample_rate_ = header.sample_rate;
+    }
+    AddFrame(offset + pos, header.samples);
+    pos = next_pos;
+  }
+  if (end_of_audio) {
+    return size;
+  }
+  return pos;
+}
+
+void FrameIndex::AddFrame(uint64_t offset, uint32_t samples) {
+  if (frame_count_ % kFramesPerEntry == 0) {
+    entries_.push_back({offset, sample_count_});
+  }
+  ++frame_count_;
+  sample_count_ += samples;
+}
+
+FrameIndex::Position FrameIndex::Find(uint64_t sample) const {
+  if (entries_.empty()) {
+    return {0, 0};
+  }
+  // first entry after 'sample', the previous one contains it
+  auto it = std::upper_bound(
+      entries_.begin(), entries_.end(), sample,
+      [](uint64_t value, const Position& entry) {
+        return value < entry.sample;
+      });
+  if (it != entries_.begin()) {
+    --it;
+  }
+  return *it;
+}
+
+std::chrono::milliseconds FrameIndex::Duration() const {
+  if (sample_rate_ == 0) {
+    return std::chrono::milliseconds(0);
+  }
+  return std::chrono::milliseconds(sample_count_ * 1000 / sample_rate_);
+}
+
+size_t FrameIndex::MemorySize() const {
+  return sizeof(*this) + entries_.capacity() * sizeof(Position);
+}
+
+}  // namespace ip
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Position of MPEG audio frames in a track allowing to seek without decoding
+// from the start. Only one frame every kFramesPerEntry is kept: about 70KB
+// for an hour of 44.1kHz audio.
+
+namespace ip {
+
+class FrameIndex {
+ public:
+  static const uint32_t kFramesPerEntry = 16;
+
+  struct Position {
+    uint64_t offset;  // of frame's header in the file
+    uint64_t sample;  // first sample of the frame
+  };
+
+  FrameIndex();
+
+  // Index frames found in 'data' which starts at 'offset' in the file.
+  // Returns the number of bytes scanned, the remaining ones (incomplete frame
+  // at the end) must be given again with more data unless 'data' reaches the
+  // end of audio.
+  size_t Scan(const uint8_t* data, size_t size, uint64_t offset,
+              bool end_of_audio);
+
+  // Indexed frame starting at or before 'sample' (the first one if none)
+  Position Find(uint64_t sample) const;
+
+  uint32_t SampleRate() const { return sample_rate_; }
+  uint64_t FrameCount() const { return frame_count_; }
+  uint64_t SampleCount() const { return sample_count_; }
+  std::chrono::milliseconds Duration() const;
+  size_t MemorySize() const;
+
+ private:
+  void AddFrame(uint64_t offset, uint32_t samples);
+
+  uint32_t sample_rate_;
+  uint64_t frame_count_;
+  uint64_t sample_count_;
+  std::vector<Position> entries_;
+};
+
+using FrameIndexPtr = std::shared_ptr<const FrameIndex>;
+
+}  // namespace ip
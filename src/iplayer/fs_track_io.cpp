@@ -0,0 +1,187 @@
+#include "iplayer/fs_track_io.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static const size_t kChunkSize = 128 * 1024;
+
+FsTrackIO::FsTrackIO()
+    : mapping_offset_(0), fd_(-1), read_chunk_(0), exit_(false) {}
+
+FsTrackIO::~FsTrackIO() { Close(); }
+
+std::error_code FsTrackIO::Open(const TrackLocation& location) {
+  Close();
+
+  // IDEA: TrackLocation should be more than a typedef on std::string,
+  // until then...
+  std::string separator("file://");
+  auto separator_pos = location.find(separator);
+  if (separator_pos == std::string::npos) {
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+  auto path = location.substr(separator.size());
+
+  // reuse the mapping done to get track info if still cached
+  mapping_ = MappingCache::Instance().Find(path,
+                                           FileMapping::Access::kSequential);
+  mapping_offset_ = 0;
+  if (mapping_) {
+    return {};
+  }
+
+  fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    std::error_code ec{errno, std::generic_category()};
+    LOG("error opening '%s': %s", path.c_str(), ec.message().c_str());
+    return ec;
+  }
+  // hints only, errors don't matter
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  posix_fadvise(fd_, 0, 2 * kChunkSize, POSIX_FADV_WILLNEED);
+
+  StartReadahead(0);
+  return {};
+}
+
+void FsTrackIO::StartReadahead(uint64_t offset) {
+  for (auto& chunk : chunks_) {
+    chunk = Chunk();
+    chunk.data.resize(kChunkSize);
+  }
+  read_chunk_ = 0;
+  exit_ = false;
+  readahead_future_ = std::async(std::launch::async,
+                                 &FsTrackIO::ReadaheadThread, this,
+                                 static_cast<off_t>(offset));
+}
+
+void FsTrackIO::StopReadahead() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+    cv_.notify_all();
+  }
+  if (readahead_future_.valid()) {
+    readahead_future_.get();
+  }
+}
+
+size_t FsTrackIO::ReadMapping(uint8_t* buffer, size_t len) {
+  auto count = std::min(len, mapping_->size() - mapping_offset_);
+  memcpy(buffer, mapping_->data() + mapping_offset_, count);
+  mapping_offset_ += count;
+  return count;
+}
+
+size_t FsTrackIO::Read(uint8_t* buffer, size_t len, std::error_code& ec) {
+  ec.clear();
+  if (mapping_) {
+    return ReadMapping(buffer, len);
+  }
+  size_t total = 0;
+  while (total < len) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return chunks_[read_chunk_].filled || exit_; });
+    if (exit_) {
+      ec = std::make_error_code(std::errc::operation_canceled);
+      break;
+    }
+    auto& chunk = chunks_[read_chunk_];
+    if (chunk.size == 0) {
+      ec = chunk.ec;  // chunk stays filled, next Read will end here too
+      break;
+    }
+    lock.unlock();
+
+    // chunk is filled so readahead thread won't touch it
+    auto count = std::min(len - total, chunk.size - chunk.consumed);
+    memcpy(buffer + total, chunk.data.data() + chunk.consumed, count);
+    chunk.consumed += count;
+    total += count;
+
+    if (chunk.consumed == chunk.size) {
+      lock.lock();
+      chunk.filled = false;
+      read_chunk_ ^= 1;
+      cv_.notify_all();
+    }
+  }
+  return total;
+}
+
+std::error_code FsTrackIO::Seek(uint64_t offset) {
+  if (mapping_) {
+    mapping_offset_ = static_cast<size_t>(
+        std::min<uint64_t>(offset, mapping_->size()));
+    return {};
+  }
+  if (fd_ < 0) {
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+  // what's read ahead is useless now
+  StopReadahead();
+  posix_fadvise(fd_, static_cast<off_t>(offset), 2 * kChunkSize,
+                POSIX_FADV_WILLNEED);
+  StartReadahead(offset);
+  return {};
+}
+
+void FsTrackIO::Close() {
+  StopReadahead();
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  mapping_.reset();
+}
+
+void FsTrackIO::ReadaheadThread(off_t offset) {
+  size_t fill_chunk = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock,
+               [&]() { return !chunks_[fill_chunk].filled || exit_; });
+      if (exit_) {
+        return;
+      }
+    }
+
+    // chunk isn't filled so reader won't touch it
+    auto& chunk = chunks_[fill_chunk];
+    ssize_t count;
+    do {
+      count = pread(fd_, chunk.data.data(), chunk.data.size(), offset);
+    } while (count < 0 && errno == EINTR);
+
+    std::error_code ec;
+    if (count < 0) {
+      ec.assign(errno, std::generic_category());
+      LOG("pread failed: %s", ec.message().c_str());
+    } else {
+      offset += count;
+      // ask kernel to fetch the chunk after the one to be read next
+      posix_fadvise(fd_, offset + kChunkSize, kChunkSize, POSIX_FADV_WILLNEED);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunk.size = count > 0 ? static_cast<size_t>(count) : 0;
+    chunk.consumed = 0;
+    chunk.ec = ec;
+    chunk.filled = true;
+    cv_.notify_all();
+    if (chunk.size == 0) {
+      return;  // end of file or error
+    }
+    fill_chunk ^= 1;
+  }
+}
+
+}  // namespace ip
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "iplayer/i_track_io.h"
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <vector>
+
+#include "iplayer/utils/mapping_cache.h"
+
+// Sequential file reader: a background thread reads (pread) the next chunk
+// while the previous one is consumed, so memory use doesn't depend on file
+// size. When the file is already mapped (MappingCache), it is read from the
+// mapping instead.
+
+namespace ip {
+
+class FsTrackIO : public ITrackIO {
+ public:
+  FsTrackIO();
+  virtual ~FsTrackIO();
+
+  std::error_code Open(const TrackLocation& track) override;
+  size_t Read(uint8_t* buffer, size_t len, std::error_code& ec) override;
+  std::error_code Seek(uint64_t offset) override;
+  void Close() override;
+
+ private:
+  struct Chunk {
+    std::vector<uint8_t> data;
+    size_t size = 0;  // 0 on end of file or error
+    size_t consumed = 0;
+    bool filled = false;  // owned by reader when true, by readahead otherwise
+    std::error_code ec;
+  };
+
+  void StartReadahead(uint64_t offset);
+  void StopReadahead();
+  void ReadaheadThread(off_t offset);
+  size_t ReadMapping(uint8_t* buffer, size_t len);
+
+  MappingCache::MappingPtr mapping_;
+  size_t mapping_offset_;
+  int fd_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  Chunk chunks_[2];
+  size_t read_chunk_;  // index of the chunk being consumed
+  bool exit_;
+  std::future<void> readahead_future_;
+};
+
+}  // namespace ip
@@ -1,57 +1,43 @@
 #include "iplayer/fs_track_provider.h"
 
-#include <dirent.h>
-#include <sys/types.h>
+#include <algorithm>
+#include <functional>
 #include <string>
 #include <vector>
 
-// needed to compute track length
-#ifdef IPLAYER_DECODER_MAD
-#include <mad.h>
-#endif  // IPLAYER_DECODER_MAD
-
+#include "iplayer/folder_watcher.h"
+#include "iplayer/frame_index.h"
+#include "iplayer/fs_track_io.h"
+#include "iplayer/id3_tag.h"
+#include "iplayer/playlist_import.h"
+#include "iplayer/playlist_track_provider.h"
 #include "iplayer/track_info.h"
 #include "iplayer/track_location.h"
-#include "iplayer/utils/file_mapping.h"
+#include "iplayer/utils/directory_cache.h"
 #include "iplayer/utils/log.h"
-#include "iplayer/utils/scope_guard.h"
+#include "iplayer/utils/mapping_cache.h"
+#include "iplayer/utils/windowed_file_mapping.h"
 
 namespace ip {
 
+bool IsTrackFileName(const std::string& name) {
+  const std::string ext(".mp3");
+  return name.size() > ext.size() &&
+         std::equal(std::rbegin(ext), std::rend(ext), std::rbegin(name));
+}
+
 std::error_code FsTrackProvider::ListDir(
     const std::string& dir, std::vector<std::string>* files) const {
-  DIR* dp = nullptr;
-  auto cleanup = CreateScopeGuard([&]() {
-    if (dp) {
-      closedir(dp);
-      dp = nullptr;
-    }
-  });
-
-  struct dirent64* dirp;
-  if ((dp = opendir(dir.c_str())) == nullptr) {
-    std::error_code ec{errno, std::generic_category()};
-    LOG("error opening '%s': %s", dir.c_str(), ec.message().c_str());
+  // unchanged directories are listed from their cached snapshot
+  DirectoryCache::Names names;
+  auto ec = DirectoryCache::Instance().List(dir, &names);
+  if (ec) {
     return ec;
   }
-  {
-    // protect dirent64
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    errno = 0;  // see manpages
-    while ((dirp = readdir64(dp)) != nullptr) {
-      std::string filename(dirp->d_name);
-
-      const std::string ext(".mp3");
-      if (!std::equal(std::rbegin(ext), std::rend(ext),
-                      std::rbegin(filename))) {
-        continue;
-      }
+  for (const auto& filename : *names) {
+    if (IsTrackFileName(filename)) {
       files->push_back("file://" + dir + "/" + filename);
     }
-    if (errno) {
-      return {errno, std::generic_category()};
-    }
   }
   return {};
 }
@@ -63,31 +49,107 @@ std::error_code FsTrackProvider::List(
   if (scheme_pos == std::string::npos) {
     return std::make_error_code(std::errc::invalid_argument);
   }
+  std::string playlist;
+  if (GetPlaylistPath(uri, &playlist)) {
+    return PlaylistTrackProvider().List(uri, locations);
+  }
   return ListDir(uri.substr(scheme.size()), locations);
 }
 
-#ifdef IPLAYER_DECODER_MAD
-
-TrackInfo FsTrackProvider::GetTrackInfo(const TrackLocation& location) {
-  TrackInfo info{location};
-
-  struct mad_stream mad_stream;
-  struct mad_header mad_header;
+ITrackWatchPtr FsTrackProvider::Watch(const std::string& uri,
+                                      TrackChanges on_change,
+                                      std::error_code& ec) {
+  std::string scheme{"file://"};
+  std::string playlist;
+  if (uri.compare(0, scheme.size(), scheme) != 0 ||
+      GetPlaylistPath(uri, &playlist)) {
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return {};
+  }
+  auto watcher = std::make_unique<FolderWatcher>();
+  ec = watcher->Start(uri.substr(scheme.size()), std::move(on_change));
+  if (ec) {
+    return {};
+  }
+  return std::move(watcher);
+}
 
-  // cleanup guard
-  auto cleanup_guard = CreateScopeGuard([&]() {
-    mad_header_finish(&mad_header);
-    mad_stream_finish(&mad_stream);
-  });
+// Give access to file content from 'offset', '*available' is set with the
+// number of readable bytes (at least 'len' unless end of file is reached).
+// Returned pointer is valid until next call.
+using MapRange = std::function<const uint8_t*(uint64_t offset, size_t len,
+                                              size_t* available)>;
+
+// window moved over files too big to be mapped at once
+static const size_t kWindowSize = 8 * 1024 * 1024;
+static const size_t kMinScanSize = 64 * 1024;  // bytes needed to make progress
+
+// Index audio frames for seeking, which also gives the exact duration
+static FrameIndexPtr BuildFrameIndex(const MapRange& map, uint64_t begin,
+                                     uint64_t end) {
+  auto index = std::make_shared<FrameIndex>();
+  uint64_t offset = begin;
+  while (offset < end) {
+    size_t available = 0;
+    auto data = map(offset, kMinScanSize, &available);
+    if (!data) {
+      break;
+    }
+    available =
+        static_cast<size_t>(std::min<uint64_t>(available, end - offset));
+    bool end_of_audio = offset + available >= end;
+    // incomplete frame at the end of the window is scanned again
+    auto scanned = index->Scan(data, available, offset, end_of_audio);
+    if (end_of_audio || scanned == 0) {
+      break;
+    }
+    offset += scanned;
+  }
+  return std::move(index);
+}
 
-  mad_stream_init(&mad_stream);
-  mad_header_init(&mad_header);
+// Read tags, duration and frame index: tags are read in place then the
+// remaining audio frames are indexed, so the file is read only once
+static void ReadTrackInfo(const MapRange& map, uint64_t size,
+                          TrackInfo* info) {
+  Id3Tag tag;
+  size_t available = 0;
+  auto head = map(0, kMinScanSize, &available);
+  const uint64_t audio_begin =
+      head ? std::min<uint64_t>(ParseId3v2Tag(head, available, &tag), size)
+           : 0;
+  // views are only valid until next map()
+  std::string title = tag.title.ToUtf8();
+  uint32_t track_number = tag.track_number;
+
+  uint64_t audio_end = size;
+  if (size - audio_begin >= 128) {
+    auto tail = map(size - 128, 128, &available);
+    if (tail) {
+      // parsed apart: 'tag' keeps views on the head which is unmapped now
+      Id3Tag v1_tag;
+      audio_end -= ParseId3v1Tag(tail, 128, &v1_tag);
+      if (title.empty()) {
+        title = v1_tag.title.ToUtf8();
+      }
+      if (track_number == 0) {
+        track_number = v1_tag.track_number;
+      }
+    }
+  }
+  info->SetTitle(title);
+  info->SetTrackNumber(track_number);
+
+  auto index = BuildFrameIndex(map, audio_begin, audio_end);
+  if (index->FrameCount()) {
+    info->SetDuration(
+        std::chrono::duration_cast<std::chrono::seconds>(index->Duration()));
+    info->SetFrameIndex(std::move(index));
+  }
+}
 
-  // compute duration, not bullet proof way to do that and I think it would be
-  // better to move this somewhere else (multiple provider might need this)
-  //
-  // see: https://sourcecodebrowser.com/sox/14.0.1/mp3-duration_8h.html
-  // see also: idv3 tags
+TrackInfo FsTrackProvider::GetTrackInfo(const TrackLocation& location) {
+  TrackInfo info{location};
 
   // IDEA: TrackLocation should be more than a typedef on std::string,
   // until then...
@@ -98,41 +160,59 @@ TrackInfo FsTrackProvider::GetTrackInfo(const TrackLocation& location) {
   }
   auto path = location.substr(separator.size());
 
-  FileMapping mapping(path);
-  mad_timer_t total_time = mad_timer_zero;
-  mad_stream_buffer(&mad_stream, mapping, mapping.size());
-  while (true) {
-    mad_stream.error = MAD_ERROR_NONE;
-    if (mad_header_decode(&mad_header, &mad_stream) == -1) {
-      if (mad_stream.error == MAD_ERROR_BUFLEN) {
-        break;
-      } else if (MAD_RECOVERABLE(mad_stream.error)) {
-        continue;
-      } else {
-        LOG("MP3Stream: Unrecoverable error in mad_header_decode (%s)",
-            mad_stream_errorstr(&mad_stream));
-        break;
-      }
-    }
-    mad_timer_add(&total_time, mad_header.duration);
+  FileIdentity id;
+  auto ec = GetFileIdentity(path, &id);
+  if (ec) {
+    throw std::system_error(ec);
   }
-  info.SetDuration(std::chrono::seconds{total_time.seconds});
   info.SetCodec("mp3");
-  return info;
-}
 
-#else
+  // mapping is shared with decoders through the cache unless the file is too
+  // big to be cached
+  auto& cache = MappingCache::Instance();
+  if (static_cast<uint64_t>(id.size) <= cache.Budget()) {
+    FileMapping::Options options;
+    options.populate = true;  // whole file is read by frame indexing
+    auto mapping =
+        cache.Get(path, FileMapping::Access::kSequential, options, ec);
+    if (mapping) {
+      auto map = [&](uint64_t offset, size_t, size_t* available) {
+        *available = mapping->size() - static_cast<size_t>(offset);
+        return mapping->data() + offset;
+      };
+      ReadTrackInfo(map, mapping->size(), &info);
+      return info;
+    }
+    LOG("cannot map %s (%s), using windowed mapping", path.c_str(),
+        ec.message().c_str());
+  }
 
-TrackInfo FsTrackProvider::GetTrackInfo(const TrackLocation& location) {
-  TrackInfo info{location};
-  info.SetCodec("mp3");
+  // big file or complete mapping failed
+  WindowedFileMapping window(kWindowSize);
+  ec = window.Open(path);
+  if (ec) {
+    throw std::system_error(ec);
+  }
+  auto map = [&](uint64_t offset, size_t len, size_t* available) {
+    std::error_code map_ec;
+    auto data = window.Map(offset, len, available, map_ec);
+    if (map_ec) {
+      LOG("cannot map %s: %s", path.c_str(), map_ec.message().c_str());
+    }
+    return data;
+  };
+  ReadTrackInfo(map, window.size(), &info);
   return info;
 }
-#endif  // IPLAYER_DECODER_MAD
 
-std::unique_ptr<ITrackIO> FsTrackProvider::OpenTrack(const TrackLocation&,
-                                                     std::error_code&) {
-  return {};
+ITrackIOPtr FsTrackProvider::OpenTrack(const TrackLocation& location,
+                                       std::error_code& ec) {
+  auto io = std::make_unique<FsTrackIO>();
+  ec = io->Open(location);
+  if (ec) {
+    return {};
+  }
+  return std::move(io);
 }
 
 }  // namespace ip
@@ -2,23 +2,26 @@
 
 #include "iplayer/i_track_provider.h"
 
-#include <mutex>
-
 namespace ip {
 
+// file names listed as tracks: a name then ".mp3" (directory listings,
+// watches and packs)
+bool IsTrackFileName(const std::string& name);
+
 class FsTrackProvider : public ITrackProvider {
  public:
   std::error_code List(const std::string& uri,
                        std::vector<TrackLocation>* locations) const override;
   TrackInfo GetTrackInfo(const TrackLocation& track) override;
-  std::unique_ptr<ITrackIO> OpenTrack(const TrackLocation& track,
-                                      std::error_code& ec) override;
+  ITrackIOPtr OpenTrack(const TrackLocation& track,
+                        std::error_code& ec) override;
+  // directories only, subdirectories are left out like in List()
+  ITrackWatchPtr Watch(const std::string& uri, TrackChanges on_change,
+                       std::error_code& ec) override;
 
  private:
   std::error_code ListDir(const std::string& dir,
                           std::vector<std::string>* files) const;
-
-  mutable std::mutex mutex_;
 };
 
 }  // namespace ip
@@ -0,0 +1,518 @@
+#include "iplayer/http_stream_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "iplayer/utils/log.h"
+#include "iplayer/utils/scope_guard.h"
+
+namespace ip {
+
+static const size_t kMaxEvents = 256;
+static const size_t kMaxRequestSize = 8 * 1024;
+// bytes of contiguous file chunks sent by one sendfile()
+static const size_t kMaxSendfileSize = 256 * 1024;
+// memory chunks sent by one sendmsg()
+static const size_t kMaxIovecs = 32;
+
+static const char kStreamHeader[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: audio/mpeg\r\n"
+    "Cache-Control: no-cache, no-store\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char kBadRequest[] =
+    "HTTP/1.0 400 Bad Request\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+static const char kMethodNotAllowed[] =
+    "HTTP/1.0 405 Method Not Allowed\r\n"
+    "Allow: GET\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+struct HttpStreamServer::Client {
+  int fd;
+  bool streaming = false;  // request answered, header_ sent first
+  bool ready = false;      // in ready_, the socket had room last time
+  std::string request;
+  std::string header;  // left to send
+  uint64_t position = 0;  // next byte of the stream for this client
+};
+
+HttpStreamServer::Source::~Source() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+HttpStreamServer& HttpStreamServer::Instance() {
+  static HttpStreamServer server;
+  return server;
+}
+
+HttpStreamServer::HttpStreamServer()
+    : running_(false),
+      port_(0),
+      listen_fd_(-1),
+      epoll_fd_(-1),
+      event_fd_(-1),
+      published_end_(0),
+      track_(0),
+      stop_(false),
+      log_end_(0),
+      streaming_(0),
+      accepted_(0),
+      bytes_sent_(0),
+      skipped_(0) {}
+
+HttpStreamServer::~HttpStreamServer() { Stop(); }
+
+std::error_code HttpStreamServer::Start(const Options& options) {
+  if (running_) {
+    return std::make_error_code(std::errc::already_connected);
+  }
+  options_ = options;
+  // a client skipping ahead lands within what's kept
+  options_.burst_size = std::min(options.burst_size, options.max_backlog);
+  auto close_fds = CreateScopeGuard([this]() {
+    for (int* fd : {&listen_fd_, &epoll_fd_, &event_fd_}) {
+      if (*fd >= 0) {
+        close(*fd);
+      }
+      *fd = -1;
+    }
+  });
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.address.c_str(), &address.sin_addr) != 1) {
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int reuse = 1;
+  if (listen_fd_ < 0 ||
+      setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse,
+                 sizeof(reuse)) != 0 ||
+      bind(listen_fd_, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_fd_, SOMAXCONN) != 0) {
+    return {errno, std::generic_category()};
+  }
+  socklen_t length = sizeof(address);
+  getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length);
+  port_ = ntohs(address.sin_port);
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || event_fd_ < 0) {
+    return {errno, std::generic_category()};
+  }
+  for (int fd : {listen_fd_, event_fd_}) {
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+      return {errno, std::generic_category()};
+    }
+  }
+
+  // a listener leaving while sendfile() writes to it mustn't kill us
+  struct sigaction action;
+  if (sigaction(SIGPIPE, nullptr, &action) == 0 &&
+      action.sa_handler == SIG_DFL) {
+    signal(SIGPIPE, SIG_IGN);
+  }
+
+  published_.clear();
+  published_end_ = 0;
+  stop_ = false;
+  log_.clear();
+  log_end_ = 0;
+  close_fds.Cancel();
+  running_ = true;
+  loop_future_ = std::async(std::launch::async, &HttpStreamServer::LoopThread,
+                            this);
+  LOG("[D] streaming on %s:%u", options.address.c_str(), port_);
+  return {};
+}
+
+void HttpStreamServer::Stop() {
+  if (!running_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    uint64_t one = 1;
+    UNUSED(write(event_fd_, &one, sizeof(one)));
+  }
+  loop_future_.get();
+  for (int* fd : {&listen_fd_, &epoll_fd_, &event_fd_}) {
+    close(*fd);
+    *fd = -1;
+  }
+  running_ = false;
+}
+
+HttpStreamStats HttpStreamServer::GetStats() const {
+  HttpStreamStats stats;
+  stats.clients = streaming_;
+  stats.accepted = accepted_;
+  stats.bytes_sent = bytes_sent_;
+  stats.skipped = skipped_;
+  return stats;
+}
+
+HttpStreamServer::SourcePtr HttpStreamServer::OpenSource(
+    const TrackLocation& location) const {
+  const std::string kScheme = "file://";
+  if (location.compare(0, kScheme.size(), kScheme) != 0) {
+    return nullptr;
+  }
+  int fd = open(location.c_str() + kScheme.size(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  auto source = std::make_shared<Source>();
+  source->fd = fd;
+  return source;
+}
+
+uint64_t HttpStreamServer::StartTrack() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ++track_;
+}
+
+void HttpStreamServer::Publish(uint64_t track, const SourcePtr& source,
+                               uint64_t offset, const uint8_t* data,
+                               size_t len) {
+  if (!running_ || len == 0) {
+    return;
+  }
+  Chunk chunk{0, len, source, offset, nullptr};
+  if (!source) {
+    chunk.data = std::make_shared<std::vector<uint8_t>>(data, data + len);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (stop_ || track != track_) {
+    return;  // event_fd_ may be closed, or a newer track plays
+  }
+  chunk.start = published_end_;
+  published_end_ += len;
+  bool wake = published_.empty();
+  published_.push_back(std::move(chunk));
+  if (wake) {
+    uint64_t one = 1;
+    UNUSED(write(event_fd_, &one, sizeof(one)));
+  }
+}
+
+void HttpStreamServer::LoopThread() {
+  epoll_event events[kMaxEvents];
+  while (true) {
+    int count = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG("[E] epoll_wait: %s", strerror(errno));
+      break;
+    }
+    bool published = false;
+    for (int i = 0; i < count; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == listen_fd_) {
+        Accept();
+      } else if (fd == event_fd_) {
+        uint64_t value;
+        UNUSED(read(event_fd_, &value, sizeof(value)));
+        published = true;
+      } else {
+        auto it = clients_.find(fd);
+        if (it != std::end(clients_)) {
+          HandleClient(it->second.get(), events[i].events);
+        }
+      }
+    }
+    if (!published) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_) {
+        break;
+      }
+    }
+    TakePublished();
+    // clients waiting for room are served on EPOLLOUT
+    std::vector<Client*> batch;
+    batch.swap(ready_);
+    for (auto* client : batch) {
+      if (!Send(client)) {
+        client->ready = false;
+        CloseClient(client);
+      } else if (client->ready) {
+        ready_.push_back(client);
+      }
+    }
+  }
+  CloseAll();
+}
+
+void HttpStreamServer::Accept() {
+  while (true) {
+    int fd = accept4(listen_fd_, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // out of descriptors, pending ones wait for the next connection
+        LOG("[E] accept: %s", strerror(errno));
+      }
+      return;
+    }
+    if (clients_.size() >= options_.max_clients) {
+      close(fd);
+      continue;
+    }
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      continue;
+    }
+    auto client = std::make_unique<Client>();
+    client->fd = fd;
+    clients_[fd] = std::move(client);
+    ++accepted_;
+  }
+}
+
+void HttpStreamServer::HandleClient(Client* client, uint32_t events) {
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    CloseClient(client);
+    return;
+  }
+  if ((events & (EPOLLIN | EPOLLRDHUP)) && !ReadRequest(client)) {
+    CloseClient(client);
+    return;
+  }
+  if ((events & EPOLLOUT) && client->streaming && !client->ready) {
+    // room again
+    client->ready = true;
+    if (!Send(client)) {
+      client->ready = false;
+      CloseClient(client);
+    } else if (client->ready) {
+      ready_.push_back(client);
+    }
+  }
+}
+
+bool HttpStreamServer::ReadRequest(Client* client) {
+  char buffer[1024];
+  while (true) {
+    auto count = read(client->fd, buffer, sizeof(buffer));
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (count == 0) {
+      return false;  // gone
+    }
+    if (client->streaming) {
+      continue;  // nothing expected, ignored
+    }
+    client->request.append(buffer, static_cast<size_t>(count));
+    auto end = client->request.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      if (client->request.size() > kMaxRequestSize) {
+        UNUSED(send(client->fd, kBadRequest, sizeof(kBadRequest) - 1,
+                    MSG_NOSIGNAL));
+        return false;
+      }
+      continue;
+    }
+    // any path plays the stream
+    if (client->request.compare(0, 4, "GET ") != 0) {
+      UNUSED(send(client->fd, kMethodNotAllowed,
+                  sizeof(kMethodNotAllowed) - 1, MSG_NOSIGNAL));
+      return false;
+    }
+    client->request.clear();
+    client->request.shrink_to_fit();
+    client->header = kStreamHeader;
+    client->streaming = true;
+    client->position = BurstStart();
+    ++streaming_;
+    // only in ready_ while it has room: Send() clears 'ready' on EAGAIN
+    client->ready = true;
+    if (!Send(client)) {
+      client->ready = false;
+      return false;
+    }
+    if (client->ready) {
+      ready_.push_back(client);
+    }
+  }
+}
+
+bool HttpStreamServer::Send(Client* client) {
+  while (!client->header.empty()) {
+    auto count = send(client->fd, client->header.data(),
+                      client->header.size(), MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        client->ready = false;
+        return true;
+      }
+      return false;
+    }
+    client->header.erase(0, static_cast<size_t>(count));
+  }
+
+  while (true) {
+    uint64_t log_start = log_.empty() ? log_end_ : log_.front().start;
+    if (client->position < log_start ||
+        log_end_ - client->position > options_.max_backlog) {
+      // too slow, what it missed is lost
+      auto burst = BurstStart();
+      skipped_ += burst - client->position;
+      client->position = burst;
+    }
+    if (client->position == log_end_) {
+      return true;  // up to date
+    }
+    auto it = std::upper_bound(
+        std::begin(log_), std::end(log_), client->position,
+        [](uint64_t position, const Chunk& chunk) {
+          return position < chunk.start;
+        });
+    const Chunk& chunk = *(it - 1);
+    auto skip = client->position - chunk.start;
+
+    ssize_t count;
+    size_t len = chunk.size - static_cast<size_t>(skip);
+    if (chunk.source) {
+      // consecutive frames of a file are sent at once
+      for (; it != std::end(log_) && it->source == chunk.source &&
+             it->offset == chunk.offset + (it->start - chunk.start) &&
+             len < kMaxSendfileSize;
+           ++it) {
+        len += it->size;
+      }
+      auto offset = static_cast<off_t>(chunk.offset + skip);
+      count = sendfile(client->fd, chunk.source->fd, &offset, len);
+      if (count == 0) {
+        // file truncated since the frames were read, skip them
+        skipped_ += len;
+        client->position += len;
+        continue;
+      }
+    } else {
+      iovec iov[kMaxIovecs];
+      size_t iov_count = 1;
+      iov[0].iov_base = const_cast<uint8_t*>(chunk.data->data() + skip);
+      iov[0].iov_len = len;
+      for (; it != std::end(log_) && !it->source && iov_count < kMaxIovecs;
+           ++it) {
+        iov[iov_count].iov_base = const_cast<uint8_t*>(it->data->data());
+        iov[iov_count].iov_len = it->size;
+        ++iov_count;
+      }
+      msghdr message;
+      memset(&message, 0, sizeof(message));
+      message.msg_iov = iov;
+      message.msg_iovlen = iov_count;
+      count = sendmsg(client->fd, &message, MSG_NOSIGNAL);
+    }
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        client->ready = false;
+        return true;
+      }
+      return false;
+    }
+    client->position += static_cast<uint64_t>(count);
+    bytes_sent_ += static_cast<uint64_t>(count);
+  }
+}
+
+void HttpStreamServer::TakePublished() {
+  std::vector<Chunk> published;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    published.swap(published_);
+  }
+  for (auto& chunk : published) {
+    log_end_ = chunk.start + chunk.size;
+    log_.push_back(std::move(chunk));
+  }
+  // enough for the slowest allowed client and for a burst
+  auto keep = std::max(options_.max_backlog, options_.burst_size);
+  while (!log_.empty() &&
+         log_end_ - (log_.front().start + log_.front().size) >= keep) {
+    log_.pop_front();
+  }
+}
+
+uint64_t HttpStreamServer::BurstStart() const {
+  // at a chunk boundary: a whole frame
+  uint64_t target =
+      log_end_ > options_.burst_size ? log_end_ - options_.burst_size : 0;
+  auto it = std::lower_bound(std::begin(log_), std::end(log_), target,
+                             [](const Chunk& chunk, uint64_t position) {
+                               return chunk.start < position;
+                             });
+  return it == std::end(log_) ? log_end_ : it->start;
+}
+
+void HttpStreamServer::CloseClient(Client* client) {
+  if (client->ready) {
+    ready_.erase(std::remove(std::begin(ready_), std::end(ready_), client),
+                 std::end(ready_));
+  }
+  if (client->streaming) {
+    --streaming_;
+  }
+  close(client->fd);
+  clients_.erase(client->fd);  // deletes it
+}
+
+void HttpStreamServer::CloseAll() {
+  for (auto& entry : clients_) {
+    close(entry.first);
+  }
+  clients_.clear();
+  ready_.clear();
+  streaming_ = 0;
+}
+
+}  // namespace ip
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "iplayer/track_location.h"
+
+// Serve what's playing to HTTP listeners: the playback decoder publishes
+// the MP3 frames it plays, unchanged, and a single thread sends them to
+// every client from an epoll loop (edge triggered, non blocking sockets).
+//
+// Published frames go to a log shared by all clients, each one only holds
+// its position in it. Frames of local files are sent from the file with
+// sendfile() (page cache to socket), others are copied once in memory.
+// A client joins with a burst of what was published last so it can start
+// playing at once, one falling behind by more than its backlog skips to
+// that burst point instead of holding memory or slowing the others.
+
+namespace ip {
+
+struct HttpStreamStats {
+  size_t clients = 0;  // streaming now
+  uint64_t accepted = 0;
+  uint64_t bytes_sent = 0;
+  uint64_t skipped = 0;  // bytes lost by slow clients
+};
+
+class HttpStreamServer {
+ public:
+  struct Options {
+    std::string address = "0.0.0.0";
+    uint16_t port = 8000;  // 0 for any
+    size_t burst_size = 64 * 1024;    // on connect, ~4s at 128kbps
+    size_t max_backlog = 512 * 1024;  // per client, also what's kept
+    size_t max_clients = 10000;
+  };
+
+  // A track's file, sendfile() reads published frames from it
+  struct Source {
+    ~Source();
+    int fd;
+  };
+  using SourcePtr = std::shared_ptr<const Source>;
+
+  static HttpStreamServer& Instance();
+
+  HttpStreamServer();
+  ~HttpStreamServer();
+
+  std::error_code Start(const Options& options);
+  void Stop();
+  bool Running() const { return running_; }
+  uint16_t Port() const { return port_; }  // the bound one
+  HttpStreamStats GetStats() const;
+
+  // Decoder side, a track about to be published. The stream follows the
+  // last track started: with a crossfade, listeners switch to the new track
+  // as it starts fading in and what's left of the old one isn't sent.
+  uint64_t StartTrack();
+  // nullptr when 'location' isn't a local file
+  SourcePtr OpenSource(const TrackLocation& location) const;
+  // 'len' bytes of whole frames of 'track': read from 'source' at 'offset'
+  // when given, copied from 'data' otherwise. Ignored once another track
+  // started.
+  void Publish(uint64_t track, const SourcePtr& source, uint64_t offset,
+               const uint8_t* data, size_t len);
+
+ private:
+  struct Chunk {
+    uint64_t start;  // position in the stream
+    size_t size;
+    SourcePtr source;  // sent from the file, or
+    uint64_t offset;
+    std::shared_ptr<const std::vector<uint8_t>> data;  // from memory
+  };
+  struct Client;
+
+  void LoopThread();
+  void Accept();
+  void HandleClient(Client* client, uint32_t events);
+  bool ReadRequest(Client* client);  // false to close it
+  bool Send(Client* client);         // false to close it
+  void TakePublished();
+  uint64_t BurstStart() const;
+  void CloseClient(Client* client);
+  void CloseAll();
+
+  Options options_;
+  std::atomic<bool> running_;
+  uint16_t port_;
+  int listen_fd_;
+  int epoll_fd_;
+  int event_fd_;  // wakes the loop: published chunks or stop
+  std::future<void> loop_future_;
+
+  std::mutex mutex_;  // published_, track_ and stop_
+  std::vector<Chunk> published_;  // not in the log yet
+  uint64_t published_end_;
+  uint64_t track_;  // last started
+  bool stop_;
+
+  // loop thread only
+  std::deque<Chunk> log_;
+  uint64_t log_end_;
+  std::unordered_map<int, std::unique_ptr<Client>> clients_;
+  std::vector<Client*> ready_;  // streaming and not waiting for room
+
+  std::atomic<size_t> streaming_;
+  std::atomic<uint64_t> accepted_;
+  std::atomic<uint64_t> bytes_sent_;
+  std::atomic<uint64_t> skipped_;
+};
+
+}  // namespace ip
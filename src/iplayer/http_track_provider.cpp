@@ -0,0 +1,425 @@
+#include "iplayer/http_track_provider.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "iplayer/frame_index.h"
+#include "iplayer/id3_tag.h"
+#include "iplayer/track_info.h"
+#include "iplayer/utils/log.h"
+#include "iplayer/utils/scope_guard.h"
+
+namespace ip {
+
+// start of the file probed for tags and frames, like the local scan
+static const size_t kProbeSize = 64 * 1024;
+static const size_t kId3v1Size = 128;
+static const size_t kReceiveSize = 16 * 1024;
+// two ranges in flight: one is received while the other one is asked for
+static const size_t kMaxInFlight = 2;
+static const int kMaxRetries = 3;
+
+static std::string HostHeader(const HttpUrl& url) {
+  auto host = url.host.find(':') == std::string::npos ? url.host
+                                                      : "[" + url.host + "]";
+  return url.port == 80 ? host : host + ":" + std::to_string(url.port);
+}
+
+static std::string Range(uint64_t begin, uint64_t size) {
+  return "bytes=" + std::to_string(begin) + "-" +
+         std::to_string(begin + size - 1);
+}
+
+// up to 'max' bytes of the current response's body
+static std::error_code ReadBody(HttpConnection* connection, size_t max,
+                                std::vector<uint8_t>* body) {
+  body->resize(max);
+  size_t size = 0;
+  std::error_code ec;
+  size_t count;
+  while (size < max &&
+         (count = connection->ReadBody(body->data() + size, max - size, ec))) {
+    size += count;
+  }
+  body->resize(size);
+  return ec;
+}
+
+static std::error_code StatusError(int status) {
+  LOG("[E] unexpected HTTP status %d", status);
+  return std::make_error_code(status == 404
+                                  ? std::errc::no_such_file_or_directory
+                                  : std::errc::protocol_error);
+}
+
+HttpTrackIO::HttpTrackIO(const Options& options, HttpConnectionPool* pool)
+    : options_(options),
+      pool_(pool),
+      opened_(false),
+      ring_(options.buffer_size),
+      size_(0),
+      exit_(false),
+      end_(false),
+      connection_(nullptr) {
+  options_.request_size = std::min(options_.request_size, ring_.Capacity());
+}
+
+HttpTrackIO::~HttpTrackIO() { Close(); }
+
+std::error_code HttpTrackIO::Open(const TrackLocation& location) {
+  Close();
+  auto ec = ParseHttpUrl(location, &url_);
+  if (ec) {
+    return ec;
+  }
+  opened_ = true;
+  size_ = 0;
+  StartPrefetch(0);
+  return {};
+}
+
+void HttpTrackIO::StartPrefetch(uint64_t offset) {
+  ring_.Clear();
+  exit_ = false;
+  end_ = false;
+  error_.clear();
+  prefetch_future_ = std::async(std::launch::async,
+                                &HttpTrackIO::PrefetchThread, this, offset);
+}
+
+void HttpTrackIO::StopPrefetch() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+    // a blocked recv() would only notice on timeout
+    if (connection_) {
+      connection_->Abort();
+    }
+    cv_.notify_all();
+  }
+  if (prefetch_future_.valid()) {
+    prefetch_future_.get();
+  }
+}
+
+size_t HttpTrackIO::Read(uint8_t* buffer, size_t len, std::error_code& ec) {
+  ec.clear();
+  if (!opened_) {
+    ec = std::make_error_code(std::errc::bad_file_descriptor);
+    return 0;
+  }
+  size_t total = 0;
+  while (total < len) {
+    auto count = ring_.Read(buffer + total, len - total);
+    total += count;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (count) {
+      cv_.notify_all();  // room for the prefetch thread
+    }
+    if (total == len) {
+      break;
+    }
+    cv_.wait(lock, [this]() { return ring_.Size() || end_ || exit_; });
+    if (ring_.Size()) {
+      continue;
+    }
+    ec = exit_ ? std::make_error_code(std::errc::operation_canceled) : error_;
+    break;
+  }
+  return total;
+}
+
+std::error_code HttpTrackIO::Seek(uint64_t offset) {
+  if (!opened_) {
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+  // what's read ahead is useless now
+  StopPrefetch();
+  StartPrefetch(offset);
+  return {};
+}
+
+void HttpTrackIO::Close() {
+  StopPrefetch();
+  opened_ = false;
+}
+
+void HttpTrackIO::SetEnd(const std::error_code& ec) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  end_ = true;
+  error_ = ec;
+  cv_.notify_all();
+}
+
+bool HttpTrackIO::WriteRing(const uint8_t* data, size_t len) {
+  while (len) {
+    auto count = ring_.Write(data, len);
+    data += count;
+    len -= count;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (count) {
+      cv_.notify_all();
+    }
+    cv_.wait(lock, [&]() { return !len || ring_.Free() || exit_; });
+    if (exit_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void HttpTrackIO::PrefetchThread(uint64_t offset) {
+  size_t failures = 0;  // in a row, without receiving anything
+  std::error_code ec;
+  uint64_t start = offset;
+  while (!Fetch(&offset, ec)) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (exit_) {
+        return;
+      }
+    }
+    LOG("[E] %s:%u%s at %llu: %s", url_.host.c_str(), url_.port,
+        url_.path.c_str(), static_cast<unsigned long long>(offset),
+        ec.message().c_str());
+    failures = offset > start ? 1 : failures + 1;
+    start = offset;
+    if (failures > kMaxRetries) {
+      SetEnd(ec);
+      return;
+    }
+  }
+}
+
+bool HttpTrackIO::Fetch(uint64_t* offset, std::error_code& ec) {
+  auto connection = pool_->Acquire(url_, ec);
+  if (!connection) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (exit_) {
+      return true;
+    }
+    connection_ = connection.get();
+  }
+  auto forget = CreateScopeGuard([this]() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    connection_ = nullptr;
+  });
+
+  auto host = HostHeader(url_);
+  uint64_t requested = *offset;  // end of the ranges asked for
+  size_t in_flight = 0;
+  uint8_t buffer[kReceiveSize];
+  while (true) {
+    // ask for the next ranges while the ring has room for them, pipelined
+    // behind the response being received
+    while (in_flight < kMaxInFlight && (size_ == 0 || requested < size_) &&
+           ring_.Free() >= requested - *offset + options_.request_size) {
+      ec = connection->Send(
+          {{"GET", url_.path, Range(requested, options_.request_size)}},
+          host);
+      if (ec) {
+        return false;
+      }
+      requested += options_.request_size;
+      ++in_flight;
+    }
+    if (in_flight == 0) {
+      if (size_ && *offset >= size_) {
+        {
+          // not to be aborted once back in the pool
+          std::lock_guard<std::mutex> lock(mutex_);
+          connection_ = nullptr;
+        }
+        pool_->Release(std::move(connection));
+        SetEnd({});
+        return true;
+      }
+      // a full ring: wait for the decoder to make room
+      requested = *offset;
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() {
+        return ring_.Free() >= options_.request_size || exit_;
+      });
+      if (exit_) {
+        return true;
+      }
+      continue;
+    }
+
+    HttpResponse response;
+    ec = connection->ReadHeader(&response);
+    if (ec) {
+      return false;
+    }
+    --in_flight;
+    uint64_t skip = 0;
+    if (response.status == 416) {
+      SetEnd({});  // past the end
+      return true;
+    } else if (response.status == 200) {
+      // no range support, the whole file comes
+      skip = *offset;
+    } else if (response.status == 206) {
+      size_ = response.RangeTotal();
+    } else {
+      ec = StatusError(response.status);
+      return false;
+    }
+
+    size_t count;
+    while ((count = connection->ReadBody(buffer, sizeof(buffer), ec))) {
+      size_t skipped = static_cast<size_t>(std::min<uint64_t>(skip, count));
+      skip -= skipped;
+      if (!WriteRing(buffer + skipped, count - skipped)) {
+        return true;
+      }
+      *offset += count - skipped;
+    }
+    if (ec) {
+      return false;
+    }
+    if (response.status == 200) {
+      // the connection still has the other responses, drop it
+      SetEnd({});
+      return true;
+    }
+  }
+}
+
+HttpTrackProvider::HttpTrackProvider()
+    : pool_(&HttpConnectionPool::Instance()) {}
+
+HttpTrackProvider::HttpTrackProvider(HttpConnectionPool* pool,
+                                     const HttpTrackIO::Options& options)
+    : pool_(pool), options_(options) {}
+
+std::error_code HttpTrackProvider::List(
+    const std::string& uri, std::vector<TrackLocation>* locations) const {
+  HttpUrl url;
+  auto ec = ParseHttpUrl(uri, &url);
+  if (ec) {
+    return ec;
+  }
+  locations->push_back(uri);
+  return {};
+}
+
+TrackInfo HttpTrackProvider::GetTrackInfo(const TrackLocation& location) {
+  TrackInfo info{location};
+  HttpUrl url;
+  auto ec = ParseHttpUrl(location, &url);
+  if (ec) {
+    throw std::system_error(ec);
+  }
+  auto connection = pool_->Acquire(url, ec);
+  if (!connection) {
+    throw std::system_error(ec);
+  }
+
+  // a single round trip: size, tags and first frames, ID3v1
+  auto host = HostHeader(url);
+  ec = connection->Send({{"HEAD", url.path, ""},
+                         {"GET", url.path, Range(0, kProbeSize)},
+                         {"GET", url.path, "bytes=-128"}},
+                        host);
+  HttpResponse response;
+  if (!ec) {
+    ec = connection->ReadHeader(&response);
+  }
+  if (!ec && response.status != 200) {
+    ec = StatusError(response.status);
+  }
+  if (ec) {
+    throw std::system_error(ec);
+  }
+  uint64_t size = response.length;
+
+  std::vector<uint8_t> head;
+  ec = connection->ReadHeader(&response);
+  if (!ec && response.status != 200 && response.status != 206) {
+    ec = StatusError(response.status);
+  }
+  if (!ec) {
+    ec = ReadBody(connection.get(), kProbeSize, &head);
+  }
+  if (ec) {
+    throw std::system_error(ec);
+  }
+  // without range support the last request would send it all again
+  bool ranges = response.status == 206;
+  std::vector<uint8_t> tail;
+  if (ranges && !connection->ReadHeader(&response) &&
+      response.status == 206) {
+    ReadBody(connection.get(), kId3v1Size, &tail);
+  }
+  pool_->Release(std::move(connection));
+  info.SetCodec("mp3");
+
+  Id3Tag tag;
+  const uint64_t audio_begin = std::min<uint64_t>(
+      ParseId3v2Tag(head.data(), head.size(), &tag), size);
+  // views are only valid while 'head' and 'tail' are
+  std::string title = tag.title.ToUtf8();
+  uint64_t audio_end = size;
+  if (tail.size() == kId3v1Size && size - audio_begin >= kId3v1Size) {
+    audio_end -= ParseId3v1Tag(tail.data(), tail.size(), &tag);
+    if (title.empty()) {
+      title = tag.title.ToUtf8();
+    }
+  }
+  info.SetTitle(title);
+  info.SetTrackNumber(tag.track_number);
+
+  // a tag bigger than the probe: frames need another request
+  std::vector<uint8_t> frames;
+  const uint8_t* audio = head.data() + std::min<uint64_t>(audio_begin,
+                                                          head.size());
+  size_t audio_size = head.size() - static_cast<size_t>(audio - head.data());
+  if (audio_size == 0 && ranges && audio_begin < audio_end) {
+    connection = pool_->Acquire(url, ec);
+    if (connection &&
+        !connection->Send({{"GET", url.path, Range(audio_begin, kProbeSize)}},
+                          host) &&
+        !connection->ReadHeader(&response) && response.status == 206 &&
+        !ReadBody(connection.get(), kProbeSize, &frames)) {
+      audio = frames.data();
+      audio_size = frames.size();
+      pool_->Release(std::move(connection));
+    }
+  }
+  audio_size = static_cast<size_t>(
+      std::min<uint64_t>(audio_size, audio_end - audio_begin));
+
+  // exact when the probe has all the frames, from their average size
+  // otherwise (exact for CBR), there's no index to seek by time then
+  auto index = std::make_shared<FrameIndex>();
+  bool end_of_audio = audio_begin + audio_size >= audio_end;
+  auto scanned = index->Scan(audio, audio_size, audio_begin, end_of_audio);
+  if (index->FrameCount() && end_of_audio) {
+    info.SetDuration(
+        std::chrono::duration_cast<std::chrono::seconds>(index->Duration()));
+    info.SetFrameIndex(std::move(index));
+  } else if (index->FrameCount() && scanned) {
+    auto duration = std::chrono::milliseconds(
+        index->Duration().count() * (audio_end - audio_begin) / scanned);
+    info.SetDuration(
+        std::chrono::duration_cast<std::chrono::seconds>(duration));
+  }
+  return info;
+}
+
+ITrackIOPtr HttpTrackProvider::OpenTrack(const TrackLocation& location,
+                                         std::error_code& ec) {
+  auto io = std::make_unique<HttpTrackIO>(options_, pool_);
+  ec = io->Open(location);
+  if (ec) {
+    return {};
+  }
+  return std::move(io);
+}
+
+}  // namespace ip
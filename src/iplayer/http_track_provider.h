@@ -0,0 +1,83 @@
+#pragma once
+
+#include "iplayer/i_track_provider.h"
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+
+#include "iplayer/utils/http_client.h"
+#include "iplayer/utils/spsc_ring.h"
+
+// Tracks served over HTTP (http://host[:port]/path.mp3).
+//
+// Track info comes from a few requests pipelined on a pooled connection
+// (HEAD for the size, the start and the end of the file for the tags and
+// some frames) so it costs a single round trip. Playback doesn't wait for
+// the download: a background thread requests the next ranges ahead of the
+// decoder into a bounded ring, keeping two requests in flight so the
+// connection doesn't idle during the round trips.
+
+namespace ip {
+
+class HttpTrackIO : public ITrackIO {
+ public:
+  struct Options {
+    size_t buffer_size = 1024 * 1024;  // read ahead of the decoder
+    size_t request_size = 256 * 1024;  // bytes of a range request
+  };
+
+  // 'pool' shared with the track info requests
+  HttpTrackIO(const Options& options, HttpConnectionPool* pool);
+  virtual ~HttpTrackIO();
+
+  std::error_code Open(const TrackLocation& track) override;
+  size_t Read(uint8_t* buffer, size_t len, std::error_code& ec) override;
+  std::error_code Seek(uint64_t offset) override;
+  void Close() override;
+
+ private:
+  void StartPrefetch(uint64_t offset);
+  void StopPrefetch();
+  void PrefetchThread(uint64_t offset);
+  // Requests ranges on one connection from '*offset' until the end, false
+  // on error ('*offset' tells what's already in the ring then)
+  bool Fetch(uint64_t* offset, std::error_code& ec);
+  bool WriteRing(const uint8_t* data, size_t len);  // false when stopped
+  void SetEnd(const std::error_code& ec);
+
+  Options options_;
+  HttpConnectionPool* pool_;
+  HttpUrl url_;
+  bool opened_;
+  SpscRing ring_;
+  uint64_t size_;  // prefetch thread only, 0 until known
+
+  std::mutex mutex_;
+  std::condition_variable cv_;  // data, room or end in the ring
+  bool exit_;
+  bool end_;  // nothing more comes in the ring
+  std::error_code error_;
+  HttpConnection* connection_;  // being used, aborted on stop
+  std::future<void> prefetch_future_;
+};
+
+class HttpTrackProvider : public ITrackProvider {
+ public:
+  HttpTrackProvider();
+  HttpTrackProvider(HttpConnectionPool* pool,
+                    const HttpTrackIO::Options& options);
+
+  // a single track, http has no listing
+  std::error_code List(const std::string& uri,
+                       std::vector<TrackLocation>* locations) const override;
+  TrackInfo GetTrackInfo(const TrackLocation& track) override;
+  ITrackIOPtr OpenTrack(const TrackLocation& track,
+                        std::error_code& ec) override;
+
+ private:
+  HttpConnectionPool* pool_;
+  HttpTrackIO::Options options_;
+};
+
+}  // namespace ip
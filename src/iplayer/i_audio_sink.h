@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <system_error>
+
+#include "iplayer/audio_format.h"
+
+namespace ip {
+
+// Where decoded PCM ends up (sound server, file...). Only one thread at a
+// time uses a sink.
+
+class IAudioSink {
+ public:
+  virtual ~IAudioSink() {}
+
+  // Prepare the sink to receive 'format', can be called again when the
+  // format changes (and is cheap when it doesn't)
+  virtual std::error_code Open(const AudioFormat& format) = 0;
+
+  // Block until 'len' bytes (whole frames) are accepted
+  virtual std::error_code Write(const uint8_t* data, size_t len) = 0;
+
+  // Block until everything written has been played
+  virtual std::error_code Drain() = 0;
+
+  // Drop what's written but not played yet
+  virtual void Flush() = 0;
+
+  virtual void Close() = 0;
+};
+
+using IAudioSinkPtr = std::unique_ptr<IAudioSink>;
+
+}  // namespace ip
@@ -1,12 +1,26 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <system_error>
 
 namespace ip {
 
+struct DecoderStats {
+  uint64_t frames = 0;
+  uint64_t frame_errors = 0;  // recoverable ones, skipped frames
+  std::chrono::milliseconds decoded{0};  // audio given to the output
+};
+
+struct DecoderOptions {
+  // Decoded to be heard: http listeners get its frames and the pcm cache
+  // learns which tracks are replayed. Others (loudness analysis,
+  // verification) only replay cached tracks.
+  bool playback = false;
+};
+
 class IDecoder {
  public:
   using CompletionCb = std::function<void(const std::error_code&)>;
@@ -15,7 +29,11 @@ class IDecoder {
 
   virtual void Pause() = 0;
   virtual void Unpause() = 0;
+  // Asynchronous, what's already buffered for the old position is dropped.
+  // Ignored when the track can't be seeked.
+  virtual void Seek(std::chrono::milliseconds position) = 0;
   virtual std::chrono::seconds GetPlayedTime() const = 0;
+  virtual DecoderStats GetStats() const = 0;
 };
 
 using IDecoderPtr = std::unique_ptr<IDecoder>;
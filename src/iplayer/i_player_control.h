@@ -2,6 +2,7 @@
 
 #include <vector>
 
+#include "iplayer/dsp_chain.h"
 #include "iplayer/track_info.h"
 #include "iplayer/track_location.h"
 
@@ -20,9 +21,15 @@ class IPlayerControl {
   virtual void Stop() = 0;
   virtual void Previous() = 0;
   virtual void Next() = 0;
+  virtual void Seek(std::chrono::seconds position) = 0;
   virtual void SetRepeatTrackEnabled(bool enable) = 0;
   virtual void SetRepeatPlaylistEnabled(bool enable) = 0;
   virtual void SetRandomTrackEnabled(bool value) = 0;
+  virtual void SetNormalizeEnabled(bool value) = 0;  // from next track
+  virtual void SetDspSettings(const DspSettings& settings) = 0;  // immediate
+  virtual DspSettings GetDspSettings() const = 0;
+  // tracks overlap by 'overlap' when changing while playing, 0 disables
+  virtual void SetCrossfade(std::chrono::milliseconds overlap) = 0;
 
   virtual void AddUri(const std::string& uri) = 0;
   virtual void AddTrack(const std::vector<TrackLocation>& track_location) = 0;
@@ -1,19 +1,28 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <system_error>
 
 #include "iplayer/track_location.h"
 
-// Abstraction to read track from any source (currently unused)
+// Abstraction to read track from any source
 
 namespace ip {
 
 class ITrackIO {
  public:
   virtual ~ITrackIO() {}
-  virtual void Open(const TrackLocation& track) = 0;
-  virtual size_t Read(uint8_t* buffer, size_t len) = 0;
+  virtual std::error_code Open(const TrackLocation& track) = 0;
+
+  // block until 'len' bytes are read, returns less on end of track or error
+  virtual size_t Read(uint8_t* buffer, size_t len, std::error_code& ec) = 0;
+
+  // next Read() starts at 'offset' bytes from the start of the track
+  virtual std::error_code Seek(uint64_t offset) = 0;
   virtual void Close() = 0;
 };
 
+using ITrackIOPtr = std::unique_ptr<ITrackIO>;
+
 }  // namespace ip
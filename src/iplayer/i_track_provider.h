@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <system_error>
 #include <vector>
@@ -11,14 +12,32 @@
 
 namespace ip {
 
+// Keeps a listed uri under watch, changes are notified until destroyed
+class ITrackWatch {
+ public:
+  virtual ~ITrackWatch() {}
+};
+
+using ITrackWatchPtr = std::unique_ptr<ITrackWatch>;
+using TrackChanges = std::function<void(std::vector<TrackLocation> added,
+                                        std::vector<TrackLocation> removed)>;
+
 class ITrackProvider {
  public:
   virtual ~ITrackProvider() {}
   virtual std::error_code List(const std::string& uri,
                                std::vector<TrackLocation>* locations) const = 0;
   virtual TrackInfo GetTrackInfo(const TrackLocation& track) = 0;
-  virtual std::unique_ptr<ITrackIO> OpenTrack(const TrackLocation& track,
-                                              std::error_code& ec) = 0;
+  virtual ITrackIOPtr OpenTrack(const TrackLocation& track,
+                                std::error_code& ec) = 0;
+
+  // 'on_change' is called from another thread, first with every track
+  // List() would give then with the tracks added to or removed from 'uri'
+  virtual ITrackWatchPtr Watch(const std::string& uri, TrackChanges on_change,
+                               std::error_code& ec) {
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return {};
+  }
 };
 
 using ITrackProviderPtr = std::unique_ptr<ITrackProvider>;
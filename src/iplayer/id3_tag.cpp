@@ -0,0 +1,270 @@
+#include "iplayer/id3_tag.h"
+
+#include <string.h>
+#include <algorithm>
+
+// see: http://id3.org/id3v2.3.0 and http://id3.org/id3v2.4.0-structure
+
+namespace ip {
+
+namespace {
+
+const size_t kId3v2HeaderSize = 10;
+const size_t kId3v2FrameHeaderSize = 10;
+const size_t kId3v1Size = 128;
+
+uint32_t ReadSyncSafe(const uint8_t* p) {
+  return (p[0] & 0x7fu) << 21 | (p[1] & 0x7fu) << 14 | (p[2] & 0x7fu) << 7 |
+         (p[3] & 0x7fu);
+}
+
+uint32_t ReadBigEndian(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+void AppendUtf8(uint32_t cp, std::string* out) {
+  if (cp < 0x80) {
+    out->push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out->push_back(static_cast<char>(0xc0 | (cp >> 6)));
+    out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+  } else if (cp < 0x10000) {
+    out->push_back(static_cast<char>(0xe0 | (cp >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+  } else {
+    out->push_back(static_cast<char>(0xf0 | (cp >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+  }
+}
+
+// Read bytes of a frame, dropping the 0x00 inserted after each 0xff when the
+// frame is unsynchronised
+class ByteReader {
+ public:
+  ByteReader(const uint8_t* data, size_t size, bool unsync)
+      : it_(data), end_(data + size), unsync_(unsync), prev_ff_(false) {}
+
+  bool Next(uint8_t* byte) {
+    if (it_ == end_) {
+      return false;
+    }
+    if (unsync_ && prev_ff_ && *it_ == 0) {
+      if (++it_ == end_) {
+        return false;
+      }
+    }
+    *byte = *it_++;
+    prev_ff_ = *byte == 0xff;
+    return true;
+  }
+
+ private:
+  const uint8_t* it_;
+  const uint8_t* end_;
+  bool unsync_;
+  bool prev_ff_;
+};
+
+}  // namespace
+
+// Call 'fn' with each character until the end of the text or a terminator:
+// bytes for 8-bit encodings, code points for UTF-16
+template <typename F>
+void Id3Text::ForEachChar(F fn) const {
+  ByteReader reader(data_, size_, unsync_);
+  uint8_t lo, hi;
+
+  if (encoding_ == Encoding::kLatin1 || encoding_ == Encoding::kUtf8) {
+    while (reader.Next(&lo) && lo) {
+      fn(lo);
+    }
+    return;
+  }
+
+  bool big_endian = encoding_ == Encoding::kUtf16Be;
+  uint32_t high_surrogate = 0;
+  while (reader.Next(&lo) && reader.Next(&hi)) {
+    if (big_endian) {
+      std::swap(lo, hi);
+    }
+    uint32_t unit = static_cast<uint32_t>(hi) << 8 | lo;
+    if (unit == 0) {
+      return;
+    }
+    if (unit == 0xfeff) {
+      continue;  // byte order mark matching current endianness
+    }
+    if (unit == 0xfffe) {
+      big_endian = !big_endian;  // byte order mark with opposite endianness
+      continue;
+    }
+    if (unit >= 0xd800 && unit < 0xdc00) {
+      high_surrogate = unit;
+      continue;
+    }
+    if (unit >= 0xdc00 && unit < 0xe000) {
+      if (!high_surrogate) {
+        fn(0xfffd);
+        continue;
+      }
+      unit = 0x10000 + ((high_surrogate - 0xd800) << 10) + (unit - 0xdc00);
+    } else if (high_surrogate) {
+      fn(0xfffd);
+    }
+    high_surrogate = 0;
+    fn(unit);
+  }
+}
+
+std::string Id3Text::ToUtf8() const {
+  std::string text;
+  text.reserve(size_);
+  ForEachChar([&](uint32_t c) {
+    if (encoding_ == Encoding::kUtf8) {
+      text.push_back(static_cast<char>(c));
+    } else {
+      AppendUtf8(c, &text);
+    }
+  });
+
+  // ID3v1 fields are padded with spaces
+  auto last = text.find_last_not_of(' ');
+  text.erase(last == std::string::npos ? 0 : last + 1);
+  return text;
+}
+
+uint32_t Id3Text::ToNumber() const {
+  uint32_t number = 0;
+  bool done = false;
+  ForEachChar([&](uint32_t c) {
+    if (done || c < '0' || c > '9' || number > 100000) {
+      done = true;
+      return;
+    }
+    number = number * 10 + (c - '0');
+  });
+  return number;
+}
+
+size_t ParseId3v2Tag(const uint8_t* data, size_t size, Id3Tag* tag) {
+  if (size < kId3v2HeaderSize || memcmp(data, "ID3", 3) != 0) {
+    return 0;
+  }
+  const uint8_t major = data[3];
+  const uint8_t flags = data[5];
+  if (data[4] == 0xff || (data[6] | data[7] | data[8] | data[9]) & 0x80) {
+    return 0;  // not a valid header
+  }
+
+  // whole tag (including optional footer) is skipped even when the version
+  // is not supported
+  size_t tag_size = kId3v2HeaderSize + ReadSyncSafe(data + 6);
+  const size_t end = std::min(tag_size, size);
+  if (major == 4 && (flags & 0x10)) {
+    tag_size += kId3v2HeaderSize;
+  }
+  if (major != 3 && major != 4) {
+    return tag_size;
+  }
+
+  const bool tag_unsync = flags & 0x80;
+  size_t pos = kId3v2HeaderSize;
+  if (flags & 0x40) {
+    // extended header, size excludes itself in v2.3
+    if (end - pos < 4) {
+      return tag_size;
+    }
+    pos += major == 4 ? ReadSyncSafe(data + pos)
+                      : ReadBigEndian(data + pos) + 4;
+  }
+
+  while (pos < end && end - pos >= kId3v2FrameHeaderSize) {
+    if (!tag->title.empty() && tag->track_number) {
+      break;  // skip remaining frames
+    }
+    const uint8_t* frame = data + pos;
+    if (frame[0] == 0) {
+      break;  // padding
+    }
+    const size_t frame_size =
+        major == 4 ? ReadSyncSafe(frame + 4) : ReadBigEndian(frame + 4);
+    const uint16_t frame_flags =
+        static_cast<uint16_t>(frame[8] << 8 | frame[9]);
+    pos += kId3v2FrameHeaderSize;
+    if (frame_size > end - pos) {
+      break;  // truncated tag
+    }
+    const uint8_t* body = frame + kId3v2FrameHeaderSize;
+    size_t body_size = frame_size;
+    pos += frame_size;
+
+    const bool is_title = memcmp(frame, "TIT2", 4) == 0;
+    const bool is_track = memcmp(frame, "TRCK", 4) == 0;
+    if (!is_title && !is_track) {
+      continue;
+    }
+
+    bool unsync = tag_unsync;
+    size_t skip = 0;
+    if (major == 4) {
+      if (frame_flags & 0x000c) {
+        continue;  // compressed or encrypted
+      }
+      unsync |= (frame_flags & 0x0002) != 0;
+      skip += (frame_flags & 0x0040) ? 1 : 0;  // group id
+      skip += (frame_flags & 0x0001) ? 4 : 0;  // data length indicator
+    } else {
+      if (frame_flags & 0x00c0) {
+        continue;  // compressed or encrypted
+      }
+      skip += (frame_flags & 0x0020) ? 1 : 0;  // group id
+    }
+    if (body_size < skip + 1 || body[skip] > 3) {
+      continue;  // no room for encoding byte or unknown encoding
+    }
+    const auto encoding = static_cast<Id3Text::Encoding>(body[skip]);
+    body += skip + 1;
+    body_size -= skip + 1;
+
+    Id3Text text(body, body_size, encoding, unsync);
+    if (is_title && tag->title.empty()) {
+      tag->title = text;
+    } else if (is_track && !tag->track_number) {
+      tag->track_number = text.ToNumber();
+    }
+  }
+  return tag_size;
+}
+
+size_t ParseId3v1Tag(const uint8_t* data, size_t size, Id3Tag* tag) {
+  if (size < kId3v1Size) {
+    return 0;
+  }
+  const uint8_t* v1 = data + size - kId3v1Size;
+  if (memcmp(v1, "TAG", 3) != 0) {
+    return 0;
+  }
+  if (tag->title.empty()) {
+    const uint8_t* title = v1 + 3;
+    const uint8_t* title_end = std::find(title, title + 30, 0);
+    tag->title = Id3Text(title, static_cast<size_t>(title_end - title),
+                         Id3Text::Encoding::kLatin1, false);
+  }
+  if (!tag->track_number && v1[125] == 0) {
+    tag->track_number = v1[126];  // ID3v1.1
+  }
+  return kId3v1Size;
+}
+
+bool ParseId3Tag(const uint8_t* data, size_t size, Id3Tag* tag) {
+  *tag = Id3Tag();
+  tag->header_size = std::min(ParseId3v2Tag(data, size, tag), size);
+  tag->trailer_size =
+      ParseId3v1Tag(data + tag->header_size, size - tag->header_size, tag);
+  return tag->header_size || tag->trailer_size;
+}
+
+}  // namespace ip
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ID3v1/ID3v2.3/ID3v2.4 tag reader working directly on mapped bytes: fields
+// are kept as views on the input buffer and only converted to std::string
+// (UTF-8) when requested, so the buffer must outlive the Id3Tag.
+
+namespace ip {
+
+// Text frame payload as found in the file (not yet decoded)
+class Id3Text {
+ public:
+  enum class Encoding : uint8_t {
+    kLatin1 = 0,
+    kUtf16 = 1,  // with byte order mark
+    kUtf16Be = 2,
+    kUtf8 = 3
+  };
+
+  Id3Text()
+      : data_(nullptr),
+        size_(0),
+        encoding_(Encoding::kLatin1),
+        unsync_(false) {}
+  Id3Text(const uint8_t* data, size_t size, Encoding encoding, bool unsync)
+      : data_(data), size_(size), encoding_(encoding), unsync_(unsync) {}
+
+  bool empty() const { return size_ == 0; }
+  std::string ToUtf8() const;
+  uint32_t ToNumber() const;  // leading digits ("3/12" -> 3), 0 if none
+
+ private:
+  template <typename F>
+  void ForEachChar(F fn) const;
+
+  const uint8_t* data_;
+  size_t size_;
+  Encoding encoding_;
+  bool unsync_;  // 0xff 0x00 sequences must be read as 0xff
+};
+
+struct Id3Tag {
+  Id3Text title;
+  uint32_t track_number = 0;
+  size_t header_size = 0;   // ID3v2 bytes at start of buffer (0 if none)
+  size_t trailer_size = 0;  // ID3v1 bytes at end of buffer (0 if none)
+};
+
+// Parse ID3v2 tag at the start of 'data' and ID3v1 tag at its end, fields
+// found in ID3v2 take precedence. Reads never go past 'size'. Returns false
+// when no tag was found.
+bool ParseId3Tag(const uint8_t* data, size_t size, Id3Tag* tag);
+
+// Same as ParseId3Tag for callers not having the whole file at once: 'data'
+// is the start of the file for ID3v2 (returned size might be bigger than
+// 'size' when the tag doesn't fit), the end of the file for ID3v1. Fields
+// already set in 'tag' are kept.
+size_t ParseId3v2Tag(const uint8_t* data, size_t size, Id3Tag* tag);
+size_t ParseId3v1Tag(const uint8_t* data, size_t size, Id3Tag* tag);
+
+}  // namespace ip
@@ -0,0 +1,197 @@
+#include "iplayer/loudness_analyzer.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <memory>
+
+#include "iplayer/i_audio_sink.h"
+#include "iplayer/loudness_meter.h"
+#include "iplayer/utils/log.h"
+
+namespace ip {
+namespace {
+
+// Feed the meter with what the decoder outputs, converted to float
+class MeterSink : public IAudioSink {
+ public:
+  explicit MeterSink(std::shared_ptr<std::unique_ptr<LoudnessMeter>> meter)
+      : meter_(std::move(meter)), format_{SampleFormat::kS16, 0, 0} {}
+
+  std::error_code Open(const AudioFormat& format) override {
+    if (*meter_) {
+      return std::make_error_code(std::errc::not_supported);  // one format
+    }
+    format_ = format;
+    *meter_ = std::make_unique<LoudnessMeter>(format.rate, format.channels);
+    return {};
+  }
+
+  std::error_code Write(const uint8_t* data, size_t len) override {
+    size_t count = len / format_.BytesPerSample();
+    samples_.resize(count);
+    switch (format_.format) {
+      case SampleFormat::kS16:
+        for (size_t i = 0; i < count; ++i) {
+          int16_t sample;
+          memcpy(&sample, data + 2 * i, sizeof(sample));
+          samples_[i] = sample / 32768.0f;
+        }
+        break;
+      case SampleFormat::kS32:
+        for (size_t i = 0; i < count; ++i) {
+          int32_t sample;
+          memcpy(&sample, data + 4 * i, sizeof(sample));
+          samples_[i] = sample / 2147483648.0f;
+        }
+        break;
+      case SampleFormat::kFloat:
+        memcpy(samples_.data(), data, count * sizeof(float));
+        break;
+    }
+    (*meter_)->Process(samples_.data(), count / format_.channels);
+    return {};
+  }
+
+  std::error_code Drain() override { return {}; }
+  void Flush() override {}
+  void Close() override {}
+
+ private:
+  std::shared_ptr<std::unique_ptr<LoudnessMeter>> meter_;
+  AudioFormat format_;
+  std::vector<float> samples_;
+};
+
+}  // namespace
+
+LoudnessAnalyzer::LoudnessAnalyzer(ProviderFactory get_provider,
+                                   DecoderFactory create_decoder,
+                                   PublishCb publish)
+    : get_provider_(std::move(get_provider)),
+      create_decoder_(std::move(create_decoder)),
+      publish_(std::move(publish)),
+      exit_(false) {
+  worker_ =
+      std::async(std::launch::async, &LoudnessAnalyzer::WorkerThread, this);
+}
+
+LoudnessAnalyzer::~LoudnessAnalyzer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+    pending_.clear();
+    cv_.notify_all();
+  }
+  worker_.get();
+}
+
+void LoudnessAnalyzer::Push(const std::vector<TrackInfo>& tracks) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& track : tracks) {
+    if (track.HasLoudness() || track.Codec().empty()) {
+      continue;
+    }
+    if (pushed_.insert(track.Location()).second) {
+      pending_.push_back(track);
+    }
+  }
+  cv_.notify_all();
+}
+
+void LoudnessAnalyzer::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& track : pending_) {
+    pushed_.erase(track.Location());
+  }
+  pending_.clear();
+}
+
+void LoudnessAnalyzer::WorkerThread() {
+  // only gets cpu time nobody else wants, threads created from here inherit
+  // the policy
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  int error = pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+  if (error) {
+    LOG("cannot lower loudness analysis priority: %s", strerror(error));
+  }
+
+  while (true) {
+    TrackInfo track;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return exit_ || !pending_.empty(); });
+      if (exit_) {
+        return;
+      }
+      track = std::move(pending_.front());
+      pending_.pop_front();
+    }
+
+    std::error_code ec;
+    try {
+      ec = Analyze(&track);
+    } catch (const std::exception& ex) {
+      UNUSED(ex);
+      LOG("cannot analyze %s: %s", track.Location().c_str(), ex.what());
+      ec = std::make_error_code(std::errc::bad_message);
+    }
+    if (ec) {
+      LOG("no loudness for %s: %s", track.Location().c_str(),
+          ec.message().c_str());
+      continue;
+    }
+    LOG("loudness of %s: %.1f LUFS, peak %.3f", track.Location().c_str(),
+        track.Loudness(), track.Peak());
+    publish_(std::move(track));
+  }
+}
+
+std::error_code LoudnessAnalyzer::Analyze(TrackInfo* track) {
+  auto provider = get_provider_(track->Location());
+  if (!provider) {
+    return std::make_error_code(std::errc::protocol_not_supported);
+  }
+  std::error_code ec;
+  auto io = provider->OpenTrack(track->Location(), ec);
+  if (ec) {
+    return ec;
+  }
+
+  auto meter = std::make_shared<std::unique_ptr<LoudnessMeter>>();
+  AudioOutput output(std::make_unique<MeterSink>(meter));
+  bool done = false;
+  auto decoder = create_decoder_(
+      track->Codec(), *track, std::move(io), &output,
+      [&](const std::error_code& decoder_ec) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ec = decoder_ec;
+        done = true;
+        cv_.notify_all();
+      });
+  if (!decoder) {
+    return std::make_error_code(std::errc::not_supported);
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&]() { return done || exit_; });
+    if (!done) {
+      // decoder's destruction interrupts it
+      return std::make_error_code(std::errc::operation_canceled);
+    }
+  }
+  if (!ec) {
+    ec = output.Drain();
+  }
+  if (ec) {
+    return ec;
+  }
+  if (!*meter) {
+    return std::make_error_code(std::errc::no_message_available);
+  }
+  track->SetLoudness((*meter)->IntegratedLoudness(), (*meter)->Peak());
+  return {};
+}
+
+}  // namespace ip
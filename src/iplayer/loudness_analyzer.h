@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "iplayer/audio_output.h"
+#include "iplayer/i_decoder.h"
+#include "iplayer/i_track_provider.h"
+#include "iplayer/track_info.h"
+#include "iplayer/track_location.h"
+
+// Measure loudness of tracks in background, one at a time, with the regular
+// decoder writing to an output session whose sink is a LoudnessMeter. The
+// worker thread runs at idle scheduling priority (SCHED_IDLE), decoder and
+// output threads it creates inherit it: playback is never slowed down.
+
+namespace ip {
+
+class LoudnessAnalyzer {
+ public:
+  using ProviderFactory =
+      std::function<ITrackProviderPtr(const TrackLocation&)>;
+  using DecoderFactory = std::function<IDecoderPtr(
+      const std::string& codec, const TrackInfo&, ITrackIOPtr, AudioOutput*,
+      IDecoder::CompletionCb)>;
+  using PublishCb = std::function<void(TrackInfo)>;  // loudness is set
+
+  LoudnessAnalyzer(ProviderFactory get_provider, DecoderFactory create_decoder,
+                   PublishCb publish);
+  ~LoudnessAnalyzer();  // stop current analysis and wait for worker
+
+  // tracks are analyzed once, in order, the ones already having loudness or
+  // no codec are ignored
+  void Push(const std::vector<TrackInfo>& tracks);
+  void Cancel();  // drop pending tracks, non blocking
+
+ private:
+  void WorkerThread();
+  std::error_code Analyze(TrackInfo* track);
+
+  ProviderFactory get_provider_;
+  DecoderFactory create_decoder_;
+  PublishCb publish_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<TrackInfo> pending_;
+  std::unordered_set<TrackLocation> pushed_;
+  bool exit_;
+  std::future<void> worker_;
+};
+
+}  // namespace ip
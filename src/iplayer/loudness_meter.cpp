@@ -0,0 +1,203 @@
+#include "iplayer/loudness_meter.h"
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define IPLAYER_LOUDNESS_SSE2  // part of x86-64, no runtime check needed
+#endif
+
+namespace ip {
+
+static const double kAbsoluteGate = -70.0;  // LUFS
+static const double kRelativeGate = -10.0;  // LU
+
+static double ToLoudness(double mean_square) {
+  return -0.691 + 10 * log10(mean_square);
+}
+
+static double ToMeanSquare(double loudness) {
+  return pow(10, (loudness + 0.691) / 10);
+}
+
+float NormalizationGain(double loudness, float peak) {
+  if (!std::isfinite(loudness)) {
+    return 1.0f;
+  }
+  double gain = pow(10, (kTargetLoudness - loudness) / 20);
+  if (peak > 0) {
+    gain = std::min(gain, 1.0 / peak);
+  }
+  return static_cast<float>(gain);
+}
+
+// Filters for any sample rate, from the 48kHz coefficients of BS.1770 (see
+// libebur128)
+LoudnessMeter::LoudnessMeter(uint32_t sample_rate, uint32_t channels)
+    : channels_(std::max<uint32_t>(channels, 1)),
+      sub_block_size_(std::max<size_t>(sample_rate / 10, 1)),
+      sub_block_fill_(0),
+      state_(channels_, ChannelState{{0, 0}, {0, 0}, 0, 0}),
+      sub_blocks_{0, 0, 0, 0},
+      sub_block_count_(0) {
+  double rate = std::max<uint32_t>(sample_rate, 1);
+  double f0 = 1681.974450955533;
+  double gain_db = 3.999843853973347;
+  double q = 0.7071752369554196;
+  double k = tan(M_PI * f0 / rate);
+  double vh = pow(10, gain_db / 20);
+  double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1 + k / q + k * k;
+  shelf_ = {(vh + vb * k / q + k * k) / a0, 2 * (k * k - vh) / a0,
+            (vh - vb * k / q + k * k) / a0, 2 * (k * k - 1) / a0,
+            (1 - k / q + k * k) / a0};
+
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = tan(M_PI * f0 / rate);
+  a0 = 1 + k / q + k * k;
+  highpass_ = {1, -2, 1, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0};
+}
+
+void LoudnessMeter::Process(const float* samples, size_t frames) {
+  while (frames > 0) {
+    auto count = std::min(frames, sub_block_size_ - sub_block_fill_);
+    auto done = channels_ == 2 ? ProcessStereo(samples, count)
+                               : ProcessScalar(samples, count);
+    samples += done * channels_;
+    frames -= done;
+    sub_block_fill_ += done;
+    if (sub_block_fill_ == sub_block_size_) {
+      EndSubBlock();
+    }
+  }
+}
+
+// reference, gives exactly the same result as the vectorized version
+size_t LoudnessMeter::ProcessScalar(const float* samples, size_t frames) {
+  for (uint32_t c = 0; c < channels_; ++c) {
+    auto& s = state_[c];
+    for (size_t i = 0; i < frames; ++i) {
+      double x = samples[i * channels_ + c];
+      double y = shelf_.b0 * x + s.shelf[0];
+      s.shelf[0] = shelf_.b1 * x - shelf_.a1 * y + s.shelf[1];
+      s.shelf[1] = shelf_.b2 * x - shelf_.a2 * y;
+      double z = highpass_.b0 * y + s.highpass[0];
+      s.highpass[0] = highpass_.b1 * y - highpass_.a1 * z + s.highpass[1];
+      s.highpass[1] = highpass_.b2 * y - highpass_.a2 * z;
+      s.energy += z * z;
+      s.peak = std::max(s.peak, std::abs(samples[i * channels_ + c]));
+    }
+  }
+  return frames;
+}
+
+// The filters are recursive: samples of a channel can't be processed in
+// parallel, but left and right are independent and go in the two lanes.
+size_t LoudnessMeter::ProcessStereo(const float* samples, size_t frames) {
+#ifdef IPLAYER_LOUDNESS_SSE2
+  auto& l = state_[0];
+  auto& r = state_[1];
+  auto shelf0 = _mm_set_pd(r.shelf[0], l.shelf[0]);
+  auto shelf1 = _mm_set_pd(r.shelf[1], l.shelf[1]);
+  auto highpass0 = _mm_set_pd(r.highpass[0], l.highpass[0]);
+  auto highpass1 = _mm_set_pd(r.highpass[1], l.highpass[1]);
+  auto energy = _mm_set_pd(r.energy, l.energy);
+  auto peak = _mm_set_ps(0, 0, r.peak, l.peak);
+  const auto sb0 = _mm_set1_pd(shelf_.b0);
+  const auto sb1 = _mm_set1_pd(shelf_.b1);
+  const auto sb2 = _mm_set1_pd(shelf_.b2);
+  const auto sa1 = _mm_set1_pd(shelf_.a1);
+  const auto sa2 = _mm_set1_pd(shelf_.a2);
+  const auto hb0 = _mm_set1_pd(highpass_.b0);
+  const auto hb1 = _mm_set1_pd(highpass_.b1);
+  const auto hb2 = _mm_set1_pd(highpass_.b2);
+  const auto ha1 = _mm_set1_pd(highpass_.a1);
+  const auto ha2 = _mm_set1_pd(highpass_.a2);
+  const auto abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  for (size_t i = 0; i < frames; ++i) {
+    auto xf = _mm_castpd_ps(
+        _mm_load_sd(reinterpret_cast<const double*>(samples + 2 * i)));
+    auto x = _mm_cvtps_pd(xf);
+    auto y = _mm_add_pd(_mm_mul_pd(sb0, x), shelf0);
+    shelf0 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(sb1, x), _mm_mul_pd(sa1, y)),
+                        shelf1);
+    shelf1 = _mm_sub_pd(_mm_mul_pd(sb2, x), _mm_mul_pd(sa2, y));
+    auto z = _mm_add_pd(_mm_mul_pd(hb0, y), highpass0);
+    highpass0 = _mm_add_pd(
+        _mm_sub_pd(_mm_mul_pd(hb1, y), _mm_mul_pd(ha1, z)), highpass1);
+    highpass1 = _mm_sub_pd(_mm_mul_pd(hb2, y), _mm_mul_pd(ha2, z));
+    energy = _mm_add_pd(energy, _mm_mul_pd(z, z));
+    peak = _mm_max_ps(peak, _mm_and_ps(xf, abs_mask));
+  }
+  _mm_storel_pd(&l.shelf[0], shelf0);
+  _mm_storeh_pd(&r.shelf[0], shelf0);
+  _mm_storel_pd(&l.shelf[1], shelf1);
+  _mm_storeh_pd(&r.shelf[1], shelf1);
+  _mm_storel_pd(&l.highpass[0], highpass0);
+  _mm_storeh_pd(&r.highpass[0], highpass0);
+  _mm_storel_pd(&l.highpass[1], highpass1);
+  _mm_storeh_pd(&r.highpass[1], highpass1);
+  _mm_storel_pd(&l.energy, energy);
+  _mm_storeh_pd(&r.energy, energy);
+  float peaks[4];
+  _mm_storeu_ps(peaks, peak);
+  l.peak = peaks[0];
+  r.peak = peaks[1];
+  return frames;
+#else
+  return ProcessScalar(samples, frames);
+#endif  // IPLAYER_LOUDNESS_SSE2
+}
+
+void LoudnessMeter::EndSubBlock() {
+  double energy = 0;
+  for (auto& s : state_) {
+    energy += s.energy;
+    s.energy = 0;
+  }
+  sub_block_fill_ = 0;
+  sub_blocks_[sub_block_count_++ % 4] = energy;
+  if (sub_block_count_ < 4) {
+    return;
+  }
+  double mean_square = (sub_blocks_[0] + sub_blocks_[1] + sub_blocks_[2] +
+                        sub_blocks_[3]) /
+                       (4 * sub_block_size_);
+  if (mean_square > ToMeanSquare(kAbsoluteGate)) {
+    blocks_.push_back(mean_square);
+  }
+}
+
+double LoudnessMeter::IntegratedLoudness() const {
+  if (blocks_.empty()) {
+    return -std::numeric_limits<double>::infinity();
+  }
+  double sum = 0;
+  for (auto block : blocks_) {
+    sum += block;
+  }
+  auto threshold = ToMeanSquare(ToLoudness(sum / blocks_.size()) +
+                                kRelativeGate);
+  sum = 0;
+  size_t count = 0;
+  for (auto block : blocks_) {
+    if (block > threshold) {
+      sum += block;
+      ++count;
+    }
+  }
+  return ToLoudness(sum / count);  // loudest block always passes
+}
+
+float LoudnessMeter::Peak() const {
+  float peak = 0;
+  for (const auto& s : state_) {
+    peak = std::max(peak, s.peak);
+  }
+  return peak;
+}
+
+}  // namespace ip
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Integrated loudness (EBU R128 / ITU-R BS.1770) and sample peak of a
+// track: audio is K-weighted, its energy measured on 400ms blocks (75%
+// overlap) and blocks are gated, absolute gate at -70 LUFS then relative
+// gate 10 LU below the loudness of what remains. Stereo is filtered with both
+// channels in the lanes of one vector.
+
+namespace ip {
+
+static const double kTargetLoudness = -18.0;  // LUFS, ReplayGain 2 reference
+
+// linear gain bringing 'loudness' (LUFS) to kTargetLoudness, lowered so that
+// 'peak' doesn't clip
+float NormalizationGain(double loudness, float peak);
+
+class LoudnessMeter {
+ public:
+  LoudnessMeter(uint32_t sample_rate, uint32_t channels);
+
+  void Process(const float* samples, size_t frames);  // interleaved
+
+  // LUFS, -infinity when nothing passed the gates (silence, too short)
+  double IntegratedLoudness() const;
+  float Peak() const;  // sample peak, linear
+
+ private:
+  struct Biquad {
+    double b0, b1, b2, a1, a2;
+  };
+  struct ChannelState {
+    double shelf[2];     // filters' delay lines (direct form II transposed)
+    double highpass[2];
+    double energy;       // of current 100ms sub-block
+    float peak;
+  };
+
+  size_t ProcessScalar(const float* samples, size_t frames);
+  size_t ProcessStereo(const float* samples, size_t frames);
+  void EndSubBlock();
+
+  Biquad shelf_;     // K-weighting stage 1, head effects
+  Biquad highpass_;  // K-weighting stage 2, RLB
+  uint32_t channels_;
+  size_t sub_block_size_;  // frames in 100ms
+  size_t sub_block_fill_;
+  std::vector<ChannelState> state_;
+  double sub_blocks_[4];  // energy of the last 4 sub-blocks, a block
+  size_t sub_block_count_;
+  std::vector<double> blocks_;  // mean square of blocks above -70 LUFS
+};
+
+}  // namespace ip
@@ -2,10 +2,12 @@
 
 #include <assert.h>
 #include <mad.h>
-#include <pulse/error.h>
-#include <pulse/simple.h>
+#include <string.h>
+#include <algorithm>
 
-#include "iplayer/utils/file_mapping.h"
+#include "iplayer/id3_tag.h"
+#include "iplayer/loudness_meter.h"
+#include "iplayer/pcm_convert.h"
 #include "iplayer/utils/log.h"
 #include "iplayer/utils/scope_guard.h"
 
@@ -19,82 +21,238 @@
 // http://read.pudn.com/downloads143/sourcecode/book/624943/libmad_05_0319/src/decoder.c__.htm?scrajs=wslfd1
 //
 
-// Some helper functions, to be cleaned up in the future
-int scale(mad_fixed_t sample) {
-  /* round */
-  sample += (1L << (MAD_F_FRACBITS - 16));
-  /* clip */
-  if (sample >= MAD_F_ONE)
-    sample = MAD_F_ONE - 1;
-  else if (sample < -MAD_F_ONE)
-    sample = -MAD_F_ONE;
-  /* quantize */
-  return sample >> (MAD_F_FRACBITS + 1 - 16);
-}
-
 namespace ip {
 
-MadDecoder::MadDecoder(const TrackInfo& track_info, CompletionCb cb)
-    : paused_(false),
-      exit_decoder_thread_(false),
+static const size_t kInputBufferSize = 64 * 1024;
+static const size_t kMaxFrameSamples = 1152;  // per channel (MPEG-1 layer 3)
+static const AudioFormat kOutputFormat = {SampleFormat::kS16, 44100, 2};
+// Layer III frames borrow up to 511 bytes from previous ones (bit reservoir)
+// and the synthesis filter has a memory: decoding restarts this many samples
+// before a seek target, what they produce is not output.
+static const uint64_t kSeekPrimingSamples = 8 * kMaxFrameSamples;
+
+MadDecoder::MadDecoder(const TrackInfo& track_info, ITrackIOPtr io,
+                       AudioOutput* output, CompletionCb cb,
+                       const DecoderOptions& options)
+    : exit_decoder_thread_(false),
+      completed_(false),
       played_time_(std::chrono::seconds(0)),
-      device_(nullptr) {
+      frames_(0),
+      frame_errors_(0),
+      output_samples_(0),
+      sample_rate_(0),
+      seekable_(track_info.GetFrameIndex() &&
+                track_info.GetFrameIndex()->SampleRate() != 0),
+      seek_pending_(false),
+      seek_position_(0),
+      skip_samples_(0),
+      options_(options),
+      frame_index_(track_info.GetFrameIndex()),
+      gain_(track_info.HasLoudness() ? NormalizationGain(track_info.Loudness(),
+                                                         track_info.Peak())
+                                     : 1.0f),
+      io_(std::move(io)),
+      input_buffer_(kInputBufferSize + MAD_BUFFER_GUARD),
+      input_offset_(0),
+      input_end_(0),
+      input_eof_(false),
+      output_buffer_(kMaxFrameSamples * kOutputFormat.BytesPerFrame()),
+      dsp_version_(0),
+      dsp_buffer_(DspBlock::kMaxChannels * kMaxFrameSamples),
+      resample_quality_(DspSettings().resample_quality),
+      capture_buffer_(DspBlock::kMaxChannels * kMaxFrameSamples),
+      streaming_(false),
+      stream_track_(0),
+      output_(output) {
   decoder_future_ = std::async(std::launch::async, &MadDecoder::DecoderThread,
                                this, track_info, cb);
 }
 
 MadDecoder::~MadDecoder() {
-  exit_decoder_thread_ = true;
-  Unpause();
+  {
+    // a seek being handled can't resume the output behind our back
+    std::lock_guard<std::mutex> lock(seek_mutex_);
+    exit_decoder_thread_ = true;
+    if (output_) {
+      output_->Interrupt();  // unblock decoder thread if it waits for room
+    }
+  }
+  decoder_future_.wait();
+  if (output_ && !completed_) {
+    // stopped by user, what's buffered mustn't be heard. A completed track
+    // keeps playing while the next one starts.
+    output_->Flush();
+  }
 }
 
-void MadDecoder::Pause() { paused_ = true; }
+// decoder thread doesn't need to be paused: it blocks as soon as the output
+// ring is full
+void MadDecoder::Pause() {
+  if (output_) {
+    output_->Pause();
+  }
+}
 
 void MadDecoder::Unpause() {
-  {
-    std::lock_guard<std::mutex> lock(pause_mutex_);
-    paused_ = false;
-    pause_cv_.notify_one();
+  if (output_) {
+    output_->Unpause();
   }
 }
 
-std::chrono::seconds MadDecoder::GetPlayedTime() const { return played_time_; }
+void MadDecoder::Seek(std::chrono::milliseconds position) {
+  std::lock_guard<std::mutex> lock(seek_mutex_);
+  seek_pending_ = true;
+  seek_position_ = position;
+  // without an index what's buffered keeps playing while it's built: the
+  // seek might still fail
+  if (output_ && seekable_) {
+    output_->Interrupt();  // decoder thread might wait for room
+  }
+}
 
-int MadDecoder::Output(struct mad_header const*, struct mad_pcm* pcm) {
-  int error = 0;
+std::chrono::seconds MadDecoder::GetPlayedTime() const {
+  // decoded time is ahead of what has been heard by what is buffered (which
+  // might also be the end of previous track)
+  auto played_time = played_time_.load();
+  auto bytes_per_second = output_ ? output_->BytesPerSecond() : 0;
+  if (bytes_per_second == 0) {
+    return played_time;
+  }
+  auto buffered =
+      std::chrono::seconds(output_->GetStats().fill / bytes_per_second);
+  return played_time > buffered ? played_time - buffered
+                                : std::chrono::seconds(0);
+}
 
-  int nsamples = pcm->length;
-  mad_fixed_t const *left_ch = pcm->samples[0], *right_ch = pcm->samples[1];
-  static char stream[1152 * 4];
-  if (pcm->channels == 2) {
-    while (nsamples--) {
-      signed int sample;
-      sample = scale(*left_ch++);
-      stream[(pcm->length - nsamples) * 4] =
-          static_cast<char>(((sample >> 0) & 0xff));
-      stream[(pcm->length - nsamples) * 4 + 1] =
-          static_cast<char>(((sample >> 8) & 0xff));
-      sample = scale(*right_ch++);
-      stream[(pcm->length - nsamples) * 4 + 2] =
-          static_cast<char>(((sample >> 0) & 0xff));
-      stream[(pcm->length - nsamples) * 4 + 3] =
-          static_cast<char>(((sample >> 8) & 0xff));
+DecoderStats MadDecoder::GetStats() const {
+  DecoderStats stats;
+  stats.frames = frames_;
+  stats.frame_errors = frame_errors_;
+  auto sample_rate = sample_rate_.load();
+  if (sample_rate) {
+    stats.decoded =
+        std::chrono::milliseconds(output_samples_ * 1000 / sample_rate);
+  }
+  return stats;
+}
+
+void MadDecoder::UpdateDsp() {
+  // runs after resampling, always at the output rate
+  auto version = output_->DspVersion();
+  if (version == dsp_version_) {
+    return;
+  }
+  dsp_version_ = version;
+  auto settings = output_->GetDspSettings();
+  resample_quality_ = settings ? settings->resample_quality
+                               : DspSettings().resample_quality;
+  if (!dsp_) {
+    if (!settings) {
+      return;
     }
-    if (pa_simple_write(device_, stream, static_cast<size_t>(1152 * 4),
-                        &error) < 0) {
-      LOG("pa_simple_write() failed: %s\n", pa_strerror(error));
-      return error;
+    dsp_ = std::make_unique<DspChain>(kOutputFormat.rate,
+                                      kOutputFormat.channels);
+  }
+  dsp_->Configure(settings ? *settings : DspSettings());
+}
+
+void MadDecoder::UpdateResampler(uint32_t sample_rate, uint32_t channels) {
+  if (sample_rate == kOutputFormat.rate || sample_rate == 0) {
+    resampler_.reset();
+    return;
+  }
+  if (resampler_ && resampler_->InputRate() == sample_rate &&
+      resampler_->Channels() == channels &&
+      resampler_->Quality() == resample_quality_) {
+    return;
+  }
+  // only allocates when the stream changes, frames never change of rate in
+  // practice so what the old filter holds can be dropped
+  resampler_ = std::make_unique<Resampler>(sample_rate, kOutputFormat.rate,
+                                           channels, resample_quality_);
+  auto max_frames = resampler_->MaxOutput(kMaxFrameSamples);
+  resample_buffer_.resize(DspBlock::kMaxChannels * max_frames);
+  output_buffer_.resize(
+      std::max(kMaxFrameSamples, max_frames) * kOutputFormat.BytesPerFrame());
+}
+
+std::error_code MadDecoder::Output(struct mad_header const*,
+                                   struct mad_pcm* pcm) {
+  size_t length = std::min<size_t>(pcm->length, kMaxFrameSamples);
+  auto skip = static_cast<size_t>(std::min<uint64_t>(skip_samples_, length));
+  skip_samples_ -= skip;
+  length -= skip;
+  if (length == 0) {
+    return {};
+  }
+  static_assert(sizeof(mad_fixed_t) == sizeof(FixedSample),
+                "unexpected mad_fixed_t");
+  uint32_t channels = pcm->channels == 2 ? 2u : 1u;
+  const FixedSample* left = pcm->samples[0] + skip;
+  const FixedSample* right = channels == 2 ? pcm->samples[1] + skip : left;
+  if (capture_) {
+    // gain applied before quantizing, dsp settings can change
+    ConvertPcm(left, channels == 2 ? right : nullptr, length,
+               SampleFormat::kS16, gain_, capture_buffer_.data());
+    if (!capture_->Append(pcm->samplerate, channels, capture_buffer_.data(),
+                          length)) {
+      capture_.reset();
     }
-  } else {
-    LOG("Mono not supported!");
   }
-  return 0;
+  return OutputFixed(left, right, channels, length, pcm->samplerate);
+}
+
+std::error_code MadDecoder::OutputFixed(const FixedSample* left,
+                                        const FixedSample* right,
+                                        uint32_t channels, size_t length,
+                                        uint32_t sample_rate) {
+  // mono is output on both channels ('right' is 'left'): read twice by the
+  // conversion or duplicated by the dsp chain
+  output_samples_ += length;
+  UpdateDsp();
+  UpdateResampler(sample_rate, channels);
+  if (!resampler_ && !(dsp_ && dsp_->Active())) {
+    ConvertPcm(left, right, length, kOutputFormat.format, gain_,
+               output_buffer_.data());
+    return output_->Write(output_buffer_.data(),
+                          length * kOutputFormat.BytesPerFrame());
+  }
+  float* planar = dsp_buffer_.data();
+  DspBlock block{{planar, planar + kMaxFrameSamples}, channels, length};
+  for (uint32_t c = 0; c < block.channel_count; ++c) {
+    FixedToFloat(c == 0 ? left : right, length, gain_, block.channels[c]);
+  }
+  if (resampler_) {
+    size_t stride = resample_buffer_.size() / DspBlock::kMaxChannels;
+    float* resampled[] = {resample_buffer_.data(),
+                          resample_buffer_.data() + stride};
+    block.frames = resampler_->Process(block.channels, length, resampled);
+    block.channels[0] = resampled[0];
+    block.channels[1] = resampled[1];
+  }
+  return OutputFloat(&block);
+}
+
+std::error_code MadDecoder::OutputFloat(DspBlock* block) {
+  if (block->frames == 0) {
+    return {};
+  }
+  if (dsp_ && dsp_->Active()) {
+    dsp_->Process(block);
+  }
+  // mono duplicated by the chain or read twice by the conversion
+  const float* right =
+      block->channel_count == 2 ? block->channels[1] : block->channels[0];
+  ConvertPcm(block->channels[0], right, block->frames, kOutputFormat.format,
+             output_buffer_.data());
+  return output_->Write(output_buffer_.data(),
+                        block->frames * kOutputFormat.BytesPerFrame());
 }
 
 void MadDecoder::DecoderThread(TrackInfo info, CompletionCb completion_cb) {
   std::error_code ec;
   try {
-    ec = Decode(info.Location());
+    ec = Decode(info);
   } catch (const std::system_error& ex) {
     ec = ex.code();
   } catch (const std::exception& ex) {
@@ -107,27 +265,182 @@ void MadDecoder::DecoderThread(TrackInfo info, CompletionCb completion_cb) {
   }
 }
 
+std::error_code MadDecoder::Refill(struct mad_stream* stream) {
+  // keep the incomplete frame at the end of the buffer
+  size_t remaining = 0;
+  if (stream->next_frame) {
+    remaining = static_cast<size_t>(stream->bufend - stream->next_frame);
+    input_offset_ += static_cast<uint64_t>(stream->next_frame -
+                                           input_buffer_.data());
+    memmove(input_buffer_.data(), stream->next_frame, remaining);
+  }
+
+  std::error_code ec;
+  auto read_size = kInputBufferSize - remaining;
+  auto count = io_->Read(input_buffer_.data() + remaining, read_size, ec);
+  if (ec) {
+    return ec;
+  }
+  input_end_ = input_offset_ + remaining + count;
+  if (count < read_size) {
+    // libmad needs MAD_BUFFER_GUARD zeroed bytes to decode the last frame
+    input_eof_ = true;
+    std::fill_n(input_buffer_.data() + remaining + count, MAD_BUFFER_GUARD, 0);
+    count += MAD_BUFFER_GUARD;
+  }
+  mad_stream_buffer(stream, input_buffer_.data(), remaining + count);
+  stream->error = MAD_ERROR_NONE;
+  return {};
+}
+
+bool MadDecoder::SeekPending() {
+  std::lock_guard<std::mutex> lock(seek_mutex_);
+  return seek_pending_;
+}
+
+std::error_code MadDecoder::StartSeek(std::chrono::milliseconds* position) {
+  std::lock_guard<std::mutex> lock(seek_mutex_);
+  seek_pending_ = false;
+  *position = seek_position_;
+  if (exit_decoder_thread_) {
+    return std::make_error_code(std::errc::operation_canceled);
+  }
+  // old position mustn't be heard. Configure() ends the interruption, no
+  // other Seek() can interrupt in between.
+  output_->Flush();
+  auto ec = output_->Configure(kOutputFormat);
+  if (ec) {
+    return ec;
+  }
+  if (resampler_) {
+    resampler_->Reset();
+  }
+  capture_.reset();  // only whole tracks are cached
+  return {};
+}
+
+FrameIndexPtr MadDecoder::BuildFrameIndex() {
+  LOG("[D] building frame index to seek");
+  auto index = std::make_shared<FrameIndex>();
+  std::vector<uint8_t> buffer(kInputBufferSize);
+  uint64_t offset = 0;  // in the track, of buffer's first byte
+  size_t size = 0;
+  bool tag_skipped = false;
+  if (io_->Seek(0)) {
+    return nullptr;
+  }
+  while (!exit_decoder_thread_) {
+    std::error_code ec;
+    auto read_size = buffer.size() - size;
+    auto count = io_->Read(buffer.data() + size, read_size, ec);
+    if (ec) {
+      return nullptr;
+    }
+    size += count;
+    bool end_of_audio = count < read_size;
+    if (!tag_skipped) {
+      // a picture in the ID3v2 tag could look like frames
+      tag_skipped = true;
+      Id3Tag tag;
+      auto tag_size = ParseId3v2Tag(buffer.data(), std::min<size_t>(size, 10),
+                                    &tag);
+      if (tag_size >= size && !end_of_audio) {
+        if (io_->Seek(tag_size)) {
+          return nullptr;
+        }
+        offset = tag_size;
+        size = 0;
+        continue;
+      }
+      tag_size = std::min(tag_size, size);
+      memmove(buffer.data(), buffer.data() + tag_size, size - tag_size);
+      offset = tag_size;
+      size -= tag_size;
+    }
+    // incomplete frame at the end is scanned again with what follows
+    auto scanned = index->Scan(buffer.data(), size, offset, end_of_audio);
+    if (end_of_audio) {
+      return index->FrameCount() && index->SampleRate() ? index : nullptr;
+    }
+    memmove(buffer.data(), buffer.data() + scanned, size - scanned);
+    offset += scanned;
+    size -= scanned;
+  }
+  return nullptr;
+}
+
+std::error_code MadDecoder::HandleSeek(struct mad_stream* stream,
+                                       struct mad_frame* frame,
+                                       struct mad_synth* synth,
+                                       uint64_t* position) {
+  if (!seekable_) {
+    auto index = BuildFrameIndex();
+    if (!index) {
+      LOG("[D] no frame index, can't seek");
+      {
+        std::lock_guard<std::mutex> lock(seek_mutex_);
+        seek_pending_ = false;
+      }
+      // decoding goes on from where it was, nothing has been dropped
+      return exit_decoder_thread_
+                 ? std::make_error_code(std::errc::operation_canceled)
+                 : io_->Seek(input_end_);
+    }
+    frame_index_ = std::move(index);
+    seekable_ = true;
+  }
+
+  std::chrono::milliseconds seek_position;
+  auto ec = StartSeek(&seek_position);
+  if (ec) {
+    return ec;
+  }
+
+  auto target = static_cast<uint64_t>(seek_position.count()) *
+                frame_index_->SampleRate() / 1000;
+  target = std::min(target, frame_index_->SampleCount());
+  auto start = frame_index_->Find(
+      target > kSeekPrimingSamples ? target - kSeekPrimingSamples : 0);
+  ec = io_->Seek(start.offset);
+  if (ec) {
+    return ec;
+  }
+  LOG("[D] seek to sample %llu from frame at %llu",
+      static_cast<unsigned long long>(target),
+      static_cast<unsigned long long>(start.offset));
+
+  // restart from an empty input buffer, forget previous frames
+  mad_stream_finish(stream);
+  mad_stream_init(stream);
+  mad_frame_mute(frame);
+  mad_synth_mute(synth);
+  input_eof_ = false;
+  input_offset_ = start.offset;
+  input_end_ = start.offset;
+  *position = start.sample;
+  skip_samples_ = target - start.sample;
+  return {};
+}
+
 std::error_code MadDecoder::Decode(const TrackInfo& info) {
-  // IDEA: should use ITrackIO instead of direct file access
   LOG("[D] decoding %s", info.Location().c_str());
-  int error = EINTR;
   struct mad_stream mad_stream;
   struct mad_frame mad_frame;
   struct mad_synth mad_synth;
 
-  mad_timer_t timer = mad_timer_zero;
-
-  // set up PulseAudio 16-bit 44.1kHz stereo output
-  static const pa_sample_spec ss = {PA_SAMPLE_S16LE, 44100, 2};
+  uint64_t position = 0;  // of next decoded sample
 
   // cleanup guard
   auto cleanup_guard = CreateScopeGuard([&]() {
     LOG("[D] end of decoding %s", info.Location().c_str());
-    if (device_) {
-      pa_simple_free(device_);
-      device_ = nullptr;
+    if (output_) {
+      auto stats = output_->GetStats();
+      UNUSED(stats);
+      LOG("[D] output: %llu underruns, %llu overruns",
+          static_cast<unsigned long long>(stats.underruns),
+          static_cast<unsigned long long>(stats.overruns));
     }
-    mad_synth_finish(&mad_synth_);
+    mad_synth_finish(&mad_synth);
     mad_frame_finish(&mad_frame);
     mad_stream_finish(&mad_stream);
   });
@@ -136,36 +449,83 @@ std::error_code MadDecoder::Decode(const TrackInfo& info) {
   mad_frame_init(&mad_frame);
   mad_synth_init(&mad_synth);
 
-  if (!(device_ = pa_simple_new(NULL, "MP3 player", PA_STREAM_PLAYBACK, NULL,
-                                "playback", &ss, NULL, NULL, &error))) {
-    LOG("pa_simple_new() failed");
-    return {errno, std::generic_category()};
+  if (!io_ || !output_) {
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+  // a new track starts playing even if the previous one was paused, only
+  // reopens the sink if previous track had another format
+  output_->Unpause();
+  auto ec = output_->Configure(kOutputFormat);
+  if (ec) {
+    return ec;
   }
 
-  // IDEA: TrackLocation should be more than a typedef on std::string and
-  // provide access to uri elements, until then...
-  std::string separator("file://");
-  auto separator_pos = info.Location().find(separator);
-  if (separator_pos == std::string::npos) {
-    return {};
+  // listeners get the frames as they're played, of the playing track only
+  auto& server = HttpStreamServer::Instance();
+  streaming_ = options_.playback && server.Running();
+  if (streaming_) {
+    stream_track_ = server.StartTrack();
+    stream_source_ = server.OpenSource(info.Location());
   }
-  auto path = info.Location().substr(separator.size());
 
-  FileMapping file_mapping(path);  // MAD_BUFFER_GUARD can cause issue
-  mad_stream_buffer(&mad_stream, file_mapping, file_mapping.size());
+  // a replayed track doesn't need to be decoded again (unless its frames
+  // are streamed), otherwise it might be worth caching
+  auto& cache = PcmCache::Instance();
+  auto cached = streaming_ ? nullptr : cache.Find(info.Location(), gain_);
+  if (cached) {
+    LOG("[D] %s is in pcm cache", info.Location().c_str());
+    gain_ = 1.0f;  // already applied to cached samples
+    ec = Replay(*cached);
+    return ec ? ec : EndOfTrack();
+  }
+  if (options_.playback) {
+    capture_ = cache.StartCapture(info.Location(), gain_, &capture_id_);
+  }
+
+  // input is streamed from io_, mad_stream is refilled each time it needs
+  // more data than available
+  input_eof_ = false;
   while (true) {
-    {
-      std::unique_lock<std::mutex> lock(pause_mutex_);
-      pause_cv_.wait(lock, [this]() { return paused_ == false; });
-    }
     if (exit_decoder_thread_) {
       return std::make_error_code(std::errc::operation_canceled);
     }
+    if (SeekPending()) {
+      ec = HandleSeek(&mad_stream, &mad_frame, &mad_synth, &position);
+      if (ec) {
+        return ec;
+      }
+    }
+    if (mad_stream.buffer == nullptr ||
+        mad_stream.error == MAD_ERROR_BUFLEN) {
+      if (input_eof_) {
+        break;  // everything has been decoded
+      }
+      ec = Refill(&mad_stream);
+      if (ec) {
+        return ec;
+      }
+    }
     if (mad_frame_decode(&mad_frame, &mad_stream)) {
+      if (mad_stream.error == MAD_ERROR_BADDATAPTR) {
+        // frame header is valid but its bit reservoir is missing (e.g. just
+        // after a seek): it still takes its time
+        uint64_t samples = 32 * MAD_NSBSAMPLES(&mad_frame.header);
+        if (skip_samples_ == 0) {
+          ++frame_errors_;  // not a seek, part of the stream is damaged
+        }
+        position += samples;
+        skip_samples_ -= std::min(skip_samples_, samples);
+        continue;
+      }
+      if (mad_stream.error == MAD_ERROR_BUFLEN) {
+        continue;
+      }
       if (MAD_RECOVERABLE(mad_stream.error)) {
+        // lost sync is expected on tags and garbage between frames
+        if (mad_stream.error != MAD_ERROR_LOSTSYNC) {
+          ++frame_errors_;
+        }
         continue;
-      } else if (mad_stream.error == MAD_ERROR_BUFLEN) {
-        break;  // it means eof as file is completely mapped
       } else {
         // ideally mad's error should be mapped to custom error_code
         return std::make_error_code(std::errc::bad_message);
@@ -174,14 +534,120 @@ std::error_code MadDecoder::Decode(const TrackInfo& info) {
     mad_synth_frame(&mad_synth, &mad_frame);
 
     // update ellapsed time
-    mad_timer_add(&timer, mad_frame.header.duration);
-    played_time_ = std::chrono::seconds(timer.seconds);
+    ++frames_;
+    position += mad_synth.pcm.length;
+    sample_rate_ = mad_frame.header.samplerate;
+    if (mad_frame.header.samplerate) {
+      played_time_ = std::chrono::seconds(
+          position / mad_frame.header.samplerate);
+    }
+
+    ec = Output(&mad_frame.header, &mad_synth.pcm);
+    if (ec == std::errc::operation_canceled && !exit_decoder_thread_ &&
+        SeekPending()) {
+      continue;  // interrupted by Seek(), frame belongs to the old position
+    }
+    if (ec) {
+      return ec;
+    }
+    if (streaming_) {
+      PublishFrame(&mad_stream);
+    }
+  }
+  if (capture_) {
+    PcmCache::Instance().Insert(info.Location(), capture_id_,
+                                capture_->Finish());
+    capture_.reset();
+  }
+  return EndOfTrack();
+}
+
+void MadDecoder::PublishFrame(const struct mad_stream* stream) {
+  // published once output: not ahead of playback by more than the ring
+  const uint8_t* begin = stream->this_frame;
+  auto len = static_cast<size_t>(stream->next_frame - begin);
+  HttpStreamServer::Instance().Publish(
+      stream_track_, stream_source_,
+      input_offset_ + (begin - input_buffer_.data()), begin, len);
+}
+
+std::error_code MadDecoder::Replay(const CachedPcm& pcm) {
+  seekable_ = true;  // exactly, all the samples are there
+  const size_t kBlockFrames = CachedPcm::kBlockFrames;
+  std::vector<int16_t> block(kBlockFrames * pcm.Channels());
+  std::vector<FixedSample> samples(DspBlock::kMaxChannels * kMaxFrameSamples);
+  FixedSample* left = samples.data();
+  FixedSample* right =
+      pcm.Channels() == 2 ? samples.data() + kMaxFrameSamples : left;
+  auto rate = pcm.SampleRate();
+  sample_rate_ = rate;
+
+  uint64_t position = 0;  // of next output frame
+  size_t block_index = SIZE_MAX;  // decoded in 'block'
+  while (position < pcm.Frames()) {
+    if (exit_decoder_thread_) {
+      return std::make_error_code(std::errc::operation_canceled);
+    }
+    if (SeekPending()) {
+      std::chrono::milliseconds target;
+      auto ec = StartSeek(&target);
+      if (ec) {
+        return ec;
+      }
+      // decoded samples are all there, seeking is exact
+      position = std::min<uint64_t>(
+          static_cast<uint64_t>(target.count()) * rate / 1000, pcm.Frames());
+      continue;
+    }
+    auto index = static_cast<size_t>(position / kBlockFrames);
+    if (index != block_index) {
+      pcm.ReadBlock(index, block.data());
+      block_index = index;
+    }
+    auto offset = static_cast<size_t>(position % kBlockFrames);
+    auto length = static_cast<size_t>(std::min<uint64_t>(
+        std::min(kMaxFrameSamples, kBlockFrames - offset),
+        pcm.Frames() - position));
+    // back to the decoder's fixed point, 16 bits samples convert exactly
+    const FixedSample kScale = 1 << (kFixedFracBits - 15);
+    for (uint32_t c = 0; c < pcm.Channels(); ++c) {
+      FixedSample* out = c == 0 ? left : right;
+      const int16_t* in = &block[offset * pcm.Channels() + c];
+      for (size_t i = 0; i < length; ++i) {
+        out[i] = in[i * pcm.Channels()] * kScale;
+      }
+    }
+    position += length;
+    played_time_ = std::chrono::seconds(position / rate);
+
+    auto ec = OutputFixed(left, right, pcm.Channels(), length, rate);
+    if (ec == std::errc::operation_canceled && !exit_decoder_thread_ &&
+        SeekPending()) {
+      continue;  // interrupted by Seek()
+    }
+    if (ec) {
+      return ec;
+    }
+  }
+  return {};
+}
 
-    error = Output(&mad_frame.header, &mad_synth.pcm);
-    if (error) {
-      return std::make_error_code(std::errc::bad_message);
+std::error_code MadDecoder::EndOfTrack() {
+  // what the resampling filter delays ends the track
+  if (resampler_) {
+    size_t stride = resample_buffer_.size() / DspBlock::kMaxChannels;
+    DspBlock block{{resample_buffer_.data(), resample_buffer_.data() + stride},
+                   resampler_->Channels(),
+                   0};
+    block.frames = resampler_->Drain(block.channels);
+    auto ec = OutputFloat(&block);
+    if (ec) {
+      return ec;
     }
   }
+  // no drain: next track can be decoded while this one is still playing
+  output_->EndOfStream();
+  completed_ = true;
   return {};
 }
 
@@ -6,12 +6,22 @@
 #include <functional>
 #include <future>
 #include <mutex>
+#include <vector>
 
+#include "iplayer/audio_output.h"
+#include "iplayer/dsp_chain.h"
+#include "iplayer/frame_index.h"
+#include "iplayer/http_stream_server.h"
+#include "iplayer/i_track_io.h"
+#include "iplayer/pcm_cache.h"
+#include "iplayer/resampler.h"
 #include "iplayer/track_info.h"
 #include "iplayer/track_location.h"
 
-struct pa_simple;
 struct mad_header;
+struct mad_stream;
+struct mad_frame;
+struct mad_synth;
 struct mad_pcm;
 
 namespace ip {
@@ -20,27 +30,85 @@ class MadDecoder : public IDecoder {
  public:
   using CompletionCb = std::function<void(const std::error_code&)>;
 
-  MadDecoder(const TrackInfo& track, CompletionCb completion_cb);
+  MadDecoder(const TrackInfo& track, ITrackIOPtr io, AudioOutput* output,
+             CompletionCb completion_cb, const DecoderOptions& options);
   virtual ~MadDecoder();
 
   void Pause() override;
   void Unpause() override;
+  void Seek(std::chrono::milliseconds position) override;
   std::chrono::seconds GetPlayedTime() const override;
+  DecoderStats GetStats() const override;
 
  private:
   void DecoderThread(TrackInfo track_info, CompletionCb completion_cb);
   std::error_code Decode(const TrackInfo& track);
+  std::error_code Refill(struct mad_stream* stream);
+  bool SeekPending();
+  // restart decoding slightly before the requested position, '*position' is
+  // set to the first sample that will be decoded
+  std::error_code HandleSeek(struct mad_stream* stream, struct mad_frame* frame,
+                             struct mad_synth* synth, uint64_t* position);
+  // drop what's buffered for the old position, get the new one
+  std::error_code StartSeek(std::chrono::milliseconds* position);
+  // index of a track played before its info was read (codec probed), the
+  // whole track is read. nullptr if it fails or the decoder is stopped.
+  FrameIndexPtr BuildFrameIndex();
+  // give the frame just decoded to http listeners
+  void PublishFrame(const struct mad_stream* stream);
+  // stream a track from the cache instead of decoding it
+  std::error_code Replay(const CachedPcm& pcm);
+  std::error_code EndOfTrack();  // flush the resampler, end the stream
 
-  int Output(struct mad_header const* header, struct mad_pcm* pcm);
+  std::error_code Output(struct mad_header const* header, struct mad_pcm* pcm);
+  // 'right' is 'left' for mono
+  std::error_code OutputFixed(const FixedSample* left,
+                              const FixedSample* right, uint32_t channels,
+                              size_t length, uint32_t sample_rate);
+  // dsp chain and conversion of float samples at the output rate
+  std::error_code OutputFloat(DspBlock* block);
+  void UpdateDsp();  // follow output's settings
+  void UpdateResampler(uint32_t sample_rate, uint32_t channels);
 
-  std::atomic<bool> paused_;
-  std::mutex pause_mutex_;
-  std::condition_variable pause_cv_;
   std::atomic<bool> exit_decoder_thread_;
+  std::atomic<bool> completed_;  // whole track went to the output
   std::atomic<std::chrono::seconds> played_time_;
+  std::atomic<uint64_t> frames_;
+  std::atomic<uint64_t> frame_errors_;
+  std::atomic<uint64_t> output_samples_;
+  std::atomic<uint32_t> sample_rate_;
   std::future<void> decoder_future_;
 
-  pa_simple* device_;
+  // frame index or cached pcm to seek in, otherwise the index is built by
+  // the decoder thread before a seek interrupts the output
+  std::atomic<bool> seekable_;
+  std::mutex seek_mutex_;  // also orders Interrupt()/Configure() on output_
+  bool seek_pending_;
+  std::chrono::milliseconds seek_position_;
+  uint64_t skip_samples_;  // decoded but not output, priming after a seek
+
+  const DecoderOptions options_;
+  FrameIndexPtr frame_index_;
+  float gain_;  // loudness normalization, applied by the conversion
+  ITrackIOPtr io_;
+  std::vector<uint8_t> input_buffer_;  // refilled from io_, bounded size
+  uint64_t input_offset_;  // in the track, of input_buffer_'s first byte
+  uint64_t input_end_;     // in the track, where next Refill() reads
+  bool input_eof_;
+  std::vector<uint8_t> output_buffer_;  // one converted (resampled) frame
+  std::unique_ptr<DspChain> dsp_;       // created once settings are set
+  uint64_t dsp_version_;
+  std::vector<float> dsp_buffer_;  // one frame, planar
+  ResampleQuality resample_quality_;      // from dsp settings
+  std::unique_ptr<Resampler> resampler_;  // if not at the output rate
+  std::vector<float> resample_buffer_;    // one resampled frame, planar
+  std::unique_ptr<CachedPcmBuilder> capture_;  // decoded track for the cache
+  FileIdentity capture_id_;
+  std::vector<int16_t> capture_buffer_;  // one frame, interleaved
+  bool streaming_;  // playing and http stream server running at the start
+  uint64_t stream_track_;  // from HttpStreamServer::StartTrack()
+  HttpStreamServer::SourcePtr stream_source_;  // nullptr: frames are copied
+  AudioOutput* output_;  // borrowed from Core
 };
 
 }  // namespace ip
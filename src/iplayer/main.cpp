@@ -1,7 +1,67 @@
 #include "iplayer/core.h"
+#include "iplayer/http_stream_server.h"
+#include "iplayer/pcm_cache.h"
 
-int main(int, char* []) {
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
   ip::Core core;
+  // --sink=null, --sink=pulse, --sink=file:/tmp/out.wav,
+  // --sink=fanout:pulse,shm:/iplayer (live pcm for local readers)...
+  const std::string kSinkOption = "--sink=";
+  // --verify [--jobs=N] dir/track...: decode everything without ui, the
+  // sink defaults to null and file sink's argument is a directory
+  const std::string kVerifyOption = "--verify";
+  const std::string kJobsOption = "--jobs=";
+  // --pcm-cache=MiB: memory for decoded tracks being replayed, 0 disables.
+  // --pcm-cache-raw: keep them uncompressed (more memory, less cpu).
+  const std::string kPcmCacheOption = "--pcm-cache=";
+  const std::string kPcmCacheRawOption = "--pcm-cache-raw";
+  // --http-stream=PORT: serve the mp3 frames being played over http
+  const std::string kHttpStreamOption = "--http-stream=";
+  std::string sink;
+  bool verify = false;
+  size_t jobs = 0;
+  std::vector<std::string> uris;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, kSinkOption.size(), kSinkOption) == 0) {
+      sink = arg.substr(kSinkOption.size());
+    } else if (arg == kVerifyOption) {
+      verify = true;
+    } else if (arg.compare(0, kJobsOption.size(), kJobsOption) == 0) {
+      jobs = strtoul(arg.c_str() + kJobsOption.size(), nullptr, 10);
+    } else if (arg.compare(0, kPcmCacheOption.size(), kPcmCacheOption) == 0) {
+      auto mib = strtoul(arg.c_str() + kPcmCacheOption.size(), nullptr, 10);
+      ip::PcmCache::Instance().SetBudget(mib * 1024 * 1024);
+    } else if (arg == kPcmCacheRawOption) {
+      ip::PcmCache::Instance().SetCompression(false);
+    } else if (arg.compare(0, kHttpStreamOption.size(), kHttpStreamOption) ==
+               0) {
+      ip::HttpStreamServer::Options options;
+      options.port = static_cast<uint16_t>(
+          strtoul(arg.c_str() + kHttpStreamOption.size(), nullptr, 10));
+      auto ec = ip::HttpStreamServer::Instance().Start(options);
+      if (ec) {
+        std::cout << "Error: cannot stream on port " << options.port << ": "
+                  << ec.message() << std::endl;
+        return 1;
+      }
+    } else {
+      uris.push_back(arg);
+    }
+  }
+
+  if (verify) {
+    auto failed = core.Verify(uris, sink.empty() ? "null" : sink, jobs);
+    return failed ? 1 : 0;
+  }
+  if (!sink.empty()) {
+    core.SetAudioSink(sink);
+  }
   core.Start();
   return 0;
 }
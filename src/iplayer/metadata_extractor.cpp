@@ -0,0 +1,194 @@
+#include "iplayer/metadata_extractor.h"
+
+#include <algorithm>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+MetadataExtractor::MetadataExtractor(ProviderFactory get_provider,
+                                     PublishCb publish)
+    : MetadataExtractor(std::move(get_provider), std::move(publish),
+                        Options()) {}
+
+MetadataExtractor::MetadataExtractor(ProviderFactory get_provider,
+                                     PublishCb publish, Options options)
+    : options_(options),
+      get_provider_(std::move(get_provider)),
+      publish_(std::move(publish)),
+      ready_prioritized_(false),
+      last_publish_(std::chrono::steady_clock::now()),
+      busy_workers_(0),
+      active_workers_(std::max<size_t>(options.max_workers, 1)),
+      exit_(false) {
+  for (size_t i = 0; i < active_workers_; ++i) {
+    workers_.push_back(std::async(std::launch::async,
+                                  &MetadataExtractor::WorkerThread, this));
+  }
+}
+
+MetadataExtractor::~MetadataExtractor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+    pending_.clear();
+    prioritized_.clear();
+    queued_.clear();
+    cv_.notify_all();
+  }
+  for (auto& worker : workers_) {
+    worker.get();
+  }
+}
+
+void MetadataExtractor::Push(const std::vector<TrackLocation>& locations) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& location : locations) {
+    if (queued_.insert(location).second) {
+      pending_.push_back(location);
+    }
+  }
+  cv_.notify_all();
+}
+
+void MetadataExtractor::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.clear();
+  prioritized_.clear();
+  queued_.clear();
+}
+
+void MetadataExtractor::Remove(
+    const std::unordered_set<TrackLocation>& locations) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // entries stay in pending_ and are skipped there
+  for (const auto& location : locations) {
+    queued_.erase(location);
+    ready_.erase(location);
+  }
+}
+
+void MetadataExtractor::Prioritize(
+    const std::vector<TrackLocation>& locations) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // entries stay in pending_ and are skipped there once extracted
+  prioritized_.clear();
+  for (const auto& location : locations) {
+    if (queued_.find(location) != std::cend(queued_)) {
+      prioritized_.push_back(location);
+    }
+  }
+  cv_.notify_all();
+}
+
+bool MetadataExtractor::PopPending(TrackLocation* location,
+                                   bool* prioritized) {
+  // private method so no synchronization
+  for (auto* queue : {&prioritized_, &pending_}) {
+    while (!queue->empty()) {
+      auto it = queued_.find(queue->front());
+      queue->pop_front();
+      if (it == std::cend(queued_)) {
+        continue;  // already extracted
+      }
+      *location = std::move(*it);
+      *prioritized = queue == &prioritized_;
+      queued_.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MetadataExtractor::ShouldPublish() const {
+  // private method so no synchronization
+  if (ready_.empty()) {
+    return false;
+  }
+  if (ready_prioritized_ || ready_.size() >= options_.batch_size) {
+    return true;
+  }
+  if (queued_.empty() && busy_workers_ == 0) {
+    return true;  // flush last results
+  }
+  return std::chrono::steady_clock::now() - last_publish_ >=
+         options_.batch_delay;
+}
+
+void MetadataExtractor::Throttle(std::chrono::steady_clock::duration latency) {
+  // private method so no synchronization
+  if (options_.io_latency_target.count() == 0) {
+    return;
+  }
+  if (latency > options_.io_latency_target) {
+    if (active_workers_ > 1) {
+      --active_workers_;
+      LOG("[D] metadata extraction throttled to %zu workers", active_workers_);
+    }
+  } else if (latency < options_.io_latency_target / 2 &&
+             active_workers_ < workers_.size()) {
+    ++active_workers_;
+    cv_.notify_one();
+  }
+}
+
+void MetadataExtractor::WorkerThread() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!exit_) {
+    if (ShouldPublish()) {
+      TrackInfos infos;
+      std::swap(infos, ready_);
+      ready_prioritized_ = false;
+      last_publish_ = std::chrono::steady_clock::now();
+      lock.unlock();
+      publish_(std::move(infos));
+      lock.lock();
+      continue;
+    }
+    if (queued_.empty() || busy_workers_ >= active_workers_) {
+      // wait for work or for the delay of the pending results to expire
+      if (ready_.empty()) {
+        cv_.wait(lock);
+      } else {
+        cv_.wait_until(lock, last_publish_ + options_.batch_delay);
+      }
+      continue;
+    }
+
+    TrackLocation location;
+    bool prioritized = false;
+    if (!PopPending(&location, &prioritized)) {
+      continue;
+    }
+    ++busy_workers_;
+    lock.unlock();
+
+    TrackInfo info;
+    bool found = false;
+    auto start = std::chrono::steady_clock::now();
+    try {
+      auto provider = get_provider_(location);
+      if (provider) {
+        info = provider->GetTrackInfo(location);
+        found = true;
+      } else {
+        LOG("cannot find track provider for %s", location.c_str());
+      }
+    } catch (const std::exception& ex) {
+      UNUSED(ex);
+      LOG("cannot get track info for %s: %s", location.c_str(), ex.what());
+    }
+    auto latency = std::chrono::steady_clock::now() - start;
+
+    lock.lock();
+    --busy_workers_;
+    if (found) {
+      ready_.insert({std::move(location), std::move(info)});
+      ready_prioritized_ |= prioritized;
+    }
+    Throttle(latency);
+    cv_.notify_one();
+  }
+}
+
+}  // namespace ip
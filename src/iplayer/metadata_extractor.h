@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "iplayer/i_track_provider.h"
+#include "iplayer/track_info.h"
+#include "iplayer/track_location.h"
+
+// Extract TrackInfo of many tracks using a pool of worker threads, results
+// are published in small batches as soon as they are available. Prioritized
+// tracks (the next ones to be played) are extracted before any other pending
+// track and published right away.
+
+namespace ip {
+
+class MetadataExtractor {
+ public:
+  using TrackInfos = std::unordered_map<TrackLocation, TrackInfo>;
+  using ProviderFactory =
+      std::function<ITrackProviderPtr(const TrackLocation&)>;
+  using PublishCb = std::function<void(TrackInfos)>;
+
+  struct Options {
+    size_t max_workers = 4;
+    size_t batch_size = 256;  // publish when this many results are ready...
+    std::chrono::milliseconds batch_delay{250};  // ...or after this delay
+
+    // when not zero, number of active workers is lowered while extraction of
+    // a single track takes longer than this (slow or saturated device) and
+    // raised again when it gets faster
+    std::chrono::milliseconds io_latency_target{0};
+  };
+
+  MetadataExtractor(ProviderFactory get_provider, PublishCb publish);
+  MetadataExtractor(ProviderFactory get_provider, PublishCb publish,
+                    Options options);
+  ~MetadataExtractor();  // drop pending work and wait for workers
+
+  void Push(const std::vector<TrackLocation>& locations);
+  void Cancel();  // drop pending work, non blocking
+  // drop pending work for these tracks, results not published yet included
+  void Remove(const std::unordered_set<TrackLocation>& locations);
+
+  // replace the prioritized tracks, the ones already extracted are ignored
+  void Prioritize(const std::vector<TrackLocation>& locations);
+
+ private:
+  void WorkerThread();
+  void Throttle(std::chrono::steady_clock::duration latency);
+  bool ShouldPublish() const;
+  bool PopPending(TrackLocation* location, bool* prioritized);
+
+  const Options options_;
+  ProviderFactory get_provider_;
+  PublishCb publish_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<TrackLocation> pending_;
+  std::deque<TrackLocation> prioritized_;
+  std::unordered_set<TrackLocation> queued_;  // not yet extracted
+  TrackInfos ready_;
+  bool ready_prioritized_;  // a prioritized track waits to be published
+  std::chrono::steady_clock::time_point last_publish_;
+  size_t busy_workers_;
+  size_t active_workers_;  // limit applied by throttling
+  bool exit_;
+  std::vector<std::future<void>> workers_;
+};
+
+}  // namespace ip
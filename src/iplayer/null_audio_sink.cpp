@@ -0,0 +1,26 @@
+#include "iplayer/null_audio_sink.h"
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+NullAudioSink::NullAudioSink() : bytes_written_(0) {}
+
+std::error_code NullAudioSink::Open(const AudioFormat& format) {
+  UNUSED(format);
+  return {};
+}
+
+std::error_code NullAudioSink::Write(const uint8_t* data, size_t len) {
+  UNUSED(data);
+  bytes_written_ += len;
+  return {};
+}
+
+std::error_code NullAudioSink::Drain() { return {}; }
+
+void NullAudioSink::Flush() {}
+
+void NullAudioSink::Close() {}
+
+}  // namespace ip
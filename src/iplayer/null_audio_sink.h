@@ -0,0 +1,27 @@
+#pragma once
+
+#include "iplayer/i_audio_sink.h"
+
+#include <atomic>
+
+namespace ip {
+
+// Discard everything immediately: decoders run as fast as they can, useful
+// for benchmarks and headless machines
+class NullAudioSink : public IAudioSink {
+ public:
+  NullAudioSink();
+
+  std::error_code Open(const AudioFormat& format) override;
+  std::error_code Write(const uint8_t* data, size_t len) override;
+  std::error_code Drain() override;
+  void Flush() override;
+  void Close() override;
+
+  uint64_t BytesWritten() const { return bytes_written_; }
+
+ private:
+  std::atomic<uint64_t> bytes_written_;
+};
+
+}  // namespace ip
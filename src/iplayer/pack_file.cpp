@@ -0,0 +1,278 @@
+#include "iplayer/pack_file.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "iplayer/frame_index.h"
+#include "iplayer/fs_track_provider.h"
+#include "iplayer/track_info.h"
+#include "iplayer/utils/log.h"
+#include "iplayer/utils/scope_guard.h"
+
+namespace ip {
+
+const uint32_t PackHeader::kMagic;
+const uint32_t PackHeader::kVersion;
+
+static void CheckPack(bool valid) {
+  if (!valid) {
+    throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+  }
+}
+
+PackFile::PackFile(const std::string& path)
+    : mapping_(path), table_(nullptr), entry_count_(0), strings_(nullptr) {
+  // validated once so entries can be trusted afterwards
+  const uint64_t size = mapping_.size();
+  CheckPack(size >= sizeof(PackHeader));
+  auto header = reinterpret_cast<const PackHeader*>(mapping_.data());
+  CheckPack(header->magic == PackHeader::kMagic &&
+            header->version == PackHeader::kVersion);
+  CheckPack(header->table_offset % alignof(PackEntry) == 0 &&
+            header->table_offset <= size &&
+            header->entry_count <=
+                (size - header->table_offset) / sizeof(PackEntry));
+  CheckPack(header->strings_offset <= size &&
+            header->strings_size <= size - header->strings_offset);
+  table_ = reinterpret_cast<const PackEntry*>(mapping_.data() +
+                                              header->table_offset);
+  entry_count_ = static_cast<size_t>(header->entry_count);
+  strings_ =
+      reinterpret_cast<const char*>(mapping_.data() + header->strings_offset);
+  for (size_t i = 0; i < entry_count_; ++i) {
+    const auto& entry = Entry(i);
+    CheckPack(entry.data_offset <= size &&
+              entry.data_size <= size - entry.data_offset &&
+              entry.path_offset <= header->strings_size &&
+              uint64_t{entry.path_size} + entry.title_size <=
+                  header->strings_size - entry.path_offset);
+    CheckPack(i == 0 || Compare(i - 1, Path(i), std::string::npos) < 0);
+  }
+}
+
+int PackFile::Compare(size_t index, const std::string& path,
+                      size_t prefix_size) const {
+  const auto& entry = Entry(index);
+  size_t size = std::min<size_t>(entry.path_size, prefix_size);
+  int result = memcmp(strings_ + entry.path_offset, path.data(),
+                      std::min(size, path.size()));
+  if (result) {
+    return result;
+  }
+  return size < path.size() ? -1 : size > path.size() ? 1 : 0;
+}
+
+bool PackFile::Find(const std::string& path, size_t* index) const {
+  size_t first = 0;
+  size_t last = entry_count_;
+  while (first < last) {
+    size_t middle = first + (last - first) / 2;
+    int result = Compare(middle, path, std::string::npos);
+    if (result == 0) {
+      *index = middle;
+      return true;
+    }
+    if (result < 0) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return false;
+}
+
+std::pair<size_t, size_t> PackFile::FindPrefix(
+    const std::string& prefix) const {
+  // paths cut to the prefix's size are still sorted
+  auto bound = [&](bool upper) {
+    size_t first = 0;
+    size_t last = entry_count_;
+    while (first < last) {
+      size_t middle = first + (last - first) / 2;
+      int result = Compare(middle, prefix, prefix.size());
+      if (result < 0 || (upper && result == 0)) {
+        first = middle + 1;
+      } else {
+        last = middle;
+      }
+    }
+    return first;
+  };
+  return {bound(false), bound(true)};
+}
+
+std::string PackFile::Path(size_t index) const {
+  const auto& entry = Entry(index);
+  return {strings_ + entry.path_offset, entry.path_size};
+}
+
+std::string PackFile::Title(size_t index) const {
+  const auto& entry = Entry(index);
+  return {strings_ + entry.path_offset + entry.path_size, entry.title_size};
+}
+
+uint32_t PackFile::TrackNumber(size_t index) const {
+  return Entry(index).track_number;
+}
+
+std::chrono::milliseconds PackFile::Duration(size_t index) const {
+  return std::chrono::milliseconds(Entry(index).duration_ms);
+}
+
+const uint8_t* PackFile::Data(size_t index) const {
+  return mapping_.data() + Entry(index).data_offset;
+}
+
+size_t PackFile::DataSize(size_t index) const {
+  return static_cast<size_t>(Entry(index).data_size);
+}
+
+// relative paths of the .mp3 files under 'dir'
+static std::error_code ListTracks(const std::string& dir,
+                                  const std::string& relative,
+                                  std::vector<std::string>* files) {
+  auto path = relative.empty() ? dir : dir + "/" + relative;
+  DIR* dp = opendir(path.c_str());
+  if (!dp) {
+    std::error_code ec{errno, std::generic_category()};
+    LOG("error opening '%s': %s", path.c_str(), ec.message().c_str());
+    return ec;
+  }
+  auto cleanup = CreateScopeGuard([&]() { closedir(dp); });
+
+  struct dirent64* dirp;
+  while ((dirp = readdir64(dp)) != nullptr) {
+    std::string name(dirp->d_name);
+    if (name == "." || name == "..") {
+      continue;
+    }
+    auto child = relative.empty() ? name : relative + "/" + name;
+    bool is_dir = dirp->d_type == DT_DIR;
+    if (dirp->d_type == DT_UNKNOWN) {
+      struct stat st;
+      is_dir = stat((dir + "/" + child).c_str(), &st) == 0 &&
+               S_ISDIR(st.st_mode);
+    }
+    if (is_dir) {
+      auto ec = ListTracks(dir, child, files);
+      if (ec) {
+        return ec;
+      }
+    } else if (IsTrackFileName(name)) {
+      files->push_back(child);
+    }
+  }
+  return {};
+}
+
+static std::error_code WriteAt(int fd, const void* data, size_t len,
+                               uint64_t offset) {
+  auto bytes = static_cast<const uint8_t*>(data);
+  while (len) {
+    auto count = pwrite(fd, bytes, len, static_cast<off_t>(offset));
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return {errno, std::generic_category()};
+    }
+    bytes += count;
+    len -= static_cast<size_t>(count);
+    offset += static_cast<uint64_t>(count);
+  }
+  return {};
+}
+
+std::error_code BuildPack(const std::string& dir, const std::string& output,
+                          size_t* count) {
+  *count = 0;
+  std::vector<std::string> files;
+  auto ec = ListTracks(dir, "", &files);
+  if (ec) {
+    return ec;
+  }
+  std::sort(std::begin(files), std::end(files));
+
+  // readers never see a partial pack
+  auto temporary = output + ".tmp";
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    return {errno, std::generic_category()};
+  }
+  auto cleanup = CreateScopeGuard([&]() {
+    close(fd);
+    unlink(temporary.c_str());
+  });
+
+  FsTrackProvider provider;
+  std::vector<PackEntry> entries;
+  std::string strings;
+  uint64_t offset = sizeof(PackHeader);
+  for (const auto& file : files) {
+    auto path = dir + "/" + file;
+    TrackInfo info;
+    std::unique_ptr<FileMapping> mapping;
+    try {
+      info = provider.GetTrackInfo("file://" + path);
+      mapping = std::make_unique<FileMapping>(path);
+    } catch (const std::system_error& e) {
+      LOG("[E] skipping '%s': %s", path.c_str(), e.what());
+      continue;
+    }
+    ec = WriteAt(fd, mapping->data(), mapping->size(), offset);
+    if (ec) {
+      return ec;
+    }
+    auto index = info.GetFrameIndex();
+    auto duration = index ? index->Duration()
+                          : std::chrono::milliseconds(info.Duration());
+    auto title = info.Title();
+    PackEntry entry;
+    entry.data_offset = offset;
+    entry.data_size = mapping->size();
+    entry.path_offset = strings.size();
+    entry.path_size = static_cast<uint32_t>(file.size());
+    entry.title_size = static_cast<uint32_t>(title.size());
+    entry.track_number = info.TrackNumber();
+    entry.duration_ms = static_cast<uint32_t>(duration.count());
+    entries.push_back(entry);
+    strings += file + title;
+    offset += mapping->size();
+  }
+
+  PackHeader header;
+  header.magic = PackHeader::kMagic;
+  header.version = PackHeader::kVersion;
+  header.entry_count = entries.size();
+  header.table_offset =
+      (offset + alignof(PackEntry) - 1) / alignof(PackEntry) *
+      alignof(PackEntry);
+  header.strings_offset =
+      header.table_offset + entries.size() * sizeof(PackEntry);
+  header.strings_size = strings.size();
+  ec = WriteAt(fd, entries.data(), entries.size() * sizeof(PackEntry),
+               header.table_offset);
+  if (!ec) {
+    ec = WriteAt(fd, strings.data(), strings.size(), header.strings_offset);
+  }
+  if (!ec) {
+    ec = WriteAt(fd, &header, sizeof(header), 0);
+  }
+  if (!ec && rename(temporary.c_str(), output.c_str()) != 0) {
+    ec.assign(errno, std::generic_category());
+  }
+  if (ec) {
+    return ec;
+  }
+  *count = entries.size();
+  return {};
+}
+
+}  // namespace ip
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "iplayer/utils/file_mapping.h"
+
+// Many small tracks in a single file: opening, stat-ing and mapping each
+// one separately is what costs on network filesystems with millions of
+// clips. A pack is mapped once, then finding, listing and reading its
+// entries are only memory accesses.
+//
+// Layout (host byte order, packs are built where they are played):
+//
+//   PackHeader | tracks' bytes | PackEntry table | strings
+//
+// Entries are sorted by path (bytewise, '/' separated, relative to the
+// packed directory) so a path or a directory is found by binary search.
+// Each one has the track's bytes and the metadata read when packing.
+
+namespace ip {
+
+struct PackHeader {
+  static const uint32_t kMagic = 0x4b415049;  // "IPAK"
+  static const uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t entry_count;
+  uint64_t table_offset;    // PackEntry[entry_count]
+  uint64_t strings_offset;  // paths and titles, not null terminated
+  uint64_t strings_size;
+};
+
+struct PackEntry {
+  uint64_t data_offset;
+  uint64_t data_size;
+  uint64_t path_offset;  // in strings, the title follows
+  uint32_t path_size;
+  uint32_t title_size;
+  uint32_t track_number;
+  uint32_t duration_ms;
+};
+
+class PackFile {
+ public:
+  // throws std::system_error like FileMapping, or on invalid content
+  explicit PackFile(const std::string& path);
+
+  size_t EntryCount() const { return entry_count_; }
+  // index of the entry at 'path', false if none
+  bool Find(const std::string& path, size_t* index) const;
+  // [first, last) entries whose path starts with 'prefix'
+  std::pair<size_t, size_t> FindPrefix(const std::string& prefix) const;
+
+  std::string Path(size_t index) const;
+  std::string Title(size_t index) const;
+  uint32_t TrackNumber(size_t index) const;
+  std::chrono::milliseconds Duration(size_t index) const;
+  const uint8_t* Data(size_t index) const;
+  size_t DataSize(size_t index) const;
+
+ private:
+  const PackEntry& Entry(size_t index) const { return table_[index]; }
+  // <0, 0, >0 like memcmp, only the first 'prefix_size' bytes of the path
+  // when given
+  int Compare(size_t index, const std::string& path,
+              size_t prefix_size) const;
+
+  FileMapping mapping_;
+  const PackEntry* table_;
+  size_t entry_count_;
+  const char* strings_;
+};
+
+using PackFilePtr = std::shared_ptr<const PackFile>;
+
+// Pack the .mp3 files found in 'dir' (recursively) into 'output', replaced
+// once complete. '*count' is set with the number of tracks packed,
+// unreadable ones are skipped.
+std::error_code BuildPack(const std::string& dir, const std::string& output,
+                          size_t* count);
+
+}  // namespace ip
@@ -0,0 +1,22 @@
+#include "iplayer/pack_file.h"
+
+#include <iostream>
+#include <string>
+
+// iplayer_pack DIR OUTPUT: pack the .mp3 files found in DIR, then play them
+// with pack://OUTPUT
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    std::cout << "Usage: " << argv[0] << " DIR OUTPUT" << std::endl;
+    return 1;
+  }
+  size_t count = 0;
+  auto ec = ip::BuildPack(argv[1], argv[2], &count);
+  if (ec) {
+    std::cout << "Error: cannot pack '" << argv[1] << "' into '" << argv[2]
+              << "': " << ec.message() << std::endl;
+    return 1;
+  }
+  std::cout << count << " tracks packed into " << argv[2] << std::endl;
+  return 0;
+}
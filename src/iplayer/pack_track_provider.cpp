@@ -0,0 +1,188 @@
+#include "iplayer/pack_track_provider.h"
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "iplayer/frame_index.h"
+#include "iplayer/id3_tag.h"
+#include "iplayer/track_info.h"
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static const std::string kScheme = "pack://";
+
+// the pack's path and what follows '#'
+static std::error_code SplitLocation(const std::string& location,
+                                     std::string* path,
+                                     std::string* entry) {
+  if (location.compare(0, kScheme.size(), kScheme) != 0) {
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+  auto separator = location.find('#', kScheme.size());
+  *path = location.substr(kScheme.size(), separator - kScheme.size());
+  *entry = separator == std::string::npos ? std::string()
+                                          : location.substr(separator + 1);
+  return {};
+}
+
+// opened once for the process, like a mount
+static std::error_code OpenPack(const std::string& path, PackFilePtr* pack) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, PackFilePtr> packs;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = packs.find(path);
+  if (it != std::end(packs)) {
+    *pack = it->second;
+    return {};
+  }
+  try {
+    *pack = std::make_shared<const PackFile>(path);
+  } catch (const std::system_error& e) {
+    LOG("[E] cannot open pack '%s': %s", path.c_str(), e.what());
+    return e.code();
+  }
+  packs.emplace(path, *pack);
+  return {};
+}
+
+// the pack and the entry 'location' points to
+static std::error_code FindPackEntry(const TrackLocation& location,
+                                     PackFilePtr* pack, size_t* index) {
+  std::string path;
+  std::string entry;
+  auto ec = SplitLocation(location, &path, &entry);
+  if (!ec) {
+    ec = OpenPack(path, pack);
+  }
+  if (ec) {
+    return ec;
+  }
+  if (!(*pack)->Find(entry, index)) {
+    return std::make_error_code(std::errc::no_such_file_or_directory);
+  }
+  return {};
+}
+
+PackTrackIO::PackTrackIO() : data_(nullptr), size_(0), offset_(0) {}
+
+std::error_code PackTrackIO::Open(const TrackLocation& location) {
+  Close();
+  size_t index = 0;
+  auto ec = FindPackEntry(location, &pack_, &index);
+  if (ec) {
+    return ec;
+  }
+  data_ = pack_->Data(index);
+  size_ = pack_->DataSize(index);
+  return {};
+}
+
+size_t PackTrackIO::Read(uint8_t* buffer, size_t len, std::error_code& ec) {
+  ec.clear();
+  if (!pack_) {
+    ec = std::make_error_code(std::errc::bad_file_descriptor);
+    return 0;
+  }
+  auto count = std::min(len, size_ - offset_);
+  memcpy(buffer, data_ + offset_, count);
+  offset_ += count;
+  return count;
+}
+
+std::error_code PackTrackIO::Seek(uint64_t offset) {
+  if (!pack_) {
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+  offset_ = static_cast<size_t>(std::min<uint64_t>(offset, size_));
+  return {};
+}
+
+void PackTrackIO::Close() {
+  pack_.reset();
+  data_ = nullptr;
+  size_ = 0;
+  offset_ = 0;
+}
+
+std::error_code PackTrackProvider::List(
+    const std::string& uri, std::vector<TrackLocation>* locations) const {
+  std::string path;
+  std::string entry;
+  auto ec = SplitLocation(uri, &path, &entry);
+  PackFilePtr pack;
+  if (!ec) {
+    ec = OpenPack(path, &pack);
+  }
+  if (ec) {
+    return ec;
+  }
+  size_t index = 0;
+  if (!entry.empty() && pack->Find(entry, &index)) {
+    locations->push_back(uri);
+    return {};
+  }
+  if (!entry.empty() && entry.back() != '/') {
+    entry += '/';
+  }
+  auto range = pack->FindPrefix(entry);
+  if (range.first == range.second) {
+    return std::make_error_code(std::errc::no_such_file_or_directory);
+  }
+  auto base = kScheme + path + "#";
+  locations->reserve(locations->size() + range.second - range.first);
+  for (index = range.first; index < range.second; ++index) {
+    locations->push_back(base + pack->Path(index));
+  }
+  return {};
+}
+
+TrackInfo PackTrackProvider::GetTrackInfo(const TrackLocation& location) {
+  PackFilePtr pack;
+  size_t index = 0;
+  auto ec = FindPackEntry(location, &pack, &index);
+  if (ec) {
+    throw std::system_error(ec);
+  }
+  // tags were read when packing
+  TrackInfo info{location};
+  info.SetCodec("mp3");
+  info.SetTitle(pack->Title(index));
+  info.SetTrackNumber(pack->TrackNumber(index));
+  info.SetDuration(
+      std::chrono::duration_cast<std::chrono::seconds>(pack->Duration(index)));
+
+  // frames are indexed from the mapping for seeking, tags left out
+  auto data = pack->Data(index);
+  size_t size = pack->DataSize(index);
+  Id3Tag tag;
+  size_t audio_begin = std::min(ParseId3v2Tag(data, size, &tag), size);
+  size_t audio_end = size;
+  if (size - audio_begin >= 128) {
+    audio_end -= ParseId3v1Tag(data + size - 128, 128, &tag);
+  }
+  auto frame_index = std::make_shared<FrameIndex>();
+  frame_index->Scan(data + audio_begin, audio_end - audio_begin, audio_begin,
+                    true);
+  if (frame_index->FrameCount()) {
+    info.SetFrameIndex(std::move(frame_index));
+  }
+  return info;
+}
+
+ITrackIOPtr PackTrackProvider::OpenTrack(const TrackLocation& location,
+                                         std::error_code& ec) {
+  auto io = std::make_unique<PackTrackIO>();
+  ec = io->Open(location);
+  if (ec) {
+    return {};
+  }
+  return std::move(io);
+}
+
+}  // namespace ip
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "iplayer/i_track_provider.h"
+
+#include "iplayer/pack_file.h"
+
+// Tracks of a pack file (see pack_file.h):
+//
+//   pack:///music/clips.pack               every track
+//   pack:///music/clips.pack#rock/         the ones under a directory
+//   pack:///music/clips.pack#rock/a.mp3    a single track
+//
+// Each pack is opened and validated once for the process, later lookups
+// and reads don't make any system call. A pack rebuilt meanwhile is only
+// seen after a restart.
+
+namespace ip {
+
+class PackTrackIO : public ITrackIO {
+ public:
+  PackTrackIO();
+
+  std::error_code Open(const TrackLocation& track) override;
+  size_t Read(uint8_t* buffer, size_t len, std::error_code& ec) override;
+  std::error_code Seek(uint64_t offset) override;
+  void Close() override;
+
+ private:
+  PackFilePtr pack_;  // keeps the data mapped
+  const uint8_t* data_;
+  size_t size_;
+  size_t offset_;
+};
+
+class PackTrackProvider : public ITrackProvider {
+ public:
+  std::error_code List(const std::string& uri,
+                       std::vector<TrackLocation>* locations) const override;
+  TrackInfo GetTrackInfo(const TrackLocation& track) override;
+  ITrackIOPtr OpenTrack(const TrackLocation& track,
+                        std::error_code& ec) override;
+};
+
+}  // namespace ip
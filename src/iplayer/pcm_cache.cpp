@@ -0,0 +1,379 @@
+#include "iplayer/pcm_cache.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static const size_t kDefaultBudget = 128 * 1024 * 1024;
+// tracks decoded once remembered to be cached the next time
+static const size_t kMaxSeen = 1024;
+
+namespace {
+
+enum BlockKind : uint8_t { kRaw = 0, kRice = 1 };
+
+// quotients from there are escaped, the value follows on kValueBits bits
+const uint32_t kEscapeQuotient = 24;
+// zigzag of a second order residual of 16 bits samples (|r| < 2^17)
+const unsigned kValueBits = 18;
+const uint32_t kMaxRiceParameter = 16;
+
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8_t>* out) : out_(out) {}
+
+  void Put(uint32_t value, unsigned bits) {  // bits <= 32
+    acc_ = (acc_ << bits) | value;
+    count_ += bits;
+    while (count_ >= 8) {
+      count_ -= 8;
+      out_->push_back(static_cast<uint8_t>(acc_ >> count_));
+    }
+  }
+
+  void Flush() {
+    if (count_) {
+      out_->push_back(static_cast<uint8_t>(acc_ << (8 - count_)));
+      count_ = 0;
+    }
+  }
+
+ private:
+  std::vector<uint8_t>* out_;
+  uint64_t acc_ = 0;
+  unsigned count_ = 0;
+};
+
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint32_t Get(unsigned bits) {  // bits <= 32
+    if (count_ < bits) {
+      Fill();
+    }
+    count_ -= bits;
+    return static_cast<uint32_t>(acc_ >> count_) &
+           static_cast<uint32_t>((uint64_t{1} << bits) - 1);
+  }
+
+  uint32_t Unary(uint32_t limit) {  // count of ones before a zero
+    uint32_t q = 0;
+    while (q < limit && Get(1)) {
+      ++q;
+    }
+    return q;
+  }
+
+ private:
+  void Fill() {
+    // past the end reads zeros, a damaged block can't read out of bounds
+    while (count_ <= 56) {
+      acc_ = (acc_ << 8) | (position_ < size_ ? data_[position_] : 0);
+      ++position_;
+      count_ += 8;
+    }
+  }
+
+  const uint8_t* data_;
+  size_t size_;
+  size_t position_ = 0;
+  uint64_t acc_ = 0;
+  unsigned count_ = 0;
+};
+
+inline uint32_t ZigZag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t UnZigZag(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// prediction from the two previous samples, starting from silence in each
+// block
+void Residuals(const int16_t* samples, size_t frames, uint32_t channels,
+               uint32_t channel, uint32_t* out) {
+  int32_t previous = 0;
+  int32_t before = 0;
+  for (size_t i = 0; i < frames; ++i) {
+    int32_t sample = samples[i * channels + channel];
+    out[i] = ZigZag(sample - (2 * previous - before));
+    before = previous;
+    previous = sample;
+  }
+}
+
+uint32_t RiceParameter(const uint32_t* values, size_t count) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; ++i) {
+    sum += values[i];
+  }
+  uint64_t mean = count ? sum / count : 0;
+  uint32_t k = 0;
+  while (k < kMaxRiceParameter && (uint64_t{2} << k) <= mean) {
+    ++k;
+  }
+  return k;
+}
+
+TrackLocation::size_type PathStart(const TrackLocation& location) {
+  const std::string kScheme = "file://";
+  return location.compare(0, kScheme.size(), kScheme) == 0
+             ? kScheme.size()
+             : TrackLocation::npos;
+}
+
+std::error_code GetTrackIdentity(const TrackLocation& location,
+                                 FileIdentity* id) {
+  auto start = PathStart(location);
+  if (start == TrackLocation::npos) {
+    return std::make_error_code(std::errc::not_supported);
+  }
+  return GetFileIdentity(location.substr(start), id);
+}
+
+}  // namespace
+
+const size_t CachedPcm::kBlockFrames;
+
+size_t CachedPcm::ReadBlock(size_t index, int16_t* out) const {
+  if (index >= blocks_.size()) {
+    return 0;
+  }
+  auto frames = static_cast<size_t>(
+      std::min<uint64_t>(kBlockFrames, frames_ - index * kBlockFrames));
+  const auto& block = blocks_[index];
+  if (block[0] == kRaw) {
+    memcpy(out, block.data() + 1, frames * channels_ * sizeof(int16_t));
+    return frames;
+  }
+  BitReader reader(block.data() + 1 + channels_,
+                   block.size() - 1 - channels_);
+  for (uint32_t c = 0; c < channels_; ++c) {
+    uint32_t k = block[1 + c];
+    int32_t previous = 0;
+    int32_t before = 0;
+    for (size_t i = 0; i < frames; ++i) {
+      uint32_t q = reader.Unary(kEscapeQuotient);
+      uint32_t value = q == kEscapeQuotient
+                           ? reader.Get(kValueBits)
+                           : (q << k) | reader.Get(k);
+      int32_t sample = UnZigZag(value) + 2 * previous - before;
+      out[i * channels_ + c] = static_cast<int16_t>(sample);
+      before = previous;
+      previous = sample;
+    }
+  }
+  return frames;
+}
+
+CachedPcmBuilder::CachedPcmBuilder(bool compress, size_t max_size,
+                                   float gain)
+    : compress_(compress),
+      max_size_(max_size),
+      pcm_(new CachedPcm()),
+      block_frames_(0) {
+  pcm_->gain_ = gain;
+}
+
+bool CachedPcmBuilder::Append(uint32_t sample_rate, uint32_t channels,
+                              const int16_t* samples, size_t frames) {
+  if (!pcm_) {
+    return false;
+  }
+  if (pcm_->channels_ == 0) {
+    pcm_->sample_rate_ = sample_rate;
+    pcm_->channels_ = channels;
+    block_.resize(CachedPcm::kBlockFrames * channels);
+  } else if (pcm_->sample_rate_ != sample_rate ||
+             pcm_->channels_ != channels) {
+    pcm_.reset();
+    return false;
+  }
+  while (frames > 0) {
+    auto length = std::min(frames, CachedPcm::kBlockFrames - block_frames_);
+    std::copy_n(samples, length * channels, &block_[block_frames_ * channels]);
+    block_frames_ += length;
+    samples += length * channels;
+    frames -= length;
+    if (block_frames_ == CachedPcm::kBlockFrames) {
+      EncodeBlock();
+      if (pcm_->memory_size_ > max_size_) {
+        pcm_.reset();
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+CachedPcmPtr CachedPcmBuilder::Finish() {
+  if (!pcm_) {
+    return nullptr;
+  }
+  if (block_frames_ > 0) {
+    EncodeBlock();
+  }
+  if (pcm_->frames_ == 0 || pcm_->memory_size_ > max_size_) {
+    return nullptr;
+  }
+  CachedPcmPtr pcm = std::move(pcm_);
+  return pcm;
+}
+
+void CachedPcmBuilder::EncodeBlock() {
+  auto channels = pcm_->channels_;
+  size_t raw_size = 1 + block_frames_ * channels * sizeof(int16_t);
+  std::vector<uint8_t> data;
+  if (compress_) {
+    data.reserve(raw_size);
+    data.push_back(kRice);
+    std::vector<uint32_t> residuals(block_frames_ * channels);
+    for (uint32_t c = 0; c < channels; ++c) {
+      uint32_t* values = &residuals[c * block_frames_];
+      Residuals(block_.data(), block_frames_, channels, c, values);
+      data.push_back(static_cast<uint8_t>(RiceParameter(values,
+                                                        block_frames_)));
+    }
+    BitWriter writer(&data);
+    for (uint32_t c = 0; c < channels && data.size() < raw_size; ++c) {
+      uint32_t k = data[1 + c];
+      for (size_t i = c * block_frames_; i < (c + 1) * block_frames_; ++i) {
+        uint32_t q = residuals[i] >> k;
+        if (q < kEscapeQuotient) {
+          writer.Put(((uint32_t{1} << q) - 1) << 1, q + 1);
+          writer.Put(residuals[i] & ((uint32_t{1} << k) - 1), k);
+        } else {
+          writer.Put((uint32_t{1} << kEscapeQuotient) - 1, kEscapeQuotient);
+          writer.Put(residuals[i], kValueBits);
+        }
+      }
+    }
+    writer.Flush();
+  }
+  // noise doesn't compress, keep it as is
+  if (!compress_ || data.size() >= raw_size) {
+    data.resize(raw_size);
+    data[0] = kRaw;
+    memcpy(data.data() + 1, block_.data(), raw_size - 1);
+  }
+  data.shrink_to_fit();
+  pcm_->memory_size_ += data.size() + sizeof(data);
+  pcm_->frames_ += block_frames_;
+  pcm_->blocks_.push_back(std::move(data));
+  block_frames_ = 0;
+}
+
+PcmCache& PcmCache::Instance() {
+  static PcmCache cache(kDefaultBudget);
+  return cache;
+}
+
+PcmCache::PcmCache(size_t budget)
+    : budget_(budget), compress_(true), cached_size_(0) {}
+
+void PcmCache::SetBudget(size_t budget) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  budget_ = budget;
+  Evict(budget_);
+}
+
+size_t PcmCache::Budget() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return budget_;
+}
+
+size_t PcmCache::CachedSize() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cached_size_;
+}
+
+void PcmCache::SetCompression(bool compress) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  compress_ = compress;
+}
+
+CachedPcmPtr PcmCache::Find(const TrackLocation& location, float gain) {
+  FileIdentity id;
+  if (GetTrackIdentity(location, &id)) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(location);
+  if (it == std::end(entries_)) {
+    return nullptr;
+  }
+  auto lru_it = it->second;
+  if (lru_it->id != id) {
+    LOG("[D] %s changed, dropping its decoded pcm", location.c_str());
+    cached_size_ -= lru_it->pcm->MemorySize();
+    lru_.erase(lru_it);
+    entries_.erase(it);
+    return nullptr;
+  }
+  if (lru_it->pcm->Gain() != gain) {
+    return nullptr;  // kept until captured again with the new gain
+  }
+  lru_.splice(std::begin(lru_), lru_, lru_it);
+  return lru_it->pcm;
+}
+
+std::unique_ptr<CachedPcmBuilder> PcmCache::StartCapture(
+    const TrackLocation& location, float gain, FileIdentity* id) {
+  if (GetTrackIdentity(location, id)) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (budget_ == 0) {
+    return nullptr;
+  }
+  if (entries_.count(location)) {
+    // replayed with another gain than the cached one
+    return std::make_unique<CachedPcmBuilder>(compress_, budget_, gain);
+  }
+  auto it = std::find(std::begin(seen_), std::end(seen_), location);
+  if (it == std::end(seen_)) {
+    seen_.push_front(location);
+    if (seen_.size() > kMaxSeen) {
+      seen_.pop_back();
+    }
+    return nullptr;
+  }
+  seen_.erase(it);
+  return std::make_unique<CachedPcmBuilder>(compress_, budget_, gain);
+}
+
+void PcmCache::Insert(const TrackLocation& location, const FileIdentity& id,
+                      CachedPcmPtr pcm) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!pcm || pcm->MemorySize() > budget_) {
+    return;
+  }
+  auto it = entries_.find(location);
+  if (it != std::end(entries_)) {
+    cached_size_ -= it->second->pcm->MemorySize();
+    lru_.erase(it->second);
+    entries_.erase(it);
+  }
+  Evict(budget_ - pcm->MemorySize());
+  cached_size_ += pcm->MemorySize();
+  lru_.push_front({location, id, std::move(pcm)});
+  entries_[location] = std::begin(lru_);
+}
+
+void PcmCache::Evict(size_t budget) {
+  // private method so no synchronization
+  while (cached_size_ > budget && !lru_.empty()) {
+    auto& entry = lru_.back();
+    cached_size_ -= entry.pcm->MemorySize();
+    entries_.erase(entry.location);
+    lru_.pop_back();
+  }
+}
+
+}  // namespace ip
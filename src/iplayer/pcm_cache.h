@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "iplayer/track_location.h"
+#include "iplayer/utils/file_mapping.h"
+
+// Process-wide LRU cache of decoded tracks: replaying one (repeat, previous)
+// streams 16 bits PCM from memory instead of decoding it again.
+//
+// What's cached is the decoder's output at the source rate with the loudness
+// normalization gain applied: quantized to 16 bits after it, loud masters
+// turned down aren't clipped. Resampling and dsp come after so their
+// settings can change, a track cached with another gain isn't replayed.
+// Tracks are split in blocks, optionally compressed losslessly (second order
+// prediction and Rice coding, the scheme of FLAC's fixed predictors), a
+// block can be decoded alone for seeking.
+//
+// Only local files are cached (keyed by location and checked against the
+// file identity) and only once played twice: a track played a single time
+// doesn't evict replayed ones. Decoders which aren't playing (loudness
+// analysis, batch verification) replay cached tracks but never capture.
+
+namespace ip {
+
+class CachedPcm {
+ public:
+  static const size_t kBlockFrames = 4096;
+
+  uint32_t SampleRate() const { return sample_rate_; }
+  uint32_t Channels() const { return channels_; }
+  float Gain() const { return gain_; }  // linear, applied to the samples
+  uint64_t Frames() const { return frames_; }
+  size_t BlockCount() const { return blocks_.size(); }
+  size_t MemorySize() const { return memory_size_; }
+
+  // Decode block 'index' to interleaved samples, 'out' has room for
+  // kBlockFrames frames. Returns the number of frames.
+  size_t ReadBlock(size_t index, int16_t* out) const;
+
+ private:
+  friend class CachedPcmBuilder;
+
+  CachedPcm() = default;
+
+  uint32_t sample_rate_ = 0;
+  uint32_t channels_ = 0;
+  float gain_ = 1.0f;
+  uint64_t frames_ = 0;
+  size_t memory_size_ = 0;
+  std::vector<std::vector<uint8_t>> blocks_;
+};
+
+using CachedPcmPtr = std::shared_ptr<const CachedPcm>;
+
+// Fed by a decoder while it plays a track
+class CachedPcmBuilder {
+ public:
+  // gives up beyond 'max_size' bytes, the track wouldn't fit in the cache.
+  // 'gain' is the one applied to the appended samples.
+  CachedPcmBuilder(bool compress, size_t max_size, float gain);
+
+  // 'frames' interleaved frames, false once given up (also if the format
+  // changes in the middle of the track)
+  bool Append(uint32_t sample_rate, uint32_t channels, const int16_t* samples,
+              size_t frames);
+  CachedPcmPtr Finish();  // nullptr if given up or empty
+
+ private:
+  void EncodeBlock();
+
+  bool compress_;
+  size_t max_size_;
+  std::unique_ptr<CachedPcm> pcm_;
+  std::vector<int16_t> block_;  // interleaved, not full yet
+  size_t block_frames_;
+};
+
+class PcmCache {
+ public:
+  static PcmCache& Instance();
+
+  PcmCache(size_t budget);  // budget: bytes of cached PCM, 0 disables
+
+  void SetBudget(size_t budget);
+  size_t Budget() const;
+  size_t CachedSize() const;
+  void SetCompression(bool compress);  // for tracks cached from now on
+
+  // a decoded track if cached with 'gain' and the file didn't change,
+  // nullptr otherwise
+  CachedPcmPtr Find(const TrackLocation& location, float gain);
+
+  // Builder to feed by a decoder about to play 'location' from its start
+  // with 'gain', nullptr if not worth caching. 'id' is then the one to give
+  // to Insert(). A track cached with another gain is captured again.
+  std::unique_ptr<CachedPcmBuilder> StartCapture(
+      const TrackLocation& location, float gain, FileIdentity* id);
+  void Insert(const TrackLocation& location, const FileIdentity& id,
+              CachedPcmPtr pcm);
+
+ private:
+  struct Entry {
+    TrackLocation location;
+    FileIdentity id;
+    CachedPcmPtr pcm;
+  };
+
+  void Evict(size_t budget);
+
+  mutable std::mutex mutex_;
+  size_t budget_;
+  bool compress_;
+  size_t cached_size_;
+  std::list<Entry> lru_;  // most recently used first
+  std::unordered_map<TrackLocation, std::list<Entry>::iterator> entries_;
+  std::list<TrackLocation> seen_;  // played once, most recent first
+};
+
+}  // namespace ip
@@ -0,0 +1,663 @@
+#include "iplayer/pcm_convert.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "iplayer/utils/log.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IPLAYER_PCM_X86
+#endif
+
+namespace ip {
+namespace {
+
+const FixedSample kFixedOne = 1 << kFixedFracBits;
+const FixedSample kFixedMax = kFixedOne - 1;
+const FixedSample kFixedMin = -kFixedOne;
+const int kS16Shift = kFixedFracBits + 1 - 16;
+const int kS32Shift = 31 - kFixedFracBits;
+const float kFloatScale = 1.0f / kFixedOne;
+
+// scalar kernels: reference for the vectorized ones which process the
+// remaining samples through them
+
+inline int16_t ToS16(FixedSample sample) {
+  sample += 1 << (kS16Shift - 1);  // round
+  sample = std::min(std::max(sample, kFixedMin), kFixedMax);
+  return static_cast<int16_t>(sample >> kS16Shift);
+}
+
+inline int32_t ToS32(FixedSample sample) {
+  sample = std::min(std::max(sample, kFixedMin), kFixedMax);
+  return static_cast<int32_t>(static_cast<uint32_t>(sample) << kS32Shift);
+}
+
+inline float ToFloat(FixedSample sample) {
+  sample = std::min(std::max(sample, kFixedMin), kFixedMax);
+  return sample * kFloatScale;
+}
+
+template <typename T, T (*Convert)(FixedSample)>
+void ConvertScalar(const FixedSample* left, const FixedSample* right,
+                   size_t count, T* out) {
+  if (right == nullptr) {
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = Convert(left[i]);
+    }
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    out[2 * i] = Convert(left[i]);
+    out[2 * i + 1] = Convert(right[i]);
+  }
+}
+
+void ConvertScalar(const FixedSample* left, const FixedSample* right,
+                   size_t count, SampleFormat format, void* out) {
+  switch (format) {
+    case SampleFormat::kS16:
+      ConvertScalar<int16_t, ToS16>(left, right, count,
+                                    static_cast<int16_t*>(out));
+      break;
+    case SampleFormat::kS32:
+      ConvertScalar<int32_t, ToS32>(left, right, count,
+                                    static_cast<int32_t*>(out));
+      break;
+    case SampleFormat::kFloat:
+      ConvertScalar<float, ToFloat>(left, right, count,
+                                    static_cast<float*>(out));
+      break;
+  }
+}
+
+// With a gain, samples are scaled as floats: a single multiply applies both
+// the gain and the scale of the output format, then they are clipped in
+// that format's range and rounded to nearest. Float inputs go through the
+// same kernels with the scale of full range floats.
+struct GainScale {
+  float factor;
+  float min;
+  float max;
+};
+
+GainScale GetGainScale(SampleFormat format, float gain) {
+  switch (format) {
+    case SampleFormat::kS16:
+      return {gain / (1 << kS16Shift), -32768.0f, 32767.0f};
+    case SampleFormat::kS32:
+      // biggest float below 2^31
+      return {gain * (1 << kS32Shift), -2147483648.0f, 2147483520.0f};
+    case SampleFormat::kFloat:
+      break;
+  }
+  return {gain * kFloatScale, -1.0f, 1.0f};
+}
+
+GainScale GetFloatScale(SampleFormat format) {
+  switch (format) {
+    case SampleFormat::kS16:
+      return {32768.0f, -32768.0f, 32767.0f};
+    case SampleFormat::kS32:
+      return {2147483648.0f, -2147483648.0f, 2147483520.0f};
+    case SampleFormat::kFloat:
+      break;
+  }
+  return {1.0f, -1.0f, 1.0f};
+}
+
+template <typename In>
+inline float ScaleSample(In sample, const GainScale& scale) {
+  float value = static_cast<float>(sample) * scale.factor;
+  return std::min(std::max(value, scale.min), scale.max);
+}
+
+template <typename T>
+inline T Quantize(float value) {
+  return static_cast<T>(lrintf(value));
+}
+
+template <>
+inline float Quantize<float>(float value) {
+  return value;
+}
+
+template <typename T, typename In>
+void ConvertGainScalar(const In* left, const In* right, size_t count,
+                       const GainScale& scale, T* out) {
+  if (right == nullptr) {
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = Quantize<T>(ScaleSample(left[i], scale));
+    }
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    out[2 * i] = Quantize<T>(ScaleSample(left[i], scale));
+    out[2 * i + 1] = Quantize<T>(ScaleSample(right[i], scale));
+  }
+}
+
+template <typename In>
+void ConvertGainScalar(const In* left, const In* right, size_t count,
+                       SampleFormat format, const GainScale& scale,
+                       void* out) {
+  switch (format) {
+    case SampleFormat::kS16:
+      ConvertGainScalar(left, right, count, scale, static_cast<int16_t*>(out));
+      break;
+    case SampleFormat::kS32:
+      ConvertGainScalar(left, right, count, scale, static_cast<int32_t*>(out));
+      break;
+    case SampleFormat::kFloat:
+      ConvertGainScalar(left, right, count, scale, static_cast<float*>(out));
+      break;
+  }
+}
+
+#ifdef IPLAYER_PCM_X86
+
+// SSE2 has no 32 bits min/max
+inline __m128i ClipSse2(__m128i v) {
+  const __m128i max = _mm_set1_epi32(kFixedMax);
+  const __m128i min = _mm_set1_epi32(kFixedMin);
+  __m128i above = _mm_cmpgt_epi32(v, max);
+  v = _mm_or_si128(_mm_and_si128(above, max), _mm_andnot_si128(above, v));
+  __m128i below = _mm_cmplt_epi32(v, min);
+  return _mm_or_si128(_mm_and_si128(below, min), _mm_andnot_si128(below, v));
+}
+
+// Clipping of S16 is done by the saturation of the pack: rounded samples
+// out of [kFixedMin, kFixedMax] give values out of the int16_t range once
+// shifted.
+inline __m128i RoundShiftS16Sse2(__m128i v) {
+  v = _mm_add_epi32(v, _mm_set1_epi32(1 << (kS16Shift - 1)));
+  return _mm_srai_epi32(v, kS16Shift);
+}
+
+inline __m128 ToFloatSse2(__m128i v) {
+  return _mm_mul_ps(_mm_cvtepi32_ps(ClipSse2(v)), _mm_set1_ps(kFloatScale));
+}
+
+size_t ConvertS16Sse2(const FixedSample* left, const FixedSample* right,
+                      size_t count, int16_t* out) {
+  size_t i = 0;
+  if (right == nullptr) {
+    for (; i + 8 <= count; i += 8) {
+      auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+      auto hi =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i + 4));
+      auto packed =
+          _mm_packs_epi32(RoundShiftS16Sse2(lo), RoundShiftS16Sse2(hi));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    return i;
+  }
+  for (; i + 4 <= count; i += 4) {
+    auto l = RoundShiftS16Sse2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i)));
+    auto r = RoundShiftS16Sse2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i)));
+    auto packed =
+        _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), packed);
+  }
+  return i;
+}
+
+size_t ConvertS32Sse2(const FixedSample* left, const FixedSample* right,
+                      size_t count, int32_t* out) {
+  size_t i = 0;
+  auto* dst = reinterpret_cast<__m128i*>(out);
+  if (right == nullptr) {
+    for (; i + 4 <= count; i += 4) {
+      auto l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+      _mm_storeu_si128(dst + i / 4, _mm_slli_epi32(ClipSse2(l), kS32Shift));
+    }
+    return i;
+  }
+  for (; i + 4 <= count; i += 4) {
+    auto l = _mm_slli_epi32(
+        ClipSse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i))),
+        kS32Shift);
+    auto r = _mm_slli_epi32(
+        ClipSse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i))),
+        kS32Shift);
+    _mm_storeu_si128(dst + i / 2, _mm_unpacklo_epi32(l, r));
+    _mm_storeu_si128(dst + i / 2 + 1, _mm_unpackhi_epi32(l, r));
+  }
+  return i;
+}
+
+size_t ConvertFloatSse2(const FixedSample* left, const FixedSample* right,
+                        size_t count, float* out) {
+  size_t i = 0;
+  if (right == nullptr) {
+    for (; i + 4 <= count; i += 4) {
+      auto l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+      _mm_storeu_ps(out + i, ToFloatSse2(l));
+    }
+    return i;
+  }
+  for (; i + 4 <= count; i += 4) {
+    auto l = ToFloatSse2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i)));
+    auto r = ToFloatSse2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i)));
+    _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+    _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+  }
+  return i;
+}
+
+inline __m128 LoadSse2(const FixedSample* src) {
+  auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  return _mm_cvtepi32_ps(v);
+}
+
+inline __m128 LoadSse2(const float* src) {
+  return _mm_loadu_ps(src);
+}
+
+inline __m128 ScaleSse2(__m128 v, const GainScale& scale) {
+  auto value = _mm_mul_ps(v, _mm_set1_ps(scale.factor));
+  value = _mm_max_ps(value, _mm_set1_ps(scale.min));
+  return _mm_min_ps(value, _mm_set1_ps(scale.max));
+}
+
+// values are already in range, pack doesn't saturate
+template <SampleFormat F>
+inline void StoreSse2(__m128 left, __m128 right, void* out, size_t i) {
+  if (F == SampleFormat::kFloat) {
+    auto* dst = static_cast<float*>(out) + 2 * i;
+    _mm_storeu_ps(dst, _mm_unpacklo_ps(left, right));
+    _mm_storeu_ps(dst + 4, _mm_unpackhi_ps(left, right));
+    return;
+  }
+  auto l = _mm_cvtps_epi32(left);
+  auto r = _mm_cvtps_epi32(right);
+  auto lo = _mm_unpacklo_epi32(l, r);
+  auto hi = _mm_unpackhi_epi32(l, r);
+  if (F == SampleFormat::kS16) {
+    auto* dst = static_cast<int16_t*>(out) + 2 * i;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                     _mm_packs_epi32(lo, hi));
+  } else {
+    auto* dst = reinterpret_cast<__m128i*>(static_cast<int32_t*>(out) + 2 * i);
+    _mm_storeu_si128(dst, lo);
+    _mm_storeu_si128(dst + 1, hi);
+  }
+}
+
+template <SampleFormat F>
+inline void StoreMonoSse2(__m128 value, void* out, size_t i) {
+  if (F == SampleFormat::kFloat) {
+    _mm_storeu_ps(static_cast<float*>(out) + i, value);
+    return;
+  }
+  auto v = _mm_cvtps_epi32(value);
+  if (F == SampleFormat::kS16) {
+    _mm_storel_epi64(
+        reinterpret_cast<__m128i*>(static_cast<int16_t*>(out) + i),
+        _mm_packs_epi32(v, v));
+  } else {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(static_cast<int32_t*>(out) + i), v);
+  }
+}
+
+template <SampleFormat F, typename In>
+size_t ConvertGainSse2(const In* left, const In* right, size_t count,
+                       const GainScale& scale, void* out) {
+  size_t i = 0;
+  if (right == nullptr) {
+    for (; i + 4 <= count; i += 4) {
+      StoreMonoSse2<F>(ScaleSse2(LoadSse2(left + i), scale), out, i);
+    }
+    return i;
+  }
+  for (; i + 4 <= count; i += 4) {
+    StoreSse2<F>(ScaleSse2(LoadSse2(left + i), scale),
+                 ScaleSse2(LoadSse2(right + i), scale), out, i);
+  }
+  return i;
+}
+
+// AVX2 unpack and pack instructions work on each 128 bits lane separately:
+// unpack gives [L0 R0 L1 R1 | L4 R4 L5 R5] and [L2 R2 L3 R3 | L6 R6 L7 R7],
+// which is already in order for the S16 pack but needs a lane permutation
+// for 32 bits outputs.
+
+__attribute__((target("avx2"))) inline __m256i ClipAvx2(__m256i v) {
+  v = _mm256_min_epi32(v, _mm256_set1_epi32(kFixedMax));
+  return _mm256_max_epi32(v, _mm256_set1_epi32(kFixedMin));
+}
+
+__attribute__((target("avx2"))) inline __m256i RoundShiftS16Avx2(__m256i v) {
+  v = _mm256_add_epi32(v, _mm256_set1_epi32(1 << (kS16Shift - 1)));
+  return _mm256_srai_epi32(v, kS16Shift);
+}
+
+__attribute__((target("avx2"))) inline __m256 ToFloatAvx2(__m256i v) {
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(ClipAvx2(v)),
+                       _mm256_set1_ps(kFloatScale));
+}
+
+__attribute__((target("avx2"))) inline __m256i LoadAvx2(
+    const FixedSample* src) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+}
+
+__attribute__((target("avx2"))) size_t ConvertS16Avx2(
+    const FixedSample* left, const FixedSample* right, size_t count,
+    int16_t* out) {
+  size_t i = 0;
+  if (right == nullptr) {
+    for (; i + 16 <= count; i += 16) {
+      auto lo = RoundShiftS16Avx2(LoadAvx2(left + i));
+      auto hi = RoundShiftS16Avx2(LoadAvx2(left + i + 8));
+      // pack interleaves the lanes of lo and hi
+      auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    return i;
+  }
+  for (; i + 8 <= count; i += 8) {
+    auto l = RoundShiftS16Avx2(LoadAvx2(left + i));
+    auto r = RoundShiftS16Avx2(LoadAvx2(right + i));
+    auto packed = _mm256_packs_epi32(_mm256_unpacklo_epi32(l, r),
+                                     _mm256_unpackhi_epi32(l, r));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), packed);
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t ConvertS32Avx2(
+    const FixedSample* left, const FixedSample* right, size_t count,
+    int32_t* out) {
+  size_t i = 0;
+  auto* dst = reinterpret_cast<__m256i*>(out);
+  if (right == nullptr) {
+    for (; i + 8 <= count; i += 8) {
+      auto l = _mm256_slli_epi32(ClipAvx2(LoadAvx2(left + i)), kS32Shift);
+      _mm256_storeu_si256(dst + i / 8, l);
+    }
+    return i;
+  }
+  for (; i + 8 <= count; i += 8) {
+    auto l = _mm256_slli_epi32(ClipAvx2(LoadAvx2(left + i)), kS32Shift);
+    auto r = _mm256_slli_epi32(ClipAvx2(LoadAvx2(right + i)), kS32Shift);
+    auto lo = _mm256_unpacklo_epi32(l, r);
+    auto hi = _mm256_unpackhi_epi32(l, r);
+    _mm256_storeu_si256(dst + i / 4, _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(dst + i / 4 + 1,
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t ConvertFloatAvx2(
+    const FixedSample* left, const FixedSample* right, size_t count,
+    float* out) {
+  size_t i = 0;
+  if (right == nullptr) {
+    for (; i + 8 <= count; i += 8) {
+      _mm256_storeu_ps(out + i, ToFloatAvx2(LoadAvx2(left + i)));
+    }
+    return i;
+  }
+  for (; i + 8 <= count; i += 8) {
+    auto l = ToFloatAvx2(LoadAvx2(left + i));
+    auto r = ToFloatAvx2(LoadAvx2(right + i));
+    auto lo = _mm256_unpacklo_ps(l, r);
+    auto hi = _mm256_unpackhi_ps(l, r);
+    _mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) inline __m256 LoadFloatAvx2(
+    const FixedSample* src) {
+  return _mm256_cvtepi32_ps(LoadAvx2(src));
+}
+
+__attribute__((target("avx2"))) inline __m256 LoadFloatAvx2(
+    const float* src) {
+  return _mm256_loadu_ps(src);
+}
+
+__attribute__((target("avx2"))) inline __m256 ScaleAvx2(
+    __m256 v, const GainScale& scale) {
+  auto value = _mm256_mul_ps(v, _mm256_set1_ps(scale.factor));
+  value = _mm256_max_ps(value, _mm256_set1_ps(scale.min));
+  return _mm256_min_ps(value, _mm256_set1_ps(scale.max));
+}
+
+template <SampleFormat F>
+__attribute__((target("avx2"))) inline void StoreAvx2(__m256 left,
+                                                      __m256 right, void* out,
+                                                      size_t i) {
+  if (F == SampleFormat::kFloat) {
+    auto* dst = static_cast<float*>(out) + 2 * i;
+    auto lo = _mm256_unpacklo_ps(left, right);
+    auto hi = _mm256_unpackhi_ps(left, right);
+    _mm256_storeu_ps(dst, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    return;
+  }
+  auto l = _mm256_cvtps_epi32(left);
+  auto r = _mm256_cvtps_epi32(right);
+  auto lo = _mm256_unpacklo_epi32(l, r);
+  auto hi = _mm256_unpackhi_epi32(l, r);
+  if (F == SampleFormat::kS16) {
+    auto* dst = static_cast<int16_t*>(out) + 2 * i;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                        _mm256_packs_epi32(lo, hi));
+  } else {
+    auto* dst = reinterpret_cast<__m256i*>(static_cast<int32_t*>(out) + 2 * i);
+    _mm256_storeu_si256(dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(dst + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+}
+
+template <SampleFormat F>
+__attribute__((target("avx2"))) inline void StoreMonoAvx2(__m256 value,
+                                                          void* out,
+                                                          size_t i) {
+  if (F == SampleFormat::kFloat) {
+    _mm256_storeu_ps(static_cast<float*>(out) + i, value);
+    return;
+  }
+  auto v = _mm256_cvtps_epi32(value);
+  if (F == SampleFormat::kS16) {
+    auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(v, v),
+                                           _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(static_cast<int16_t*>(out) + i),
+        _mm256_castsi256_si128(packed));
+  } else {
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(static_cast<int32_t*>(out) + i), v);
+  }
+}
+
+template <SampleFormat F, typename In>
+__attribute__((target("avx2"))) size_t ConvertGainAvx2(
+    const In* left, const In* right, size_t count, const GainScale& scale,
+    void* out) {
+  size_t i = 0;
+  if (right == nullptr) {
+    for (; i + 8 <= count; i += 8) {
+      StoreMonoAvx2<F>(ScaleAvx2(LoadFloatAvx2(left + i), scale), out, i);
+    }
+    return i;
+  }
+  for (; i + 8 <= count; i += 8) {
+    StoreAvx2<F>(ScaleAvx2(LoadFloatAvx2(left + i), scale),
+                 ScaleAvx2(LoadFloatAvx2(right + i), scale), out, i);
+  }
+  return i;
+}
+
+template <typename In>
+using GainKernel = size_t (*)(const In*, const In*, size_t, const GainScale&,
+                              void*);
+
+template <SampleFormat F, typename In>
+GainKernel<In> SelectGainKernel(bool avx2) {
+  return avx2 ? ConvertGainAvx2<F, In> : ConvertGainSse2<F, In>;
+}
+
+size_t FixedToFloatSse2(const FixedSample* in, size_t count, float factor,
+                        float* out) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(out + i, _mm_mul_ps(LoadSse2(in + i), _mm_set1_ps(factor)));
+  }
+  return i;
+}
+
+#endif  // IPLAYER_PCM_X86
+
+// Vectorized kernels return the number of samples per channel converted,
+// the remaining ones (less than a vector) go through the scalar kernel.
+template <typename T>
+using Kernel = size_t (*)(const FixedSample*, const FixedSample*, size_t, T*);
+
+template <typename T>
+void ConvertWith(Kernel<T> kernel, const FixedSample* left,
+                 const FixedSample* right, size_t count, SampleFormat format,
+                 T* out) {
+  size_t done = kernel(left, right, count, out);
+  size_t channels = right == nullptr ? 1 : 2;
+  ConvertScalar(left + done, right == nullptr ? nullptr : right + done,
+                count - done, format, out + done * channels);
+}
+
+template <typename In>
+void ConvertScaled(SimdLevel level, const In* left, const In* right,
+                   size_t count, SampleFormat format, const GainScale& scale,
+                   void* out) {
+  size_t done = 0;
+#ifdef IPLAYER_PCM_X86
+  if (level != SimdLevel::kScalar) {
+    bool avx2 = level == SimdLevel::kAvx2;
+    GainKernel<In> kernel = nullptr;
+    switch (format) {
+      case SampleFormat::kS16:
+        kernel = SelectGainKernel<SampleFormat::kS16, In>(avx2);
+        break;
+      case SampleFormat::kS32:
+        kernel = SelectGainKernel<SampleFormat::kS32, In>(avx2);
+        break;
+      case SampleFormat::kFloat:
+        kernel = SelectGainKernel<SampleFormat::kFloat, In>(avx2);
+        break;
+    }
+    done = kernel(left, right, count, scale, out);
+  }
+#else
+  UNUSED(level);
+#endif
+  size_t channels = right == nullptr ? 1 : 2;
+  auto* rest = static_cast<uint8_t*>(out) +
+               done * channels * AudioFormat{format, 0, 0}.BytesPerSample();
+  ConvertGainScalar(left + done, right == nullptr ? nullptr : right + done,
+                    count - done, format, scale, rest);
+}
+
+SimdLevel DetectSimdLevel() {
+#ifdef IPLAYER_PCM_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SimdLevel::kSse2;
+  }
+#endif
+  return SimdLevel::kScalar;
+}
+
+}  // namespace
+
+SimdLevel GetSimdLevel() {
+  static const SimdLevel level = DetectSimdLevel();
+  return level;
+}
+
+void ConvertPcm(const FixedSample* left, const FixedSample* right,
+                size_t count, SampleFormat format, void* out) {
+  ConvertPcm(GetSimdLevel(), left, right, count, format, out);
+}
+
+void ConvertPcm(const FixedSample* left, const FixedSample* right,
+                size_t count, SampleFormat format, float gain, void* out) {
+  ConvertPcm(GetSimdLevel(), left, right, count, format, gain, out);
+}
+
+void ConvertPcm(SimdLevel level, const FixedSample* left,
+                const FixedSample* right, size_t count, SampleFormat format,
+                float gain, void* out) {
+  if (gain == 1.0f) {
+    ConvertPcm(level, left, right, count, format, out);
+    return;
+  }
+  ConvertScaled(level, left, right, count, format, GetGainScale(format, gain),
+                out);
+}
+
+void ConvertPcm(const float* left, const float* right, size_t count,
+                SampleFormat format, void* out) {
+  ConvertPcm(GetSimdLevel(), left, right, count, format, out);
+}
+
+void ConvertPcm(SimdLevel level, const float* left, const float* right,
+                size_t count, SampleFormat format, void* out) {
+  ConvertScaled(level, left, right, count, format, GetFloatScale(format), out);
+}
+
+void FixedToFloat(const FixedSample* in, size_t count, float gain,
+                  float* out) {
+  float factor = gain * kFloatScale;
+  size_t i = 0;
+#ifdef IPLAYER_PCM_X86
+  if (GetSimdLevel() != SimdLevel::kScalar) {
+    i = FixedToFloatSse2(in, count, factor, out);
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = static_cast<float>(in[i]) * factor;
+  }
+}
+
+void ConvertPcm(SimdLevel level, const FixedSample* left,
+                const FixedSample* right, size_t count, SampleFormat format,
+                void* out) {
+#ifdef IPLAYER_PCM_X86
+  if (level != SimdLevel::kScalar) {
+    bool avx2 = level == SimdLevel::kAvx2;
+    switch (format) {
+      case SampleFormat::kS16:
+        ConvertWith<int16_t>(avx2 ? ConvertS16Avx2 : ConvertS16Sse2, left,
+                             right, count, format, static_cast<int16_t*>(out));
+        return;
+      case SampleFormat::kS32:
+        ConvertWith<int32_t>(avx2 ? ConvertS32Avx2 : ConvertS32Sse2, left,
+                             right, count, format, static_cast<int32_t*>(out));
+        return;
+      case SampleFormat::kFloat:
+        ConvertWith<float>(avx2 ? ConvertFloatAvx2 : ConvertFloatSse2, left,
+                           right, count, format, static_cast<float*>(out));
+        return;
+    }
+  }
+#else
+  UNUSED(level);
+#endif
+  ConvertScalar(left, right, count, format, out);
+}
+
+}  // namespace ip
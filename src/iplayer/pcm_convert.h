@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "iplayer/audio_format.h"
+
+// Conversion of decoded fixed point samples (libmad's mad_fixed_t, 28
+// fractional bits) to interleaved PCM: round, clip, quantize and interleave
+// in a single pass. Vectorized kernels are selected at runtime depending on
+// the cpu, all of them give the same result as the scalar one.
+
+namespace ip {
+
+using FixedSample = int32_t;
+static const int kFixedFracBits = 28;
+
+enum class SimdLevel { kScalar, kSse2, kAvx2 };
+
+SimdLevel GetSimdLevel();  // best level supported by the cpu
+
+// Convert 'count' samples of each channel ('right' is nullptr for mono) to
+// interleaved 'format' written in 'out'
+void ConvertPcm(const FixedSample* left, const FixedSample* right,
+                size_t count, SampleFormat format, void* out);
+
+// Same applying 'gain' (linear) in the same pass, results are clipped. A
+// gain of 1 gives exactly the result of the conversion above.
+void ConvertPcm(const FixedSample* left, const FixedSample* right,
+                size_t count, SampleFormat format, float gain, void* out);
+
+// Convert full range float samples ([-1, 1]), clipped and rounded to nearest
+void ConvertPcm(const float* left, const float* right, size_t count,
+                SampleFormat format, void* out);
+
+// Fixed point samples of a channel to floats with 'gain' applied, not clipped
+void FixedToFloat(const FixedSample* in, size_t count, float gain,
+                  float* out);
+
+// same using a specific kernel (for tests/benchmarks), 'level' must be
+// supported by the cpu
+void ConvertPcm(SimdLevel level, const FixedSample* left,
+                const FixedSample* right, size_t count, SampleFormat format,
+                void* out);
+void ConvertPcm(SimdLevel level, const FixedSample* left,
+                const FixedSample* right, size_t count, SampleFormat format,
+                float gain, void* out);
+void ConvertPcm(SimdLevel level, const float* left, const float* right,
+                size_t count, SampleFormat format, void* out);
+
+}  // namespace ip
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "iplayer/audio_format.h"
+
+// Mixing of two interleaved PCM streams of the same format for transitions
+// between tracks. The vectorized kernel gives exactly the scalar result.
+
+namespace ip {
+
+// Equal power crossfade of 'frames' frames, the first one being at
+// 'position' of a fade lasting 'length' frames: 'fading_out' is weighted by
+// cos and 'fading_in' by sin of the progress (0 to pi/2), the sum of their
+// powers stays constant. Results are clipped, 'out' may be one of the
+// inputs.
+void CrossfadePcm(const AudioFormat& format, const uint8_t* fading_out,
+                  const uint8_t* fading_in, size_t frames, size_t position,
+                  size_t length, uint8_t* out);
+
+}  // namespace ip
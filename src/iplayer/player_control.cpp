@@ -2,18 +2,55 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <unordered_set>
 
+#include "iplayer/playlist_import.h"
 #include "iplayer/utils/log.h"
 
 namespace ip {
 
+// number of tracks, starting from current one, having their metadata
+// extracted before any other track
+static const size_t kPrioritizedTrackCount = 8;
+// tracks of a playlist added at once, the first ones are playable early
+static const size_t kImportBatchSize = 4096;
+
 PlayerControl::PlayerControl(Core* core)
-    : core_(core), status_(Status::kStop) {}
+    : core_(core),
+      status_(Status::kStop),
+      normalize_(true),
+      generation_(0),
+      lane_(core->GetAudioOutput()),
+      loudness_(
+          [core](const TrackLocation& location) {
+            return core->GetTrackProvider(location);
+          },
+          [core](const std::string& codec, const TrackInfo& info,
+                 ITrackIOPtr io, AudioOutput* output,
+                 IDecoder::CompletionCb completion_cb) {
+            return core->CreateDecoder(codec, info, std::move(io), output,
+                                       std::move(completion_cb));
+          },
+          std::bind(&PlayerControl::PublishLoudness, this,
+                    std::placeholders::_1)),
+      metadata_([core](const TrackLocation& location) {
+                  return core->GetTrackProvider(location);
+                },
+                std::bind(&PlayerControl::PublishTrackInfo, this,
+                          std::placeholders::_1)) {}
 
 void PlayerControl::Exit() {
-  std::lock_guard<std::mutex> lock(mutex_);
-  StopAndSeekBegin();
-  core_->Stop();
+  std::vector<ITrackWatchPtr> watches;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    watches.swap(watches_);
+    metadata_.Cancel();
+    loudness_.Cancel();
+    StopAndSeekBegin();
+    core_->Stop();
+  }
+  // stopped without the lock, changes being applied take it
+  watches.clear();
 }
 
 void PlayerControl::Play() {
@@ -55,6 +92,19 @@ void PlayerControl::Stop() {
 
 void PlayerControl::Next() {
   std::lock_guard<std::mutex> lock(mutex_);
+  PlayNext();
+}
+
+void PlayerControl::OnCompletion(uint64_t generation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (generation != generation_) {
+    return;  // track was already replaced, it completed while fading out
+  }
+  PlayNext();
+}
+
+void PlayerControl::PlayNext() {
+  // private method so no synchronization
   TrackInfo track;
   auto ec = playlist_.SeekTrack(1, Playlist::SeekWay::kCurrent, &track);
   if (ec) {
@@ -75,6 +125,14 @@ void PlayerControl::Previous() {
   PlayTrack(track);
 }
 
+void PlayerControl::Seek(std::chrono::seconds position) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!decoder_) {
+    return;
+  }
+  decoder_->Seek(position);
+}
+
 void PlayerControl::SetRepeatPlaylistEnabled(bool value) {
   std::lock_guard<std::mutex> lock(mutex_);
   playlist_.SetRepeatPlaylistEnabled(value);
@@ -85,9 +143,35 @@ void PlayerControl::SetRepeatTrackEnabled(bool value) {
   playlist_.SetRepeatTrackEnabled(value);
 }
 
+void PlayerControl::SetNormalizeEnabled(bool value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  normalize_ = value;
+}
+
+void PlayerControl::SetDspSettings(const DspSettings& settings) {
+  auto* output = core_->GetAudioOutput();
+  if (output) {
+    output->SetDspSettings(std::make_shared<DspSettings>(settings));
+  }
+}
+
+DspSettings PlayerControl::GetDspSettings() const {
+  auto* output = core_->GetAudioOutput();
+  auto settings = output ? output->GetDspSettings() : nullptr;
+  return settings ? *settings : DspSettings();
+}
+
+void PlayerControl::SetCrossfade(std::chrono::milliseconds overlap) {
+  auto* output = core_->GetAudioOutput();
+  if (output) {
+    output->SetCrossfade(overlap);
+  }
+}
+
 void PlayerControl::SetRandomTrackEnabled(bool value) {
   std::lock_guard<std::mutex> lock(mutex_);
   playlist_.SetModeRandom(value);
+  PrioritizeNextTracks();
 }
 
 void PlayerControl::Unpause() {
@@ -100,24 +184,58 @@ void PlayerControl::Unpause() {
 }
 
 void PlayerControl::StopAndSeekBegin() {
+  fading_decoder_.reset();
   decoder_.reset();
   playlist_.SeekTrack(0, Playlist::SeekWay::kBegin, nullptr);
   status_ = Status::kStop;
+  PrioritizeNextTracks();
 }
 
-void PlayerControl::PlayTrack(const TrackInfo& info) {
+void PlayerControl::PrioritizeNextTracks() {
+  // private method so no synchronization
+  metadata_.Prioritize(playlist_.NextTracks(kPrioritizedTrackCount));
+}
+
+void PlayerControl::PlayTrack(const TrackInfo& track_info) {
+  // following tracks get their metadata before the rest of the playlist
+  PrioritizeNextTracks();
+
   // IDEA: refactor to do this in decoder's thread to avoid any ui freeze.
-  // As getting TrackInfo is async it might not be ready, got get it directly
-  auto codec = info.Codec();
+  auto provider = core_->GetTrackProvider(track_info.Location());
+  if (!provider) {
+    // try to play next track
+    core_->QueueExecution(std::bind(&PlayerControl::Next, this));
+    return;
+  }
+  TrackInfo info = track_info;
+
+  // decoders read the track through the provider, they don't need to know
+  // where it comes from
+  std::error_code io_ec;
+  auto io = provider->OpenTrack(info.Location(), io_ec);
+  if (io_ec) {
+    LOG("[D] cannot open %s: %s", info.Location().c_str(),
+        io_ec.message().c_str());
+    core_->QueueExecution(std::bind(&PlayerControl::Next, this));
+    return;
+  }
+
+  // The codec is told by the track's first bytes, whatever its extension or
+  // the provider's guess. Only when they are not enough, TrackInfo is got
+  // directly as it might not be ready yet (unlikely as current track is
+  // prioritized), which reads the whole track. Without it, the decoder
+  // builds the frame index itself if the track is seeked.
+  auto codec = io ? core_->ProbeCodec(&io) : std::string();
   if (codec.empty()) {
-    auto provider = core_->GetTrackProvider(info.Location());
-    if (!provider) {
-      // try to play next track
-      core_->QueueExecution(std::bind(&PlayerControl::Next, this));
-      return;
+    if (info.Codec().empty()) {
+      info = provider->GetTrackInfo(info.Location());
+      playlist_.SetTrackInfo({{info.Location(), info}});
+      loudness_.Push({info});
     }
-    auto new_info = provider->GetTrackInfo(info.Location());
-    codec = new_info.Codec();
+    codec = info.Codec();
+  }
+  if (!normalize_) {
+    info.ClearLoudness();
   }
 
   // this lambda will be called from decoder's thread context just before
@@ -125,16 +243,37 @@ void PlayerControl::PlayTrack(const TrackInfo& info) {
   // decoder_'s destruction (could use a shared_ptr)
   //
   // Decoder thread's future will hold on destruction avoiding race condition
-  auto on_completion = [this](const std::error_code& ec) {
+  auto generation = ++generation_;
+  auto on_completion = [this, generation](const std::error_code& ec) {
     if (ec) {
       LOG("[D] completion callback error: %s (%d)", ec.message().c_str(),
           ec.value());
       return;
     }
-    core_->QueueExecution(std::bind(&PlayerControl::Next, this));
+    core_->QueueExecution(
+        std::bind(&PlayerControl::OnCompletion, this, generation));
   };
 
-  decoder_ = core_->CreateDecoder(codec, info, std::move(on_completion));
+  // A decoder must be gone before another one uses its output lane. With
+  // crossfade, the playing track fades out on its lane while the new one
+  // starts on the other, freed from what's left of an older fade.
+  bool crossfade = decoder_ && status_ == Status::kPlay &&
+                   lane_->GetCrossfade().count() > 0;
+  if (fading_decoder_) {
+    fading_decoder_.reset();
+    lane_->Partner()->Flush();
+  }
+  if (crossfade) {
+    lane_->FadeOut();
+    fading_decoder_ = std::move(decoder_);
+    lane_ = lane_->Partner();
+  } else {
+    decoder_.reset();
+  }
+  DecoderOptions options;
+  options.playback = true;
+  decoder_ = core_->CreateDecoder(codec, info, std::move(io), lane_,
+                                  std::move(on_completion), options);
   if (!decoder_) {
     LOG("[D] no decoder found for %s", codec.c_str());
     return;
@@ -143,14 +282,41 @@ void PlayerControl::PlayTrack(const TrackInfo& info) {
 }
 
 void PlayerControl::AddUri(const std::string& uri) {
+  std::string playlist;
+  if (GetPlaylistPath(uri, &playlist)) {
+    auto import = [this, playlist]() {
+      auto ec = ImportPlaylist(playlist, kImportBatchSize,
+                               [this](std::vector<TrackLocation>&& batch) {
+                                 AddTrack(batch);
+                               });
+      if (ec) {
+        LOG("%s", ec.message().c_str());
+      }
+    };
+    core_->QueueExecution(std::move(import));
+    return;
+  }
+
   auto list_track = [this, uri]() {
     auto provider = core_->GetTrackProvider(uri);
     if (!provider) {
       return;
     }
 
+    // a watched uri gives its tracks then only what changes
+    std::error_code ec;
+    auto watch = provider->Watch(
+        uri, std::bind(&PlayerControl::ApplyTrackChanges, this,
+                       std::placeholders::_1, std::placeholders::_2),
+        ec);
+    if (watch) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      watches_.push_back(std::move(watch));
+      return;
+    }
+
     std::vector<TrackLocation> locations;
-    auto ec = provider->List(uri, &locations);
+    ec = provider->List(uri, &locations);
     if (ec) {
       LOG("%s", ec.message().c_str());
       return;
@@ -163,23 +329,43 @@ void PlayerControl::AddUri(const std::string& uri) {
 void PlayerControl::AddTrack(const std::vector<TrackLocation>& locations) {
   std::lock_guard<std::mutex> lock(mutex_);
   playlist_.AddTrack(locations);
+  metadata_.Push(locations);
+  PrioritizeNextTracks();
+}
 
-  auto get_all_info = [this, locations]() {
-    std::unordered_map<TrackLocation, TrackInfo> infos;
-    for (const auto& location : locations) {
-      auto provider = core_->GetTrackProvider(location);
-      if (!provider) {
-        LOG("cannot find track provider for %s", location.c_str());
-        continue;
-      }
+void PlayerControl::ApplyTrackChanges(std::vector<TrackLocation> added,
+                                      std::vector<TrackLocation> removed) {
+  // called from watches
+  std::unordered_set<TrackLocation> gone(std::begin(removed),
+                                         std::end(removed));
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!gone.empty()) {
+    playlist_.RemoveTrack(gone);
+    metadata_.Remove(gone);
+  }
+  if (!added.empty()) {
+    playlist_.AddTrack(added);
+    metadata_.Push(added);
+  }
+  PrioritizeNextTracks();
+}
 
-      auto track = provider->GetTrackInfo(location);
-      infos.insert({location, track});
-    }
-    std::lock_guard<std::mutex> lock(mutex_);
-    playlist_.SetTrackInfo(std::move(infos));
-  };
-  core_->QueueExecution(get_all_info);
+void PlayerControl::PublishTrackInfo(MetadataExtractor::TrackInfos infos) {
+  // called from metadata extraction workers
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<TrackInfo> tracks;
+  for (const auto& info : infos) {
+    tracks.push_back(info.second);
+  }
+  playlist_.SetTrackInfo(std::move(infos));
+  // tracks are fully known now, their loudness can be measured
+  loudness_.Push(tracks);
+}
+
+void PlayerControl::PublishLoudness(TrackInfo info) {
+  // called from loudness analysis worker
+  std::lock_guard<std::mutex> lock(mutex_);
+  playlist_.SetTrackInfo({{info.Location(), info}});
 }
 
 TrackInfo PlayerControl::GetCurrentTrackInfo(
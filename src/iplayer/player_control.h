@@ -4,9 +4,12 @@
 
 #include <atomic>
 #include <mutex>
+#include <vector>
 
 #include "iplayer/core.h"
 #include "iplayer/i_decoder.h"
+#include "iplayer/loudness_analyzer.h"
+#include "iplayer/metadata_extractor.h"
 #include "iplayer/playlist.h"
 
 namespace ip {
@@ -23,9 +26,14 @@ class PlayerControl : public IPlayerControl {
   void Stop() override;
   void Previous() override;
   void Next() override;
+  void Seek(std::chrono::seconds position) override;
   void SetRepeatTrackEnabled(bool enable) override;
   void SetRepeatPlaylistEnabled(bool enable) override;
   void SetRandomTrackEnabled(bool value) override;
+  void SetNormalizeEnabled(bool value) override;
+  void SetDspSettings(const DspSettings& settings) override;
+  DspSettings GetDspSettings() const override;
+  void SetCrossfade(std::chrono::milliseconds overlap) override;
 
   void AddUri(const std::string& uri) override;
   void AddTrack(const std::vector<TrackLocation>& track_location) override;
@@ -37,15 +45,31 @@ class PlayerControl : public IPlayerControl {
 
  private:
   void Unpause();
+  void PlayNext();
+  void OnCompletion(uint64_t generation);
   void StopAndSeekBegin();
   void SelectTrack(int64_t pos, TrackLocation* track_location);
   void PlayTrack(const TrackInfo& track_info);
+  void PublishTrackInfo(MetadataExtractor::TrackInfos infos);
+  void PublishLoudness(TrackInfo info);
+  void PrioritizeNextTracks();
+  void ApplyTrackChanges(std::vector<TrackLocation> added,
+                         std::vector<TrackLocation> removed);
 
   mutable std::mutex mutex_;
   Core* core_;
   Status status_;
+  bool normalize_;  // apply gain from loudness analysis
   std::unique_ptr<IDecoder> decoder_;
+  uint64_t generation_;  // of decoder_, older completions are ignored
+  AudioOutput* lane_;    // output lane decoder_ writes to
+  // previous track fading out on the other lane, kept until next change
+  std::unique_ptr<IDecoder> fading_decoder_;
   Playlist playlist_;
+  LoudnessAnalyzer loudness_;   // uses playlist_, fed by metadata_
+  MetadataExtractor metadata_;  // its workers use playlist_
+  // watched uris (directories), destroyed first as they feed metadata_
+  std::vector<ITrackWatchPtr> watches_;
 };
 
 }  // namespace ip
@@ -42,11 +42,12 @@ void Playlist::AddTrack(const std::vector<TrackLocation>& tracks) {
   }
 
   // append to random map new indexes and randomize their positions
+  const size_t first = playlist_.size() - tracks.size();
   for (size_t i = 0; i < tracks.size(); ++i) {
-    random_.push_back(static_cast<TrackId>(playlist_.size() + i - 1));
+    random_.push_back(static_cast<TrackId>(first + i));
 
     std::uniform_int_distribution<TrackId> random_index(
-        0, static_cast<TrackId>(playlist_.size() - 1));
+        0, static_cast<TrackId>(random_.size() - 1));
     std::iter_swap(std::rbegin(random_),
                    std::begin(random_) + random_index(prng_));
   }
@@ -202,6 +203,28 @@ TrackInfo Playlist::CurrentTrack() const {
   }
 }
 
+std::vector<TrackLocation> Playlist::NextTracks(size_t count) const {
+  std::vector<TrackLocation> locations;
+  if (playlist_.empty()) {
+    return locations;
+  }
+  if (repeat_track_) {
+    count = 1;
+  }
+  if (!repeat_playlist_) {
+    count = std::min(count, playlist_.size() - current_track_);
+  }
+  count = std::min(count, playlist_.size());
+  for (size_t i = 0; i < count; ++i) {
+    auto id = (current_track_ + i) % playlist_.size();
+    if (random_mode_) {
+      id = random_[id];
+    }
+    locations.push_back(playlist_[id].Location());
+  }
+  return locations;
+}
+
 size_t Playlist::Remaining() const {
   assert(current_track_ == 0 ? true : current_track_ < playlist_.size());
   return playlist_.size() - 1 - current_track_;
@@ -36,6 +36,9 @@ class Playlist {
   TrackInfo CurrentTrack() const;
   size_t Remaining() const;
 
+  // locations of current track and the ones following it in play order
+  std::vector<TrackLocation> NextTracks(size_t count) const;
+
   void SetRepeatPlaylistEnabled(bool value);
   void SetRepeatTrackEnabled(bool value);
   void SetModeRandom(bool value);
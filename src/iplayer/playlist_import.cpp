@@ -0,0 +1,362 @@
+#include "iplayer/playlist_import.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+#include "iplayer/utils/file_mapping.h"
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static const std::string kFileScheme = "file://";
+static const std::string kPlaylistScheme = "playlist://";
+
+static bool HasExtension(const std::string& path, PlaylistFormat* format) {
+  static const struct {
+    const char* extension;
+    PlaylistFormat format;
+  } kExtensions[] = {{".m3u", PlaylistFormat::kM3u},
+                     {".m3u8", PlaylistFormat::kM3u},
+                     {".pls", PlaylistFormat::kPls},
+                     {".xspf", PlaylistFormat::kXspf}};
+  auto dot = path.rfind('.');
+  if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+    return false;
+  }
+  for (const auto& extension : kExtensions) {
+    if (strcasecmp(path.c_str() + dot, extension.extension) == 0) {
+      *format = extension.format;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GetPlaylistPath(const std::string& uri, std::string* path) {
+  if (uri.compare(0, kPlaylistScheme.size(), kPlaylistScheme) == 0) {
+    *path = uri.substr(kPlaylistScheme.size());
+    return true;
+  }
+  std::string candidate;
+  if (uri.compare(0, kFileScheme.size(), kFileScheme) == 0) {
+    candidate = uri.substr(kFileScheme.size());
+  } else if (uri.find("://") == std::string::npos) {
+    candidate = uri;
+  }
+  PlaylistFormat format;
+  if (candidate.empty() || !HasExtension(candidate, &format)) {
+    return false;
+  }
+  *path = candidate;
+  return true;
+}
+
+static int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = static_cast<char>(tolower(c));
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static void AppendPercentDecoded(const char* data, size_t size,
+                                 std::string* out) {
+  for (size_t i = 0; i < size; ++i) {
+    int high = 0;
+    int low = 0;
+    if (data[i] == '%' && i + 2 < size &&
+        (high = HexValue(data[i + 1])) >= 0 &&
+        (low = HexValue(data[i + 2])) >= 0) {
+      out->push_back(static_cast<char>(high * 16 + low));
+      i += 2;
+    } else {
+      out->push_back(data[i]);
+    }
+  }
+}
+
+static void AppendUtf8(uint32_t code, std::string* out) {
+  if (code < 0x80) {
+    out->push_back(static_cast<char>(code));
+  } else if (code < 0x800) {
+    out->push_back(static_cast<char>(0xc0 | (code >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+  } else if (code < 0x10000) {
+    out->push_back(static_cast<char>(0xe0 | (code >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+  } else {
+    out->push_back(static_cast<char>(0xf0 | (code >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+  }
+}
+
+// XML text with its character and predefined entity references replaced
+static std::string DecodeXmlText(const char* data, size_t size) {
+  static const struct {
+    const char* name;
+    char value;
+  } kEntities[] = {{"amp;", '&'},
+                   {"lt;", '<'},
+                   {"gt;", '>'},
+                   {"quot;", '"'},
+                   {"apos;", '\''}};
+  std::string text;
+  for (size_t i = 0; i < size; ++i) {
+    if (data[i] != '&') {
+      text.push_back(data[i]);
+      continue;
+    }
+    auto rest = std::string(data + i + 1, std::min<size_t>(size - i - 1, 10));
+    auto end = rest.find(';');
+    bool decoded = false;
+    if (end != std::string::npos && rest[0] == '#') {
+      bool hex = rest.size() > 1 && (rest[1] == 'x' || rest[1] == 'X');
+      char* last = nullptr;
+      auto code = strtoul(rest.c_str() + (hex ? 2 : 1), &last, hex ? 16 : 10);
+      if (last == rest.c_str() + end && code > 0 && code <= 0x10ffff) {
+        AppendUtf8(static_cast<uint32_t>(code), &text);
+        decoded = true;
+      }
+    }
+    for (const auto& entity : kEntities) {
+      if (!decoded && rest.compare(0, strlen(entity.name), entity.name) == 0) {
+        text.push_back(entity.value);
+        decoded = true;
+      }
+    }
+    if (decoded) {
+      i += end + 1;
+    } else {
+      text.push_back('&');
+    }
+  }
+  return text;
+}
+
+// Turn playlist entries into locations, given in batches
+class LocationBatcher {
+ public:
+  LocationBatcher(const std::string& dir, size_t batch_size,
+                  const PlaylistBatch& on_batch)
+      : dir_prefix_(kFileScheme + dir + "/"),
+        batch_size_(std::max<size_t>(batch_size, 1)),
+        on_batch_(on_batch) {
+    batch_.reserve(batch_size_);
+  }
+
+  // 'uri': the entry is a uri reference (XSPF), paths in it are percent
+  // encoded too
+  void Add(const char* data, size_t size, bool uri) {
+    while (size && isspace(static_cast<unsigned char>(*data))) {
+      ++data;
+      --size;
+    }
+    while (size && isspace(static_cast<unsigned char>(data[size - 1]))) {
+      --size;
+    }
+    if (size == 0) {
+      return;
+    }
+    TrackLocation location;
+    static const char kSeparator[] = "://";
+    auto scheme_end = std::search(data, data + size, kSeparator,
+                                  kSeparator + strlen(kSeparator));
+    bool has_scheme = scheme_end != data + size &&
+                      std::find(data, scheme_end, '/') == scheme_end;
+    if (size >= kFileScheme.size() &&
+        strncasecmp(data, kFileScheme.c_str(), kFileScheme.size()) == 0) {
+      // file://localhost/path or file:///path
+      data += kFileScheme.size();
+      size -= kFileScheme.size();
+      const size_t kLocalhost = strlen("localhost");
+      if (size > kLocalhost &&
+          strncasecmp(data, "localhost", kLocalhost) == 0 &&
+          data[kLocalhost] == '/') {
+        data += kLocalhost;
+        size -= kLocalhost;
+      }
+      location.reserve(kFileScheme.size() + size);
+      location = kFileScheme;
+      AppendPercentDecoded(data, size, &location);
+    } else if (has_scheme) {
+      location.assign(data, size);
+    } else {
+      bool absolute = *data == '/';
+      location.reserve((absolute ? kFileScheme.size() : dir_prefix_.size()) +
+                       size);
+      location = absolute ? kFileScheme : dir_prefix_;
+      if (uri) {
+        AppendPercentDecoded(data, size, &location);
+      } else {
+        location.append(data, size);
+      }
+    }
+    batch_.push_back(std::move(location));
+    if (batch_.size() >= batch_size_) {
+      Flush();
+    }
+  }
+
+  void Flush() {
+    if (batch_.empty()) {
+      return;
+    }
+    on_batch_(std::move(batch_));
+    batch_.clear();
+    batch_.reserve(batch_size_);
+  }
+
+ private:
+  std::string dir_prefix_;
+  size_t batch_size_;
+  const PlaylistBatch& on_batch_;
+  std::vector<TrackLocation> batch_;
+};
+
+// calls 'on_line' with each line, without its end of line
+template <typename F>
+static void ForEachLine(const char* data, size_t size, F on_line) {
+  const char* end = data + size;
+  while (data < end) {
+    auto eol = static_cast<const char*>(memchr(data, '\n', end - data));
+    if (!eol) {
+      eol = end;
+    }
+    on_line(data, static_cast<size_t>(eol - data));
+    data = eol + 1;
+  }
+}
+
+static void ParseM3u(const char* data, size_t size,
+                     LocationBatcher* batcher) {
+  ForEachLine(data, size, [batcher](const char* line, size_t len) {
+    // directives (#EXTINF...) and comments
+    if (len && line[0] != '#') {
+      batcher->Add(line, len, false);
+    }
+  });
+}
+
+static void ParsePls(const char* data, size_t size,
+                     LocationBatcher* batcher) {
+  ForEachLine(data, size, [batcher](const char* line, size_t len) {
+    // File1=path, Title1 and Length1 are read from the track itself
+    const size_t kKey = strlen("file");
+    if (len <= kKey || strncasecmp(line, "file", kKey) != 0) {
+      return;
+    }
+    auto equal = static_cast<const char*>(memchr(line, '=', len));
+    if (equal && std::all_of(line + kKey, equal, [](char c) {
+          return c >= '0' && c <= '9';
+        })) {
+      batcher->Add(equal + 1, len - static_cast<size_t>(equal + 1 - line),
+                   false);
+    }
+  });
+}
+
+static const char* Find(const char* begin, const char* end,
+                        const char* pattern) {
+  auto found = static_cast<const char*>(
+      memmem(begin, static_cast<size_t>(end - begin), pattern,
+             strlen(pattern)));
+  return found ? found : end;
+}
+
+static void ParseXspf(const char* data, size_t size,
+                      LocationBatcher* batcher) {
+  // the playlist itself may have a <location> before its tracks
+  const char* end = data + size;
+  const char* position = Find(data, end, "<trackList");
+  const std::string kOpen = "<location>";
+  const std::string kClose = "</location>";
+  while ((position = Find(position, end, kOpen.c_str())) != end) {
+    position += kOpen.size();
+    const char* close = Find(position, end, kClose.c_str());
+    auto len = static_cast<size_t>(close - position);
+    if (memchr(position, '&', len)) {
+      auto text = DecodeXmlText(position, len);
+      batcher->Add(text.data(), text.size(), true);
+    } else {
+      batcher->Add(position, len, true);
+    }
+    position = close;
+  }
+}
+
+void ParsePlaylist(const char* data, size_t size, PlaylistFormat format,
+                   const std::string& dir, size_t batch_size,
+                   const PlaylistBatch& on_batch) {
+  // UTF-8 byte order mark
+  if (size >= 3 && memcmp(data, "\xef\xbb\xbf", 3) == 0) {
+    data += 3;
+    size -= 3;
+  }
+  LocationBatcher batcher(dir, batch_size, on_batch);
+  switch (format) {
+    case PlaylistFormat::kM3u:
+      ParseM3u(data, size, &batcher);
+      break;
+    case PlaylistFormat::kPls:
+      ParsePls(data, size, &batcher);
+      break;
+    case PlaylistFormat::kXspf:
+      ParseXspf(data, size, &batcher);
+      break;
+  }
+  batcher.Flush();
+}
+
+static PlaylistFormat GuessFormat(const uint8_t* data, size_t size) {
+  size_t i = 0;
+  while (i < size && (isspace(data[i]) || data[i] >= 0x80)) {
+    ++i;  // blanks and byte order mark
+  }
+  const std::string kPls = "[playlist]";
+  if (size - i >= kPls.size() &&
+      strncasecmp(reinterpret_cast<const char*>(data + i), kPls.c_str(),
+                  kPls.size()) == 0) {
+    return PlaylistFormat::kPls;
+  }
+  return i < size && data[i] == '<' ? PlaylistFormat::kXspf
+                                    : PlaylistFormat::kM3u;
+}
+
+std::error_code ImportPlaylist(const std::string& path, size_t batch_size,
+                               const PlaylistBatch& on_batch) {
+  FileIdentity id;
+  auto ec = GetFileIdentity(path, &id);
+  if (ec) {
+    LOG("error opening '%s': %s", path.c_str(), ec.message().c_str());
+    return ec;
+  }
+  if (id.size == 0) {
+    return {};  // can't be mapped, nothing to add anyway
+  }
+  auto slash = path.rfind('/');
+  auto dir = slash == std::string::npos
+                 ? std::string(".")
+                 : slash == 0 ? std::string() : path.substr(0, slash);
+  try {
+    FileMapping mapping(path);
+    mapping.Advise(FileMapping::Access::kSequential);
+    PlaylistFormat format;
+    if (!HasExtension(path, &format)) {
+      format = GuessFormat(mapping.data(), mapping.size());
+    }
+    ParsePlaylist(reinterpret_cast<const char*>(mapping.data()),
+                  mapping.size(), format, dir, batch_size, on_batch);
+  } catch (const std::system_error& e) {
+    LOG("error mapping '%s': %s", path.c_str(), e.what());
+    return e.code();
+  }
+  return {};
+}
+
+}  // namespace ip
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "iplayer/track_location.h"
+
+// Read M3U/M3U8, PLS and XSPF playlists: the file is mapped and scanned in
+// place, only the resolved locations are allocated. Entries are given in
+// batches so a huge playlist can start filling the player's one before it
+// is completely read.
+//
+// Relative paths are resolved from the playlist's directory, absolute ones
+// and file:// uris (percent encoded) become file:// locations, other uris
+// (http://...) are kept as they are.
+
+namespace ip {
+
+enum class PlaylistFormat { kM3u, kPls, kXspf };
+
+using PlaylistBatch = std::function<void(std::vector<TrackLocation>&&)>;
+
+// Path of the playlist 'uri' points to: playlist://PATH, or file://PATH
+// and PATH with a playlist extension (.m3u, .m3u8, .pls, .xspf)
+bool GetPlaylistPath(const std::string& uri, std::string* path);
+
+// the format is guessed from the extension, then from the content
+std::error_code ImportPlaylist(const std::string& path, size_t batch_size,
+                               const PlaylistBatch& on_batch);
+
+// for playlists already in memory, 'dir' resolves relative paths
+void ParsePlaylist(const char* data, size_t size, PlaylistFormat format,
+                   const std::string& dir, size_t batch_size,
+                   const PlaylistBatch& on_batch);
+
+}  // namespace ip
@@ -0,0 +1,39 @@
+#include "iplayer/playlist_track_provider.h"
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "iplayer/playlist_import.h"
+#include "iplayer/track_info.h"
+
+namespace ip {
+
+static const size_t kBatchSize = 4096;
+
+std::error_code PlaylistTrackProvider::List(
+    const std::string& uri, std::vector<TrackLocation>* locations) const {
+  std::string path;
+  if (!GetPlaylistPath(uri, &path)) {
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+  return ImportPlaylist(
+      path, kBatchSize, [locations](std::vector<TrackLocation>&& batch) {
+        locations->insert(std::end(*locations),
+                          std::make_move_iterator(std::begin(batch)),
+                          std::make_move_iterator(std::end(batch)));
+      });
+}
+
+TrackInfo PlaylistTrackProvider::GetTrackInfo(const TrackLocation&) {
+  // a playlist isn't a track, its entries are
+  throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+}
+
+ITrackIOPtr PlaylistTrackProvider::OpenTrack(const TrackLocation&,
+                                             std::error_code& ec) {
+  ec = std::make_error_code(std::errc::invalid_argument);
+  return {};
+}
+
+}  // namespace ip
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "iplayer/i_track_provider.h"
+
+// playlist:///path/list.m3u lists the playlist's tracks, played with their
+// own provider (file://, http://...). Playlists are also recognized by
+// their extension (see GetPlaylistPath()).
+
+namespace ip {
+
+class PlaylistTrackProvider : public ITrackProvider {
+ public:
+  std::error_code List(const std::string& uri,
+                       std::vector<TrackLocation>* locations) const override;
+  TrackInfo GetTrackInfo(const TrackLocation& track) override;
+  ITrackIOPtr OpenTrack(const TrackLocation& track,
+                        std::error_code& ec) override;
+};
+
+}  // namespace ip
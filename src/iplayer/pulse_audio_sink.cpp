@@ -0,0 +1,82 @@
+#include "iplayer/pulse_audio_sink.h"
+
+#include <pulse/error.h>
+#include <pulse/simple.h>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static pa_sample_format_t ToPulseFormat(SampleFormat format) {
+  switch (format) {
+    case SampleFormat::kS16:
+      return PA_SAMPLE_S16NE;
+    case SampleFormat::kS32:
+      return PA_SAMPLE_S32NE;
+    case SampleFormat::kFloat:
+      return PA_SAMPLE_FLOAT32NE;
+  }
+  return PA_SAMPLE_INVALID;
+}
+
+PulseAudioSink::PulseAudioSink()
+    : device_(nullptr), format_{SampleFormat::kS16, 0, 0} {}
+
+PulseAudioSink::~PulseAudioSink() { Close(); }
+
+std::error_code PulseAudioSink::Open(const AudioFormat& format) {
+  if (device_ && format == format_) {
+    return {};
+  }
+  Close();
+
+  pa_sample_spec ss;
+  ss.format = ToPulseFormat(format.format);
+  ss.rate = format.rate;
+  ss.channels = static_cast<uint8_t>(format.channels);
+  int error = 0;
+  if (!(device_ = pa_simple_new(NULL, "MP3 player", PA_STREAM_PLAYBACK, NULL,
+                                "playback", &ss, NULL, NULL, &error))) {
+    LOG("pa_simple_new() failed: %s", pa_strerror(error));
+    return std::make_error_code(std::errc::io_error);
+  }
+  format_ = format;
+  return {};
+}
+
+std::error_code PulseAudioSink::Write(const uint8_t* data, size_t len) {
+  int error = 0;
+  if (!device_) {
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+  if (pa_simple_write(device_, data, len, &error) < 0) {
+    LOG("pa_simple_write() failed: %s", pa_strerror(error));
+    return std::make_error_code(std::errc::io_error);
+  }
+  return {};
+}
+
+std::error_code PulseAudioSink::Drain() {
+  int error = 0;
+  if (device_ && pa_simple_drain(device_, &error) < 0) {
+    LOG("pa_simple_drain() failed: %s", pa_strerror(error));
+    return std::make_error_code(std::errc::io_error);
+  }
+  return {};
+}
+
+void PulseAudioSink::Flush() {
+  int error = 0;
+  if (device_ && pa_simple_flush(device_, &error) < 0) {
+    LOG("pa_simple_flush() failed: %s", pa_strerror(error));
+  }
+}
+
+void PulseAudioSink::Close() {
+  if (device_) {
+    pa_simple_free(device_);
+    device_ = nullptr;
+  }
+}
+
+}  // namespace ip
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "iplayer/i_audio_sink.h"
+
+struct pa_simple;
+
+namespace ip {
+
+// PulseAudio playback stream, only reconnected when the format changes
+class PulseAudioSink : public IAudioSink {
+ public:
+  PulseAudioSink();
+  virtual ~PulseAudioSink();
+
+  std::error_code Open(const AudioFormat& format) override;
+  std::error_code Write(const uint8_t* data, size_t len) override;
+  std::error_code Drain() override;
+  void Flush() override;
+  void Close() override;
+
+ private:
+  pa_simple* device_;
+  AudioFormat format_;
+};
+
+}  // namespace ip
@@ -0,0 +1,307 @@
+#include "iplayer/resampler.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IPLAYER_RESAMPLE_X86
+#endif
+
+namespace ip {
+
+namespace {
+
+// input frames copied at once after the history, bounds the buffers
+const size_t kChunkFrames = 1024;
+// above, phases are quantized: ratios of common rates need at most 441
+const uint64_t kMaxPhases = 1024;
+
+struct QualityParams {
+  size_t taps;    // multiple of 8 (one AVX register)
+  double beta;    // Kaiser window, trades stopband for transition width
+  double cutoff;  // center of the transition, of the lowest Nyquist
+};
+
+QualityParams GetQualityParams(ResampleQuality quality) {
+  switch (quality) {
+    case ResampleQuality::kFast:
+      return {32, 6.5, 0.87};
+    case ResampleQuality::kMedium:
+      return {64, 9.0, 0.91};
+    case ResampleQuality::kBest:
+      return {128, 11.5, 0.94};
+  }
+  return {64, 9.0, 0.91};
+}
+
+uint64_t Gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    auto r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// zeroth order modified Bessel function of the first kind
+double BesselI0(double x) {
+  double sum = 1;
+  double term = 1;
+  for (int k = 1; k < 64 && term > sum * 1e-12; ++k) {
+    double t = x / (2 * k);
+    term *= t * t;
+    sum += term;
+  }
+  return sum;
+}
+
+double Sinc(double x) {
+  return x == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+}
+
+// Each output sample is computed by one of these from 'taps' input samples
+// of each channel ('right' is nullptr for mono)
+
+void FilterScalar(const float* left, const float* right, const float* coefs,
+                  size_t taps, float* out_left, float* out_right) {
+  float sum_left = 0;
+  float sum_right = 0;
+  for (size_t i = 0; i < taps; ++i) {
+    sum_left += left[i] * coefs[i];
+    if (right) {
+      sum_right += right[i] * coefs[i];
+    }
+  }
+  *out_left = sum_left;
+  if (right) {
+    *out_right = sum_right;
+  }
+}
+
+#ifdef IPLAYER_RESAMPLE_X86
+
+__attribute__((target("sse2"))) inline float HorizontalSumSse2(
+    __m128 v) {
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse2"))) void FilterSse2(const float* left,
+                                                const float* right,
+                                                const float* coefs,
+                                                size_t taps, float* out_left,
+                                                float* out_right) {
+  // two accumulators per channel hide the latency of the additions
+  __m128 left0 = _mm_setzero_ps(), left1 = _mm_setzero_ps();
+  if (right) {
+    __m128 right0 = _mm_setzero_ps(), right1 = _mm_setzero_ps();
+    for (size_t i = 0; i < taps; i += 8) {
+      __m128 c0 = _mm_loadu_ps(coefs + i);
+      __m128 c1 = _mm_loadu_ps(coefs + i + 4);
+      left0 = _mm_add_ps(left0, _mm_mul_ps(_mm_loadu_ps(left + i), c0));
+      left1 = _mm_add_ps(left1, _mm_mul_ps(_mm_loadu_ps(left + i + 4), c1));
+      right0 = _mm_add_ps(right0, _mm_mul_ps(_mm_loadu_ps(right + i), c0));
+      right1 =
+          _mm_add_ps(right1, _mm_mul_ps(_mm_loadu_ps(right + i + 4), c1));
+    }
+    *out_right = HorizontalSumSse2(_mm_add_ps(right0, right1));
+  } else {
+    for (size_t i = 0; i < taps; i += 8) {
+      left0 = _mm_add_ps(
+          left0, _mm_mul_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(coefs + i)));
+      left1 = _mm_add_ps(left1, _mm_mul_ps(_mm_loadu_ps(left + i + 4),
+                                           _mm_loadu_ps(coefs + i + 4)));
+    }
+  }
+  *out_left = HorizontalSumSse2(_mm_add_ps(left0, left1));
+}
+
+__attribute__((target("avx2"))) inline float HorizontalSumAvx2(__m256 v) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2"))) void FilterAvx2(const float* left,
+                                                const float* right,
+                                                const float* coefs,
+                                                size_t taps, float* out_left,
+                                                float* out_right) {
+  __m256 left_sum = _mm256_setzero_ps();
+  if (right) {
+    __m256 right_sum = _mm256_setzero_ps();
+    for (size_t i = 0; i < taps; i += 8) {
+      __m256 c = _mm256_loadu_ps(coefs + i);
+      left_sum =
+          _mm256_add_ps(left_sum, _mm256_mul_ps(_mm256_loadu_ps(left + i), c));
+      right_sum = _mm256_add_ps(right_sum,
+                                _mm256_mul_ps(_mm256_loadu_ps(right + i), c));
+    }
+    *out_right = HorizontalSumAvx2(right_sum);
+  } else {
+    for (size_t i = 0; i < taps; i += 8) {
+      left_sum = _mm256_add_ps(left_sum,
+                               _mm256_mul_ps(_mm256_loadu_ps(left + i),
+                                             _mm256_loadu_ps(coefs + i)));
+    }
+  }
+  *out_left = HorizontalSumAvx2(left_sum);
+}
+
+#endif  // IPLAYER_RESAMPLE_X86
+
+}  // namespace
+
+const uint32_t Resampler::kMaxChannels;
+
+Resampler::Resampler(uint32_t input_rate, uint32_t output_rate,
+                     uint32_t channels, ResampleQuality quality)
+    : Resampler(input_rate, output_rate, channels, quality, GetSimdLevel()) {}
+
+Resampler::Resampler(uint32_t input_rate, uint32_t output_rate,
+                     uint32_t channels, ResampleQuality quality,
+                     SimdLevel level)
+    : input_rate_(input_rate),
+      output_rate_(output_rate),
+      channels_(std::min(std::max(channels, 1u), kMaxChannels)),
+      quality_(quality),
+      level_(level) {
+  assert(input_rate > 0 && output_rate > 0);
+  auto gcd = Gcd(input_rate, output_rate);
+  up_ = output_rate / gcd;
+  down_ = input_rate / gcd;
+  auto params = GetQualityParams(quality);
+  taps_ = params.taps;
+  phases_ = static_cast<size_t>(std::min(up_, kMaxPhases));
+
+  // phase p gives the output p/phases_ of an input after the center of the
+  // taps, its coefficients are normalized for a unity gain at DC
+  double cutoff = params.cutoff * std::min(1.0, static_cast<double>(up_) /
+                                                    static_cast<double>(down_));
+  double half = static_cast<double>(taps_ / 2);
+  double window_norm = BesselI0(params.beta);
+  coefs_.resize(phases_ * taps_);
+  for (size_t p = 0; p < phases_; ++p) {
+    double fraction = static_cast<double>(p) / phases_;
+    float* coefs = &coefs_[p * taps_];
+    double sum = 0;
+    for (size_t k = 0; k < taps_; ++k) {
+      double distance = half - 1 - static_cast<double>(k) + fraction;
+      double x = distance / half;
+      double window =
+          BesselI0(params.beta * sqrt(std::max(0.0, 1 - x * x))) /
+          window_norm;
+      double value = window * cutoff * Sinc(cutoff * distance);
+      coefs[k] = static_cast<float>(value);
+      sum += value;
+    }
+    for (size_t k = 0; k < taps_; ++k) {
+      coefs[k] = static_cast<float>(coefs[k] / sum);
+    }
+  }
+  for (uint32_t c = 0; c < channels_; ++c) {
+    buffer_[c].resize(taps_ + kChunkFrames);
+  }
+  Reset();
+}
+
+size_t Resampler::MaxOutput(size_t frames) const {
+  return static_cast<size_t>((frames + taps_) * up_ / down_) + 2;
+}
+
+void Resampler::Reset() {
+  // history is silence, first output is centered on the first input
+  for (uint32_t c = 0; c < channels_; ++c) {
+    std::fill(buffer_[c].begin(), buffer_[c].end(), 0.0f);
+  }
+  fill_ = taps_ / 2 - 1;
+  position_ = 0;
+  phase_ = 0;
+  input_frames_ = 0;
+  output_frames_ = 0;
+}
+
+size_t Resampler::Process(const float* const* in, size_t frames,
+                          float* const* out) {
+  size_t count = 0;
+  size_t done = 0;
+  float* shifted[kMaxChannels] = {};
+  while (done < frames) {
+    // after Run() less than taps_ frames are left, there is room for a chunk
+    size_t length = std::min(frames - done, buffer_[0].size() - fill_);
+    for (uint32_t c = 0; c < channels_; ++c) {
+      memcpy(&buffer_[c][fill_], in[c] + done, length * sizeof(float));
+      shifted[c] = out[c] + count;
+    }
+    fill_ += length;
+    done += length;
+    input_frames_ += length;
+    count += Run(shifted, SIZE_MAX);
+  }
+  return count;
+}
+
+size_t Resampler::Drain(float* const* out) {
+  // outputs are due up to the time of the last input, whatever comes after
+  // in the buffer only feeds the taps
+  uint64_t expected = (input_frames_ * up_ + down_ - 1) / down_;
+  size_t length = buffer_[0].size() - fill_;
+  for (uint32_t c = 0; c < channels_; ++c) {
+    std::fill_n(&buffer_[c][fill_], length, 0.0f);
+  }
+  fill_ += length;
+  auto count = Run(out, static_cast<size_t>(expected - output_frames_));
+  Reset();
+  return count;
+}
+
+size_t Resampler::Run(float* const* out, size_t max) {
+  const float* right_in = channels_ == 2 ? buffer_[1].data() : nullptr;
+  float dummy = 0;
+  size_t count = 0;
+  while (count < max && position_ + taps_ <= fill_) {
+    size_t phase = static_cast<size_t>(phase_ * phases_ / up_);
+    const float* coefs = &coefs_[phase * taps_];
+    const float* left = buffer_[0].data() + position_;
+    const float* right = right_in ? right_in + position_ : nullptr;
+    float* out_left = out[0] + count;
+    float* out_right = right ? out[1] + count : &dummy;
+    switch (level_) {
+#ifdef IPLAYER_RESAMPLE_X86
+      case SimdLevel::kAvx2:
+        FilterAvx2(left, right, coefs, taps_, out_left, out_right);
+        break;
+      case SimdLevel::kSse2:
+        FilterSse2(left, right, coefs, taps_, out_left, out_right);
+        break;
+#endif
+      default:
+        FilterScalar(left, right, coefs, taps_, out_left, out_right);
+        break;
+    }
+    ++count;
+    phase_ += down_;
+    position_ += static_cast<size_t>(phase_ / up_);
+    phase_ %= up_;
+  }
+  output_frames_ += count;
+
+  // keep what next outputs need at the beginning of the buffer, position_
+  // can be ahead of the input when decimating
+  size_t consumed = std::min(position_, fill_);
+  for (uint32_t c = 0; c < channels_; ++c) {
+    memmove(buffer_[c].data(), buffer_[c].data() + consumed,
+            (fill_ - consumed) * sizeof(float));
+  }
+  fill_ -= consumed;
+  position_ -= consumed;
+  return count;
+}
+
+}  // namespace ip
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "iplayer/pcm_convert.h"
+
+// Sample rate conversion of planar float streams so that every track plays
+// at the rate the output is opened with.
+//
+// Polyphase FIR: the ratio is reduced to output/input = L/M and a Kaiser
+// windowed sinc is split into L phases computed once, each output sample is
+// the dot product of one phase with the last input samples. The cutoff is
+// under the lowest of both Nyquist frequencies (anti-aliasing when
+// decimating). The filter is centered: output is aligned with the input,
+// the last samples come out on Drain().
+
+namespace ip {
+
+enum class ResampleQuality {
+  kFast,    // 32 taps, >60dB stopband, passband to ~75% of Nyquist
+  kMedium,  // 64 taps, >90dB stopband, passband to ~82% of Nyquist
+  kBest     // 128 taps, >110dB stopband, passband to ~88% of Nyquist
+};
+
+class Resampler {
+ public:
+  static const uint32_t kMaxChannels = 2;
+
+  Resampler(uint32_t input_rate, uint32_t output_rate, uint32_t channels,
+            ResampleQuality quality);
+  // using a specific kernel (for tests/benchmarks), 'level' must be
+  // supported by the cpu
+  Resampler(uint32_t input_rate, uint32_t output_rate, uint32_t channels,
+            ResampleQuality quality, SimdLevel level);
+
+  uint32_t InputRate() const { return input_rate_; }
+  uint32_t OutputRate() const { return output_rate_; }
+  uint32_t Channels() const { return channels_; }
+  ResampleQuality Quality() const { return quality_; }
+
+  // room 'out' channels need for the result of Process() of 'frames'
+  size_t MaxOutput(size_t frames) const;
+
+  // Resample 'frames' frames of 'in' channels (any count, no allocation),
+  // returns the number of frames written to 'out'
+  size_t Process(const float* const* in, size_t frames, float* const* out);
+
+  // End of stream: output what the filter delay still holds, 'out' needs
+  // room for MaxOutput(0). All in all, N input frames gave exactly
+  // ceil(N * output_rate / input_rate) frames. The next stream can follow.
+  size_t Drain(float* const* out);
+
+  void Reset();  // forget previous input, on seek
+
+ private:
+  size_t Run(float* const* out, size_t max);  // outputs from buffered input
+
+  uint32_t input_rate_;
+  uint32_t output_rate_;
+  uint32_t channels_;
+  ResampleQuality quality_;
+  SimdLevel level_;
+  uint64_t up_;    // L
+  uint64_t down_;  // M
+  size_t taps_;
+  size_t phases_;  // L, or less when L is huge (nearest phase is used)
+  std::vector<float> coefs_;  // phases_ x taps_
+  std::vector<float> buffer_[kMaxChannels];  // history then pending input
+  size_t fill_;      // frames in buffer_
+  size_t position_;  // first tap of next output, can be past fill_
+  uint64_t phase_;   // of next output between two inputs, in 1/L
+  uint64_t input_frames_;   // since last Reset()/Drain()
+  uint64_t output_frames_;  // idem
+};
+
+}  // namespace ip
@@ -0,0 +1,327 @@
+#include "iplayer/shm_audio_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+#include <thread>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+// the header and the ring don't share a cache line
+static const uint32_t kDataOffset = 256;
+static_assert(sizeof(ShmPcmHeader) <= kDataOffset, "header too big");
+
+// attempts to read the header while the writer updates it
+static const int kMaxAttempts = 1000;
+
+static int64_t MonotonicNs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+static size_t RoundUpPowerOf2(size_t value) {
+  size_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+const uint32_t ShmPcmHeader::kMagic;
+const uint32_t ShmPcmHeader::kVersion;
+const size_t ShmAudioSink::kDefaultCapacity;
+
+ShmAudioSink::ShmAudioSink(const std::string& name, size_t capacity)
+    : name_(name),
+      capacity_(RoundUpPowerOf2(std::max<size_t>(capacity, 4096))),
+      mapping_(nullptr),
+      mapping_size_(0),
+      header_(nullptr),
+      ring_(nullptr) {}
+
+ShmAudioSink::~ShmAudioSink() {
+  if (!mapping_) {
+    return;
+  }
+  Close();
+  munmap(mapping_, mapping_size_);
+  // readers keep their mapping, they see the writer inactive
+  shm_unlink(name_.c_str());
+}
+
+std::error_code ShmAudioSink::Open(const AudioFormat& format) {
+  if (!header_) {
+    auto ec = CreateSegment();
+    if (ec) {
+      LOG("[E] shared memory %s: %s", name_.c_str(), ec.message().c_str());
+      return ec;
+    }
+  }
+  auto sample_format = static_cast<uint32_t>(format.format);
+  auto relaxed = std::memory_order_relaxed;
+  if (header_->active.load(relaxed) &&
+      header_->sample_format.load(relaxed) == sample_format &&
+      header_->rate.load(relaxed) == format.rate &&
+      header_->channels.load(relaxed) == format.channels) {
+    return {};
+  }
+  BeginUpdate();
+  header_->active.store(1, relaxed);
+  header_->sample_format.store(sample_format, relaxed);
+  header_->rate.store(format.rate, relaxed);
+  header_->channels.store(format.channels, relaxed);
+  header_->segment_start.store(header_->written.load(relaxed), relaxed);
+  EndUpdate();
+  return {};
+}
+
+std::error_code ShmAudioSink::Write(const uint8_t* data, size_t len) {
+  if (!header_) {
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+  auto relaxed = std::memory_order_relaxed;
+  uint64_t position = header_->written.load(relaxed);
+  uint64_t end = position + len;
+  // readers check it after copying: what they copied is valid if it's
+  // still within the ring's capacity behind it
+  header_->writing.store(end, relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  // only the last 'capacity' bytes of a huge write survive anyway
+  if (len > capacity_) {
+    data += len - capacity_;
+    position += len - capacity_;
+    len = capacity_;
+  }
+  size_t index = static_cast<size_t>(position & (capacity_ - 1));
+  size_t first = std::min(len, capacity_ - index);
+  memcpy(ring_ + index, data, first);
+  memcpy(ring_, data + first, len - first);
+
+  BeginUpdate();
+  header_->written.store(end, relaxed);
+  header_->timestamp_ns.store(MonotonicNs(), relaxed);
+  EndUpdate();
+  return {};
+}
+
+std::error_code ShmAudioSink::Drain() { return {}; }
+
+void ShmAudioSink::Flush() {
+  if (!header_) {
+    return;
+  }
+  auto relaxed = std::memory_order_relaxed;
+  BeginUpdate();
+  header_->segment_start.store(header_->written.load(relaxed), relaxed);
+  EndUpdate();
+}
+
+void ShmAudioSink::Close() {
+  if (!header_) {
+    return;
+  }
+  BeginUpdate();
+  header_->active.store(0, std::memory_order_relaxed);
+  EndUpdate();
+}
+
+std::error_code ShmAudioSink::CreateSegment() {
+  // one left by a crashed writer is replaced
+  shm_unlink(name_.c_str());
+  int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                    0644);
+  if (fd < 0) {
+    return {errno, std::generic_category()};
+  }
+  size_t size = kDataOffset + capacity_;
+  void* mapping = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  std::error_code ec(errno, std::generic_category());
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    shm_unlink(name_.c_str());
+    return ec;
+  }
+  mapping_ = mapping;
+  mapping_size_ = size;
+  // zero filled by ftruncate(), atomics included
+  header_ = new (mapping) ShmPcmHeader;
+  header_->version = ShmPcmHeader::kVersion;
+  header_->data_offset = kDataOffset;
+  header_->capacity = capacity_;
+  ring_ = static_cast<uint8_t*>(mapping) + kDataOffset;
+  header_->magic.store(ShmPcmHeader::kMagic, std::memory_order_release);
+  return {};
+}
+
+void ShmAudioSink::BeginUpdate() {
+  // single writer: no need for a read-modify-write
+  auto sequence = header_->sequence.load(std::memory_order_relaxed);
+  header_->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void ShmAudioSink::EndUpdate() {
+  auto sequence = header_->sequence.load(std::memory_order_relaxed);
+  header_->sequence.store(sequence + 1, std::memory_order_release);
+}
+
+ShmPcmReader::ShmPcmReader()
+    : mapping_(nullptr),
+      mapping_size_(0),
+      header_(nullptr),
+      ring_(nullptr),
+      started_(false),
+      position_(0),
+      skipped_(0) {}
+
+ShmPcmReader::~ShmPcmReader() { Close(); }
+
+std::error_code ShmPcmReader::Open(const std::string& name) {
+  Close();
+  int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return {errno, std::generic_category()};
+  }
+  struct stat st;
+  void* mapping = MAP_FAILED;
+  if (fstat(fd, &st) == 0) {
+    mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                   MAP_SHARED, fd, 0);
+  }
+  std::error_code ec(errno, std::generic_category());
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return ec;
+  }
+  mapping_ = mapping;
+  mapping_size_ = static_cast<size_t>(st.st_size);
+
+  // the writer may still be initializing it
+  auto header = static_cast<const ShmPcmHeader*>(mapping);
+  if (mapping_size_ < sizeof(ShmPcmHeader) ||
+      header->magic.load(std::memory_order_acquire) != ShmPcmHeader::kMagic) {
+    Close();
+    return std::make_error_code(std::errc::resource_unavailable_try_again);
+  }
+  if (header->version != ShmPcmHeader::kVersion ||
+      header->data_offset + header->capacity > mapping_size_ ||
+      header->capacity == 0 ||
+      (header->capacity & (header->capacity - 1)) != 0) {
+    Close();
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+  header_ = header;
+  ring_ = static_cast<const uint8_t*>(mapping) + header->data_offset;
+  started_ = false;
+  skipped_ = 0;
+  return {};
+}
+
+void ShmPcmReader::Close() {
+  if (mapping_) {
+    munmap(mapping_, mapping_size_);
+  }
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+  header_ = nullptr;
+  ring_ = nullptr;
+}
+
+bool ShmPcmReader::GetState(ShmPcmState* state) const {
+  if (!header_) {
+    return false;
+  }
+  auto relaxed = std::memory_order_relaxed;
+  for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+    auto sequence = header_->sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    state->active = header_->active.load(relaxed) != 0;
+    state->format.format =
+        static_cast<SampleFormat>(header_->sample_format.load(relaxed));
+    state->format.rate = header_->rate.load(relaxed);
+    state->format.channels =
+        static_cast<uint16_t>(header_->channels.load(relaxed));
+    state->written = header_->written.load(relaxed);
+    state->segment_start = header_->segment_start.load(relaxed);
+    state->timestamp_ns = header_->timestamp_ns.load(relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->sequence.load(relaxed) == sequence) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t ShmPcmReader::Read(uint8_t* data, size_t len, ShmPcmState* state) {
+  uint64_t capacity = header_ ? header_->capacity : 0;
+  while (GetState(state)) {
+    size_t frame_size = state->format.BytesPerFrame();
+    if (state->format.channels == 0 || len < frame_size) {
+      return 0;
+    }
+    if (!started_) {
+      position_ = state->written;
+      started_ = true;
+    }
+    // a flush or a format change since the last read
+    if (position_ < state->segment_start || position_ > state->written) {
+      skipped_ += state->segment_start > position_
+                      ? state->segment_start - position_
+                      : 0;
+      position_ = state->segment_start;
+    }
+    // too late, continue from the oldest whole frame still there (the one
+    // being written may already be overwriting the ring)
+    uint64_t newest = std::max(
+        state->written, header_->writing.load(std::memory_order_relaxed));
+    uint64_t oldest = newest > capacity ? newest - capacity : 0;
+    if (position_ < oldest) {
+      uint64_t offset = oldest - state->segment_start;
+      uint64_t next = state->segment_start +
+                      (offset + frame_size - 1) / frame_size * frame_size;
+      if (next > state->written) {
+        // a write bigger than the ring is overwriting all of it, nothing
+        // whole to read before it's over
+        return 0;
+      }
+      skipped_ += next - position_;
+      position_ = next;
+    }
+
+    auto count = static_cast<size_t>(
+        std::min<uint64_t>(state->written - position_, len));
+    count -= count % frame_size;
+    size_t index = static_cast<size_t>(position_ & (capacity - 1));
+    size_t first = std::min<size_t>(count, capacity - index);
+    memcpy(data, ring_ + index, first);
+    memcpy(data + first, ring_, count - first);
+
+    // the writer may have overwritten it meanwhile
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t writing = header_->writing.load(std::memory_order_relaxed);
+    if (writing > capacity && writing - capacity > position_) {
+      continue;
+    }
+    position_ += count;
+    return count;
+  }
+  return 0;
+}
+
+}  // namespace ip
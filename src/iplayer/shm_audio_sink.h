@@ -0,0 +1,124 @@
+#pragma once
+
+#include "iplayer/i_audio_sink.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Live PCM for local processes (visualizers, meters): the stream is
+// published in a POSIX shared memory ring that any number of readers map
+// read-only. The writer never waits for readers, a reader late by more than
+// the ring loses the oldest bytes.
+//
+// Layout of the segment: a ShmPcmHeader then the ring at 'data_offset'.
+// Positions are bytes ever written, the ring index of a position is
+// position % capacity. The format and positions are updated under a
+// sequence lock (odd while updating), readers retry when it changed.
+
+namespace ip {
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared atomics must be lock-free");
+
+struct ShmPcmHeader {
+  static const uint32_t kMagic = 0x4d435049;  // "IPCM"
+  static const uint32_t kVersion = 1;
+
+  std::atomic<uint32_t> magic;  // stored last once the segment is ready
+  uint32_t version;
+  uint32_t data_offset;  // of the ring, from the start of the segment
+  uint32_t reserved;
+  uint64_t capacity;  // bytes of the ring, a power of 2
+
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint32_t> active;  // 1 between the writer's Open() and Close()
+  std::atomic<uint32_t> sample_format;  // SampleFormat
+  std::atomic<uint32_t> rate;
+  std::atomic<uint32_t> channels;
+  std::atomic<uint32_t> padding;
+  // readable up to there
+  std::atomic<uint64_t> written;
+  // where the current format starts, or the stream after a flush (seek)
+  std::atomic<uint64_t> segment_start;
+  // CLOCK_MONOTONIC time when 'written' was reached
+  std::atomic<int64_t> timestamp_ns;
+
+  // Out of the sequence lock: the writer raises it before overwriting the
+  // ring, bytes before writing - capacity may have been overwritten
+  std::atomic<uint64_t> writing;
+};
+
+// Publish what's written to the shared memory object 'name' ("/iplayer"),
+// created on the first Open() and removed with the sink. Write() never
+// blocks: use it as a fan-out branch next to a real sink to follow playback
+// (ex: "fanout:pulse,shm:/iplayer").
+class ShmAudioSink : public IAudioSink {
+ public:
+  static const size_t kDefaultCapacity = 1 << 20;
+
+  explicit ShmAudioSink(const std::string& name,
+                        size_t capacity = kDefaultCapacity);
+  virtual ~ShmAudioSink();
+
+  std::error_code Open(const AudioFormat& format) override;
+  std::error_code Write(const uint8_t* data, size_t len) override;
+  std::error_code Drain() override;
+  void Flush() override;  // readers skip to what's written next
+  void Close() override;  // the segment stays, inactive
+
+ private:
+  std::error_code CreateSegment();
+  void BeginUpdate();
+  void EndUpdate();
+
+  std::string name_;
+  size_t capacity_;
+  void* mapping_;
+  size_t mapping_size_;
+  ShmPcmHeader* header_;
+  uint8_t* ring_;
+};
+
+struct ShmPcmState {
+  bool active;
+  AudioFormat format;
+  uint64_t written;
+  uint64_t segment_start;
+  int64_t timestamp_ns;
+};
+
+// Reference reader of a ShmAudioSink's segment, from another process or
+// not. It starts with what's written after its first Read().
+class ShmPcmReader {
+ public:
+  ShmPcmReader();
+  virtual ~ShmPcmReader();
+
+  std::error_code Open(const std::string& name);
+  void Close();
+
+  // consistent copy of the header, false if not open or the writer is
+  // stuck in the middle of an update
+  bool GetState(ShmPcmState* state) const;
+
+  // Copy up to 'len' bytes (whole frames) of one format following what was
+  // last read, 0 when nothing new. 'state' is the one they were read with,
+  // its format is theirs.
+  size_t Read(uint8_t* data, size_t len, ShmPcmState* state);
+
+  // bytes lost by falling behind the ring or skipped by a flush
+  uint64_t Skipped() const { return skipped_; }
+
+ private:
+  void* mapping_;
+  size_t mapping_size_;
+  const ShmPcmHeader* header_;
+  const uint8_t* ring_;
+  bool started_;
+  uint64_t position_;
+  uint64_t skipped_;
+};
+
+}  // namespace ip
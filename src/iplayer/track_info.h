@@ -4,6 +4,7 @@
 #include <memory>
 #include <system_error>
 
+#include "iplayer/frame_index.h"
 #include "iplayer/i_track_io.h"
 #include "iplayer/track_location.h"
 
@@ -11,10 +12,20 @@ namespace ip {
 
 class TrackInfo {
  public:
-  TrackInfo() : number_(0), duration_(0) {}
+  TrackInfo()
+      : number_(0),
+        duration_(0),
+        has_loudness_(false),
+        loudness_(0),
+        peak_(0) {}
 
   TrackInfo(const TrackLocation& location)
-      : location_(location), number_(0), duration_(0) {}
+      : location_(location),
+        number_(0),
+        duration_(0),
+        has_loudness_(false),
+        loudness_(0),
+        peak_(0) {}
 
   TrackInfo(const TrackLocation& location, const std::string& title,
             uint32_t number, std::chrono::seconds duration,
@@ -23,21 +34,32 @@ class TrackInfo {
         codec_(codec),
         title_(title),
         number_(number),
-        duration_(duration) {}
+        duration_(duration),
+        has_loudness_(false),
+        loudness_(0),
+        peak_(0) {}
 
   TrackInfo(TrackInfo&& o) noexcept
       : location_(std::move(o.location_)),
         codec_(std::move(o.codec_)),
         title_(std::move(o.title_)),
         number_(o.number_),
-        duration_(o.duration_) {}
+        duration_(o.duration_),
+        frame_index_(std::move(o.frame_index_)),
+        has_loudness_(o.has_loudness_),
+        loudness_(o.loudness_),
+        peak_(o.peak_) {}
 
   TrackInfo(const TrackInfo& o)
       : location_(std::move(o.location_)),
         codec_(std::move(o.codec_)),
         title_(std::move(o.title_)),
         number_(o.number_),
-        duration_(o.duration_) {}
+        duration_(o.duration_),
+        frame_index_(o.frame_index_),
+        has_loudness_(o.has_loudness_),
+        loudness_(o.loudness_),
+        peak_(o.peak_) {}
 
   TrackInfo& operator=(TrackInfo&& o) noexcept {
     if (this == &o) {
@@ -48,6 +70,10 @@ class TrackInfo {
     title_ = std::move(o.title_);
     number_ = o.number_;
     duration_ = o.duration_;
+    frame_index_ = std::move(o.frame_index_);
+    has_loudness_ = o.has_loudness_;
+    loudness_ = o.loudness_;
+    peak_ = o.peak_;
     return *this;
   }
 
@@ -60,6 +86,10 @@ class TrackInfo {
     title_ = o.title_;
     number_ = o.number_;
     duration_ = o.duration_;
+    frame_index_ = o.frame_index_;
+    has_loudness_ = o.has_loudness_;
+    loudness_ = o.loudness_;
+    peak_ = o.peak_;
     return *this;
   }
 
@@ -67,12 +97,23 @@ class TrackInfo {
   void SetTitle(const std::string& title) { title_ = title; }
   void SetDuration(std::chrono::seconds duration) { duration_ = duration; }
   void SetCodec(const std::string& codec) { codec_ = codec; }
+  void SetFrameIndex(FrameIndexPtr index) { frame_index_ = std::move(index); }
+  void SetLoudness(double loudness, float peak) {
+    has_loudness_ = true;
+    loudness_ = loudness;
+    peak_ = peak;
+  }
+  void ClearLoudness() { has_loudness_ = false; }
 
   TrackLocation Location() const { return location_; }
   uint32_t TrackNumber() const { return number_; }
   std::string Title() const { return title_; }
   std::chrono::seconds Duration() const { return duration_; }
   std::string Codec() const { return codec_; }
+  FrameIndexPtr GetFrameIndex() const { return frame_index_; }
+  bool HasLoudness() const { return has_loudness_; }
+  double Loudness() const { return loudness_; }  // integrated, LUFS
+  float Peak() const { return peak_; }            // sample peak, linear
 
  private:
   TrackLocation location_;
@@ -80,6 +121,10 @@ class TrackInfo {
   std::string title_;
   uint32_t number_;
   std::chrono::seconds duration_;
+  FrameIndexPtr frame_index_;  // for seeking, shared by copies
+  bool has_loudness_;  // analyzed in background after metadata
+  double loudness_;
+  float peak_;
 };
 
 bool operator==(const TrackInfo& lhs, const TrackInfo& rhs);
@@ -0,0 +1,106 @@
+#include "iplayer/utils/directory_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "iplayer/utils/log.h"
+#include "iplayer/utils/scope_guard.h"
+
+namespace ip {
+
+static const size_t kDefaultCapacity = 256;
+
+DirectoryCache& DirectoryCache::Instance() {
+  static DirectoryCache cache(kDefaultCapacity);
+  return cache;
+}
+
+DirectoryCache::DirectoryCache(size_t capacity)
+    : capacity_(capacity), scan_count_(0) {}
+
+size_t DirectoryCache::ScanCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return scan_count_;
+}
+
+static std::error_code ReadDir(const std::string& dir,
+                               std::vector<std::string>* names) {
+  DIR* dp = opendir(dir.c_str());
+  if (!dp) {
+    std::error_code ec{errno, std::generic_category()};
+    LOG("error opening '%s': %s", dir.c_str(), ec.message().c_str());
+    return ec;
+  }
+  auto cleanup = CreateScopeGuard([&]() { closedir(dp); });
+
+  // readdir64 is thread safe on different streams
+  struct dirent64* dirp;
+  errno = 0;  // see manpages
+  while ((dirp = readdir64(dp)) != nullptr) {
+    if (strcmp(dirp->d_name, ".") == 0 || strcmp(dirp->d_name, "..") == 0) {
+      continue;
+    }
+    names->emplace_back(dirp->d_name);
+  }
+  if (errno) {
+    return {errno, std::generic_category()};
+  }
+  return {};
+}
+
+std::error_code DirectoryCache::List(const std::string& dir, Names* names) {
+  // identity is taken before reading: a change during the read gives a
+  // different mtime and the snapshot is read again next time
+  FileIdentity id;
+  auto ec = GetFileIdentity(dir, &id);
+  if (ec) {
+    LOG("error opening '%s': %s", dir.c_str(), ec.message().c_str());
+    return ec;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(dir);
+    if (it != std::end(entries_)) {
+      auto lru_it = it->second;
+      if (lru_it->second.id == id) {
+        lru_.splice(std::begin(lru_), lru_, lru_it);
+        *names = lru_it->second.names;
+        return {};
+      }
+      lru_.erase(lru_it);
+      entries_.erase(it);
+    }
+  }
+
+  // read without holding the lock, like MappingCache
+  timespec now = {0, 0};
+  clock_gettime(CLOCK_REALTIME, &now);
+  auto read = std::make_shared<std::vector<std::string>>();
+  ec = ReadDir(dir, read.get());
+  if (ec) {
+    return ec;
+  }
+  *names = read;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++scan_count_;
+  if (id.mtime.tv_sec >= now.tv_sec || capacity_ == 0) {
+    return {};  // racy snapshot, see header
+  }
+  auto it = entries_.find(dir);
+  if (it != std::end(entries_)) {
+    lru_.erase(it->second);
+    entries_.erase(it);
+  }
+  while (lru_.size() >= capacity_) {
+    entries_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  lru_.emplace_front(dir, Snapshot{id, read});
+  entries_[dir] = std::begin(lru_);
+  return {};
+}
+
+}  // namespace ip
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "iplayer/utils/file_mapping.h"
+
+// Process-wide LRU cache of directory listings. A snapshot is reused while
+// the directory's identity (inode, mtime...) is unchanged: adding, removing
+// or renaming an entry updates the directory's mtime, so listing an
+// unchanged directory again costs a single stat().
+//
+// A snapshot taken in the same second as the directory's last change is not
+// kept: on filesystems with coarse timestamps a later change in that second
+// would leave the mtime unchanged.
+
+namespace ip {
+
+class DirectoryCache {
+ public:
+  // entry names, '.' and '..' excluded, in readdir() order
+  using Names = std::shared_ptr<const std::vector<std::string>>;
+
+  static DirectoryCache& Instance();
+
+  DirectoryCache(size_t capacity);  // capacity: number of directories kept
+
+  std::error_code List(const std::string& dir, Names* names);
+
+  size_t ScanCount() const;  // directories actually read, for statistics
+
+ private:
+  struct Snapshot {
+    FileIdentity id;
+    Names names;
+  };
+  using Entry = std::pair<std::string, Snapshot>;
+
+  mutable std::mutex mutex_;
+  const size_t capacity_;
+  size_t scan_count_;
+  std::list<Entry> lru_;  // most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+};
+
+}  // namespace ip
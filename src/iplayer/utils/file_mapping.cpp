@@ -9,9 +9,40 @@
 
 namespace ip {
 
+static FileIdentity ToFileIdentity(const struct stat& metadata) {
+  FileIdentity id;
+  id.device = metadata.st_dev;
+  id.inode = metadata.st_ino;
+  id.size = metadata.st_size;
+  id.mtime = metadata.st_mtim;
+  return id;
+}
+
+bool operator==(const FileIdentity& lhs, const FileIdentity& rhs) {
+  return lhs.device == rhs.device && lhs.inode == rhs.inode &&
+         lhs.size == rhs.size && lhs.mtime.tv_sec == rhs.mtime.tv_sec &&
+         lhs.mtime.tv_nsec == rhs.mtime.tv_nsec;
+}
+
+bool operator!=(const FileIdentity& lhs, const FileIdentity& rhs) {
+  return !(lhs == rhs);
+}
+
+std::error_code GetFileIdentity(const std::string& path, FileIdentity* id) {
+  struct stat metadata;
+  if (stat(path.c_str(), &metadata) < 0) {
+    return {errno, std::generic_category()};
+  }
+  *id = ToFileIdentity(metadata);
+  return {};
+}
+
 FileMapping::FileMapping(const std::string& path)
+    : FileMapping(path, Options()) {}
+
+FileMapping::FileMapping(const std::string& path, const Options& options)
     : address_(nullptr), size_(0) {
-  auto ec = MapFile(path);
+  auto ec = MapFile(path, options);
   if (ec) {
     throw std::system_error(ec);
   }
@@ -23,7 +54,26 @@ void* FileMapping::address() const { return address_; }
 
 size_t FileMapping::size() const { return size_; }
 
-std::error_code FileMapping::MapFile(const std::string& path) {
+void FileMapping::Advise(Access access) const {
+  int advice = MADV_NORMAL;
+  switch (access) {
+    case Access::kNormal:
+      advice = MADV_NORMAL;
+      break;
+    case Access::kSequential:
+      advice = MADV_SEQUENTIAL;
+      break;
+    case Access::kRandom:
+      advice = MADV_RANDOM;
+      break;
+  }
+  if (address_ && madvise(address_, size_, advice) < 0) {
+    LOG("madvise(%d) failed: %d", advice, errno);
+  }
+}
+
+std::error_code FileMapping::MapFile(const std::string& path,
+                                     const Options& options) {
   std::error_code ec;
   FILE* fp = nullptr;
   struct stat metadata;
@@ -47,12 +97,19 @@ std::error_code FileMapping::MapFile(const std::string& path) {
   }
 
   auto size = static_cast<size_t>(metadata.st_size);
-  auto address = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+  int flags = MAP_SHARED | (options.populate ? MAP_POPULATE : 0);
+  auto address = mmap(0, size, PROT_READ, flags, fd, 0);
   if (address == MAP_FAILED) {
     return {errno, std::generic_category()};
   }
+#ifdef MADV_HUGEPAGE
+  if (options.huge_pages && madvise(address, size, MADV_HUGEPAGE) < 0) {
+    LOG("huge pages not available for %s", path.c_str());
+  }
+#endif  // MADV_HUGEPAGE
   address_ = address;
   size_ = size;
+  identity_ = ToFileIdentity(metadata);
   return {};
 }
 
@@ -1,26 +1,55 @@
 #pragma once
 
+#include <sys/types.h>
+#include <time.h>
+#include <cstdint>
 #include <string>
 #include <system_error>
 
 namespace ip {
 
+// Allow to detect that a file changed since it was last accessed
+struct FileIdentity {
+  dev_t device = 0;
+  ino_t inode = 0;
+  off_t size = 0;
+  timespec mtime = {0, 0};
+};
+
+bool operator==(const FileIdentity& lhs, const FileIdentity& rhs);
+bool operator!=(const FileIdentity& lhs, const FileIdentity& rhs);
+std::error_code GetFileIdentity(const std::string& path, FileIdentity* id);
+
 class FileMapping {
  public:
+  enum class Access { kNormal, kSequential, kRandom };
+
+  struct Options {
+    bool populate = false;  // prefault pages (MAP_POPULATE)
+    bool huge_pages = false;  // if supported by the filesystem
+  };
+
   FileMapping(const std::string& path);
+  FileMapping(const std::string& path, const Options& options);
   virtual ~FileMapping();
 
   void* address() const;
   size_t size() const;
+  const uint8_t* data() const { return static_cast<uint8_t*>(address_); }
+  const FileIdentity& identity() const { return identity_; }
+
+  // hint for the kernel, applies to the whole mapping (all its users)
+  void Advise(Access access) const;
 
   operator unsigned char*() { return static_cast<unsigned char*>(address_); }
 
  private:
-  std::error_code MapFile(const std::string& path);
+  std::error_code MapFile(const std::string& path, const Options& options);
   void UnMap();
 
   void* address_;
   size_t size_;
+  FileIdentity identity_;
 };
 
 }  // namespace ip
@@ -0,0 +1,352 @@
+#include "iplayer/utils/http_client.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static const size_t kMaxIdlePerHost = 4;
+static const size_t kMaxHeaderSize = 64 * 1024;
+static const size_t kReceiveSize = 16 * 1024;
+// a server not answering at all fails the request
+static const time_t kTimeoutSeconds = 10;
+
+static std::string ToLower(std::string str) {
+  std::transform(std::begin(str), std::end(str), std::begin(str),
+                 [](char c) { return static_cast<char>(tolower(c)); });
+  return str;
+}
+
+static std::string Trim(const std::string& str) {
+  auto begin = str.find_first_not_of(" \t");
+  auto end = str.find_last_not_of(" \t\r");
+  return begin == std::string::npos ? std::string()
+                                    : str.substr(begin, end - begin + 1);
+}
+
+std::error_code ParseHttpUrl(const std::string& url, HttpUrl* parsed) {
+  const std::string kScheme = "http://";
+  if (url.compare(0, kScheme.size(), kScheme) != 0) {
+    return std::make_error_code(std::errc::invalid_argument);
+  }
+  auto host_begin = kScheme.size();
+  auto path_begin = url.find('/', host_begin);
+  auto authority = url.substr(host_begin, path_begin - host_begin);
+  parsed->path = path_begin == std::string::npos ? "/" : url.substr(path_begin);
+  // "[::1]:8000", the host is given to getaddrinfo() without the brackets
+  std::string host;
+  if (!authority.empty() && authority[0] == '[') {
+    auto bracket = authority.find(']');
+    if (bracket == std::string::npos ||
+        (bracket + 1 < authority.size() && authority[bracket + 1] != ':')) {
+      return std::make_error_code(std::errc::invalid_argument);
+    }
+    host = authority.substr(1, bracket - 1);
+    authority.erase(0, bracket + 1);
+  }
+  auto colon = authority.rfind(':');
+  parsed->port = 80;
+  if (colon != std::string::npos) {
+    auto port = strtoul(authority.c_str() + colon + 1, nullptr, 10);
+    if (port == 0 || port > 65535) {
+      return std::make_error_code(std::errc::invalid_argument);
+    }
+    parsed->port = static_cast<uint16_t>(port);
+    authority.resize(colon);
+  }
+  parsed->host = host.empty() ? authority : host;
+  return parsed->host.empty()
+             ? std::make_error_code(std::errc::invalid_argument)
+             : std::error_code();
+}
+
+uint64_t HttpResponse::RangeTotal() const {
+  // "bytes 0-99/1234"
+  auto it = headers.find("content-range");
+  if (it == std::end(headers)) {
+    return 0;
+  }
+  auto slash = it->second.find('/');
+  return slash == std::string::npos
+             ? 0
+             : strtoull(it->second.c_str() + slash + 1, nullptr, 10);
+}
+
+HttpConnection::HttpConnection(int fd, const std::string& key)
+    : fd_(fd),
+      key_(key),
+      input_begin_(0),
+      has_body_length_(true),
+      body_left_(0),
+      keep_alive_(true),
+      broken_(false),
+      aborted_(false) {}
+
+HttpConnection::~HttpConnection() { close(fd_); }
+
+std::error_code HttpConnection::Send(const std::vector<HttpRequest>& requests,
+                                     const std::string& host) {
+  std::string data;
+  for (const auto& request : requests) {
+    data += request.method + " " + request.path + " HTTP/1.1\r\nHost: " +
+            host + "\r\n";
+    if (!request.range.empty()) {
+      data += "Range: " + request.range + "\r\n";
+    }
+    data += "\r\n";
+    methods_.push_back(request.method);
+  }
+  size_t sent = 0;
+  while (sent < data.size()) {
+    auto count = send(fd_, data.data() + sent, data.size() - sent,
+                      MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      broken_ = true;
+      return {errno, std::generic_category()};
+    }
+    sent += static_cast<size_t>(count);
+  }
+  return {};
+}
+
+std::error_code HttpConnection::ReadHeader(HttpResponse* response) {
+  if (methods_.empty() || broken_ || (has_body_length_ && body_left_)) {
+    return std::make_error_code(std::errc::operation_not_permitted);
+  }
+  // pipelined responses may already be there. Searched in place, what was
+  // scanned isn't looked at again but for a terminator split by a receive.
+  static const char kHeaderEnd[] = "\r\n\r\n";
+  const size_t kHeaderEndSize = sizeof(kHeaderEnd) - 1;
+  size_t scanned = input_begin_;
+  std::vector<uint8_t>::iterator end;
+  while ((end = std::search(input_.begin() + scanned, input_.end(),
+                            kHeaderEnd, kHeaderEnd + kHeaderEndSize)) ==
+         input_.end()) {
+    scanned = std::max(input_begin_ + kHeaderEndSize - 1, input_.size()) -
+              (kHeaderEndSize - 1);
+    if (input_.size() - input_begin_ > kMaxHeaderSize) {
+      broken_ = true;
+      return std::make_error_code(std::errc::message_size);
+    }
+    uint8_t buffer[kReceiveSize];
+    std::error_code ec;
+    auto count = Receive(buffer, sizeof(buffer), ec);
+    if (count == 0) {
+      broken_ = true;
+      return ec ? ec : std::make_error_code(std::errc::connection_reset);
+    }
+    input_.insert(input_.end(), buffer, buffer + count);
+  }
+  std::string header(input_.begin() + input_begin_, end);
+  input_begin_ = static_cast<size_t>(end - input_.begin()) + kHeaderEndSize;
+  auto method = methods_.front();
+  methods_.pop_front();
+
+  *response = HttpResponse();
+  size_t line_end = header.find("\r\n");
+  auto status_line = header.substr(0, line_end);
+  if (status_line.compare(0, 5, "HTTP/") != 0 ||
+      status_line.find(' ') == std::string::npos) {
+    broken_ = true;
+    return std::make_error_code(std::errc::bad_message);
+  }
+  response->status = atoi(status_line.c_str() + status_line.find(' ') + 1);
+  while (line_end != std::string::npos) {
+    auto begin = line_end + 2;
+    line_end = header.find("\r\n", begin);
+    auto line = header.substr(begin, line_end - begin);
+    auto colon = line.find(':');
+    if (colon != std::string::npos) {
+      response->headers[ToLower(line.substr(0, colon))] =
+          Trim(line.substr(colon + 1));
+    }
+  }
+
+  auto connection = response->headers.find("connection");
+  keep_alive_ = status_line.compare(0, 8, "HTTP/1.0") != 0;
+  if (connection != std::end(response->headers)) {
+    keep_alive_ = strcasecmp(connection->second.c_str(), "close") != 0 &&
+                  (keep_alive_ ||
+                   strcasecmp(connection->second.c_str(), "keep-alive") == 0);
+  }
+  auto length = response->headers.find("content-length");
+  if (length != std::end(response->headers)) {
+    response->has_length = true;
+    response->length = strtoull(length->second.c_str(), nullptr, 10);
+  }
+  if (response->headers.count("transfer-encoding")) {
+    broken_ = true;
+    return std::make_error_code(std::errc::not_supported);
+  }
+  has_body_length_ = true;
+  body_left_ = response->length;
+  if (method == "HEAD" || response->status == 204 ||
+      response->status == 304 || response->status / 100 == 1) {
+    body_left_ = 0;
+  } else if (!response->has_length) {
+    // up to the connection's end
+    has_body_length_ = false;
+    keep_alive_ = false;
+  }
+  return {};
+}
+
+size_t HttpConnection::ReadBody(uint8_t* buffer, size_t len,
+                                std::error_code& ec) {
+  ec.clear();
+  if (has_body_length_) {
+    len = static_cast<size_t>(std::min<uint64_t>(len, body_left_));
+  }
+  if (len == 0) {
+    return 0;
+  }
+  size_t count = std::min(len, input_.size() - input_begin_);
+  if (count) {
+    memcpy(buffer, input_.data() + input_begin_, count);
+    input_begin_ += count;
+  } else {
+    count = Receive(buffer, len, ec);
+    if (count == 0) {
+      broken_ = true;
+      if (!ec && has_body_length_) {
+        ec = std::make_error_code(std::errc::connection_reset);
+      }
+    }
+  }
+  if (input_begin_ == input_.size()) {
+    input_.clear();
+    input_begin_ = 0;
+  }
+  if (has_body_length_) {
+    body_left_ -= count;
+  }
+  return count;
+}
+
+std::error_code HttpConnection::SkipBody() {
+  uint8_t buffer[kReceiveSize];
+  std::error_code ec;
+  while (ReadBody(buffer, sizeof(buffer), ec) > 0) {
+  }
+  return ec;
+}
+
+void HttpConnection::Abort() {
+  aborted_ = true;
+  shutdown(fd_, SHUT_RDWR);
+}
+
+bool HttpConnection::Reusable() const {
+  return !broken_ && !aborted_ && keep_alive_ && has_body_length_ &&
+         body_left_ == 0 && methods_.empty() && input_begin_ == input_.size();
+}
+
+bool HttpConnection::PeerClosed() const {
+  // reusable: nothing is expected, any data or end means it's unusable
+  uint8_t byte;
+  auto count = recv(fd_, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return count >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+size_t HttpConnection::Receive(uint8_t* buffer, size_t len,
+                               std::error_code& ec) {
+  while (true) {
+    auto count = recv(fd_, buffer, len, 0);
+    if (count >= 0) {
+      return static_cast<size_t>(count);
+    }
+    if (errno != EINTR) {
+      ec.assign(errno == EAGAIN ? ETIMEDOUT : errno, std::generic_category());
+      return 0;
+    }
+  }
+}
+
+HttpConnectionPool& HttpConnectionPool::Instance() {
+  static HttpConnectionPool pool(kMaxIdlePerHost);
+  return pool;
+}
+
+HttpConnectionPool::HttpConnectionPool(size_t max_idle_per_host)
+    : max_idle_per_host_(max_idle_per_host), connects_(0) {}
+
+HttpConnectionPtr HttpConnectionPool::Acquire(const HttpUrl& url,
+                                              std::error_code& ec) {
+  ec.clear();
+  auto key = url.host + ":" + std::to_string(url.port);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = idle_.find(key); it != std::end(idle_) && it->first == key;
+         it = idle_.erase(it)) {
+      if (!it->second->PeerClosed()) {
+        auto connection = std::move(it->second);
+        idle_.erase(it);
+        return connection;
+      }
+    }
+  }
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  int error = getaddrinfo(url.host.c_str(), std::to_string(url.port).c_str(),
+                          &hints, &addresses);
+  if (error) {
+    LOG("[E] cannot resolve %s: %s", url.host.c_str(), gai_strerror(error));
+    ec = std::make_error_code(std::errc::host_unreachable);
+    return nullptr;
+  }
+  int fd = -1;
+  ec = std::make_error_code(std::errc::host_unreachable);
+  for (auto address = addresses; address && fd < 0;
+       address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC,
+                address->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    timeval timeout{kTimeoutSeconds, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+      ec.assign(errno, std::generic_category());
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    return nullptr;
+  }
+  ec.clear();
+  ++connects_;
+  return std::make_unique<HttpConnection>(fd, key);
+}
+
+void HttpConnectionPool::Release(HttpConnectionPtr connection) {
+  if (!connection || !connection->Reusable()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (idle_.count(connection->Key()) >= max_idle_per_host_) {
+    return;
+  }
+  auto key = connection->Key();
+  idle_.emplace(key, std::move(connection));
+}
+
+}  // namespace ip
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Minimal HTTP/1.1 client for remote tracks: connections are kept alive and
+// pooled per host, several requests can be sent at once (pipelining, their
+// responses come back in order) and bodies are read progressively. Only
+// bodies with a Content-Length (or up to the connection's end) are
+// supported, not chunked ones.
+
+namespace ip {
+
+struct HttpUrl {
+  std::string host;
+  uint16_t port = 80;
+  std::string path;  // with the query, "/" at least
+};
+
+std::error_code ParseHttpUrl(const std::string& url, HttpUrl* parsed);
+
+struct HttpRequest {
+  std::string method;
+  std::string path;
+  std::string range;  // "bytes=0-99" or "bytes=-128", none when empty
+};
+
+struct HttpResponse {
+  int status = 0;
+  std::map<std::string, std::string> headers;  // names in lower case
+  bool has_length = false;
+  uint64_t length = 0;  // of the body
+
+  // total size from a 206's Content-Range, 0 if unknown
+  uint64_t RangeTotal() const;
+};
+
+class HttpConnection {
+ public:
+  HttpConnection(int fd, const std::string& key);
+  ~HttpConnection();
+
+  // written at once, responses are read in the same order
+  std::error_code Send(const std::vector<HttpRequest>& requests,
+                       const std::string& host);
+  // status and headers of the next response
+  std::error_code ReadHeader(HttpResponse* response);
+  // up to 'len' bytes of the current response's body, 0 at its end
+  size_t ReadBody(uint8_t* buffer, size_t len, std::error_code& ec);
+  std::error_code SkipBody();
+
+  // Unblock a Send()/Read*() from another thread, for good
+  void Abort();
+
+  // current body read to its end and the server keeps the connection
+  bool Reusable() const;
+  // an idle connection the server closed meanwhile
+  bool PeerClosed() const;
+  const std::string& Key() const { return key_; }
+
+ private:
+  size_t Receive(uint8_t* buffer, size_t len, std::error_code& ec);
+
+  int fd_;
+  std::string key_;  // host:port
+  std::deque<std::string> methods_;  // of the responses still to read
+  std::vector<uint8_t> input_;  // received, not consumed yet
+  size_t input_begin_;
+  bool has_body_length_;
+  uint64_t body_left_;
+  bool keep_alive_;
+  bool broken_;  // error or a body to read until the connection's end
+  std::atomic<bool> aborted_;
+};
+
+using HttpConnectionPtr = std::unique_ptr<HttpConnection>;
+
+class HttpConnectionPool {
+ public:
+  static HttpConnectionPool& Instance();
+
+  explicit HttpConnectionPool(size_t max_idle_per_host);
+
+  // an idle connection to 'url' host, or a new one
+  HttpConnectionPtr Acquire(const HttpUrl& url, std::error_code& ec);
+  // kept for later if reusable
+  void Release(HttpConnectionPtr connection);
+
+  uint64_t Connects() const { return connects_; }  // opened so far
+
+ private:
+  std::mutex mutex_;
+  size_t max_idle_per_host_;
+  std::multimap<std::string, HttpConnectionPtr> idle_;
+  std::atomic<uint64_t> connects_;
+};
+
+}  // namespace ip
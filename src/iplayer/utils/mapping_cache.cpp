@@ -0,0 +1,127 @@
+#include "iplayer/utils/mapping_cache.h"
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+static const size_t kDefaultBudget = 256 * 1024 * 1024;
+
+MappingCache& MappingCache::Instance() {
+  static MappingCache cache(kDefaultBudget);
+  return cache;
+}
+
+MappingCache::MappingCache(size_t budget) : budget_(budget), cached_size_(0) {}
+
+void MappingCache::SetBudget(size_t budget) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  budget_ = budget;
+  Evict(budget_);
+}
+
+size_t MappingCache::Budget() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return budget_;
+}
+
+size_t MappingCache::CachedSize() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cached_size_;
+}
+
+MappingCache::MappingPtr MappingCache::Get(const std::string& path,
+                                           FileMapping::Access access,
+                                           std::error_code& ec) {
+  return Get(path, access, FileMapping::Options(), ec);
+}
+
+MappingCache::MappingPtr MappingCache::Get(const std::string& path,
+                                           FileMapping::Access access,
+                                           const FileMapping::Options& options,
+                                           std::error_code& ec) {
+  FileIdentity id;
+  ec = GetFileIdentity(path, &id);
+  if (ec) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto mapping = Lookup(path, id);
+    if (mapping) {
+      mapping->Advise(access);
+      return mapping;
+    }
+  }
+
+  // map without holding the lock, two threads might map the same file at
+  // the same time: the last one replaces the other in the cache
+  MappingPtr mapping;
+  try {
+    mapping = std::make_shared<const FileMapping>(path, options);
+  } catch (const std::system_error& ex) {
+    ec = ex.code();
+    return nullptr;
+  }
+  mapping->Advise(access);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (mapping->size() > budget_) {
+    return mapping;  // too big to be cached
+  }
+  auto it = entries_.find(path);
+  if (it != std::end(entries_)) {
+    cached_size_ -= it->second->second->size();
+    lru_.erase(it->second);
+    entries_.erase(it);
+  }
+  Evict(budget_ - mapping->size());
+  lru_.emplace_front(path, mapping);
+  entries_[path] = std::begin(lru_);
+  cached_size_ += mapping->size();
+  return mapping;
+}
+
+MappingCache::MappingPtr MappingCache::Find(const std::string& path,
+                                            FileMapping::Access access) {
+  FileIdentity id;
+  if (GetFileIdentity(path, &id)) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto mapping = Lookup(path, id);
+  if (mapping) {
+    mapping->Advise(access);
+  }
+  return mapping;
+}
+
+MappingCache::MappingPtr MappingCache::Lookup(const std::string& path,
+                                              const FileIdentity& id) {
+  // private method so no synchronization
+  auto it = entries_.find(path);
+  if (it == std::end(entries_)) {
+    return nullptr;
+  }
+  auto lru_it = it->second;
+  if (lru_it->second->identity() != id) {
+    LOG("[D] %s changed, dropping its mapping", path.c_str());
+    cached_size_ -= lru_it->second->size();
+    lru_.erase(lru_it);
+    entries_.erase(it);
+    return nullptr;
+  }
+  lru_.splice(std::begin(lru_), lru_, lru_it);
+  return lru_it->second;
+}
+
+void MappingCache::Evict(size_t budget) {
+  // private method so no synchronization
+  while (cached_size_ > budget && !lru_.empty()) {
+    auto& entry = lru_.back();
+    cached_size_ -= entry.second->size();
+    entries_.erase(entry.first);
+    lru_.pop_back();
+  }
+}
+
+}  // namespace ip
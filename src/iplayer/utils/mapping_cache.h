@@ -0,0 +1,52 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "iplayer/utils/file_mapping.h"
+
+// Process-wide LRU cache of file mappings shared between their users (track
+// info extraction, decoding, repeated playback...). Mappings are reference
+// counted: an evicted mapping stays valid until its last user releases it,
+// the budget only bounds what the cache keeps alive by itself.
+
+namespace ip {
+
+class MappingCache {
+ public:
+  using MappingPtr = std::shared_ptr<const FileMapping>;
+
+  static MappingCache& Instance();
+
+  MappingCache(size_t budget);  // budget: bytes kept mapped by the cache
+
+  void SetBudget(size_t budget);
+  size_t Budget() const;
+  size_t CachedSize() const;
+
+  // get a cached mapping or map the file, 'access' is applied to the mapping
+  MappingPtr Get(const std::string& path, FileMapping::Access access,
+                 std::error_code& ec);
+  MappingPtr Get(const std::string& path, FileMapping::Access access,
+                 const FileMapping::Options& options, std::error_code& ec);
+
+  // get a mapping only if cached and still valid, nullptr otherwise
+  MappingPtr Find(const std::string& path, FileMapping::Access access);
+
+ private:
+  using Entry = std::pair<std::string, MappingPtr>;
+
+  MappingPtr Lookup(const std::string& path, const FileIdentity& id);
+  void Evict(size_t budget);
+
+  mutable std::mutex mutex_;
+  size_t budget_;
+  size_t cached_size_;
+  std::list<Entry> lru_;  // most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+};
+
+}  // namespace ip
@@ -0,0 +1,62 @@
+#include "iplayer/utils/spsc_ring.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace ip {
+
+static size_t RoundUpPowerOf2(size_t value) {
+  size_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+SpscRing::SpscRing(size_t capacity)
+    : buffer_(RoundUpPowerOf2(std::max<size_t>(capacity, 1))),
+      mask_(buffer_.size() - 1),
+      write_pos_(0),
+      read_pos_(0) {}
+
+size_t SpscRing::Write(const uint8_t* data, size_t len) {
+  auto write_pos = write_pos_.load(std::memory_order_relaxed);
+  auto read_pos = read_pos_.load(std::memory_order_acquire);
+  len = std::min(len, Capacity() - (write_pos - read_pos));
+
+  auto index = write_pos & mask_;
+  auto first = std::min(len, Capacity() - index);
+  memcpy(buffer_.data() + index, data, first);
+  memcpy(buffer_.data(), data + first, len - first);
+
+  write_pos_.store(write_pos + len, std::memory_order_release);
+  return len;
+}
+
+size_t SpscRing::Read(uint8_t* data, size_t len) {
+  auto read_pos = read_pos_.load(std::memory_order_relaxed);
+  auto write_pos = write_pos_.load(std::memory_order_acquire);
+  len = std::min(len, write_pos - read_pos);
+
+  auto index = read_pos & mask_;
+  auto first = std::min(len, Capacity() - index);
+  memcpy(data, buffer_.data() + index, first);
+  memcpy(data + first, buffer_.data(), len - first);
+
+  read_pos_.store(read_pos + len, std::memory_order_release);
+  return len;
+}
+
+void SpscRing::Clear() {
+  read_pos_.store(write_pos_.load(std::memory_order_acquire),
+                  std::memory_order_release);
+}
+
+size_t SpscRing::Size() const {
+  // read_pos_ first: it can't go past a write_pos_ loaded afterwards
+  auto read_pos = read_pos_.load(std::memory_order_acquire);
+  auto write_pos = write_pos_.load(std::memory_order_acquire);
+  return write_pos - read_pos;
+}
+
+}  // namespace ip
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ip {
+
+// Lock-free ring of bytes for a single producer and a single consumer: one
+// thread may call Write() while another one calls Read() or Clear(), Size()
+// and Free() are safe from both (but only a snapshot). Nothing blocks, the
+// caller decides how to wait when the ring is full/empty.
+
+class SpscRing {
+ public:
+  explicit SpscRing(size_t capacity);  // rounded up to a power of 2
+
+  size_t Write(const uint8_t* data, size_t len);  // returns bytes written
+  size_t Read(uint8_t* data, size_t len);         // returns bytes read
+  void Clear();  // consumer side, drop everything readable
+
+  size_t Size() const;  // readable bytes
+  size_t Free() const { return Capacity() - Size(); }
+  size_t Capacity() const { return mask_ + 1; }
+
+ private:
+  static const size_t kCacheLineSize = 64;
+
+  std::vector<uint8_t> buffer_;
+  size_t mask_;
+  // positions only grow (index is position & mask_), each one is written by
+  // a single side and kept on its own cache line to avoid false sharing
+  char padding0_[kCacheLineSize];
+  std::atomic<size_t> write_pos_;
+  char padding1_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> read_pos_;
+  char padding2_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+};
+
+}  // namespace ip
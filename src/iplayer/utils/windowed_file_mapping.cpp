@@ -0,0 +1,102 @@
+#include "iplayer/utils/windowed_file_mapping.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+WindowedFileMapping::WindowedFileMapping(size_t window_size)
+    : fd_(-1),
+      size_(0),
+      window_size_(window_size),
+      window_(nullptr),
+      window_offset_(0),
+      window_length_(0) {}
+
+WindowedFileMapping::~WindowedFileMapping() { Close(); }
+
+std::error_code WindowedFileMapping::Open(const std::string& path) {
+  Close();
+  fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    return {errno, std::generic_category()};
+  }
+  struct stat metadata;
+  if (fstat(fd_, &metadata) < 0) {
+    std::error_code ec{errno, std::generic_category()};
+    Close();
+    return ec;
+  }
+  size_ = static_cast<uint64_t>(metadata.st_size);
+  return {};
+}
+
+void WindowedFileMapping::Close() {
+  Release();
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  size_ = 0;
+}
+
+void WindowedFileMapping::Release() {
+  if (!window_) {
+    return;
+  }
+  // drop pages right away, they won't be read again through this mapping
+  madvise(window_, window_length_, MADV_DONTNEED);
+  if (munmap(window_, window_length_)) {
+    LOG("failed to munmap window: %d", errno);
+  }
+  window_ = nullptr;
+  window_length_ = 0;
+}
+
+const uint8_t* WindowedFileMapping::Map(uint64_t offset, size_t len,
+                                        size_t* available,
+                                        std::error_code& ec) {
+  ec.clear();
+  *available = 0;
+  if (offset >= size_) {
+    return nullptr;
+  }
+  len = static_cast<size_t>(std::min<uint64_t>(len, size_ - offset));
+
+  // current window already contains the range
+  if (window_ && offset >= window_offset_ &&
+      offset + len <= window_offset_ + window_length_) {
+    auto delta = static_cast<size_t>(offset - window_offset_);
+    *available = window_length_ - delta;
+    return static_cast<const uint8_t*>(window_) + delta;
+  }
+
+  Release();
+  static const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  const uint64_t window_offset = offset - offset % page_size;
+  const auto delta = static_cast<size_t>(offset - window_offset);
+  const auto length = static_cast<size_t>(std::min<uint64_t>(
+      std::max(window_size_, delta + len), size_ - window_offset));
+
+  auto address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd_,
+                      static_cast<off_t>(window_offset));
+  if (address == MAP_FAILED) {
+    ec.assign(errno, std::generic_category());
+    return nullptr;
+  }
+  madvise(address, length, MADV_SEQUENTIAL);
+  madvise(address, length, MADV_WILLNEED);
+
+  window_ = address;
+  window_offset_ = window_offset;
+  window_length_ = length;
+  *available = length - delta;
+  return static_cast<const uint8_t*>(window_) + delta;
+}
+
+}  // namespace ip
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+// Map a fixed size window of a file instead of the whole file: the window is
+// moved where data is requested, the previous one is released. Resident and
+// virtual memory are bounded by the window size whatever the file size.
+
+namespace ip {
+
+class WindowedFileMapping {
+ public:
+  WindowedFileMapping(size_t window_size);
+  virtual ~WindowedFileMapping();
+
+  std::error_code Open(const std::string& path);
+  void Close();
+
+  uint64_t size() const { return size_; }
+
+  // Return a pointer to 'offset', mapping a new window if needed. At least
+  // 'len' bytes are available unless end of file is reached, '*available'
+  // is set with the number of bytes readable from the returned pointer.
+  const uint8_t* Map(uint64_t offset, size_t len, size_t* available,
+                     std::error_code& ec);
+
+ private:
+  void Release();
+
+  int fd_;
+  uint64_t size_;
+  size_t window_size_;
+  void* window_;
+  uint64_t window_offset_;
+  size_t window_length_;
+};
+
+}  // namespace ip
@@ -0,0 +1,379 @@
+#include "iplayer/audio_output.h"
+
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ip {
+
+// what reached the sink, shared with the test as AudioOutput owns the sink
+struct Collected {
+  std::mutex mutex;
+  std::vector<uint8_t> bytes;
+  bool misaligned = false;
+  int opened = 0;
+  int flushed = 0;
+
+  std::vector<uint8_t> Bytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+  }
+};
+
+class CollectorSink : public IAudioSink {
+ public:
+  CollectorSink(std::shared_ptr<Collected> collected,
+                std::chrono::milliseconds delay = {})
+      : collected_(collected), delay_(delay), frame_size_(1) {}
+
+  std::error_code Open(const AudioFormat& format) override {
+    std::lock_guard<std::mutex> lock(collected_->mutex);
+    ++collected_->opened;
+    frame_size_ = format.BytesPerFrame();
+    return {};
+  }
+  std::error_code Write(const uint8_t* data, size_t len) override {
+    std::this_thread::sleep_for(delay_);
+    std::lock_guard<std::mutex> lock(collected_->mutex);
+    if (len % frame_size_) {
+      collected_->misaligned = true;
+    }
+    collected_->bytes.insert(collected_->bytes.end(), data, data + len);
+    return {};
+  }
+  std::error_code Drain() override { return {}; }
+  void Flush() override {
+    std::lock_guard<std::mutex> lock(collected_->mutex);
+    ++collected_->flushed;
+  }
+  void Close() override {}
+
+ private:
+  std::shared_ptr<Collected> collected_;
+  std::chrono::milliseconds delay_;
+  size_t frame_size_;
+};
+
+class FailingSink : public CollectorSink {
+ public:
+  FailingSink() : CollectorSink(std::make_shared<Collected>()) {}
+  std::error_code Write(const uint8_t*, size_t) override {
+    return std::make_error_code(std::errc::io_error);
+  }
+};
+
+const AudioFormat kCdFormat{SampleFormat::kS16, 44100, 2};
+
+std::vector<uint8_t> CreateData(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<uint8_t>(i % 253);
+  }
+  return data;
+}
+
+bool WaitFor(std::function<bool()> condition) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+bool CaseWriteDrain() {
+  auto collected = std::make_shared<Collected>();
+  AudioOutput::Options options;
+  options.buffer_size = 4096;
+  options.period_size = 1024;
+  AudioOutput output(std::make_unique<CollectorSink>(collected), options);
+  if (output.Configure(kCdFormat)) {
+    return false;
+  }
+
+  // bigger than the ring, written by frames
+  auto data = CreateData(1024 * 1024);
+  for (size_t pos = 0; pos < data.size(); pos += 4608) {
+    auto len = std::min<size_t>(4608, data.size() - pos);
+    if (output.Write(data.data() + pos, len)) {
+      return false;
+    }
+  }
+  if (output.Drain()) {
+    return false;
+  }
+  auto stats = output.GetStats();
+  return collected->Bytes() == data && !collected->misaligned &&
+         stats.fill == 0 && stats.capacity == 4096 && stats.overruns > 0 &&
+         output.BytesPerSecond() == 44100 * 4;
+}
+
+// the sink is only reopened when the format changes and successive streams
+// aren't separated by a drain
+bool CaseSuccessiveStreams() {
+  auto collected = std::make_shared<Collected>();
+  AudioOutput output(std::make_unique<CollectorSink>(collected));
+  auto data = CreateData(64 * 1024);
+  for (int i = 0; i < 3; ++i) {
+    if (output.Configure(kCdFormat) || output.Write(data.data(), data.size())) {
+      return false;
+    }
+    output.EndOfStream();
+  }
+  if (collected->opened != 1) {
+    return false;
+  }
+  // previous format is played before reopening
+  if (output.Configure({SampleFormat::kFloat, 48000, 2}) ||
+      collected->Bytes().size() != 3 * data.size() || collected->opened != 2) {
+    return false;
+  }
+  return output.Write(data.data(), 8) == std::error_code() &&
+         output.Drain() == std::error_code() && !collected->misaligned;
+}
+
+// while paused the sink isn't fed and the producer sleeps once the ring is
+// full
+bool CasePause() {
+  auto collected = std::make_shared<Collected>();
+  AudioOutput::Options options;
+  options.buffer_size = 4096;
+  AudioOutput output(std::make_unique<CollectorSink>(collected), options);
+  output.Configure(kCdFormat);
+  output.Pause();
+
+  auto data = CreateData(16 * 1024);
+  std::atomic<bool> done(false);
+  auto producer = std::async(std::launch::async, [&]() {
+    auto ec = output.Write(data.data(), data.size());
+    done = true;
+    return ec;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  auto stats = output.GetStats();
+  if (done || !collected->Bytes().empty() || stats.fill != 4096 ||
+      stats.overruns != 0) {
+    return false;
+  }
+  output.Unpause();
+  if (producer.get() || output.Drain()) {
+    return false;
+  }
+  return collected->Bytes() == data;
+}
+
+// slow producer starves the sink
+bool CaseUnderrun() {
+  auto collected = std::make_shared<Collected>();
+  AudioOutput output(std::make_unique<CollectorSink>(collected));
+  output.Configure(kCdFormat);
+  auto data = CreateData(400);
+  for (uint64_t i = 0; i < 3; ++i) {
+    output.Write(data.data(), data.size());
+    // the sink got it all and the output thread found the ring empty
+    // behind it, next write comes late whatever the scheduling
+    if (!WaitFor([&]() {
+          return collected->Bytes().size() == (i + 1) * data.size() &&
+                 output.GetStats().underruns > i;
+        })) {
+      return false;
+    }
+  }
+  output.Drain();
+  return output.GetStats().underruns >= 3 && collected->Bytes().size() == 1200;
+}
+
+// stopping a track: producer is unblocked, what's buffered is dropped and
+// the session is still usable
+bool CaseInterruptFlush() {
+  auto collected = std::make_shared<Collected>();
+  AudioOutput::Options options;
+  options.buffer_size = 4096;
+  options.period_size = 256;
+  AudioOutput output(std::make_unique<CollectorSink>(
+                         collected, std::chrono::milliseconds(20)),
+                     options);
+  output.Configure(kCdFormat);
+  auto data = CreateData(64 * 1024);
+  auto producer = std::async(std::launch::async, [&]() {
+    return output.Write(data.data(), data.size());
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  output.Interrupt();
+  if (producer.get() != std::errc::operation_canceled) {
+    return false;
+  }
+  output.Flush();
+  if (output.GetStats().fill != 0 || collected->flushed != 1 ||
+      collected->Bytes().size() >= data.size()) {
+    return false;
+  }
+  // interruption ends with next stream
+  auto played = collected->Bytes().size();
+  if (output.Configure(kCdFormat) || output.Write(data.data(), 1024) ||
+      output.Drain()) {
+    return false;
+  }
+  return collected->Bytes().size() == played + 1024;
+}
+
+bool CaseStopUnblocksProducer() {
+  auto collected = std::make_shared<Collected>();
+  AudioOutput::Options options;
+  options.buffer_size = 1024;
+  options.period_size = 256;
+  AudioOutput output(std::make_unique<CollectorSink>(
+                         collected, std::chrono::milliseconds(50)),
+                     options);
+  output.Configure(kCdFormat);
+  auto data = CreateData(64 * 1024);
+  auto producer = std::async(std::launch::async, [&]() {
+    return output.Write(data.data(), data.size());
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  output.Stop();
+  return producer.get() == std::errc::operation_canceled;
+}
+
+// a sink error fails the stream, next stream reopens the sink
+bool CaseSinkError() {
+  AudioOutput output(std::make_unique<FailingSink>());
+  output.Configure(kCdFormat);
+  auto data = CreateData(1024 * 1024);
+  auto ec = output.Write(data.data(), data.size());
+  if (!ec) {
+    ec = output.Drain();
+  }
+  if (ec != std::errc::io_error) {
+    return false;
+  }
+  return output.Configure(kCdFormat) == std::error_code() &&
+         output.Write(data.data(), 4) == std::error_code();
+}
+
+std::vector<uint8_t> CreateConstant(int16_t value, size_t frames) {
+  std::vector<int16_t> samples(2 * frames, value);
+  std::vector<uint8_t> data(samples.size() * sizeof(int16_t));
+  memcpy(data.data(), samples.data(), data.size());
+  return data;
+}
+
+int16_t SampleAt(const std::vector<uint8_t>& bytes, size_t frame) {
+  int16_t sample;
+  memcpy(&sample, bytes.data() + frame * kCdFormat.BytesPerFrame(),
+         sizeof(sample));
+  return sample;
+}
+
+// without fade, streams of the two lanes are played in the order they
+// started
+bool CaseLanesInOrder() {
+  auto collected = std::make_shared<Collected>();
+  AudioOutput output(std::make_unique<CollectorSink>(collected));
+  auto* partner = output.Partner();
+  auto first = CreateConstant(1, 4000);
+  auto second = CreateConstant(2, 4000);
+  output.Pause();
+  if (output.Configure(kCdFormat) ||
+      output.Write(first.data(), first.size()) ||
+      partner->Configure(kCdFormat) ||
+      partner->Write(second.data(), second.size())) {
+    return false;
+  }
+  output.EndOfStream();
+  output.Unpause();
+  if (partner->Drain()) {
+    return false;
+  }
+  auto bytes = collected->Bytes();
+  return bytes.size() == first.size() + second.size() &&
+         SampleAt(bytes, 3999) == 1 && SampleAt(bytes, 4000) == 2 &&
+         partner->Partner() == &output;
+}
+
+// an ended stream fades over its last frames, one still written is cut
+// once the overlap is over: the count of frames played is exact
+bool CaseCrossfade() {
+  const size_t kFrames = 8000;
+  const size_t kOverlap = 4410;  // 100ms
+  auto out_data = CreateConstant(10000, kFrames);
+  auto in_data = CreateConstant(20000, kFrames);
+  for (bool ended : {true, false}) {
+    auto collected = std::make_shared<Collected>();
+    AudioOutput output(std::make_unique<CollectorSink>(collected));
+    auto* partner = output.Partner();
+    output.SetCrossfade(std::chrono::milliseconds(100));
+    output.Pause();
+    if (output.Configure(kCdFormat) ||
+        output.Write(out_data.data(), out_data.size())) {
+      return false;
+    }
+    if (ended) {
+      output.EndOfStream();
+    }
+    output.FadeOut();
+    if (partner->Configure(kCdFormat) ||
+        partner->Write(in_data.data(), in_data.size())) {
+      return false;
+    }
+    output.Unpause();
+    if (partner->Drain()) {
+      return false;
+    }
+    auto bytes = collected->Bytes();
+    size_t fade_start = ended ? kFrames - kOverlap : 0;
+    size_t mid = fade_start + kOverlap / 2;
+    if (bytes.size() != (fade_start + kFrames) * kCdFormat.BytesPerFrame() ||
+        SampleAt(bytes, fade_start) != 10000 ||
+        abs(SampleAt(bytes, mid) - 21213) > 2 ||
+        SampleAt(bytes, fade_start + kOverlap) != 20000 ||
+        (ended && SampleAt(bytes, 0) != 10000)) {
+      return false;
+    }
+    // a cut stream is told to stop
+    auto ec = output.Write(out_data.data(), 4);
+    if (ended ? ec != std::error_code()
+              : ec != std::errc::operation_canceled) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseWriteDrain()) {
+    return 1;
+  }
+  if (!ip::CaseSuccessiveStreams()) {
+    return 1;
+  }
+  if (!ip::CasePause()) {
+    return 1;
+  }
+  if (!ip::CaseUnderrun()) {
+    return 1;
+  }
+  if (!ip::CaseInterruptFlush()) {
+    return 1;
+  }
+  if (!ip::CaseStopUnblocksProducer()) {
+    return 1;
+  }
+  if (!ip::CaseSinkError()) {
+    return 1;
+  }
+  if (!ip::CaseLanesInOrder()) {
+    return 1;
+  }
+  if (!ip::CaseCrossfade()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "iplayer/audio_sink_factory.h"
+#include "iplayer/file_audio_sink.h"
+#include "iplayer/null_audio_sink.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace ip {
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                              std::istreambuf_iterator<char>());
+}
+
+uint32_t ReadLe(const std::vector<uint8_t>& bytes, size_t offset,
+                size_t size) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < size; ++i) {
+    value |= static_cast<uint32_t>(bytes[offset + i]) << (8 * i);
+  }
+  return value;
+}
+
+bool CaseWavFile() {
+  std::string path = "/tmp/iplayer_audio_sink_test.wav";
+  std::vector<uint8_t> pcm(4000, 0x5a);
+  {
+    FileAudioSink sink(path);
+    AudioFormat format{SampleFormat::kS16, 44100, 2};
+    if (sink.Open(format) || sink.Open(format)) {
+      return false;
+    }
+    if (sink.Write(pcm.data(), 1000) || sink.Write(pcm.data(), 3000)) {
+      return false;
+    }
+    // a WAV file can't change format
+    if (sink.Open({SampleFormat::kFloat, 48000, 2}) !=
+        std::errc::not_supported) {
+      return false;
+    }
+  }  // header is completed on close
+  auto file = ReadFile(path);
+  unlink(path.c_str());
+  return file.size() == 44 + 4000 &&
+         std::string(file.begin(), file.begin() + 4) == "RIFF" &&
+         ReadLe(file, 4, 4) == 36 + 4000 &&
+         std::string(file.begin() + 8, file.begin() + 16) == "WAVEfmt " &&
+         ReadLe(file, 20, 2) == 1 && ReadLe(file, 22, 2) == 2 &&
+         ReadLe(file, 24, 4) == 44100 && ReadLe(file, 28, 4) == 44100 * 4 &&
+         ReadLe(file, 32, 2) == 4 && ReadLe(file, 34, 2) == 16 &&
+         std::string(file.begin() + 36, file.begin() + 40) == "data" &&
+         ReadLe(file, 40, 4) == 4000 && file.back() == 0x5a;
+}
+
+bool CaseRawFile() {
+  std::string path = "/tmp/iplayer_audio_sink_test.raw";
+  std::vector<uint8_t> pcm{1, 2, 3, 4, 5, 6, 7, 8};
+  {
+    FileAudioSink sink(path);
+    if (sink.Write(pcm.data(), pcm.size()) != std::errc::bad_file_descriptor) {
+      return false;
+    }
+    if (sink.Open({SampleFormat::kFloat, 48000, 1}) ||
+        sink.Write(pcm.data(), pcm.size())) {
+      return false;
+    }
+  }
+  auto file = ReadFile(path);
+  unlink(path.c_str());
+  return file == pcm;
+}
+
+bool CaseFactory() {
+  std::string argument;
+  AudioSinkFactory factory;
+  factory.Register("null", [](const std::string&) -> IAudioSinkPtr {
+    return std::make_unique<NullAudioSink>();
+  });
+  factory.Register("file", [&argument](const std::string& path) {
+    argument = path;
+    return std::make_unique<FileAudioSink>(path);
+  });
+
+  auto sink = factory.Create("null");
+  std::vector<uint8_t> pcm(16);
+  if (!sink || sink->Open({SampleFormat::kS16, 44100, 2}) ||
+      sink->Write(pcm.data(), pcm.size())) {
+    return false;
+  }
+  if (static_cast<NullAudioSink*>(sink.get())->BytesWritten() != 16) {
+    return false;
+  }
+  if (!factory.Create("file:/tmp/a:b.wav") || argument != "/tmp/a:b.wav") {
+    return false;
+  }
+  return factory.Create("pulse") == nullptr;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseWavFile()) {
+    return 1;
+  }
+  if (!ip::CaseRawFile()) {
+    return 1;
+  }
+  if (!ip::CaseFactory()) {
+    return 1;
+  }
+  return 0;
+}
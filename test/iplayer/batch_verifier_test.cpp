@@ -0,0 +1,173 @@
+#include "iplayer/batch_verifier.h"
+
+#include <atomic>
+#include <future>
+#include <set>
+#include <thread>
+
+namespace ip {
+
+const AudioFormat kCdFormat{SampleFormat::kS16, 44100, 2};
+
+class FakeTrackProvider : public ITrackProvider {
+ public:
+  std::error_code List(const std::string&,
+                       std::vector<TrackLocation>*) const override {
+    return {};
+  }
+  TrackInfo GetTrackInfo(const TrackLocation& location) override {
+    if (location.find("missing") != std::string::npos) {
+      throw std::system_error(
+          std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+    return TrackInfo{location, "title", 1, std::chrono::seconds(1), "fake"};
+  }
+  ITrackIOPtr OpenTrack(const TrackLocation&, std::error_code&) override {
+    return {};
+  }
+};
+
+// decodes in flight, and the most seen at once
+std::atomic<int> g_decoding(0);
+std::atomic<int> g_peak_decoding(0);
+
+// "decode" one second of audio, slowly enough to see workers overlap
+class FakeDecoder : public IDecoder {
+ public:
+  FakeDecoder(const TrackInfo& track, ITrackIOPtr, AudioOutput* output,
+              CompletionCb completion_cb) {
+    future_ = std::async(std::launch::async, [=]() {
+      auto decoding = ++g_decoding;
+      auto peak = g_peak_decoding.load();
+      while (decoding > peak &&
+             !g_peak_decoding.compare_exchange_weak(peak, decoding)) {
+      }
+      std::error_code ec;
+      if (track.Location().find("broken") != std::string::npos) {
+        ec = std::make_error_code(std::errc::bad_message);
+      } else {
+        ec = Decode(output, track.Location().find("damaged") !=
+                                std::string::npos);
+      }
+      --g_decoding;
+      completion_cb(ec);
+    });
+  }
+  ~FakeDecoder() { future_.wait(); }
+
+  void Pause() override {}
+  void Unpause() override {}
+  void Seek(std::chrono::milliseconds) override {}
+  std::chrono::seconds GetPlayedTime() const override {
+    return std::chrono::seconds(0);
+  }
+  DecoderStats GetStats() const override { return stats_; }
+
+ private:
+  std::error_code Decode(AudioOutput* output, bool damaged) {
+    auto ec = output->Configure(kCdFormat);
+    std::vector<uint8_t> frame(4 * 1102, 0);  // 25ms
+    for (int i = 0; i < 40 && !ec; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      ec = output->Write(frame.data(), frame.size());
+      ++stats_.frames;
+    }
+    stats_.frame_errors = damaged ? 2 : 0;
+    stats_.decoded = std::chrono::milliseconds(1000);
+    output->EndOfStream();
+    return ec;
+  }
+
+  DecoderStats stats_;
+  std::future<void> future_;
+};
+
+class CountingSink : public IAudioSink {
+ public:
+  explicit CountingSink(std::atomic<uint64_t>* bytes) : bytes_(bytes) {}
+  std::error_code Open(const AudioFormat&) override { return {}; }
+  std::error_code Write(const uint8_t*, size_t len) override {
+    *bytes_ += len;
+    return {};
+  }
+  std::error_code Drain() override { return {}; }
+  void Flush() override {}
+  void Close() override {}
+
+ private:
+  std::atomic<uint64_t>* bytes_;
+};
+
+bool CaseVerify() {
+  std::atomic<uint64_t> bytes(0);
+  BatchVerifier::Options options;
+  options.jobs = 4;
+  BatchVerifier verifier(
+      [](const TrackLocation& location) -> ITrackProviderPtr {
+        if (location.compare(0, 7, "fake://") != 0) {
+          return nullptr;
+        }
+        return std::make_unique<FakeTrackProvider>();
+      },
+      [](const std::string& codec, const TrackInfo& info, ITrackIOPtr io,
+         AudioOutput* output, IDecoder::CompletionCb cb) -> IDecoderPtr {
+        if (codec != "fake") {
+          return nullptr;
+        }
+        return std::make_unique<FakeDecoder>(info, std::move(io), output, cb);
+      },
+      [&bytes](const TrackInfo&) {
+        return std::make_unique<CountingSink>(&bytes);
+      },
+      options);
+
+  std::vector<TrackLocation> locations;
+  for (int i = 0; i < 12; ++i) {
+    locations.push_back("fake://track" + std::to_string(i));
+  }
+  locations.push_back("fake://broken");
+  locations.push_back("fake://damaged");
+  locations.push_back("fake://missing");
+  locations.push_back("unknown://track");
+
+  std::set<TrackLocation> reported;
+  auto results = verifier.Run(locations, [&](const VerifyResult& result) {
+    reported.insert(result.location);  // never called concurrently
+  });
+
+  if (results.size() != locations.size() ||
+      reported.size() != locations.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < 12; ++i) {
+    const auto& result = results[i];
+    if (result.location != locations[i] || result.ec ||
+        result.stats.decoded != std::chrono::milliseconds(1000) ||
+        result.duration != std::chrono::milliseconds(1000) ||
+        result.Speed() <= 1) {
+      return false;
+    }
+  }
+  if (results[12].ec != std::errc::bad_message ||
+      results[13].ec || results[13].stats.frame_errors != 2 ||
+      results[14].ec != std::errc::no_such_file_or_directory ||
+      results[15].ec != std::errc::protocol_not_supported) {
+    return false;
+  }
+  // every decoded track went through its sink
+  if (bytes != 13 * 40 * 4 * 1102) {
+    return false;
+  }
+  // 13 tracks of ~80ms each: workers must overlap, but never more than the
+  // 4 jobs asked for
+  return g_peak_decoding > 1 && g_peak_decoding <= 4;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseVerify()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include "iplayer/decoder_factory.h"
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "iplayer/codec_probe.h"
+#include "test/iplayer/test_tracks.h"
+
+namespace ip {
+
+// track in memory, counting reads and seeks
+class MemoryTrackIO : public ITrackIO {
+ public:
+  MemoryTrackIO(const std::vector<uint8_t>& data, size_t* reads,
+                size_t* seeks)
+      : data_(data), offset_(0), reads_(reads), seeks_(seeks) {}
+
+  std::error_code Open(const TrackLocation&) override { return {}; }
+  size_t Read(uint8_t* buffer, size_t len, std::error_code& ec) override {
+    ec.clear();
+    ++*reads_;
+    auto count = std::min(len, data_.size() - offset_);
+    memcpy(buffer, data_.data() + offset_, count);
+    offset_ += count;
+    return count;
+  }
+  std::error_code Seek(uint64_t offset) override {
+    ++*seeks_;
+    offset_ = std::min<size_t>(offset, data_.size());
+    return {};
+  }
+  void Close() override {}
+
+ private:
+  std::vector<uint8_t> data_;
+  size_t offset_;
+  size_t* reads_;
+  size_t* seeks_;
+};
+
+// ID3v2.3 header announcing 'size' bytes of frames
+std::vector<uint8_t> CreateId3v2(size_t size, size_t present) {
+  std::vector<uint8_t> tag = {'I', 'D', '3', 3, 0, 0,
+                              static_cast<uint8_t>((size >> 21) & 0x7f),
+                              static_cast<uint8_t>((size >> 14) & 0x7f),
+                              static_cast<uint8_t>((size >> 7) & 0x7f),
+                              static_cast<uint8_t>(size & 0x7f)};
+  tag.resize(tag.size() + present, 0);  // padding
+  return tag;
+}
+
+std::vector<uint8_t> Concat(std::vector<uint8_t> lhs,
+                            const std::vector<uint8_t>& rhs) {
+  lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+  return lhs;
+}
+
+std::vector<uint8_t> Bytes(const std::string& text) {
+  return {text.begin(), text.end()};
+}
+
+// like Core does
+void RegisterProbes(DecoderFactory* factory) {
+  factory->RegisterProbe("flac", &ProbeFlac);
+  factory->RegisterProbe("ogg", &ProbeOgg);
+  factory->RegisterProbe("wav", &ProbeWave);
+  factory->RegisterProbe("mp3", &ProbeMpegAudio);
+}
+
+std::string Probe(const DecoderFactory& factory,
+                  const std::vector<uint8_t>& data) {
+  return factory.Probe(data.data(), data.size());
+}
+
+bool CaseProbe() {
+  DecoderFactory factory;
+  RegisterProbes(&factory);
+  auto mpeg = CreateMpegFrames(20);
+  auto junk = Bytes("not a header");
+  std::vector<uint8_t> ogg = {'O', 'g', 'g', 'S', 0, 2};
+  auto wave =
+      Concat({'R', 'I', 'F', 'F', 0x24, 0x08, 0, 0}, Bytes("WAVEfmt "));
+  return Probe(factory, mpeg) == "mp3" &&
+         Probe(factory, Concat(junk, mpeg)) == "mp3" &&
+         Probe(factory, Concat(CreateId3v2(100, 100), mpeg)) == "mp3" &&
+         // tag bigger than the probed bytes (cover art)
+         Probe(factory, CreateId3v2(1000000, 4086)) == "mp3" &&
+         Probe(factory, Bytes("fLaC")) == "flac" &&
+         Probe(factory, Concat(CreateId3v2(20, 20), Bytes("fLaC"))) ==
+             "flac" &&
+         Probe(factory, ogg) == "ogg" && Probe(factory, wave) == "wav" &&
+         // a single frame header could be audio data looking like one
+         Probe(factory, Concat(junk, {0xff, 0xfb, 0x90, 0x00})).empty() &&
+         Probe(factory, junk).empty() && Probe(factory, {}).empty() &&
+         DecoderFactory().Probe(mpeg.data(), mpeg.size()).empty();
+}
+
+// probing a track reads its beginning once, whatever its size, and the
+// decoder still reads it from the start
+bool CaseProbeTrack() {
+  DecoderFactory factory;
+  RegisterProbes(&factory);
+  auto track = Concat(CreateId3v2(100, 100), CreateMpegFrames(1000));
+  size_t reads = 0;
+  size_t seeks = 0;
+  ITrackIOPtr io = std::make_unique<MemoryTrackIO>(track, &reads, &seeks);
+  if (factory.Probe(&io) != "mp3" || reads != 1 || seeks != 0) {
+    return false;
+  }
+
+  std::vector<uint8_t> read(track.size() + 10);
+  std::error_code ec;
+  if (io->Read(read.data(), 10, ec) != 10 ||
+      io->Read(read.data() + 10, read.size() - 10, ec) != track.size() - 10 ||
+      ec || !std::equal(track.begin(), track.end(), read.begin())) {
+    return false;
+  }
+  // seeking reads the track itself again
+  return !io->Seek(500) && io->Read(read.data(), 10, ec) == 10 &&
+         std::equal(read.begin(), read.begin() + 10, track.begin() + 500) &&
+         seeks == 1;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseProbe()) {
+    return 1;
+  }
+  if (!ip::CaseProbeTrack()) {
+    return 1;
+  }
+  return 0;
+}
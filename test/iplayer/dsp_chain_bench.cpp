@@ -0,0 +1,74 @@
+#include "iplayer/dsp_chain.h"
+#include "iplayer/pcm_convert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Cost of the full decoder side processing of a 44.1kHz stereo stream: fixed
+// point to float, dsp chain with every stage enabled (3 EQ bands) and
+// conversion to S16, on frames of MPEG-1 layer 3 size. Reported as the share
+// of a core one stream needs, the budget is 1%.
+//
+// usage: dsp_chain_bench [iterations]
+
+namespace ip {
+
+int Bench(size_t iterations) {
+  const size_t kFrameSamples = 1152;
+  const double kRate = 44100;
+  const FixedSample one = 1 << kFixedFracBits;
+  std::mt19937 generator(0);
+  std::uniform_int_distribution<FixedSample> dist(-one, one);
+  std::vector<FixedSample> left(kFrameSamples), right(kFrameSamples);
+  for (size_t i = 0; i < kFrameSamples; ++i) {
+    left[i] = dist(generator);
+    right[i] = dist(generator);
+  }
+
+  DspSettings settings;
+  settings.gain_db = 3;
+  settings.eq = {{EqBand::Type::kLowShelf, 100, 0.707f, 4},
+                 {EqBand::Type::kPeak, 1000, 1.0f, -3},
+                 {EqBand::Type::kHighShelf, 8000, 0.707f, 2}};
+  settings.limiter = true;
+  settings.remix = Remix::kSwap;
+  DspChain chain(static_cast<uint32_t>(kRate), 2);
+  chain.Configure(settings);
+
+  std::vector<float> planar(2 * kFrameSamples);
+  std::vector<int16_t> out(2 * kFrameSamples);
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    DspBlock block{{planar.data(), planar.data() + kFrameSamples},
+                   2,
+                   kFrameSamples};
+    FixedToFloat(left.data(), kFrameSamples, 1.0f, block.channels[0]);
+    FixedToFloat(right.data(), kFrameSamples, 1.0f, block.channels[1]);
+    chain.Process(&block);
+    ConvertPcm(block.channels[0], block.channels[1], kFrameSamples,
+               SampleFormat::kS16, out.data());
+    // keep the compiler from skipping iterations
+    asm volatile("" : : "r"(out.data()) : "memory");
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  double audio = kFrameSamples * iterations / kRate;
+  double load = 100 * elapsed.count() / audio;
+  printf("%.1f ns/frame, %.3f%% of a core per stream, %.0fx realtime %s\n",
+         1e9 * elapsed.count() / (kFrameSamples * iterations), load,
+         audio / elapsed.count(), load < 1 ? "" : "OVER BUDGET");
+  return load < 1 ? 0 : 1;
+}
+
+}  // namespace ip
+
+int main(int argc, char* argv[]) {
+  size_t iterations = 20000;
+  if (argc > 1) {
+    iterations = strtoul(argv[1], nullptr, 10);
+  }
+  return ip::Bench(iterations);
+}
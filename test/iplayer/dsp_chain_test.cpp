@@ -0,0 +1,178 @@
+#include "iplayer/dsp_chain.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+namespace ip {
+
+const size_t kFrames = 1152;
+
+std::vector<float> CreateSine(double frequency, double amplitude,
+                              size_t count) {
+  std::vector<float> samples(count);
+  for (size_t i = 0; i < count; ++i) {
+    samples[i] =
+        static_cast<float>(amplitude * sin(2 * M_PI * frequency * i / 44100));
+  }
+  return samples;
+}
+
+float MaxAbs(const float* samples, size_t count) {
+  float peak = 0;
+  for (size_t i = 0; i < count; ++i) {
+    peak = std::max(peak, fabsf(samples[i]));
+  }
+  return peak;
+}
+
+// a neutral chain stays inactive, going back to neutral waits for the gain
+// to be ramped back to unity
+bool CaseNeutral() {
+  DspChain chain(44100, 2);
+  chain.Configure(DspSettings());
+  if (chain.Active()) {
+    return false;
+  }
+  DspSettings settings;
+  settings.gain_db = -6;
+  chain.Configure(settings);
+  if (!chain.Active()) {
+    return false;
+  }
+  std::vector<float> left(kFrames, 0.5f), right(kFrames, 0.5f);
+  DspBlock block{{left.data(), right.data()}, 2, kFrames};
+  chain.Process(&block);
+  chain.Configure(DspSettings());
+  if (!chain.Active()) {
+    return false;
+  }
+  block = {{left.data(), right.data()}, 2, kFrames};
+  chain.Process(&block);
+  return !chain.Active();
+}
+
+// a new gain is reached at the end of the next block without any step
+bool CaseGainRamp() {
+  DspChain chain(44100, 2);
+  DspSettings settings;
+  settings.gain_db = static_cast<float>(20 * log10(2.0));
+  chain.Configure(settings);
+  std::vector<float> left(kFrames, 0.5f), right(kFrames, 0.5f);
+  DspBlock block{{left.data(), right.data()}, 2, kFrames};
+  chain.Process(&block);
+  for (size_t i = 0; i < kFrames; ++i) {
+    float previous = i == 0 ? 0.5f : left[i - 1];
+    if (left[i] != right[i] || left[i] < previous ||
+        left[i] - previous > 1e-3f) {
+      return false;
+    }
+  }
+  if (fabsf(left.back() - 1.0f) > 1e-5f) {
+    return false;
+  }
+  std::fill(left.begin(), left.end(), 0.5f);
+  block = {{left.data(), right.data()}, 2, 7};
+  chain.Process(&block);
+  return fabsf(left[0] - 1.0f) < 1e-5f && fabsf(left[6] - 1.0f) < 1e-5f;
+}
+
+// +6dB at 1kHz, other frequencies are untouched. The stereo (vectorized)
+// path gives exactly the mono one.
+bool CaseEq() {
+  DspSettings settings;
+  settings.eq.push_back({EqBand::Type::kPeak, 1000, 1, 6});
+  DspChain stereo(44100, 2);
+  stereo.Configure(settings);
+  DspChain mono(44100, 1);
+  mono.Configure(settings);
+
+  auto left = CreateSine(1000, 0.1, 44100);
+  auto right = left;
+  auto single = left;
+  DspBlock block{{left.data(), right.data()}, 2, left.size()};
+  stereo.Process(&block);
+  DspBlock mono_block{{single.data(), nullptr}, 1, single.size()};
+  mono.Process(&mono_block);
+  if (left != single || right != single) {
+    return false;
+  }
+  // skip the transient
+  if (fabs(MaxAbs(&left[22050], 22050) - 0.1 * pow(10, 6.0 / 20)) > 1e-3) {
+    return false;
+  }
+  auto low = CreateSine(50, 0.1, 44100);
+  DspBlock low_block{{low.data(), nullptr}, 1, low.size()};
+  mono.Process(&low_block);
+  return fabs(MaxAbs(&low[22050], 22050) - 0.1) < 2e-3;
+}
+
+// below the threshold nothing changes, above the output stays under full
+// scale whatever the input
+bool CaseLimiter() {
+  DspSettings settings;
+  settings.limiter = true;
+  settings.limiter_threshold = 0.5f;
+  DspChain chain(44100, 1);
+  chain.Configure(settings);
+  std::vector<float> samples{0.3f, -0.5f, 0.75f, -2.0f, 100.0f,
+                             0.75f, -2.0f, 0.1f, 1e9f};
+  auto input = samples;
+  DspBlock block{{samples.data(), nullptr}, 1, samples.size()};
+  chain.Process(&block);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    float a = fabsf(input[i]);
+    float expected = a <= 0.5f ? a : 0.5f + 0.5f * (a - 0.5f) / a;
+    if (fabsf(fabsf(samples[i]) - expected) > 1e-6f ||
+        (samples[i] < 0) != (input[i] < 0) || fabsf(samples[i]) > 1.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CaseRemix() {
+  DspChain chain(44100, 2);
+  DspSettings settings;
+  settings.remix = Remix::kSwap;
+  chain.Configure(settings);
+  // mono is duplicated, swapping makes no difference
+  std::vector<float> left(kFrames, 0.25f), right(kFrames, 0);
+  DspBlock block{{left.data(), right.data()}, 1, kFrames};
+  chain.Process(&block);
+  if (block.channel_count != 2 || block.channels[1][kFrames - 1] != 0.25f) {
+    return false;
+  }
+  std::fill(right.begin(), right.end(), 0.75f);
+  block = {{left.data(), right.data()}, 2, kFrames};
+  chain.Process(&block);
+  if (block.channels[0] != right.data() || block.channels[1] != left.data()) {
+    return false;
+  }
+  settings.remix = Remix::kMono;
+  chain.Configure(settings);
+  block = {{left.data(), right.data()}, 2, 9};
+  chain.Process(&block);
+  return left[0] == 0.5f && right[8] == 0.5f && left[9] == 0.25f;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseNeutral()) {
+    return 1;
+  }
+  if (!ip::CaseGainRamp()) {
+    return 1;
+  }
+  if (!ip::CaseEq()) {
+    return 1;
+  }
+  if (!ip::CaseLimiter()) {
+    return 1;
+  }
+  if (!ip::CaseRemix()) {
+    return 1;
+  }
+  return 0;
+}
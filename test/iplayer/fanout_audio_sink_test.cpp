@@ -0,0 +1,180 @@
+#include "iplayer/fanout_audio_sink.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "iplayer/null_audio_sink.h"
+
+namespace ip {
+
+const AudioFormat kCdFormat{SampleFormat::kS16, 44100, 2};
+const size_t kPeriod = 4410;  // 25ms
+
+struct Recorded {
+  std::mutex mutex;
+  std::vector<uint8_t> bytes;
+  std::vector<const uint8_t*> pointers;  // of each write
+  size_t opens = 0;
+  size_t closes = 0;
+  bool held = false;  // writes wait until it's cleared
+  std::condition_variable cv;
+
+  void Release() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      held = false;
+    }
+    cv.notify_all();
+  }
+};
+
+class RecordingSink : public IAudioSink {
+ public:
+  explicit RecordingSink(std::shared_ptr<Recorded> recorded,
+                         bool fail = false)
+      : recorded_(recorded), fail_(fail) {}
+
+  std::error_code Open(const AudioFormat&) override {
+    std::lock_guard<std::mutex> lock(recorded_->mutex);
+    ++recorded_->opens;
+    return {};
+  }
+  std::error_code Write(const uint8_t* data, size_t len) override {
+    std::unique_lock<std::mutex> lock(recorded_->mutex);
+    recorded_->cv.wait(lock, [this]() { return !recorded_->held; });
+    if (fail_) {
+      return std::make_error_code(std::errc::io_error);
+    }
+    recorded_->bytes.insert(recorded_->bytes.end(), data, data + len);
+    recorded_->pointers.push_back(data);
+    return {};
+  }
+  std::error_code Drain() override { return {}; }
+  void Flush() override {}
+  void Close() override {
+    std::lock_guard<std::mutex> lock(recorded_->mutex);
+    ++recorded_->closes;
+  }
+
+ private:
+  std::shared_ptr<Recorded> recorded_;
+  bool fail_;
+};
+
+// every sink gets the same blocks, a slow one drops the oldest instead of
+// slowing down the main one
+bool CaseFanout() {
+  auto main = std::make_shared<Recorded>();
+  auto fast = std::make_shared<Recorded>();
+  auto slow = std::make_shared<Recorded>();
+  slow->held = true;  // stuck until all the writes are done
+  std::vector<FanoutAudioSink::Branch> branches;
+  branches.push_back({std::make_unique<RecordingSink>(fast),
+                      std::chrono::milliseconds(10000)});
+  branches.push_back({std::make_unique<RecordingSink>(slow),
+                      std::chrono::milliseconds(100)});
+  FanoutAudioSink sink(std::make_unique<RecordingSink>(main),
+                       std::move(branches));
+
+  const size_t kWrites = 100;
+  std::vector<uint8_t> data(kWrites * kPeriod);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i / kPeriod);
+  }
+  if (sink.Open(kCdFormat)) {
+    return false;
+  }
+  for (size_t i = 0; i < kWrites; ++i) {
+    if (sink.Write(&data[i * kPeriod], kPeriod)) {
+      return false;
+    }
+  }
+  // writes didn't wait for the stuck branch
+  slow->Release();
+  sink.Close();
+
+  if (main->bytes != data || fast->bytes != data ||
+      fast->pointers != main->pointers || sink.Dropped(0) != 0) {
+    return false;
+  }
+  // dropped blocks are whole and the oldest, what's left is in order
+  if (slow->bytes.size() + sink.Dropped(1) != data.size() ||
+      slow->bytes.size() % kPeriod || sink.Dropped(1) == 0 ||
+      slow->bytes.back() != kWrites - 1 || slow->opens != 1 ||
+      slow->closes != 1) {
+    return false;
+  }
+  for (size_t i = 1; i < slow->bytes.size(); ++i) {
+    if (slow->bytes[i] < slow->bytes[i - 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// a failing branch doesn't fail playback, it's retried when reopened
+bool CaseBranchFailure() {
+  auto main = std::make_shared<Recorded>();
+  auto failing = std::make_shared<Recorded>();
+  std::vector<FanoutAudioSink::Branch> branches;
+  branches.push_back({std::make_unique<RecordingSink>(failing, true),
+                      std::chrono::milliseconds(1000)});
+  FanoutAudioSink sink(std::make_unique<RecordingSink>(main),
+                       std::move(branches));
+  std::vector<uint8_t> data(kPeriod);
+  if (sink.Open(kCdFormat) || sink.Write(data.data(), data.size()) ||
+      sink.Write(data.data(), data.size()) || sink.Drain() ||
+      sink.Open(kCdFormat) || sink.Drain()) {
+    return false;
+  }
+  sink.Close();
+  return main->bytes.size() == 2 * kPeriod && failing->opens == 2 &&
+         failing->bytes.empty();
+}
+
+bool CaseSpec() {
+  AudioSinkFactory factory;
+  factory.Register("null", [](const std::string&) -> IAudioSinkPtr {
+    return std::make_unique<NullAudioSink>();
+  });
+  factory.Register("fanout", [&factory](const std::string& specs) {
+    return CreateFanoutAudioSink(factory, specs);
+  });
+  auto sink = factory.Create("fanout:null,null@10,null");
+  std::vector<uint8_t> data(kPeriod);
+  if (!sink || sink->Open(kCdFormat) ||
+      sink->Write(data.data(), data.size())) {
+    return false;
+  }
+  sink->Close();
+
+  // only digits after the last '@' are a lag
+  std::vector<std::string> paths;
+  factory.Register("file", [&paths](const std::string& path) {
+    paths.push_back(path);
+    return std::make_unique<NullAudioSink>();
+  });
+  if (!factory.Create("fanout:null,file:/tmp/a@b.wav,file:/tmp/c@d.wav@20") ||
+      paths != std::vector<std::string>{"/tmp/a@b.wav", "/tmp/c@d.wav"}) {
+    return false;
+  }
+  return factory.Create("fanout:null,pulse") == nullptr;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseFanout()) {
+    return 1;
+  }
+  if (!ip::CaseBranchFailure()) {
+    return 1;
+  }
+  if (!ip::CaseSpec()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include "iplayer/folder_watcher.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "iplayer/fs_track_provider.h"
+#include "iplayer/utils/directory_cache.h"
+
+namespace ip {
+
+void CreateFile(const std::string& path) {
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void RemoveDir(const std::string& dir) {
+  DirectoryCache::Names names;
+  DirectoryCache cache(0);
+  if (!cache.List(dir, &names)) {
+    for (const auto& name : *names) {
+      unlink((dir + "/" + name).c_str());
+    }
+  }
+  rmdir(dir.c_str());
+}
+
+// tracks as seen through the notified changes
+struct Changes {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::set<TrackLocation> tracks;
+  bool consistent = true;  // nothing added twice or removed while unknown
+  std::mutex* block = nullptr;  // held to stall the watcher thread
+
+  TrackChanges Callback() {
+    return [this](std::vector<TrackLocation> added,
+                  std::vector<TrackLocation> removed) {
+      if (block) {
+        std::lock_guard<std::mutex> stall(*block);
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      for (const auto& location : removed) {
+        consistent = consistent && tracks.erase(location) == 1;
+      }
+      for (const auto& location : added) {
+        consistent = consistent && tracks.insert(location).second;
+      }
+      cv.notify_all();
+    };
+  }
+
+  bool WaitFor(const std::set<TrackLocation>& expected) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return cv.wait_for(lock, std::chrono::seconds(10),
+                       [&]() { return tracks == expected; }) &&
+           consistent;
+  }
+};
+
+bool CaseDirectoryCache() {
+  char dir[] = "/tmp/iplayer_watch_XXXXXX";
+  if (!mkdtemp(dir)) {
+    return false;
+  }
+  std::string path = dir;
+  CreateFile(path + "/a.mp3");
+  CreateFile(path + "/b.txt");
+  // snapshots of directories changed in the current second are not kept
+  timespec old[] = {{0, UTIME_OMIT}, {time(nullptr) - 10, 0}};
+  utimensat(AT_FDCWD, dir, old, 0);
+
+  DirectoryCache cache(4);
+  DirectoryCache::Names first;
+  DirectoryCache::Names second;
+  DirectoryCache::Names third;
+  DirectoryCache::Names missing;
+  bool result =
+      !cache.List(path, &first) && first->size() == 2 &&
+      !cache.List(path, &second) && first == second &&
+      cache.ScanCount() == 1;
+  CreateFile(path + "/c.mp3");
+  result = result && !cache.List(path, &third) && third->size() == 3 &&
+           cache.ScanCount() == 2 &&
+           cache.List(path + "/missing", &missing) ==
+               std::errc::no_such_file_or_directory;
+  RemoveDir(path);
+  return result;
+}
+
+bool CaseWatch() {
+  char dir[] = "/tmp/iplayer_watch_XXXXXX";
+  if (!mkdtemp(dir)) {
+    return false;
+  }
+  std::string path = dir;
+  auto base = "file://" + path + "/";
+  CreateFile(path + "/a.mp3");
+  CreateFile(path + "/notes.txt");
+
+  FsTrackProvider provider;
+  Changes changes;
+  std::error_code ec;
+  auto watch = provider.Watch("file://" + path, changes.Callback(), ec);
+  bool result = watch && !ec && changes.WaitFor({base + "a.mp3"});
+
+  // written, renamed, moved in, deleted
+  std::ofstream(path + "/b.mp3") << "data";
+  result = result && changes.WaitFor({base + "a.mp3", base + "b.mp3"});
+  rename((path + "/b.mp3").c_str(), (path + "/c.mp3").c_str());
+  CreateFile(path + "/d.tmp");
+  rename((path + "/d.tmp").c_str(), (path + "/d.mp3").c_str());
+  unlink((path + "/a.mp3").c_str());
+  CreateFile(path + "/other.txt");
+  result = result && changes.WaitFor({base + "c.mp3", base + "d.mp3"});
+
+  // the directory itself is gone
+  RemoveDir(path);
+  result = result && changes.WaitFor({});
+  watch.reset();
+
+  return result &&
+         !provider.Watch("file:///nonexistent", changes.Callback(), ec) &&
+         ec == std::errc::no_such_file_or_directory &&
+         !provider.Watch("file:///a/list.m3u", changes.Callback(), ec) &&
+         ec == std::errc::operation_not_supported;
+}
+
+// more changes than the kernel queues while the watcher is stalled
+bool CaseOverflow() {
+  size_t max_events = 0;
+  std::ifstream("/proc/sys/fs/inotify/max_queued_events") >> max_events;
+  if (max_events == 0 || max_events > 100000) {
+    return true;  // too long to overflow
+  }
+  char dir[] = "/tmp/iplayer_watch_XXXXXX";
+  if (!mkdtemp(dir)) {
+    return false;
+  }
+  std::string path = dir;
+  auto base = "file://" + path + "/";
+  std::mutex block;
+  Changes changes;
+  changes.block = &block;
+  FolderWatcher watcher;
+  bool result = !watcher.Start(path, changes.Callback());
+
+  std::set<TrackLocation> expected;
+  {
+    std::lock_guard<std::mutex> stall(block);
+    CreateFile(path + "/first.mp3");
+    // the watcher thread now waits for 'block' in the callback
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    for (size_t i = 0; i < max_events + 100; ++i) {
+      auto name = std::to_string(i) + ".mp3";
+      CreateFile(path + "/" + name);
+      expected.insert(base + name);
+    }
+    unlink((path + "/first.mp3").c_str());
+  }
+  result = result && changes.WaitFor(expected) && watcher.RescanCount() > 0;
+  watcher.Stop();
+  RemoveDir(path);
+  return result;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseDirectoryCache()) {
+    return 1;
+  }
+  if (!ip::CaseWatch()) {
+    return 1;
+  }
+  if (!ip::CaseOverflow()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include "iplayer/frame_index.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "test/iplayer/test_tracks.h"
+
+namespace ip {
+
+struct Stream {
+  std::vector<uint8_t> data;
+  std::vector<uint64_t> offsets;  // of each frame
+};
+
+Stream CreateStream(size_t frame_count, size_t garbage) {
+  Stream stream;
+  stream.data.assign(garbage, 0x42);
+  auto frames = CreateMpegFrames(frame_count, &stream.offsets);
+  for (auto& offset : stream.offsets) {
+    // audio data looking like a header must not be taken for a frame
+    frames[offset + 100] = 0xff;
+    frames[offset + 101] = 0xfb;
+    frames[offset + 102] = 0x90;
+    offset += garbage;
+  }
+  stream.data.insert(stream.data.end(), frames.begin(), frames.end());
+  return stream;
+}
+
+// scan by windows the way a track provider does
+FrameIndex Scan(const Stream& stream, size_t window) {
+  FrameIndex index;
+  uint64_t offset = 0;
+  while (offset < stream.data.size()) {
+    auto available = std::min<size_t>(window, stream.data.size() - offset);
+    bool end_of_audio = offset + available >= stream.data.size();
+    auto scanned = index.Scan(stream.data.data() + offset, available, offset,
+                              end_of_audio);
+    if (end_of_audio || scanned == 0) {
+      break;
+    }
+    offset += scanned;
+  }
+  return index;
+}
+
+bool CaseScan(size_t window) {
+  auto stream = CreateStream(100, 10);
+  auto index = Scan(stream, window);
+  return index.SampleRate() == 44100 && index.FrameCount() == 100 &&
+         index.SampleCount() == 100 * kMpegFrameSamples &&
+         index.Duration() == std::chrono::milliseconds(2612);
+}
+
+bool CaseFind() {
+  auto stream = CreateStream(100, 10);
+  auto index = Scan(stream, stream.data.size());
+  const uint64_t entry_samples =
+      FrameIndex::kFramesPerEntry * kMpegFrameSamples;
+  auto first = index.Find(0);
+  auto before_second = index.Find(entry_samples - 1);
+  auto second = index.Find(entry_samples);
+  auto last = index.Find(1000000);
+  auto last_entry = (100 - 1) / FrameIndex::kFramesPerEntry;
+  return first.offset == stream.offsets[0] && first.sample == 0 &&
+         before_second.offset == stream.offsets[0] &&
+         second.offset == stream.offsets[FrameIndex::kFramesPerEntry] &&
+         second.sample == entry_samples &&
+         last.offset ==
+             stream.offsets[last_entry * FrameIndex::kFramesPerEntry] &&
+         last.sample == last_entry * entry_samples;
+}
+
+// a truncated last frame isn't counted
+bool CaseTruncated() {
+  auto stream = CreateStream(20, 0);
+  stream.data.resize(stream.data.size() - 100);
+  auto index = Scan(stream, 1024);
+  return index.FrameCount() == 19;
+}
+
+bool CaseNoAudio() {
+  std::vector<uint8_t> data(4096, 0xff);
+  FrameIndex index;
+  index.Scan(data.data(), data.size(), 0, true);
+  return index.FrameCount() == 0 && index.SampleRate() == 0 &&
+         index.Duration() == std::chrono::milliseconds(0) &&
+         index.Find(1000).offset == 0;
+}
+
+}  // namespace ip
+
+int main() {
+  for (size_t window : {500, 1000, 4096, 1000000}) {
+    if (!ip::CaseScan(window)) {
+      return 1;
+    }
+  }
+  if (!ip::CaseFind()) {
+    return 1;
+  }
+  if (!ip::CaseTruncated()) {
+    return 1;
+  }
+  if (!ip::CaseNoAudio()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,161 @@
+#include "iplayer/fs_track_io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "iplayer/utils/log.h"
+#include "iplayer/utils/mapping_cache.h"
+
+namespace ip {
+
+std::string CreateFile(const std::vector<uint8_t>& content) {
+  char path[] = "/tmp/iplayer_fs_track_io_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return {};
+  }
+  auto written = write(fd, content.data(), content.size());
+  close(fd);
+  if (written != static_cast<ssize_t>(content.size())) {
+    return {};
+  }
+  return path;
+}
+
+std::vector<uint8_t> CreateContent(size_t size) {
+  std::vector<uint8_t> content(size);
+  for (size_t i = 0; i < size; ++i) {
+    content[i] = static_cast<uint8_t>(std::rand());
+  }
+  return content;
+}
+
+bool CaseReadAll(size_t file_size, size_t read_size, bool mapped) {
+  auto content = CreateContent(file_size);
+  auto path = CreateFile(content);
+  if (path.empty()) {
+    return false;
+  }
+
+  // when already mapped, file is read from the cached mapping
+  MappingCache::MappingPtr mapping;
+  if (mapped) {
+    std::error_code ec;
+    mapping = MappingCache::Instance().Get(
+        path, FileMapping::Access::kRandom, ec);
+    if (file_size && !mapping) {
+      return false;
+    }
+  }
+
+  std::vector<uint8_t> result;
+  std::vector<uint8_t> buffer(read_size);
+  FsTrackIO io;
+  auto ec = io.Open("file://" + path);
+  if (ec) {
+    unlink(path.c_str());
+    return false;
+  }
+  while (true) {
+    auto count = io.Read(buffer.data(), buffer.size(), ec);
+    result.insert(std::end(result), std::begin(buffer),
+                  std::begin(buffer) + count);
+    if (ec || count < buffer.size()) {
+      break;
+    }
+  }
+  io.Close();
+  unlink(path.c_str());
+
+  // reading after end of file must keep returning nothing
+  if (ec || result != content) {
+    LOG("read %zu/%zu bytes (%s)", result.size(), content.size(),
+        ec.message().c_str());
+    return false;
+  }
+  return true;
+}
+
+bool CaseOpenError() {
+  FsTrackIO io;
+  if (!io.Open("file:///nonexistent/track.mp3")) {
+    return false;
+  }
+  if (!io.Open("/no/scheme.mp3")) {
+    return false;
+  }
+  return true;
+}
+
+bool CaseCloseWhileReading() {
+  auto path = CreateFile(CreateContent(4 * 1024 * 1024));
+  FsTrackIO io;
+  io.Open("file://" + path);
+  uint8_t byte;
+  std::error_code ec;
+  io.Read(&byte, 1, ec);
+  io.Close();  // readahead thread must stop with unread chunks
+  auto count = io.Read(&byte, 1, ec);
+  unlink(path.c_str());
+  return count == 0 && ec;
+}
+
+// reading goes on from the new offset, with or without a mapping
+bool CaseSeek(bool mapped) {
+  auto content = CreateContent(1000000);
+  auto path = CreateFile(content);
+  MappingCache::MappingPtr mapping;
+  if (mapped) {
+    std::error_code ec;
+    mapping = MappingCache::Instance().Get(
+        path, FileMapping::Access::kRandom, ec);
+  }
+  FsTrackIO io;
+  io.Open("file://" + path);
+  std::vector<uint8_t> buffer(1000);
+  std::error_code ec;
+  bool ok = true;
+  for (uint64_t offset : {500000, 1000, 999500, 131072}) {
+    ok = ok && !io.Seek(offset);
+    auto count = io.Read(buffer.data(), buffer.size(), ec);
+    auto expected = std::min<size_t>(buffer.size(), content.size() - offset);
+    ok = ok && !ec && count == expected &&
+         std::equal(buffer.begin(), buffer.begin() + count,
+                    content.begin() + offset);
+  }
+  // past the end, nothing more to read
+  ok = ok && !io.Seek(2000000) && io.Read(buffer.data(), 1, ec) == 0;
+  io.Close();
+  unlink(path.c_str());
+  return ok;
+}
+
+}  // namespace ip
+
+int main() {
+  // sizes around readahead chunk size (128KiB)
+  for (size_t file_size : {0, 1, 4096, 131071, 131072, 131073, 1000000}) {
+    for (size_t read_size : {1, 1000, 65536, 131072, 300000}) {
+      if (file_size > 4096 && read_size == 1) {
+        continue;
+      }
+      if (!ip::CaseReadAll(file_size, read_size, false) ||
+          !ip::CaseReadAll(file_size, read_size, true)) {
+        return 1;
+      }
+    }
+  }
+  if (!ip::CaseOpenError()) {
+    return 1;
+  }
+  if (!ip::CaseCloseWhileReading()) {
+    return 1;
+  }
+  if (!ip::CaseSeek(false) || !ip::CaseSeek(true)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,362 @@
+#include "iplayer/http_stream_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ip {
+
+const size_t kFrameSize = 400;
+
+// index then filler: frames are recognized whole in what's received
+std::vector<uint8_t> CreateFrames(size_t first, size_t count) {
+  std::vector<uint8_t> frames(count * kFrameSize);
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t* frame = &frames[i * kFrameSize];
+    auto index = static_cast<uint32_t>(first + i);
+    memset(frame, static_cast<int>(index & 0xff), kFrameSize);
+    memcpy(frame, &index, sizeof(index));
+  }
+  return frames;
+}
+
+void PublishFrames(HttpStreamServer* server, const std::vector<uint8_t>& data,
+                   const HttpStreamServer::SourcePtr& source = nullptr,
+                   uint64_t track = 0) {
+  for (size_t offset = 0; offset < data.size(); offset += kFrameSize) {
+    server->Publish(track, source, offset, &data[offset], kFrameSize);
+  }
+}
+
+bool WaitFor(std::function<bool()> condition) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+int Connect(uint16_t port, const std::string& request, int receive_buffer) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  timeval timeout{5, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (receive_buffer) {
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer,
+               sizeof(receive_buffer));
+  }
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ||
+      send(fd, request.data(), request.size(), 0) !=
+          static_cast<ssize_t>(request.size())) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// header then 'size' bytes of body at most, less on timeout or close
+bool Receive(int fd, size_t size, std::string* header,
+             std::vector<uint8_t>* body) {
+  std::string received;
+  size_t header_size = std::string::npos;
+  char buffer[16 * 1024];
+  while (header_size == std::string::npos ||
+         received.size() < header_size + size) {
+    auto count = read(fd, buffer, sizeof(buffer));
+    if (count <= 0) {
+      break;
+    }
+    received.append(buffer, static_cast<size_t>(count));
+    auto end = received.find("\r\n\r\n");
+    if (header_size == std::string::npos && end != std::string::npos) {
+      header_size = end + 4;
+    }
+  }
+  if (header_size == std::string::npos) {
+    return false;
+  }
+  *header = received.substr(0, header_size);
+  body->assign(received.begin() + header_size, received.end());
+  return true;
+}
+
+HttpStreamServer::Options TestOptions() {
+  HttpStreamServer::Options options;
+  options.address = "127.0.0.1";
+  options.port = 0;
+  return options;
+}
+
+// every listener gets the burst then the same frames, from memory or
+// straight from the track's file
+bool CaseStream() {
+  char path[] = "/tmp/iplayer_http_stream_XXXXXX";
+  int file = mkstemp(path);
+  auto file_frames = CreateFrames(20, 50);
+  if (file < 0 || write(file, file_frames.data(), file_frames.size()) !=
+                      static_cast<ssize_t>(file_frames.size())) {
+    return false;
+  }
+  close(file);
+
+  HttpStreamServer server;
+  auto options = TestOptions();
+  options.burst_size = 1 << 20;
+  if (server.Start(options)) {
+    return false;
+  }
+  auto source = server.OpenSource(std::string("file://") + path);
+  unlink(path);
+  if (!source) {
+    return false;
+  }
+  auto burst = CreateFrames(0, 20);
+  PublishFrames(&server, burst);
+
+  const size_t kClients = 100;
+  std::vector<int> clients;
+  for (size_t i = 0; i < kClients; ++i) {
+    clients.push_back(Connect(server.Port(), "GET / HTTP/1.0\r\n\r\n", 0));
+  }
+  if (!WaitFor([&]() { return server.GetStats().clients == kClients; })) {
+    return false;
+  }
+  PublishFrames(&server, file_frames, source);
+  auto last = CreateFrames(70, 20);
+  PublishFrames(&server, last);
+
+  auto expected = burst;
+  expected.insert(expected.end(), file_frames.begin(), file_frames.end());
+  expected.insert(expected.end(), last.begin(), last.end());
+  bool result = true;
+  for (int fd : clients) {
+    std::string header;
+    std::vector<uint8_t> body;
+    result = result && fd >= 0 &&
+             Receive(fd, expected.size(), &header, &body) &&
+             header.compare(0, 15, "HTTP/1.0 200 OK") == 0 &&
+             header.find("audio/mpeg") != std::string::npos &&
+             body == expected;
+    close(fd);
+  }
+  result = result && WaitFor([&]() { return server.GetStats().clients == 0; });
+  auto stats = server.GetStats();
+  server.Stop();
+  return result && stats.accepted == kClients &&
+         stats.bytes_sent == kClients * expected.size() && stats.skipped == 0;
+}
+
+// a listener not reading doesn't hold more than its backlog, it skips to
+// recent frames and still gets whole ones in order
+bool CaseSlowClient() {
+  HttpStreamServer server;
+  auto options = TestOptions();
+  options.burst_size = 10 * kFrameSize;
+  options.max_backlog = 100 * kFrameSize;
+  if (server.Start(options)) {
+    return false;
+  }
+  int fd = Connect(server.Port(), "GET /stream HTTP/1.1\r\n\r\n", 4096);
+  if (fd < 0 || !WaitFor([&]() { return server.GetStats().clients == 1; })) {
+    return false;
+  }
+  const size_t kFrames = 20000;
+  auto frames = CreateFrames(0, kFrames);
+  PublishFrames(&server, frames);
+  if (!WaitFor([&]() { return server.GetStats().skipped > 0; })) {
+    return false;
+  }
+
+  std::string header;
+  std::vector<uint8_t> received;
+  Receive(fd, 0, &header, &received);
+  std::vector<uint8_t> buffer(64 * 1024);
+  uint32_t index = 0;
+  while (true) {
+    size_t whole = received.size() / kFrameSize * kFrameSize;
+    if (whole) {
+      memcpy(&index, &received[whole - kFrameSize], sizeof(index));
+    }
+    if (index == kFrames - 1) {
+      break;
+    }
+    auto count = read(fd, buffer.data(), buffer.size());
+    if (count <= 0) {
+      break;
+    }
+    received.insert(received.end(), buffer.begin(), buffer.begin() + count);
+  }
+  close(fd);
+  server.Stop();
+
+  if (received.size() % kFrameSize != 0 || index != kFrames - 1 ||
+      received.size() >= frames.size()) {
+    return false;
+  }
+  uint32_t previous = 0;
+  for (size_t offset = 0; offset < received.size(); offset += kFrameSize) {
+    memcpy(&index, &received[offset], sizeof(index));
+    if ((offset && index <= previous) || index >= kFrames ||
+        memcmp(&received[offset], &frames[index * kFrameSize], kFrameSize)) {
+      return false;
+    }
+    previous = index;
+  }
+  return true;
+}
+
+// thousands of listeners on the loop thread
+bool CaseManyClients() {
+  HttpStreamServer server;
+  auto options = TestOptions();
+  options.burst_size = 10 * kFrameSize;
+  if (server.Start(options)) {
+    return false;
+  }
+  auto frames = CreateFrames(0, 10);
+  PublishFrames(&server, frames);
+  const size_t kClients = 2000;
+  std::vector<int> clients;
+  for (size_t i = 0; i < kClients; ++i) {
+    int fd = Connect(server.Port(), "GET / HTTP/1.0\r\n\r\n", 0);
+    if (fd < 0) {
+      break;
+    }
+    clients.push_back(fd);
+  }
+  bool result =
+      clients.size() == kClients &&
+      WaitFor([&]() { return server.GetStats().clients == kClients; });
+  for (int fd : clients) {
+    std::string header;
+    std::vector<uint8_t> body;
+    result = result && Receive(fd, frames.size(), &header, &body) &&
+             body == frames;
+    close(fd);
+  }
+  result = result && WaitFor([&]() { return server.GetStats().clients == 0; });
+  server.Stop();
+  return result;
+}
+
+// listeners gone while their socket was full, the frames published next
+// only go to the others
+bool CaseFullClientGone() {
+  HttpStreamServer server;
+  auto options = TestOptions();
+  options.burst_size = 16 << 20;
+  options.max_backlog = 16 << 20;
+  if (server.Start(options)) {
+    return false;
+  }
+  // more than a socket holds (autotuned send buffer of a few MB)
+  auto frames = CreateFrames(0, options.burst_size / kFrameSize);
+  PublishFrames(&server, frames);
+  const size_t kClients = 20;
+  std::vector<int> clients;
+  for (size_t i = 0; i < kClients; ++i) {
+    clients.push_back(Connect(server.Port(), "GET / HTTP/1.0\r\n\r\n", 4096));
+  }
+  bool result =
+      WaitFor([&]() { return server.GetStats().clients == kClients; });
+  for (int fd : clients) {
+    close(fd);
+  }
+  result = result && WaitFor([&]() { return server.GetStats().clients == 0; });
+  auto last = CreateFrames(frames.size() / kFrameSize, 10);
+  PublishFrames(&server, last);
+  int fd = Connect(server.Port(), "GET / HTTP/1.0\r\n\r\n", 0);
+  std::string header;
+  std::vector<uint8_t> body;
+  result = result && fd >= 0 &&
+           WaitFor([&]() { return server.GetStats().clients == 1; }) &&
+           Receive(fd, 10, &header, &body) && body.size() >= 10;
+  close(fd);
+  server.Stop();
+  return result;
+}
+
+// a track fading out while the next one starts isn't heard anymore
+bool CaseNextTrack() {
+  HttpStreamServer server;
+  auto options = TestOptions();
+  options.burst_size = 1 << 20;
+  if (server.Start(options)) {
+    return false;
+  }
+  auto first = server.StartTrack();
+  auto old_frames = CreateFrames(0, 10);
+  PublishFrames(&server, old_frames, nullptr, first);
+  auto second = server.StartTrack();
+  PublishFrames(&server, CreateFrames(10, 10), nullptr, first);
+  auto new_frames = CreateFrames(20, 10);
+  PublishFrames(&server, new_frames, nullptr, second);
+
+  auto expected = old_frames;
+  expected.insert(expected.end(), new_frames.begin(), new_frames.end());
+  int fd = Connect(server.Port(), "GET / HTTP/1.0\r\n\r\n", 0);
+  std::string header;
+  std::vector<uint8_t> body;
+  bool result = fd >= 0 && Receive(fd, expected.size(), &header, &body) &&
+                body == expected;
+  close(fd);
+  server.Stop();
+  return result;
+}
+
+bool CaseBadRequest() {
+  HttpStreamServer server;
+  if (server.Start(TestOptions())) {
+    return false;
+  }
+  int fd = Connect(server.Port(), "POST / HTTP/1.0\r\n\r\n", 0);
+  std::string header;
+  std::vector<uint8_t> body;
+  char byte;
+  bool result = fd >= 0 && Receive(fd, 0, &header, &body) &&
+                header.compare(0, 12, "HTTP/1.0 405") == 0 &&
+                read(fd, &byte, 1) == 0 && server.GetStats().clients == 0;
+  close(fd);
+  server.Stop();
+  return result;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseStream()) {
+    return 1;
+  }
+  if (!ip::CaseSlowClient()) {
+    return 1;
+  }
+  if (!ip::CaseManyClients()) {
+    return 1;
+  }
+  if (!ip::CaseFullClientGone()) {
+    return 1;
+  }
+  if (!ip::CaseNextTrack()) {
+    return 1;
+  }
+  if (!ip::CaseBadRequest()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,359 @@
+#include "iplayer/http_track_provider.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "iplayer/utils/http_client.h"
+#include "test/iplayer/test_tracks.h"
+
+namespace ip {
+
+// Local stand-in for a remote server: keep-alive, pipelined requests, HEAD
+// and ranges. Each batch of requests received waits 'latency' before being
+// answered (a round trip) and bodies are sent at 'rate' bytes/s, like a
+// distant server.
+class LocalHttpServer {
+ public:
+  LocalHttpServer(const std::vector<uint8_t>& track,
+                  std::chrono::milliseconds latency, size_t rate)
+      : track_(track),
+        latency_(latency),
+        rate_(rate),
+        stop_(false),
+        drop_after_(0),
+        connections_(0),
+        requests_(0),
+        round_trips_(0),
+        sent_(0) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), size);
+    listen(listen_fd_, 16);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &size);
+    port_ = ntohs(address.sin_port);
+    accept_thread_ = std::thread([this]() { AcceptThread(); });
+  }
+
+  ~LocalHttpServer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      for (int fd : clients_) {
+        shutdown(fd, SHUT_RDWR);
+      }
+    }
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+    close(listen_fd_);
+  }
+
+  std::string Url(const std::string& path = "/track.mp3") const {
+    return "http://127.0.0.1:" + std::to_string(port_) + path;
+  }
+  size_t Connections() const { return connections_; }
+  size_t Requests() const { return requests_; }
+  size_t RoundTrips() const { return round_trips_; }
+  size_t Sent() const { return sent_; }  // bytes of bodies
+
+  // connections are closed once they sent 'bytes' of bodies, 0 for never
+  void DropConnectionsAfter(size_t bytes) { drop_after_ = bytes; }
+
+ private:
+  void AcceptThread() {
+    int fd;
+    while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC)) >= 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_) {
+        close(fd);
+        break;
+      }
+      ++connections_;
+      clients_.push_back(fd);
+      threads_.emplace_back([this, fd]() { Serve(fd); });
+    }
+  }
+
+  void Serve(int fd) {
+    std::string input;
+    char buffer[4096];
+    ssize_t count;
+    size_t sent = 0;  // on this connection
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+      input.append(buffer, static_cast<size_t>(count));
+      std::this_thread::sleep_for(latency_);
+      ++round_trips_;
+      size_t end;
+      while ((end = input.find("\r\n\r\n")) != std::string::npos) {
+        auto request = input.substr(0, end);
+        input.erase(0, end + 4);
+        ++requests_;
+        if (!Respond(fd, request, &sent)) {
+          shutdown(fd, SHUT_RDWR);
+          return;
+        }
+      }
+    }
+    shutdown(fd, SHUT_RDWR);
+  }
+
+  bool Respond(int fd, const std::string& request, size_t* sent) {
+    bool head = request.compare(0, 5, "HEAD ") == 0;
+    auto path = request.substr(request.find(' ') + 1);
+    path.resize(path.find(' '));
+    if (path != "/track.mp3") {
+      return Send(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    }
+    size_t size = track_.size();
+    size_t begin = 0;
+    size_t end = size;
+    auto range = request.find("Range: bytes=");
+    if (range != std::string::npos && !head) {
+      const char* spec = request.c_str() + range + 13;
+      if (*spec == '-') {
+        begin = size - std::min<size_t>(size, strtoul(spec + 1, nullptr, 10));
+      } else {
+        char* last;
+        begin = strtoul(spec, &last, 10);
+        if (*++last >= '0' && *last <= '9') {
+          end = std::min<size_t>(size, strtoul(last, nullptr, 10) + 1);
+        }
+      }
+      if (begin >= size) {
+        return Send(fd,
+                    "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                    "Content-Length: 0\r\n\r\n");
+      }
+    }
+    std::string header;
+    if (range != std::string::npos && !head) {
+      header = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " +
+               std::to_string(begin) + "-" + std::to_string(end - 1) + "/" +
+               std::to_string(size) + "\r\n";
+    } else {
+      header = "HTTP/1.1 200 OK\r\n";
+    }
+    header += "Content-Length: " + std::to_string(end - begin) + "\r\n\r\n";
+    if (!Send(fd, header)) {
+      return false;
+    }
+    const size_t kPiece = 8 * 1024;
+    for (size_t offset = begin; !head && offset < end; offset += kPiece) {
+      auto piece = std::min(kPiece, end - offset);
+      if ((drop_after_ && *sent >= drop_after_) ||
+          !Send(fd, std::string(track_.begin() + offset,
+                                track_.begin() + offset + piece))) {
+        return false;
+      }
+      *sent += piece;
+      sent_ += piece;
+      std::this_thread::sleep_for(std::chrono::microseconds(
+          piece * 1000000 / rate_));
+    }
+    return true;
+  }
+
+  bool Send(int fd, const std::string& data) {
+    return send(fd, data.data(), data.size(), MSG_NOSIGNAL) ==
+           static_cast<ssize_t>(data.size());
+  }
+
+  std::vector<uint8_t> track_;
+  std::chrono::milliseconds latency_;
+  size_t rate_;
+  int listen_fd_;
+  uint16_t port_;
+  std::thread accept_thread_;
+  std::mutex mutex_;
+  bool stop_;
+  std::vector<int> clients_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> drop_after_;
+  std::atomic<size_t> connections_;
+  std::atomic<size_t> requests_;
+  std::atomic<size_t> round_trips_;
+  std::atomic<size_t> sent_;
+};
+
+bool CaseTrackInfo() {
+  // 2000 frames, ~52s
+  auto track = CreateTrack("Remote", 2000);
+  LocalHttpServer server(track, std::chrono::milliseconds(100), 4000000);
+  HttpConnectionPool pool(4);
+  HttpTrackProvider provider(&pool, HttpTrackIO::Options());
+  auto info = provider.GetTrackInfo(server.Url());
+  // the probes are pipelined: a single round trip, not three
+  if (info.Title() != "Remote" || info.Codec() != "mp3" ||
+      info.Duration() != std::chrono::seconds(52) || info.GetFrameIndex() ||
+      server.Requests() != 3 || server.RoundTrips() != 1) {
+    return false;
+  }
+
+  // a short track is probed whole, it can be seeked by time
+  LocalHttpServer short_server(CreateTrack("", 50),
+                               std::chrono::milliseconds(0), 4000000);
+  info = provider.GetTrackInfo(short_server.Url());
+  auto index = info.GetFrameIndex();
+  if (!index || index->FrameCount() != 50 || !info.Title().empty()) {
+    return false;
+  }
+  try {
+    provider.GetTrackInfo(short_server.Url("/missing.mp3"));
+    return false;
+  } catch (const std::system_error& e) {
+    return e.code() == std::errc::no_such_file_or_directory;
+  }
+}
+
+bool CaseStartBeforeDownload() {
+  auto track = CreateTrack("Remote", 2000);
+  // ~2s to download it all
+  const size_t kRate = 400000;
+  LocalHttpServer server(track, std::chrono::milliseconds(50), kRate);
+  HttpConnectionPool pool(4);
+  HttpTrackIO::Options options;
+  options.request_size = 64 * 1024;
+  HttpTrackProvider provider(&pool, options);
+  std::error_code ec;
+  auto io = provider.OpenTrack(server.Url(), ec);
+  if (!io) {
+    return false;
+  }
+  std::vector<uint8_t> data(track.size() + 100);
+  // the decoder's first read is served while the track is still coming (a
+  // read waiting for it all would have to be late by the ~2s it takes)
+  auto count = io->Read(data.data(), 16 * 1024, ec);
+  if (ec || count != 16 * 1024 || server.Sent() >= track.size()) {
+    return false;
+  }
+  count += io->Read(data.data() + count, data.size() - count, ec);
+  data.resize(count);
+  // ranges asked on a single kept-alive connection
+  return !ec && data == track && pool.Connects() == 1 &&
+         server.Connections() == 1 &&
+         server.Requests() >= track.size() / options.request_size;
+}
+
+bool CaseSeek() {
+  auto track = CreateTrack("Remote", 2000);
+  LocalHttpServer server(track, std::chrono::milliseconds(20), 4000000);
+  HttpConnectionPool pool(4);
+  HttpTrackIO::Options options;
+  options.buffer_size = 128 * 1024;
+  options.request_size = 32 * 1024;
+  HttpTrackIO io(options, &pool);
+  if (io.Open(server.Url())) {
+    return false;
+  }
+  std::error_code ec;
+  std::vector<uint8_t> data(1000);
+  // seek while the prefetch is waiting for room or receiving
+  for (size_t offset : {500000, 10, 700000, 0}) {
+    if (io.Seek(offset) || io.Read(data.data(), data.size(), ec) != 1000 ||
+        !std::equal(data.begin(), data.end(), track.begin() + offset)) {
+      return false;
+    }
+  }
+  // the end and past it
+  io.Seek(track.size() - 10);
+  if (io.Read(data.data(), data.size(), ec) != 10 || ec) {
+    return false;
+  }
+  io.Seek(track.size() + 10);
+  return io.Read(data.data(), data.size(), ec) == 0 && !ec;
+}
+
+// connections dropped while the track is received are resumed from where
+// they stopped, as many times as they made progress
+bool CaseDroppedConnections() {
+  auto track = CreateTrack("Remote", 2000);
+  LocalHttpServer server(track, std::chrono::milliseconds(0), 40000000);
+  server.DropConnectionsAfter(64 * 1024);
+  HttpConnectionPool pool(4);
+  HttpTrackIO::Options options;
+  options.request_size = 32 * 1024;
+  HttpTrackProvider provider(&pool, options);
+  std::error_code ec;
+  auto io = provider.OpenTrack(server.Url(), ec);
+  if (!io) {
+    return false;
+  }
+  std::vector<uint8_t> data(track.size() + 100);
+  size_t size = 0;
+  size_t count;
+  while ((count = io->Read(data.data() + size, data.size() - size, ec))) {
+    size += count;
+  }
+  data.resize(size);
+  return !ec && data == track && server.Connections() > 4;
+}
+
+bool CaseList() {
+  HttpTrackProvider provider;
+  std::vector<TrackLocation> locations;
+  return provider.List("http://host/a.mp3", &locations) == std::error_code() &&
+         locations.size() == 1 && locations[0] == "http://host/a.mp3" &&
+         provider.List("file:///a.mp3", &locations) && locations.size() == 1;
+}
+
+// an IPv6 literal reaches getaddrinfo() without its brackets
+bool CaseParseUrl() {
+  HttpUrl url;
+  if (ParseHttpUrl("http://[::1]:8000/a.mp3?b", &url) || url.host != "::1" ||
+      url.port != 8000 || url.path != "/a.mp3?b") {
+    return false;
+  }
+  if (ParseHttpUrl("http://[fe80::1]", &url) || url.host != "fe80::1" ||
+      url.port != 80 || url.path != "/") {
+    return false;
+  }
+  if (ParseHttpUrl("http://host:81/a.mp3", &url) || url.host != "host" ||
+      url.port != 81) {
+    return false;
+  }
+  return ParseHttpUrl("http://[::1/a.mp3", &url) &&
+         ParseHttpUrl("http://[::1]8000/a.mp3", &url) &&
+         ParseHttpUrl("http://[]:80/a.mp3", &url) &&
+         ParseHttpUrl("http://host:0/a.mp3", &url);
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseTrackInfo()) {
+    return 1;
+  }
+  if (!ip::CaseStartBeforeDownload()) {
+    return 1;
+  }
+  if (!ip::CaseSeek()) {
+    return 1;
+  }
+  if (!ip::CaseDroppedConnections()) {
+    return 1;
+  }
+  if (!ip::CaseList()) {
+    return 1;
+  }
+  if (!ip::CaseParseUrl()) {
+    return 1;
+  }
+  return 0;
+}
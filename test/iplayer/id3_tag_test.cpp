@@ -0,0 +1,197 @@
+#include "iplayer/id3_tag.h"
+
+#include <string>
+#include <vector>
+
+namespace ip {
+
+using Bytes = std::vector<uint8_t>;
+
+void Append(Bytes* bytes, const std::string& str) {
+  bytes->insert(std::end(*bytes), std::begin(str), std::end(str));
+}
+
+void AppendSize(Bytes* bytes, uint32_t size, bool sync_safe) {
+  int shift = sync_safe ? 7 : 8;
+  uint32_t mask = sync_safe ? 0x7f : 0xff;
+  for (int i = 3; i >= 0; --i) {
+    bytes->push_back(static_cast<uint8_t>((size >> (shift * i)) & mask));
+  }
+}
+
+Bytes CreateFrame(const std::string& id, const Bytes& body, uint8_t major) {
+  Bytes frame;
+  Append(&frame, id);
+  AppendSize(&frame, static_cast<uint32_t>(body.size()), major == 4);
+  frame.push_back(0);
+  frame.push_back(0);
+  frame.insert(std::end(frame), std::begin(body), std::end(body));
+  return frame;
+}
+
+Bytes CreateTextFrame(const std::string& id, uint8_t encoding,
+                      const Bytes& text, uint8_t major) {
+  Bytes body{encoding};
+  body.insert(std::end(body), std::begin(text), std::end(text));
+  return CreateFrame(id, body, major);
+}
+
+Bytes CreateTag(const std::vector<Bytes>& frames, uint8_t major,
+                uint8_t flags = 0, size_t padding = 16) {
+  Bytes content;
+  for (const auto& frame : frames) {
+    content.insert(std::end(content), std::begin(frame), std::end(frame));
+  }
+  content.resize(content.size() + padding, 0);
+
+  Bytes tag;
+  Append(&tag, "ID3");
+  tag.push_back(major);
+  tag.push_back(0);
+  tag.push_back(flags);
+  AppendSize(&tag, static_cast<uint32_t>(content.size()), true);
+  tag.insert(std::end(tag), std::begin(content), std::end(content));
+  return tag;
+}
+
+Bytes Latin1(const std::string& str) { return Bytes(str.begin(), str.end()); }
+
+bool CaseId3v23() {
+  auto file = CreateTag({CreateFrame("TPE1", Latin1("someone"), 3),
+                         CreateTextFrame("TIT2", 0, Latin1("Caf\xe9"), 3),
+                         CreateTextFrame("TRCK", 0, Latin1("7/12"), 3)},
+                        3);
+  const size_t tag_size = file.size();
+  Append(&file, "\xff\xfb\x90\x00 audio frames");
+
+  Id3Tag tag;
+  if (!ParseId3Tag(file.data(), file.size(), &tag)) {
+    return false;
+  }
+  return tag.title.ToUtf8() == "Caf\xc3\xa9" && tag.track_number == 7 &&
+         tag.header_size == tag_size && tag.trailer_size == 0;
+}
+
+bool CaseId3v24() {
+  // UTF-16 with BOM, UTF-8 and extended header
+  Bytes utf16{0xff, 0xfe, 'H', 0, 'i', 0, 0x3d, 0xd8, 0x00, 0xde, 0, 0};
+  auto frames = CreateTag({CreateTextFrame("TIT2", 1, utf16, 4),
+                           CreateTextFrame("TRCK", 3, Latin1("03"), 4)},
+                          4, 0x40);
+  Bytes file(std::begin(frames), std::begin(frames) + 10);
+  AppendSize(&file, 6, true);  // extended header (size includes itself)
+  file.push_back(1);
+  file.push_back(0);
+  file.insert(std::end(file), std::begin(frames) + 10, std::end(frames));
+  // fix tag size to account for the extended header
+  Bytes size;
+  AppendSize(&size, static_cast<uint32_t>(file.size() - 10), true);
+  std::copy(std::begin(size), std::end(size), std::begin(file) + 6);
+
+  Id3Tag tag;
+  if (!ParseId3Tag(file.data(), file.size(), &tag)) {
+    return false;
+  }
+  return tag.title.ToUtf8() == "Hi\xf0\x9f\x98\x80" && tag.track_number == 3 &&
+         tag.header_size == file.size();
+}
+
+bool CaseUnsynchronisation() {
+  Bytes text{'a', 0xff, 0x00, 'b'};  // unsynchronised latin1 "a\xffb"
+  auto file = CreateTag({CreateTextFrame("TIT2", 0, text, 3)}, 3, 0x80);
+
+  Id3Tag tag;
+  ParseId3Tag(file.data(), file.size(), &tag);
+  return tag.title.ToUtf8() == "a\xc3\xbf" "b";
+}
+
+bool CaseId3v1() {
+  Bytes file = Latin1("\xff\xfb\x90\x00 audio frames");
+  Bytes v1(128, 0);
+  std::string title("Title padded");
+  std::copy(std::begin(title), std::end(title), std::begin(v1) + 3);
+  v1[0] = 'T';
+  v1[1] = 'A';
+  v1[2] = 'G';
+  v1[3 + title.size()] = ' ';
+  v1[126] = 9;
+  file.insert(std::end(file), std::begin(v1), std::end(v1));
+
+  Id3Tag tag;
+  if (!ParseId3Tag(file.data(), file.size(), &tag)) {
+    return false;
+  }
+  return tag.title.ToUtf8() == title && tag.track_number == 9 &&
+         tag.header_size == 0 && tag.trailer_size == 128;
+}
+
+bool CaseId3v2OverridesId3v1() {
+  auto file = CreateTag({CreateTextFrame("TIT2", 3, Latin1("v2"), 3)}, 3);
+  Bytes v1(128, 0);
+  v1[0] = 'T';
+  v1[1] = 'A';
+  v1[2] = 'G';
+  v1[3] = 'x';
+  v1[126] = 4;
+  file.insert(std::end(file), std::begin(v1), std::end(v1));
+
+  Id3Tag tag;
+  ParseId3Tag(file.data(), file.size(), &tag);
+  return tag.title.ToUtf8() == "v2" && tag.track_number == 4;
+}
+
+bool CaseTruncated() {
+  auto file = CreateTag({CreateTextFrame("TIT2", 0, Latin1("title"), 3)}, 3);
+
+  // every prefix must be handled without reading past its end
+  for (size_t size = 0; size < file.size(); ++size) {
+    Bytes prefix(std::begin(file), std::begin(file) + size);
+    Id3Tag tag;
+    ParseId3Tag(prefix.data(), prefix.size(), &tag);
+    if (tag.header_size > size) {
+      return false;
+    }
+  }
+
+  // frame size bigger than the tag
+  auto frame = CreateTextFrame("TIT2", 0, Latin1("title"), 3);
+  frame[7] = 0x7f;
+  file = CreateTag({frame}, 3);
+  Id3Tag tag;
+  ParseId3Tag(file.data(), file.size(), &tag);
+  return tag.title.empty() && tag.header_size == file.size();
+}
+
+bool CaseNoTag() {
+  Bytes file = Latin1("\xff\xfb\x90\x00 audio frames");
+  Id3Tag tag;
+  return !ParseId3Tag(file.data(), file.size(), &tag) && tag.title.empty() &&
+         tag.header_size == 0 && tag.trailer_size == 0;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseId3v23()) {
+    return 1;
+  }
+  if (!ip::CaseId3v24()) {
+    return 1;
+  }
+  if (!ip::CaseUnsynchronisation()) {
+    return 1;
+  }
+  if (!ip::CaseId3v1()) {
+    return 1;
+  }
+  if (!ip::CaseId3v2OverridesId3v1()) {
+    return 1;
+  }
+  if (!ip::CaseTruncated()) {
+    return 1;
+  }
+  if (!ip::CaseNoTag()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "iplayer/loudness_analyzer.h"
+
+#include <math.h>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+
+namespace ip {
+
+class FakeTrackProvider : public ITrackProvider {
+ public:
+  std::error_code List(const std::string&,
+                       std::vector<TrackLocation>*) const override {
+    return {};
+  }
+  TrackInfo GetTrackInfo(const TrackLocation& location) override {
+    return TrackInfo{location, "title", 1, std::chrono::seconds(5), "fake"};
+  }
+  ITrackIOPtr OpenTrack(const TrackLocation&, std::error_code&) override {
+    return {};
+  }
+};
+
+// decode 5s of a 1kHz sine, its level in dBFS is the track's location
+class SineDecoder : public IDecoder {
+ public:
+  SineDecoder(const TrackInfo& track, ITrackIOPtr, AudioOutput* output,
+              CompletionCb completion_cb) {
+    double level = std::stod(track.Location());
+    future_ = std::async(std::launch::async, [=]() {
+      const AudioFormat format{SampleFormat::kS16, 44100, 2};
+      auto ec = output->Configure(format);
+      double amplitude = pow(10, level / 20) * 32767;
+      std::vector<int16_t> frame(2 * 1152);
+      for (size_t i = 0; i < 5 * 44100 && !ec; i += 1152) {
+        for (size_t j = 0; j < 1152; ++j) {
+          auto value = static_cast<int16_t>(
+              lrint(amplitude * sin(2 * M_PI * 1000 * (i + j) / 44100)));
+          frame[2 * j] = frame[2 * j + 1] = value;
+        }
+        ec = output->Write(reinterpret_cast<uint8_t*>(frame.data()),
+                           frame.size() * sizeof(int16_t));
+      }
+      output->EndOfStream();
+      completion_cb(ec);
+    });
+  }
+  ~SineDecoder() { future_.wait(); }
+
+  void Pause() override {}
+  void Unpause() override {}
+  void Seek(std::chrono::milliseconds) override {}
+  std::chrono::seconds GetPlayedTime() const override {
+    return std::chrono::seconds(0);
+  }
+  DecoderStats GetStats() const override { return {}; }
+
+ private:
+  std::future<void> future_;
+};
+
+bool CaseAnalyze() {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::map<TrackLocation, TrackInfo> published;
+  LoudnessAnalyzer analyzer(
+      [](const TrackLocation&) {
+        return std::make_unique<FakeTrackProvider>();
+      },
+      [](const std::string&, const TrackInfo& info, ITrackIOPtr io,
+         AudioOutput* output, IDecoder::CompletionCb cb) {
+        return std::make_unique<SineDecoder>(info, std::move(io), output, cb);
+      },
+      [&](TrackInfo info) {
+        std::lock_guard<std::mutex> lock(mutex);
+        published[info.Location()] = info;
+        cv.notify_all();
+      });
+
+  TrackInfo analyzed{"-30", "title", 1, std::chrono::seconds(5), "fake"};
+  analyzed.SetLoudness(-30, 0.03f);
+  TrackInfo no_codec("-40");
+  std::vector<TrackInfo> tracks{
+      {"-23", "title", 1, std::chrono::seconds(5), "fake"},
+      {"-13", "title", 1, std::chrono::seconds(5), "fake"},
+      analyzed,
+      no_codec};
+  analyzer.Push(tracks);
+  analyzer.Push(tracks);  // already pushed ones are ignored
+
+  // the worker runs at idle priority: on a busy machine (parallel tests) it
+  // only gets the cpu once the others are done
+  std::unique_lock<std::mutex> lock(mutex);
+  if (!cv.wait_for(lock, std::chrono::seconds(120),
+                   [&]() { return published.size() >= 2; })) {
+    return false;
+  }
+  // give a chance to unexpected publications
+  cv.wait_for(lock, std::chrono::milliseconds(100));
+  if (published.size() != 2) {
+    return false;
+  }
+  const auto& quiet = published["-23"];
+  const auto& loud = published["-13"];
+  return quiet.HasLoudness() && fabs(quiet.Loudness() + 23) < 0.2 &&
+         fabs(quiet.Peak() - pow(10, -23.0 / 20)) < 1e-3 &&
+         loud.HasLoudness() && fabs(loud.Loudness() + 13) < 0.2 &&
+         quiet.Codec() == "fake";
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseAnalyze()) {
+    return 1;
+  }
+  return 0;
+}
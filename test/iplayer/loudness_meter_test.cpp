@@ -0,0 +1,101 @@
+#include "iplayer/loudness_meter.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+namespace ip {
+
+// 'seconds' of a 1kHz sine at 'level' dBFS, silence for channels beyond
+// 'active'
+std::vector<float> CreateSine(uint32_t rate, uint32_t channels,
+                              uint32_t active, double level, double seconds) {
+  auto frames = static_cast<size_t>(rate * seconds);
+  double amplitude = pow(10, level / 20);
+  std::vector<float> samples(frames * channels, 0);
+  for (size_t i = 0; i < frames; ++i) {
+    auto value =
+        static_cast<float>(amplitude * sin(2 * M_PI * 1000 * i / rate));
+    for (uint32_t c = 0; c < active; ++c) {
+      samples[i * channels + c] = value;
+    }
+  }
+  return samples;
+}
+
+bool Near(double value, double expected) {
+  return fabs(value - expected) < 0.1;
+}
+
+// EBU Tech 3341: stereo 1kHz sine at -23 dBFS gives -23 LUFS
+bool CaseReferenceSine() {
+  for (uint32_t rate : {44100, 48000}) {
+    LoudnessMeter meter(rate, 2);
+    auto samples = CreateSine(rate, 2, 2, -23, 20);
+    // odd chunks, sub-blocks span several calls
+    size_t frames = samples.size() / 2;
+    for (size_t pos = 0; pos < frames; pos += 1152) {
+      meter.Process(samples.data() + 2 * pos,
+                    std::min<size_t>(1152, frames - pos));
+    }
+    if (!Near(meter.IntegratedLoudness(), -23) ||
+        fabs(meter.Peak() - pow(10, -23.0 / 20)) > 1e-3) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// one channel has half the energy: 3 LU less, whatever the channel count
+bool CaseChannels() {
+  LoudnessMeter mono(48000, 1);
+  auto samples = CreateSine(48000, 1, 1, -23, 10);
+  mono.Process(samples.data(), samples.size());
+  LoudnessMeter stereo(48000, 2);
+  samples = CreateSine(48000, 2, 1, -23, 10);
+  stereo.Process(samples.data(), samples.size() / 2);
+  return Near(mono.IntegratedLoudness(), -26) &&
+         Near(stereo.IntegratedLoudness(), -26);
+}
+
+// silence is gated out, a quiet part 20 LU below doesn't count either
+bool CaseGating() {
+  LoudnessMeter meter(48000, 2);
+  auto loud = CreateSine(48000, 2, 2, -23, 10);
+  auto quiet = CreateSine(48000, 2, 2, -43, 10);
+  std::vector<float> silence(48000 * 2 * 10, 0);
+  meter.Process(loud.data(), loud.size() / 2);
+  meter.Process(silence.data(), silence.size() / 2);
+  meter.Process(quiet.data(), quiet.size() / 2);
+  if (!Near(meter.IntegratedLoudness(), -23)) {
+    return false;
+  }
+  LoudnessMeter silent(48000, 2);
+  silent.Process(silence.data(), silence.size() / 2);
+  return std::isinf(silent.IntegratedLoudness()) && silent.Peak() == 0;
+}
+
+bool CaseNormalizationGain() {
+  // 5dB louder than target, 5dB quieter but limited by the peak
+  return fabs(NormalizationGain(-13, 0.5f) - pow(10, -5.0 / 20)) < 1e-6 &&
+         fabs(NormalizationGain(-23, 0.9f) - 1 / 0.9) < 1e-6 &&
+         NormalizationGain(-HUGE_VAL, 0) == 1.0f;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseReferenceSine()) {
+    return 1;
+  }
+  if (!ip::CaseChannels()) {
+    return 1;
+  }
+  if (!ip::CaseGating()) {
+    return 1;
+  }
+  if (!ip::CaseNormalizationGain()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "iplayer/utils/mapping_cache.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+class TempFile {
+ public:
+  TempFile(size_t size, char fill) {
+    char path[] = "/tmp/iplayer_mapping_cache_XXXXXX";
+    int fd = mkstemp(path);
+    path_ = path;
+    Write(fd, size, fill);
+    close(fd);
+  }
+  ~TempFile() { unlink(path_.c_str()); }
+
+  void Rewrite(size_t size, char fill) {
+    unlink(path_.c_str());  // new inode
+    int fd = open(path_.c_str(), O_CREAT | O_WRONLY, 0600);
+    Write(fd, size, fill);
+    close(fd);
+  }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  void Write(int fd, size_t size, char fill) {
+    std::vector<char> content(size, fill);
+    if (write(fd, content.data(), size) != static_cast<ssize_t>(size)) {
+      LOG("cannot write %s", path_.c_str());
+    }
+  }
+
+  std::string path_;
+};
+
+bool CaseShared() {
+  MappingCache cache(1024 * 1024);
+  TempFile file(4096, 'a');
+  std::error_code ec;
+  auto first = cache.Get(file.path(), FileMapping::Access::kRandom, ec);
+  auto second = cache.Get(file.path(), FileMapping::Access::kSequential, ec);
+  auto found = cache.Find(file.path(), FileMapping::Access::kSequential);
+  return !ec && first && first == second && first == found &&
+         cache.CachedSize() == 4096 && first->data()[4095] == 'a';
+}
+
+bool CaseBudget() {
+  MappingCache cache(3 * 4096);
+  std::vector<std::unique_ptr<TempFile>> files;
+  for (int i = 0; i < 4; ++i) {
+    files.push_back(std::make_unique<TempFile>(4096, 'a' + i));
+  }
+  std::error_code ec;
+  auto first = cache.Get(files[0]->path(), FileMapping::Access::kRandom, ec);
+  cache.Get(files[1]->path(), FileMapping::Access::kRandom, ec);
+  cache.Get(files[2]->path(), FileMapping::Access::kRandom, ec);
+  cache.Get(files[0]->path(), FileMapping::Access::kRandom, ec);  // touch
+  cache.Get(files[3]->path(), FileMapping::Access::kRandom, ec);
+
+  // least recently used is evicted
+  if (cache.CachedSize() > cache.Budget() ||
+      cache.Find(files[1]->path(), FileMapping::Access::kRandom) ||
+      !cache.Find(files[0]->path(), FileMapping::Access::kRandom)) {
+    return false;
+  }
+
+  // evicted mapping stays valid for its users
+  cache.SetBudget(0);
+  if (cache.CachedSize() != 0 || first->data()[0] != 'a') {
+    return false;
+  }
+
+  // too big to be cached but still mapped
+  auto big = cache.Get(files[3]->path(), FileMapping::Access::kRandom, ec);
+  return big && cache.CachedSize() == 0;
+}
+
+bool CaseFileChanged() {
+  MappingCache cache(1024 * 1024);
+  TempFile file(4096, 'a');
+  std::error_code ec;
+  auto old = cache.Get(file.path(), FileMapping::Access::kRandom, ec);
+  file.Rewrite(8192, 'b');
+  if (cache.Find(file.path(), FileMapping::Access::kRandom)) {
+    return false;
+  }
+  auto mapping = cache.Get(file.path(), FileMapping::Access::kRandom, ec);
+  return mapping && mapping != old && mapping->size() == 8192 &&
+         mapping->data()[0] == 'b' && old->data()[0] == 'a';
+}
+
+bool CaseError() {
+  MappingCache cache(1024 * 1024);
+  std::error_code ec;
+  auto mapping =
+      cache.Get("/nonexistent/file", FileMapping::Access::kRandom, ec);
+  return !mapping && ec;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseShared()) {
+    return 1;
+  }
+  if (!ip::CaseBudget()) {
+    return 1;
+  }
+  if (!ip::CaseFileChanged()) {
+    return 1;
+  }
+  if (!ip::CaseError()) {
+    return 1;
+  }
+  return 0;
+}
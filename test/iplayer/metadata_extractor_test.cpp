@@ -0,0 +1,195 @@
+#include "iplayer/metadata_extractor.h"
+
+#include <atomic>
+#include <thread>
+
+#include "iplayer/utils/log.h"
+
+namespace ip {
+
+// provider simulating slow I/O and recording concurrency
+class SlowTrackProvider : public ITrackProvider {
+ public:
+  SlowTrackProvider(std::atomic<size_t>* running, std::atomic<size_t>* peak,
+                    std::chrono::milliseconds latency)
+      : running_(running), peak_(peak), latency_(latency) {}
+
+  std::error_code List(const std::string&,
+                       std::vector<TrackLocation>*) const override {
+    return {};
+  }
+
+  TrackInfo GetTrackInfo(const TrackLocation& location) override {
+    if (location.find("broken") != std::string::npos) {
+      throw std::runtime_error("broken track");
+    }
+    auto running = ++*running_;
+    auto peak = peak_->load();
+    while (running > peak && !peak_->compare_exchange_weak(peak, running)) {
+    }
+    std::this_thread::sleep_for(latency_);
+    --*running_;
+    return TrackInfo{location, "title", 1, std::chrono::seconds(1), "dummy"};
+  }
+
+  ITrackIOPtr OpenTrack(const TrackLocation&, std::error_code&) override {
+    return {};
+  }
+
+ private:
+  std::atomic<size_t>* running_;
+  std::atomic<size_t>* peak_;
+  std::chrono::milliseconds latency_;
+};
+
+std::vector<TrackLocation> CreateTrackLocations(size_t count) {
+  std::vector<TrackLocation> locations;
+  for (size_t i = 0; i < count; ++i) {
+    locations.push_back("foo_" + std::to_string(i));
+  }
+  return locations;
+}
+
+bool CaseIncrementalPublish() {
+  std::atomic<size_t> running{0}, peak{0};
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t published = 0;
+  size_t publish_count = 0;
+  size_t first_batch_size = 0;
+
+  MetadataExtractor::Options options;
+  options.max_workers = 3;
+  options.batch_size = 10;
+  {
+    MetadataExtractor extractor(
+        [&](const TrackLocation&) {
+          return std::make_unique<SlowTrackProvider>(
+              &running, &peak, std::chrono::milliseconds(2));
+        },
+        [&](MetadataExtractor::TrackInfos infos) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (publish_count++ == 0) {
+            first_batch_size = infos.size();
+          }
+          published += infos.size();
+          cv.notify_one();
+        },
+        options);
+
+    auto locations = CreateTrackLocations(200);
+    locations.push_back("broken");
+    extractor.Push(locations);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!cv.wait_for(lock, std::chrono::seconds(10),
+                     [&]() { return published == 200; })) {
+      LOG("only %zu tracks published", published);
+      return false;
+    }
+  }
+  LOG("%zu batches, peak concurrency %zu", publish_count, peak.load());
+  return peak <= options.max_workers && peak > 1 && publish_count > 1 &&
+         first_batch_size < 200;
+}
+
+bool CaseThrottle() {
+  std::atomic<size_t> running{0}, peak{0};
+  std::atomic<size_t> published{0};
+
+  MetadataExtractor::Options options;
+  options.max_workers = 4;
+  options.io_latency_target = std::chrono::milliseconds(1);
+  MetadataExtractor extractor(
+      [&](const TrackLocation&) {
+        return std::make_unique<SlowTrackProvider>(
+            &running, &peak, std::chrono::milliseconds(5));
+      },
+      [&](MetadataExtractor::TrackInfos infos) { published += infos.size(); },
+      options);
+
+  extractor.Push(CreateTrackLocations(20));
+  auto start = std::chrono::steady_clock::now();
+  while (published < 20) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    if (std::chrono::steady_clock::now() - start > std::chrono::seconds(10)) {
+      return false;
+    }
+  }
+
+  // every extraction is slower than target: once throttled, only a single
+  // worker must be running
+  peak = 0;
+  extractor.Push(CreateTrackLocations(10));
+  while (published < 30) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return peak == 1;
+}
+
+bool CaseCancel() {
+  std::atomic<size_t> running{0}, peak{0};
+  std::atomic<size_t> published{0};
+  MetadataExtractor extractor(
+      [&](const TrackLocation&) {
+        return std::make_unique<SlowTrackProvider>(
+            &running, &peak, std::chrono::milliseconds(10));
+      },
+      [&](MetadataExtractor::TrackInfos infos) { published += infos.size(); });
+  extractor.Push(CreateTrackLocations(1000));
+  extractor.Cancel();
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  return published < 1000;
+}
+
+bool CasePrioritize() {
+  std::atomic<size_t> running{0}, peak{0};
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t published = 0;
+  size_t published_before_prioritized = 0;
+
+  MetadataExtractor::Options options;
+  options.max_workers = 1;
+  MetadataExtractor extractor(
+      [&](const TrackLocation&) {
+        return std::make_unique<SlowTrackProvider>(
+            &running, &peak, std::chrono::milliseconds(1));
+      },
+      [&](MetadataExtractor::TrackInfos infos) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (infos.find("foo_190") != std::cend(infos)) {
+          published_before_prioritized = published;
+        }
+        published += infos.size();
+        cv.notify_one();
+      },
+      options);
+
+  extractor.Push(CreateTrackLocations(200));
+  extractor.Prioritize({"foo_190", "unknown"});
+
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait_for(lock, std::chrono::seconds(10),
+              [&]() { return published == 200; });
+  // prioritized track is published alone, without waiting for a full batch
+  return published == 200 && published_before_prioritized < 10;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseIncrementalPublish()) {
+    return 1;
+  }
+  if (!ip::CaseThrottle()) {
+    return 1;
+  }
+  if (!ip::CasePrioritize()) {
+    return 1;
+  }
+  if (!ip::CaseCancel()) {
+    return 1;
+  }
+  return 0;
+}
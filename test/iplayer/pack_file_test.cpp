@@ -0,0 +1,153 @@
+#include "iplayer/pack_file.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "iplayer/pack_track_provider.h"
+#include "iplayer/track_info.h"
+#include "test/iplayer/test_tracks.h"
+
+namespace ip {
+
+void WriteFile(const std::string& path, const std::vector<uint8_t>& content) {
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(content.data()),
+             static_cast<std::streamsize>(content.size()));
+}
+
+struct Library {
+  std::string dir;
+  std::vector<std::string> files;  // relative to 'dir'
+  std::vector<std::string> dirs;
+
+  ~Library() {
+    for (const auto& file : files) {
+      unlink((dir + "/" + file).c_str());
+    }
+    for (auto it = dirs.rbegin(); it != dirs.rend(); ++it) {
+      rmdir((dir + "/" + *it).c_str());
+    }
+    rmdir(dir.c_str());
+  }
+
+  void Add(const std::string& file, const std::vector<uint8_t>& content) {
+    WriteFile(dir + "/" + file, content);
+    files.push_back(file);
+  }
+  void AddDir(const std::string& name) {
+    mkdir((dir + "/" + name).c_str(), 0755);
+    dirs.push_back(name);
+  }
+};
+
+bool CasePack() {
+  char dir[] = "/tmp/iplayer_pack_XXXXXX";
+  if (!mkdtemp(dir)) {
+    return false;
+  }
+  Library library;
+  library.dir = dir;
+  library.AddDir("rock");
+  library.AddDir("rockabilly");
+  auto b = CreateTrack("B", 50);
+  library.Add("rockabilly/d.mp3", CreateTrack("D", 10));
+  library.Add("rock/c.mp3", CreateTrack("C", 20));
+  library.Add("rock/b.mp3", b);
+  library.Add("a.mp3", CreateTrack("A", 100));
+  library.Add("notes.txt", {'n', 'o'});
+  library.Add("empty.mp3", {});  // unreadable, skipped
+  library.Add(".mp3", CreateTrack("E", 10));  // no name, not a track
+  library.Add("p3", CreateTrack("F", 10));
+  library.files.push_back("library.pack");
+  auto output = library.dir + "/library.pack";
+
+  size_t count = 0;
+  if (BuildPack(library.dir, output, &count) || count != 4) {
+    return false;
+  }
+  // sorted for lookups
+  PackFile pack(output);
+  size_t index = 0;
+  auto rock = pack.FindPrefix("rock/");
+  if (pack.EntryCount() != 4 || pack.Path(0) != "a.mp3" ||
+      pack.Path(3) != "rockabilly/d.mp3" || !pack.Find("rock/b.mp3", &index) ||
+      index != 1 || pack.Find("rock", &index) || rock.first != 1 ||
+      rock.second != 3 || pack.FindPrefix("").second != 4 ||
+      pack.Title(2) != "C" || pack.DataSize(1) != b.size() ||
+      pack.Duration(1) != std::chrono::milliseconds(50 * 1152 * 1000 / 44100)) {
+    return false;
+  }
+
+  PackTrackProvider provider;
+  auto base = "pack://" + output;
+  std::vector<TrackLocation> all;
+  std::vector<TrackLocation> directory;
+  std::vector<TrackLocation> single;
+  std::vector<TrackLocation> none;
+  if (provider.List(base, &all) || all.size() != 4 ||
+      all[1] != base + "#rock/b.mp3" ||
+      provider.List(base + "#rock", &directory) || directory.size() != 2 ||
+      provider.List(base + "#rock/c.mp3", &single) || single.size() != 1 ||
+      provider.List(base + "#jazz", &none) !=
+          std::errc::no_such_file_or_directory) {
+    return false;
+  }
+
+  auto info = provider.GetTrackInfo(all[1]);
+  auto frame_index = info.GetFrameIndex();
+  if (info.Title() != "B" || info.Codec() != "mp3" ||
+      info.Duration() != std::chrono::seconds(1) || !frame_index ||
+      frame_index->FrameCount() != 50) {
+    return false;
+  }
+  std::error_code ec;
+  auto io = provider.OpenTrack(all[1], ec);
+  std::vector<uint8_t> data(b.size() + 10);
+  if (!io || io->Read(data.data(), data.size(), ec) != b.size() || ec ||
+      !std::equal(b.begin(), b.end(), data.begin()) || io->Seek(1000) ||
+      io->Read(data.data(), 10, ec) != 10 ||
+      !std::equal(data.begin(), data.begin() + 10, b.begin() + 1000)) {
+    return false;
+  }
+  return !provider.OpenTrack(base + "#rock/z.mp3", ec) &&
+         ec == std::errc::no_such_file_or_directory;
+}
+
+bool CaseInvalid() {
+  char path[] = "/tmp/iplayer_pack_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  auto content = CreateTrack("not a pack", 10);
+  WriteFile(path, content);
+  bool result = false;
+  try {
+    PackFile pack(path);
+  } catch (const std::system_error& e) {
+    result = e.code() == std::errc::invalid_argument;
+  }
+  std::vector<TrackLocation> locations;
+  PackTrackProvider provider;
+  result = result && provider.List(std::string("pack://") + path, &locations) &&
+           locations.empty();
+  unlink(path);
+  return result;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CasePack()) {
+    return 1;
+  }
+  if (!ip::CaseInvalid()) {
+    return 1;
+  }
+  return 0;
+}
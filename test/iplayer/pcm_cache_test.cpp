@@ -0,0 +1,182 @@
+#include "iplayer/pcm_cache.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace ip {
+
+const size_t kFrames = 3 * CachedPcm::kBlockFrames + 123;
+
+std::string CreateFile(const char* content) {
+  char path[] = "/tmp/iplayer_pcm_cache_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return {};
+  }
+  auto written = write(fd, content, strlen(content));
+  close(fd);
+  return written < 0 ? std::string() : path;
+}
+
+// a sine, then noise, then full scale square (biggest residuals) and
+// silence
+std::vector<int16_t> CreateSamples(uint32_t channels) {
+  std::mt19937 generator(0);
+  std::uniform_int_distribution<int> noise(-32768, 32767);
+  std::vector<int16_t> samples(kFrames * channels);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    size_t frame = i / channels;
+    if (frame < CachedPcm::kBlockFrames) {
+      samples[i] = static_cast<int16_t>(
+          20000 * sin(2 * M_PI * 440 * frame / 44100 + i % channels));
+    } else if (frame < 2 * CachedPcm::kBlockFrames) {
+      samples[i] = static_cast<int16_t>(noise(generator));
+    } else if (frame < 3 * CachedPcm::kBlockFrames) {
+      samples[i] = frame % 2 ? 32767 : -32768;
+    }
+  }
+  return samples;
+}
+
+CachedPcmPtr Build(const std::vector<int16_t>& samples, uint32_t channels,
+                   bool compress) {
+  CachedPcmBuilder builder(compress, 1 << 30, 1.0f);
+  for (size_t done = 0; done < kFrames; done += 1152) {
+    size_t length = std::min<size_t>(1152, kFrames - done);
+    if (!builder.Append(44100, channels, &samples[done * channels], length)) {
+      return nullptr;
+    }
+  }
+  return builder.Finish();
+}
+
+// what's read back is what was cached, compression only gains on signals
+bool CaseRoundTrip() {
+  for (uint32_t channels : {1, 2}) {
+    auto samples = CreateSamples(channels);
+    auto raw = Build(samples, channels, false);
+    auto compressed = Build(samples, channels, true);
+    if (!raw || !compressed || compressed->Frames() != kFrames ||
+        compressed->BlockCount() != 4 || compressed->Channels() != channels ||
+        compressed->MemorySize() >= raw->MemorySize()) {
+      return false;
+    }
+    for (const auto& pcm : {raw, compressed}) {
+      std::vector<int16_t> result;
+      std::vector<int16_t> block(CachedPcm::kBlockFrames * channels);
+      for (size_t i = 0; i < pcm->BlockCount(); ++i) {
+        auto frames = pcm->ReadBlock(i, block.data());
+        result.insert(result.end(), block.begin(),
+                      block.begin() + frames * channels);
+      }
+      if (result != samples) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// tracks over the size limit or changing format aren't kept
+bool CaseGiveUp() {
+  std::vector<int16_t> samples(2 * CachedPcm::kBlockFrames);
+  CachedPcmBuilder small(false, 1000, 1.0f);
+  if (small.Append(44100, 2, samples.data(), CachedPcm::kBlockFrames) ||
+      small.Finish()) {
+    return false;
+  }
+  CachedPcmBuilder changing(true, 1 << 30, 1.0f);
+  return changing.Append(44100, 2, samples.data(), 100) &&
+         !changing.Append(48000, 2, samples.data(), 100) &&
+         !changing.Finish();
+}
+
+// a track is cached the second time it's played and dropped when its file
+// changes, the least recently used ones leave first
+bool CaseCache() {
+  auto pcm = Build(CreateSamples(2), 2, true);
+  PcmCache cache(2 * pcm->MemorySize() + 1);
+  std::vector<std::string> paths;
+  for (auto content : {"a", "b", "c"}) {
+    paths.push_back(CreateFile(content));
+  }
+  bool result = true;
+  FileIdentity id;
+  for (const auto& path : paths) {
+    auto location = "file://" + path;
+    result = result && !cache.StartCapture(location, 1.0f, &id) &&
+             cache.StartCapture(location, 1.0f, &id);
+    cache.Insert(location, id, pcm);
+    result = result && cache.Find(location, 1.0f) == pcm;
+  }
+  // third one evicted the first one
+  result = result && cache.CachedSize() == 2 * pcm->MemorySize() &&
+           !cache.Find("file://" + paths[0], 1.0f) &&
+           cache.Find("file://" + paths[1], 1.0f);
+
+  FILE* file = fopen(paths[1].c_str(), "a");
+  if (file) {
+    fputs("more", file);
+    fclose(file);
+  }
+  result = result && !cache.Find("file://" + paths[1], 1.0f) &&
+           cache.CachedSize() == pcm->MemorySize();
+  // only local files are cached
+  result = result && !cache.StartCapture("dummy://1", 1.0f, &id) &&
+           !cache.StartCapture("dummy://1", 1.0f, &id);
+  for (const auto& path : paths) {
+    unlink(path.c_str());
+  }
+  return result;
+}
+
+// a track cached with another gain isn't replayed but stays cached until
+// captured again with the new one
+bool CaseGain() {
+  auto pcm = Build(CreateSamples(1), 1, true);
+  PcmCache cache(4 * pcm->MemorySize());
+  auto path = CreateFile("a");
+  auto location = "file://" + path;
+  FileIdentity id;
+  cache.StartCapture(location, 1.0f, &id);
+  cache.StartCapture(location, 1.0f, &id);
+  cache.Insert(location, id, pcm);
+  bool result = !cache.Find(location, 0.5f) &&
+                cache.Find(location, 1.0f) == pcm;
+  auto builder = cache.StartCapture(location, 0.5f, &id);
+  if (builder) {
+    std::vector<int16_t> samples(100);
+    builder->Append(44100, 1, samples.data(), samples.size());
+    cache.Insert(location, id, builder->Finish());
+  }
+  auto found = cache.Find(location, 0.5f);
+  result = result && found && found->Gain() == 0.5f &&
+           !cache.Find(location, 1.0f) &&
+           cache.CachedSize() == found->MemorySize();
+  unlink(path.c_str());
+  return result;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseRoundTrip()) {
+    return 1;
+  }
+  if (!ip::CaseGiveUp()) {
+    return 1;
+  }
+  if (!ip::CaseCache()) {
+    return 1;
+  }
+  if (!ip::CaseGain()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "iplayer/pcm_convert.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Throughput of the PCM conversion kernels on frames of MPEG-1 layer 3 size,
+// results are checked against the scalar kernel.
+//
+// usage: pcm_convert_bench [iterations]
+
+namespace ip {
+
+const char* LevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar:
+      return "scalar";
+    case SimdLevel::kSse2:
+      return "sse2";
+    case SimdLevel::kAvx2:
+      return "avx2";
+  }
+  return "?";
+}
+
+const char* FormatName(SampleFormat format) {
+  switch (format) {
+    case SampleFormat::kS16:
+      return "s16";
+    case SampleFormat::kS32:
+      return "s32";
+    case SampleFormat::kFloat:
+      return "float";
+  }
+  return "?";
+}
+
+int Bench(size_t iterations) {
+  const size_t kFrameSamples = 1152;
+  const FixedSample one = 1 << kFixedFracBits;
+  std::mt19937 generator(0);
+  std::uniform_int_distribution<FixedSample> dist(-2 * one, 2 * one);
+  std::vector<FixedSample> left(kFrameSamples), right(kFrameSamples);
+  for (size_t i = 0; i < kFrameSamples; ++i) {
+    left[i] = dist(generator);
+    right[i] = dist(generator);
+  }
+
+  std::vector<SimdLevel> levels{SimdLevel::kScalar};
+  if (GetSimdLevel() != SimdLevel::kScalar) {
+    levels.push_back(SimdLevel::kSse2);
+  }
+  if (GetSimdLevel() == SimdLevel::kAvx2) {
+    levels.push_back(SimdLevel::kAvx2);
+  }
+
+  int result = 0;
+  for (auto format :
+       {SampleFormat::kS16, SampleFormat::kS32, SampleFormat::kFloat}) {
+    std::vector<uint8_t> expected(kFrameSamples * 2 * 4);
+    ConvertPcm(SimdLevel::kScalar, left.data(), right.data(), kFrameSamples,
+               format, expected.data());
+    for (auto level : levels) {
+      std::vector<uint8_t> out(expected.size());
+      auto begin = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < iterations; ++i) {
+        ConvertPcm(level, left.data(), right.data(), kFrameSamples, format,
+                   out.data());
+        // keep the compiler from skipping iterations
+        asm volatile("" : : "r"(out.data()) : "memory");
+      }
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - begin;
+      bool match = memcmp(expected.data(), out.data(), out.size()) == 0;
+      double samples = 2.0 * kFrameSamples * iterations;
+      printf("%-6s %-6s %8.1f Msamples/s %s\n", FormatName(format),
+             LevelName(level), samples / elapsed.count() / 1e6,
+             match ? "" : "MISMATCH");
+      if (!match) {
+        result = 1;
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace ip
+
+int main(int argc, char* argv[]) {
+  size_t iterations = 100000;
+  if (argc > 1) {
+    iterations = strtoul(argv[1], nullptr, 10);
+  }
+  return ip::Bench(iterations);
+}
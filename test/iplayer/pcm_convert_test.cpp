@@ -0,0 +1,172 @@
+#include "iplayer/pcm_convert.h"
+
+#include <string.h>
+#include <random>
+#include <vector>
+
+namespace ip {
+
+std::vector<SimdLevel> SupportedLevels() {
+  std::vector<SimdLevel> levels{SimdLevel::kScalar};
+  if (GetSimdLevel() != SimdLevel::kScalar) {
+    levels.push_back(SimdLevel::kSse2);
+  }
+  if (GetSimdLevel() == SimdLevel::kAvx2) {
+    levels.push_back(SimdLevel::kAvx2);
+  }
+  return levels;
+}
+
+std::vector<FixedSample> CreateSamples(size_t count, uint32_t seed) {
+  const FixedSample one = 1 << kFixedFracBits;
+  std::vector<FixedSample> samples(count);
+  std::mt19937 generator(seed);
+  // decoded samples can go above full scale, check clipping too
+  std::uniform_int_distribution<FixedSample> dist(-2 * one, 2 * one);
+  for (auto& sample : samples) {
+    sample = dist(generator);
+  }
+  // exact limits
+  const FixedSample limits[] = {one - 1, one, -one, -one - 1, 0, -1, 1};
+  for (size_t i = 0; i < count && i < sizeof(limits) / sizeof(limits[0]);
+       ++i) {
+    samples[i] = limits[i];
+  }
+  return samples;
+}
+
+bool CaseScalarReference() {
+  const FixedSample one = 1 << kFixedFracBits;
+  std::vector<FixedSample> left{0, one / 2, -one / 2, one, -2 * one};
+  std::vector<FixedSample> right{one - 1, -one, 4096, 4095, -4097};
+  std::vector<int16_t> s16(left.size() * 2);
+  ConvertPcm(SimdLevel::kScalar, left.data(), right.data(), left.size(),
+             SampleFormat::kS16, s16.data());
+  std::vector<int16_t> expected_s16{0,     32767,  16384, -32768, -16384,
+                                    1,     32767,  0,     -32768, -1};
+  if (s16 != expected_s16) {
+    return false;
+  }
+
+  std::vector<int32_t> s32(left.size());
+  ConvertPcm(SimdLevel::kScalar, left.data(), nullptr, left.size(),
+             SampleFormat::kS32, s32.data());
+  std::vector<int32_t> expected_s32{0, 1 << 30, -(1 << 30), 0x7ffffff8,
+                                    INT32_MIN};
+  if (s32 != expected_s32) {
+    return false;
+  }
+
+  std::vector<float> f(left.size());
+  ConvertPcm(SimdLevel::kScalar, left.data(), nullptr, left.size(),
+             SampleFormat::kFloat, f.data());
+  return f[0] == 0.0f && f[1] == 0.5f && f[2] == -0.5f && f[3] == 1.0f &&
+         f[4] == -1.0f;
+}
+
+bool CaseGainReference() {
+  const FixedSample one = 1 << kFixedFracBits;
+  std::vector<FixedSample> left{one / 2, one / 2, -one / 4};
+  std::vector<FixedSample> right{one, -one, 3};
+  std::vector<int16_t> s16(left.size() * 2);
+  ConvertPcm(SimdLevel::kScalar, left.data(), right.data(), left.size(),
+             SampleFormat::kS16, 2.0f, s16.data());
+  // full scale is clipped after the gain
+  std::vector<int16_t> expected_s16{32767, 32767, 32767, -32768, -16384, 0};
+  if (s16 != expected_s16) {
+    return false;
+  }
+  std::vector<float> f(left.size());
+  ConvertPcm(SimdLevel::kScalar, left.data(), nullptr, left.size(),
+             SampleFormat::kFloat, 0.5f, f.data());
+  return f[0] == 0.25f && f[1] == 0.25f && f[2] == -0.125f;
+}
+
+// every kernel must give exactly the scalar result, whatever the length
+// (vector body + scalar tail), the alignment of the buffers and the gain
+bool CaseKernelsMatchScalar() {
+  const SampleFormat formats[] = {SampleFormat::kS16, SampleFormat::kS32,
+                                  SampleFormat::kFloat};
+  auto left = CreateSamples(1200, 1);
+  auto right = CreateSamples(1200, 2);
+  for (auto level : SupportedLevels()) {
+    for (auto format : formats) {
+      for (size_t offset = 0; offset < 3; ++offset) {
+        for (size_t count : {0, 1, 3, 7, 8, 15, 16, 17, 33, 576, 1152}) {
+          for (bool stereo : {false, true}) {
+            for (float gain : {1.0f, 0.3f, 1.7f}) {
+              size_t out_size = count * 2 * 4 + 1;
+              std::vector<uint8_t> expected(out_size, 0xaa);
+              std::vector<uint8_t> result(out_size, 0xaa);
+              const FixedSample* r = stereo ? right.data() + offset : nullptr;
+              ConvertPcm(SimdLevel::kScalar, left.data() + offset, r, count,
+                         format, gain, expected.data() + 1);
+              ConvertPcm(level, left.data() + offset, r, count, format, gain,
+                         result.data() + 1);
+              if (memcmp(expected.data(), result.data(), out_size) != 0) {
+                return false;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// float input, as coming out of the dsp chain
+bool CaseFloatInput() {
+  std::vector<float> left{0.5f, 1.5f, -1.0f, 0.25f / 32768};
+  std::vector<int16_t> s16(left.size());
+  ConvertPcm(SimdLevel::kScalar, left.data(), nullptr, left.size(),
+             SampleFormat::kS16, s16.data());
+  if (s16 != std::vector<int16_t>{16384, 32767, -32768, 0}) {
+    return false;
+  }
+  std::vector<float> samples(1200);
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<float> dist(-1.5f, 1.5f);
+  for (auto& sample : samples) {
+    sample = dist(generator);
+  }
+  const SampleFormat formats[] = {SampleFormat::kS16, SampleFormat::kS32,
+                                  SampleFormat::kFloat};
+  for (auto level : SupportedLevels()) {
+    for (auto format : formats) {
+      for (size_t count : {0, 3, 8, 17, 1152}) {
+        for (bool stereo : {false, true}) {
+          size_t out_size = count * 2 * 4;
+          std::vector<uint8_t> expected(out_size, 0xaa);
+          std::vector<uint8_t> result(out_size, 0xaa);
+          const float* r = stereo ? samples.data() + 1 : nullptr;
+          ConvertPcm(SimdLevel::kScalar, samples.data(), r, count, format,
+                     expected.data());
+          ConvertPcm(level, samples.data(), r, count, format, result.data());
+          if (expected != result) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseScalarReference()) {
+    return 1;
+  }
+  if (!ip::CaseGainReference()) {
+    return 1;
+  }
+  if (!ip::CaseKernelsMatchScalar()) {
+    return 1;
+  }
+  if (!ip::CaseFloatInput()) {
+    return 1;
+  }
+  return 0;
+}
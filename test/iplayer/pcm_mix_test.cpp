@@ -0,0 +1,101 @@
+#include "iplayer/pcm_mix.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+namespace ip {
+
+const size_t kLength = 1000;
+
+// fading out alone is weighted by cos, fading in alone by sin: the sum of
+// their powers stays 1 along the fade
+bool CaseEqualPower() {
+  const AudioFormat format{SampleFormat::kFloat, 44100, 2};
+  std::vector<float> one(2 * kLength, 1.0f), silence(2 * kLength, 0.0f);
+  std::vector<float> out_weight(2 * kLength), in_weight(2 * kLength);
+  auto bytes = [](std::vector<float>& v) {
+    return reinterpret_cast<uint8_t*>(v.data());
+  };
+  CrossfadePcm(format, bytes(one), bytes(silence), kLength, 0, kLength,
+               bytes(out_weight));
+  CrossfadePcm(format, bytes(silence), bytes(one), kLength, 0, kLength,
+               bytes(in_weight));
+  if (out_weight[0] != 1.0f || in_weight[0] != 0.0f) {
+    return false;
+  }
+  for (size_t i = 0; i < 2 * kLength; ++i) {
+    float power = out_weight[i] * out_weight[i] + in_weight[i] * in_weight[i];
+    if (fabsf(power - 1.0f) > 1e-5f || out_weight[i] != out_weight[i ^ 1]) {
+      return false;
+    }
+    double progress = M_PI_2 * (i / 2) / kLength;
+    if (fabs(out_weight[i] - cos(progress)) > 1e-5 ||
+        fabs(in_weight[i] - sin(progress)) > 1e-5) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// a fade cut in blocks of any size, including single frames that take the
+// scalar path, gives exactly the same samples, clipped at full scale
+template <typename T>
+bool CheckBlocks(SampleFormat sample_format, T value, T clipped) {
+  for (uint8_t channels : {1, 2}) {
+    const AudioFormat format{sample_format, 44100, channels};
+    std::vector<T> fading_out(channels * kLength);
+    std::vector<T> fading_in(channels * kLength);
+    for (size_t i = 0; i < fading_out.size(); ++i) {
+      fading_out[i] = static_cast<T>(i % 2 ? value : -value);
+      fading_in[i] = static_cast<T>(i % 3 ? value : -value);
+    }
+    auto whole = fading_out;
+    auto* in = reinterpret_cast<const uint8_t*>(fading_in.data());
+    CrossfadePcm(format, reinterpret_cast<uint8_t*>(whole.data()), in,
+                 kLength, 0, kLength, reinterpret_cast<uint8_t*>(whole.data()));
+    std::vector<T> blocks(fading_out.size());
+    size_t frame_size = format.BytesPerFrame();
+    for (size_t position = 0, block = 1; position < kLength;
+         position += block, block = block % 7 + 1) {
+      size_t frames = std::min(block, kLength - position);
+      CrossfadePcm(
+          format,
+          reinterpret_cast<const uint8_t*>(fading_out.data()) +
+              position * frame_size,
+          in + position * frame_size, frames, position, kLength,
+          reinterpret_cast<uint8_t*>(blocks.data()) + position * frame_size);
+    }
+    if (memcmp(whole.data(), blocks.data(), whole.size() * sizeof(T))) {
+      return false;
+    }
+    // in phase at the middle of the fade, sqrt(2) gain goes over full scale
+    const size_t mid = (kLength / 2) * channels;
+    for (size_t i = mid; i < mid + channels; ++i) {
+      if (fading_out[i] == value && fading_in[i] == value &&
+          whole[i] != clipped) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool CaseBlocks() {
+  return CheckBlocks<int16_t>(SampleFormat::kS16, 30000, 32767) &&
+         CheckBlocks<int32_t>(SampleFormat::kS32, 2000000000, 2147483520) &&
+         CheckBlocks<float>(SampleFormat::kFloat, 0.9f, 1.0f);
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseEqualPower()) {
+    return 1;
+  }
+  if (!ip::CaseBlocks()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include "iplayer/playlist_import.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "iplayer/playlist.h"
+
+// Time to import a huge m3u file (1M tracks, 48MB) into the player's
+// playlist: reading, parsing and adding by batches. The budget is 3s per
+// million tracks.
+//
+// usage: playlist_import_bench [tracks]
+
+namespace ip {
+
+// seconds taken, negative when the import failed
+double Bench(size_t track_count) {
+  std::string content = "#EXTM3U\n";
+  content.reserve(track_count * 48);
+  for (size_t i = 0; i < track_count; ++i) {
+    content += "#EXTINF:180,Artist - Title\nartist/album/";
+    content += std::to_string(i);
+    content += ".mp3\n";
+  }
+  char path[] = "/tmp/iplayer_playlist_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return -1;
+  }
+  close(fd);
+  unlink(path);
+  auto named = std::string(path) + ".m3u";
+  {
+    std::ofstream file(named, std::ios::binary);
+    file << content;
+  }
+
+  Playlist playlist;
+  auto begin = std::chrono::steady_clock::now();
+  auto ec = ImportPlaylist(named, 4096,
+                           [&](std::vector<TrackLocation>&& batch) {
+                             playlist.AddTrack(batch);
+                           });
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  unlink(named.c_str());
+  auto imported = playlist.GetTracks().size();
+  printf("%zu tracks in %.0f ms, %.0f tracks/s\n", imported,
+         elapsed.count() * 1000, imported / elapsed.count());
+  if (ec || imported != track_count) {
+    printf("import failed: %s\n", ec.message().c_str());
+    return -1;
+  }
+  return elapsed.count();
+}
+
+}  // namespace ip
+
+int main(int argc, char* argv[]) {
+  size_t track_count = 1000000;
+  if (argc > 1) {
+    track_count = strtoul(argv[1], nullptr, 10);
+  }
+  double seconds = ip::Bench(track_count);
+  if (seconds < 0) {
+    return 1;
+  }
+  if (seconds > 3.0 * track_count / 1000000) {
+    printf("OVER BUDGET\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include "iplayer/playlist_import.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "iplayer/fs_track_provider.h"
+#include "iplayer/playlist.h"
+#include "iplayer/playlist_track_provider.h"
+
+namespace ip {
+
+std::vector<TrackLocation> Parse(const std::string& content,
+                                 PlaylistFormat format) {
+  std::vector<TrackLocation> locations;
+  ParsePlaylist(content.data(), content.size(), format, "/music", 100,
+                [&](std::vector<TrackLocation>&& batch) {
+                  locations.insert(locations.end(), batch.begin(),
+                                   batch.end());
+                });
+  return locations;
+}
+
+bool CaseM3u() {
+  auto locations = Parse(
+      "\xef\xbb\xbf#EXTM3U\r\n"
+      "#EXTINF:123,Artist - Title\r\n"
+      "a b.mp3\r\n"
+      "\r\n"
+      "  sub/c.mp3  \n"
+      "/abs/d.mp3\n"
+      "file:///e%20f.mp3\n"
+      "file://localhost/g.mp3\n"
+      "http://host/h.mp3\n"
+      "#comment",
+      PlaylistFormat::kM3u);
+  return locations == std::vector<TrackLocation>{
+                          "file:///music/a b.mp3", "file:///music/sub/c.mp3",
+                          "file:///abs/d.mp3", "file:///e f.mp3",
+                          "file:///g.mp3", "http://host/h.mp3"};
+}
+
+bool CasePls() {
+  auto locations = Parse(
+      "[playlist]\n"
+      "File1=a.mp3\n"
+      "Title1=A\n"
+      "Length1=-1\n"
+      "file2=http://host/b.mp3\n"
+      "FileX=ignored.mp3\n"
+      "NumberOfEntries=2\n"
+      "Version=2\n",
+      PlaylistFormat::kPls);
+  return locations ==
+         std::vector<TrackLocation>{"file:///music/a.mp3", "http://host/b.mp3"};
+}
+
+bool CaseXspf() {
+  auto locations = Parse(
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n"
+      "  <location>http://host/playlist.xspf</location>\n"
+      "  <trackList>\n"
+      "    <track><location>rock%20n%20roll/a.mp3</location></track>\n"
+      "    <track><title>B</title>\n"
+      "      <location>file:///b&amp;c.mp3</location></track>\n"
+      "    <track><location>http://host/d.mp3?x=1&amp;y=&#50;</location>"
+      "</track>\n"
+      "  </trackList>\n"
+      "</playlist>\n",
+      PlaylistFormat::kXspf);
+  return locations == std::vector<TrackLocation>{
+                          "file:///music/rock n roll/a.mp3", "file:///b&c.mp3",
+                          "http://host/d.mp3?x=1&y=2"};
+}
+
+bool CaseBatches() {
+  std::string content;
+  for (int i = 0; i < 10; ++i) {
+    content += std::to_string(i) + ".mp3\n";
+  }
+  std::vector<size_t> sizes;
+  ParsePlaylist(content.data(), content.size(), PlaylistFormat::kM3u, "/", 3,
+                [&](std::vector<TrackLocation>&& batch) {
+                  sizes.push_back(batch.size());
+                });
+  return sizes == std::vector<size_t>{3, 3, 3, 1};
+}
+
+std::string CreateFile(const std::string& content, const std::string& suffix) {
+  char path[] = "/tmp/iplayer_playlist_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return {};
+  }
+  close(fd);
+  unlink(path);
+  auto named = path + suffix;
+  std::ofstream file(named, std::ios::binary);
+  file << content;
+  return named;
+}
+
+bool CaseProviders() {
+  std::string path;
+  if (!GetPlaylistPath("playlist:///a/list", &path) || path != "/a/list" ||
+      !GetPlaylistPath("file:///a/list.M3U8", &path) ||
+      path != "/a/list.M3U8" || !GetPlaylistPath("list.pls", &path) ||
+      GetPlaylistPath("http://host/list.m3u", &path) ||
+      GetPlaylistPath("file:///a/b.mp3", &path) ||
+      GetPlaylistPath("file:///a.m3u/b.mp3", &path)) {
+    return false;
+  }
+
+  // no extension: the format is guessed from the content
+  auto pls = CreateFile("[playlist]\nFile1=a.mp3\n", "");
+  auto m3u = CreateFile("a.mp3\nb.mp3\n", ".m3u");
+  auto dir = pls.substr(0, pls.rfind('/'));
+  PlaylistTrackProvider provider;
+  FsTrackProvider fs;
+  std::vector<TrackLocation> guessed;
+  std::vector<TrackLocation> by_extension;
+  std::vector<TrackLocation> missing;
+  bool result =
+      !provider.List("playlist://" + pls, &guessed) &&
+      guessed == std::vector<TrackLocation>{"file://" + dir + "/a.mp3"} &&
+      !fs.List("file://" + m3u, &by_extension) && by_extension.size() == 2 &&
+      provider.List("playlist:///nonexistent.m3u", &missing) ==
+          std::errc::no_such_file_or_directory;
+  unlink(pls.c_str());
+  unlink(m3u.c_str());
+  return result;
+}
+
+// a playlist file imported into the player's playlist by batches, in order
+// (the 1M tracks timing is playlist_import_bench)
+bool CaseImport() {
+  const size_t kTracks = 10000;
+  std::string content = "#EXTM3U\n";
+  for (size_t i = 0; i < kTracks; ++i) {
+    content += "#EXTINF:180,Artist - Title\nartist/album/";
+    content += std::to_string(i);
+    content += ".mp3\n";
+  }
+  auto path = CreateFile(content, ".m3u");
+  Playlist playlist;
+  size_t batches = 0;
+  auto ec = ImportPlaylist(path, 4096,
+                           [&](std::vector<TrackLocation>&& batch) {
+                             ++batches;
+                             playlist.AddTrack(batch);
+                           });
+  unlink(path.c_str());
+  auto tracks = playlist.GetTracks();
+  if (ec || tracks.size() != kTracks || batches != 3) {
+    return false;
+  }
+  auto dir = "file://" + path.substr(0, path.rfind('/')) + "/artist/album/";
+  for (size_t i = 0; i < kTracks; ++i) {
+    if (tracks[i].Location() != dir + std::to_string(i) + ".mp3") {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseM3u()) {
+    return 1;
+  }
+  if (!ip::CasePls()) {
+    return 1;
+  }
+  if (!ip::CaseXspf()) {
+    return 1;
+  }
+  if (!ip::CaseBatches()) {
+    return 1;
+  }
+  if (!ip::CaseProviders()) {
+    return 1;
+  }
+  if (!ip::CaseImport()) {
+    return 1;
+  }
+  return 0;
+}
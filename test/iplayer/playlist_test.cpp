@@ -244,6 +244,66 @@ bool CaseRandomPlay(int seed) {
   return true;
 }
 
+bool CaseNextTracks() {
+  Playlist playlist(42);
+  auto locations = CreateTrackLocations(10, 1);
+  playlist.AddTrack(locations);
+
+  auto check = [&](size_t count) {
+    Playlist::TrackId current = 0;
+    auto tracks = playlist.GetTracks(&current);
+    auto next = playlist.NextTracks(count);
+    for (size_t i = 0; i < next.size(); ++i) {
+      if (next[i] != tracks[(current + i) % tracks.size()].Location()) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  playlist.SeekTrack(8, Playlist::SeekWay::kCurrent, nullptr);
+  if (playlist.NextTracks(5).size() != 2 || !check(5)) {
+    return false;
+  }
+  playlist.SetRepeatPlaylistEnabled(true);
+  if (playlist.NextTracks(5).size() != 5 || !check(5)) {
+    return false;
+  }
+  playlist.SetModeRandom(true);
+  playlist.SeekTrack(3, Playlist::SeekWay::kCurrent, nullptr);
+  if (!check(10)) {
+    return false;
+  }
+  playlist.SetRepeatTrackEnabled(true);
+  auto next = playlist.NextTracks(5);
+  if (next.size() != 1 || next[0] != playlist.CurrentTrack().Location()) {
+    return false;
+  }
+  return true;
+}
+
+// tracks added by batches in random mode are all played once
+bool CaseRandomAddTrack() {
+  Playlist playlist(0);
+  playlist.SetModeRandom(true);
+  std::vector<TrackLocation> all;
+  for (size_t batch = 0; batch < 4; ++batch) {
+    std::vector<TrackLocation> locations;
+    for (size_t i = 0; i < 3; ++i) {
+      locations.push_back("foo_" + std::to_string(batch * 3 + i));
+    }
+    playlist.AddTrack(locations);
+    all.insert(std::end(all), std::begin(locations), std::end(locations));
+  }
+  std::vector<TrackLocation> played;
+  for (const auto& track : playlist.GetTracks()) {
+    played.push_back(track.Location());
+  }
+  std::sort(std::begin(all), std::end(all));
+  std::sort(std::begin(played), std::end(played));
+  return played == all;
+}
+
 }  // namespace ip
 
 int main() {
@@ -262,6 +322,12 @@ int main() {
   if (!ip::CaseRepeatPlaylist()) {
     return 1;
   }
+  if (!ip::CaseNextTracks()) {
+    return 1;
+  }
+  if (!ip::CaseRandomAddTrack()) {
+    return 1;
+  }
   for (int i = 0; i < 10000; ++i) {
     if (!ip::CaseRandomPlay(i)) {
       return 1;
@@ -0,0 +1,65 @@
+#include "iplayer/resampler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Throughput of the conversion of a 48kHz stereo stream to 44.1kHz for each
+// quality, fed by frames of MPEG-1 layer 3 size. Reported as how many times
+// faster than realtime a single core runs, the default quality must reach
+// 100x.
+//
+// usage: resampler_bench [iterations]
+
+namespace ip {
+
+double Bench(ResampleQuality quality, const char* name, size_t iterations) {
+  const size_t kFrameSamples = 1152;
+  const uint32_t kInputRate = 48000;
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> left(kFrameSamples), right(kFrameSamples);
+  for (size_t i = 0; i < kFrameSamples; ++i) {
+    left[i] = dist(generator);
+    right[i] = dist(generator);
+  }
+
+  Resampler resampler(kInputRate, 44100, 2, quality);
+  std::vector<float> out_left(resampler.MaxOutput(kFrameSamples));
+  std::vector<float> out_right(out_left.size());
+  const float* in[] = {left.data(), right.data()};
+  float* out[] = {out_left.data(), out_right.data()};
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    resampler.Process(in, kFrameSamples, out);
+    // keep the compiler from skipping iterations
+    asm volatile("" : : "r"(out_left.data()) : "memory");
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  double audio = static_cast<double>(kFrameSamples) * iterations / kInputRate;
+  double speed = audio / elapsed.count();
+  printf("%-6s %.1f ns/frame, %.0fx realtime\n", name,
+         1e9 * elapsed.count() / (kFrameSamples * iterations), speed);
+  return speed;
+}
+
+}  // namespace ip
+
+int main(int argc, char* argv[]) {
+  size_t iterations = 20000;
+  if (argc > 1) {
+    iterations = strtoul(argv[1], nullptr, 10);
+  }
+  ip::Bench(ip::ResampleQuality::kFast, "fast", iterations);
+  double speed =
+      ip::Bench(ip::ResampleQuality::kMedium, "medium", iterations);
+  ip::Bench(ip::ResampleQuality::kBest, "best", iterations);
+  if (speed < 100) {
+    printf("OVER BUDGET\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,164 @@
+#include "iplayer/resampler.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+namespace ip {
+
+const uint32_t kOutputRate = 44100;
+
+std::vector<SimdLevel> SupportedLevels() {
+  std::vector<SimdLevel> levels{SimdLevel::kScalar};
+  if (GetSimdLevel() != SimdLevel::kScalar) {
+    levels.push_back(SimdLevel::kSse2);
+  }
+  if (GetSimdLevel() == SimdLevel::kAvx2) {
+    levels.push_back(SimdLevel::kAvx2);
+  }
+  return levels;
+}
+
+std::vector<float> CreateSine(double frequency, uint32_t rate, size_t count) {
+  std::vector<float> samples(count);
+  for (size_t i = 0; i < count; ++i) {
+    samples[i] =
+        static_cast<float>(0.5 * sin(2 * M_PI * frequency * i / rate));
+  }
+  return samples;
+}
+
+// whole stream by blocks of 'block' frames (the last one may be shorter),
+// the second channel is the first one reversed
+std::vector<std::vector<float>> Resample(Resampler* resampler,
+                                         const std::vector<float>& input,
+                                         size_t block) {
+  std::vector<float> reversed(input.rbegin(), input.rend());
+  std::vector<std::vector<float>> output(resampler->Channels());
+  std::vector<float> left(resampler->MaxOutput(block));
+  std::vector<float> right(left.size());
+  float* out[] = {left.data(), right.data()};
+  size_t done = 0;
+  bool drained = false;
+  while (!drained) {
+    size_t count;
+    if (done == input.size()) {
+      count = resampler->Drain(out);
+      drained = true;
+    } else {
+      size_t length = std::min(block, input.size() - done);
+      const float* in[] = {input.data() + done, reversed.data() + done};
+      count = resampler->Process(in, length, out);
+      done += length;
+    }
+    for (uint32_t c = 0; c < resampler->Channels(); ++c) {
+      output[c].insert(output[c].end(), out[c], out[c] + count);
+    }
+  }
+  return output;
+}
+
+// N input frames give exactly ceil(N * output / input) frames whatever the
+// blocks, a drained resampler can be reused
+bool CaseLength() {
+  const size_t kFrames = 10007;
+  std::vector<float> input(kFrames, 0.25f);
+  for (uint32_t rate : {8000, 11025, 22050, 32000, 48000, 96000}) {
+    Resampler resampler(rate, kOutputRate, 1, ResampleQuality::kMedium);
+    auto expected = (uint64_t{kFrames} * kOutputRate + rate - 1) / rate;
+    for (size_t block : {1, 577, 1152, 4096, 20000}) {
+      auto output = Resample(&resampler, input, block);
+      if (output[0].size() != expected) {
+        return false;
+      }
+      // constant is kept once the start/end of the filter are left
+      if (fabsf(output[0][expected / 2] - 0.25f) > 1e-5f) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// a tone in the passband keeps its amplitude and phase: the output is the
+// tone at the new rate
+bool CaseSine() {
+  for (auto quality : {ResampleQuality::kFast, ResampleQuality::kMedium,
+                       ResampleQuality::kBest}) {
+    for (uint32_t rate : {32000, 48000}) {
+      Resampler resampler(rate, kOutputRate, 1, quality);
+      auto input = CreateSine(1000, rate, rate);
+      auto output = Resample(&resampler, input, 1152);
+      auto expected = CreateSine(1000, kOutputRate, output[0].size());
+      for (size_t i = 200; i < output[0].size() - 200; ++i) {
+        if (fabsf(output[0][i] - expected[i]) > 1e-3f) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// decimating, a tone above the output Nyquist frequency is removed instead
+// of aliasing in the audible band
+bool CaseAntiAliasing() {
+  const float kLimits[] = {1e-3f, 1e-4f, 1e-5f};  // -60, -80, -100dB of 0.5
+  for (auto quality : {ResampleQuality::kFast, ResampleQuality::kMedium,
+                       ResampleQuality::kBest}) {
+    Resampler resampler(48000, kOutputRate, 1, quality);
+    auto output = Resample(&resampler, CreateSine(23500, 48000, 48000), 1152);
+    float peak = 0;
+    for (size_t i = 200; i < output[0].size() - 200; ++i) {
+      peak = std::max(peak, fabsf(output[0][i]));
+    }
+    if (peak > 0.5f * kLimits[static_cast<int>(quality)]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// vectorized kernels only differ from the scalar one by rounding, channels
+// are independent
+bool CaseKernels() {
+  auto input = CreateSine(440, 48000, 9000);
+  Resampler scalar(48000, kOutputRate, 2, ResampleQuality::kMedium,
+                   SimdLevel::kScalar);
+  auto reference = Resample(&scalar, input, 1152);
+  for (auto level : SupportedLevels()) {
+    Resampler stereo(48000, kOutputRate, 2, ResampleQuality::kMedium, level);
+    Resampler mono(48000, kOutputRate, 1, ResampleQuality::kMedium, level);
+    auto output = Resample(&stereo, input, 1000);
+    auto single = Resample(&mono, input, 1152);
+    if (single[0] != output[0] || output[1].size() != reference[1].size()) {
+      return false;
+    }
+    for (uint32_t c = 0; c < 2; ++c) {
+      for (size_t i = 0; i < reference[c].size(); ++i) {
+        if (fabsf(output[c][i] - reference[c][i]) > 1e-6f) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseLength()) {
+    return 1;
+  }
+  if (!ip::CaseSine()) {
+    return 1;
+  }
+  if (!ip::CaseAntiAliasing()) {
+    return 1;
+  }
+  if (!ip::CaseKernels()) {
+    return 1;
+  }
+  return 0;
+}
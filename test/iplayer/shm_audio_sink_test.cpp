@@ -0,0 +1,163 @@
+#include "iplayer/shm_audio_sink.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ip {
+
+const AudioFormat kCdFormat{SampleFormat::kS16, 44100, 2};
+const size_t kPeriod = 4 * 4410;  // 100ms
+const size_t kCapacity = 1 << 16;
+
+std::string SegmentName() {
+  return "/iplayer_shm_test_" + std::to_string(getpid());
+}
+
+std::vector<uint8_t> CreatePcm(size_t size) {
+  std::vector<uint8_t> pcm(size);
+  for (size_t i = 0; i < size; ++i) {
+    pcm[i] = static_cast<uint8_t>(i * 7 % 251);
+  }
+  return pcm;
+}
+
+// what a reader process gets is what was written after it started
+bool CaseOtherProcess() {
+  auto name = SegmentName();
+  auto pcm = CreatePcm(40 * kPeriod);
+  // room for it all: a reader descheduled on a loaded machine must not
+  // overrun here
+  ShmAudioSink sink(name, pcm.size());
+  int fds[2];
+  if (sink.Open(kCdFormat) || pipe(fds) != 0) {
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    ShmPcmReader reader;
+    std::vector<uint8_t> received(pcm.size());
+    size_t size = 0;
+    ShmPcmState state;
+    if (reader.Open(name) || reader.Read(received.data(), kPeriod, &state)) {
+      _exit(1);
+    }
+    char ready = 1;
+    if (write(fds[1], &ready, 1) != 1) {
+      _exit(1);
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (size < pcm.size() && std::chrono::steady_clock::now() < deadline) {
+      auto count = reader.Read(&received[size], pcm.size() - size, &state);
+      if (count == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      size += count;
+    }
+    bool ok = received == pcm && reader.Skipped() == 0 && state.active &&
+              state.format == kCdFormat && state.timestamp_ns > 0;
+    _exit(ok ? 0 : 1);
+  }
+  char ready = 0;
+  if (pid < 0 || read(fds[0], &ready, 1) != 1) {
+    return false;
+  }
+  for (size_t i = 0; i < pcm.size(); i += kPeriod) {
+    if (sink.Write(&pcm[i], kPeriod)) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  close(fds[0]);
+  close(fds[1]);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// a reader falling behind loses the oldest bytes, not the writer's time
+bool CaseOverrun() {
+  auto name = SegmentName();
+  auto pcm = CreatePcm(200 * 1000);  // > 3 rings
+  ShmAudioSink sink(name, kCapacity);
+  ShmPcmReader reader;
+  ShmPcmState state;
+  std::vector<uint8_t> received(2 * kCapacity);
+  if (sink.Open(kCdFormat) || reader.Open(name) ||
+      reader.Read(received.data(), received.size(), &state)) {
+    return false;
+  }
+  for (size_t i = 0; i < pcm.size(); i += 1000) {
+    if (sink.Write(&pcm[i], 1000)) {
+      return false;
+    }
+  }
+  auto count = reader.Read(received.data(), received.size(), &state);
+  auto skipped = reader.Skipped();
+  return count <= kCapacity && count + skipped == pcm.size() &&
+         skipped % kCdFormat.BytesPerFrame() == 0 &&
+         std::equal(received.begin(), received.begin() + count,
+                    pcm.begin() + skipped) &&
+         reader.Read(received.data(), received.size(), &state) == 0;
+}
+
+// flushes and format changes, the segment outlives its readers' interest
+bool CaseSegments() {
+  auto name = SegmentName();
+  auto pcm = CreatePcm(4 * kPeriod);
+  ShmPcmReader reader;
+  ShmPcmState state;
+  std::vector<uint8_t> received(pcm.size());
+  {
+    ShmAudioSink sink(name, kCapacity);
+    if (reader.Open(name) != std::errc::no_such_file_or_directory ||
+        sink.Open(kCdFormat) || reader.Open(name) ||
+        reader.Read(received.data(), received.size(), &state)) {
+      return false;
+    }
+    // unread data before a flush is skipped
+    sink.Write(pcm.data(), kPeriod);
+    sink.Flush();
+    sink.Write(&pcm[kPeriod], kPeriod);
+    if (reader.Read(received.data(), received.size(), &state) != kPeriod ||
+        reader.Skipped() != kPeriod ||
+        !std::equal(received.begin(), received.begin() + kPeriod,
+                    pcm.begin() + kPeriod)) {
+      return false;
+    }
+    AudioFormat float_format{SampleFormat::kFloat, 48000, 2};
+    if (sink.Open(float_format) || sink.Write(pcm.data(), 2 * kPeriod) ||
+        reader.Read(received.data(), received.size(), &state) !=
+            2 * kPeriod ||
+        state.format != float_format || !state.active) {
+      return false;
+    }
+    sink.Close();
+    if (!reader.GetState(&state) || state.active) {
+      return false;
+    }
+  }
+  // gone with the sink, a mapped one stays readable
+  ShmPcmReader late;
+  return late.Open(name) == std::errc::no_such_file_or_directory &&
+         reader.GetState(&state) && !state.active;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseOtherProcess()) {
+    return 1;
+  }
+  if (!ip::CaseOverrun()) {
+    return 1;
+  }
+  if (!ip::CaseSegments()) {
+    return 1;
+  }
+  return 0;
+}
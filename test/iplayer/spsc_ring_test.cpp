@@ -0,0 +1,94 @@
+#include "iplayer/utils/spsc_ring.h"
+
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace ip {
+
+bool CaseWrapAround() {
+  SpscRing ring(10);
+  if (ring.Capacity() != 16 || ring.Size() != 0 || ring.Free() != 16) {
+    return false;
+  }
+  std::vector<uint8_t> data(20);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i);
+  }
+  // full ring only takes what fits
+  if (ring.Write(data.data(), data.size()) != 16 || ring.Free() != 0) {
+    return false;
+  }
+  std::vector<uint8_t> out(20);
+  if (ring.Read(out.data(), 10) != 10 || out[0] != 0 || out[9] != 9) {
+    return false;
+  }
+  // this write wraps around the end of the buffer
+  if (ring.Write(data.data(), 8) != 8 || ring.Size() != 14) {
+    return false;
+  }
+  if (ring.Read(out.data(), out.size()) != 14) {
+    return false;
+  }
+  std::vector<uint8_t> expected{10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7};
+  if (!std::equal(expected.begin(), expected.end(), out.begin())) {
+    return false;
+  }
+  ring.Write(data.data(), 5);
+  ring.Clear();
+  return ring.Size() == 0 && ring.Read(out.data(), 1) == 0;
+}
+
+// producer and consumer threads with odd sizes, consumer must see the exact
+// byte sequence
+bool CaseConcurrent() {
+  const size_t kTotal = 1024 * 1024;
+  SpscRing ring(4096);
+  auto producer = std::async(std::launch::async, [&ring]() {
+    std::vector<uint8_t> chunk(777);
+    size_t pos = 0;
+    while (pos < kTotal) {
+      auto len = std::min(chunk.size(), kTotal - pos);
+      for (size_t i = 0; i < len; ++i) {
+        chunk[i] = static_cast<uint8_t>((pos + i) % 251);
+      }
+      size_t written = 0;
+      while (written < len) {
+        auto count = ring.Write(chunk.data() + written, len - written);
+        if (count == 0) {
+          std::this_thread::yield();
+        }
+        written += count;
+      }
+      pos += len;
+    }
+  });
+
+  std::vector<uint8_t> chunk(1000);
+  size_t pos = 0;
+  bool ok = true;
+  while (pos < kTotal) {
+    auto len = ring.Read(chunk.data(), chunk.size());
+    if (len == 0) {
+      std::this_thread::yield();
+    }
+    for (size_t i = 0; i < len; ++i) {
+      ok = ok && chunk[i] == static_cast<uint8_t>((pos + i) % 251);
+    }
+    pos += len;
+  }
+  producer.wait();
+  return ok && ring.Size() == 0;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseWrapAround()) {
+    return 1;
+  }
+  if (!ip::CaseConcurrent()) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Synthetic MP3 tracks for tests: valid frame headers followed by filler,
+// enough for scanning, probing and tag reading (not for decoding).
+
+namespace ip {
+
+// MPEG 1 layer III, 128kbps, 44.1kHz: 417 bytes frames, 418 when padded
+const size_t kMpegFrameSize = 417;
+const uint32_t kMpegFrameSamples = 1152;
+
+// 'frame_count' frames filled with their index, one in three padded. Where
+// each frame starts is added to 'offsets' when given.
+inline std::vector<uint8_t> CreateMpegFrames(
+    size_t frame_count, std::vector<uint64_t>* offsets = nullptr) {
+  std::vector<uint8_t> data;
+  for (size_t i = 0; i < frame_count; ++i) {
+    bool padding = i % 3 == 0;
+    if (offsets) {
+      offsets->push_back(data.size());
+    }
+    std::vector<uint8_t> frame(kMpegFrameSize + (padding ? 1 : 0),
+                               static_cast<uint8_t>(i));
+    frame[0] = 0xff;
+    frame[1] = 0xfb;
+    frame[2] = padding ? 0x92 : 0x90;
+    frame[3] = 0x00;
+    data.insert(data.end(), frame.begin(), frame.end());
+  }
+  return data;
+}
+
+// ID3v2.3 tag with a latin1 TIT2 frame, nothing for an empty title
+inline std::vector<uint8_t> CreateTitleTag(const std::string& title) {
+  if (title.empty()) {
+    return {};
+  }
+  size_t frame_size = title.size() + 1;
+  size_t tag_size = 10 + frame_size;
+  std::vector<uint8_t> tag = {'I', 'D', '3', 3, 0, 0, 0, 0,
+                              static_cast<uint8_t>(tag_size >> 7),
+                              static_cast<uint8_t>(tag_size & 0x7f),
+                              'T', 'I', 'T', '2', 0, 0,
+                              static_cast<uint8_t>(frame_size >> 8),
+                              static_cast<uint8_t>(frame_size & 0xff), 0, 0,
+                              0};
+  tag.insert(tag.end(), title.begin(), title.end());
+  return tag;
+}
+
+inline std::vector<uint8_t> CreateTrack(const std::string& title,
+                                        size_t frame_count) {
+  auto track = CreateTitleTag(title);
+  auto frames = CreateMpegFrames(frame_count);
+  track.insert(track.end(), frames.begin(), frames.end());
+  return track;
+}
+
+}  // namespace ip
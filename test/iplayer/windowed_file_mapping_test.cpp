@@ -0,0 +1,102 @@
+#include "iplayer/utils/windowed_file_mapping.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "iplayer/fs_track_provider.h"
+#include "iplayer/utils/log.h"
+#include "iplayer/utils/mapping_cache.h"
+
+namespace ip {
+
+std::string CreateFile(const std::vector<uint8_t>& content) {
+  char path[] = "/tmp/iplayer_windowed_mapping_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return {};
+  }
+  auto written = write(fd, content.data(), content.size());
+  close(fd);
+  if (written != static_cast<ssize_t>(content.size())) {
+    return {};
+  }
+  return path;
+}
+
+bool CaseSlidingWindow() {
+  std::vector<uint8_t> content(1000000);
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = static_cast<uint8_t>(i * 7 + i / 251);
+  }
+  auto path = CreateFile(content);
+
+  WindowedFileMapping mapping(64 * 1024);
+  auto ec = mapping.Open(path);
+  unlink(path.c_str());
+  if (ec || mapping.size() != content.size()) {
+    return false;
+  }
+
+  // read sequentially with overlapping ranges then jump around
+  std::vector<uint64_t> offsets;
+  for (uint64_t offset = 0; offset < content.size(); offset += 10007) {
+    offsets.push_back(offset);
+  }
+  offsets.insert(std::end(offsets), {999999, 0, 500000, 65535, 65536});
+  for (auto offset : offsets) {
+    size_t available = 0;
+    auto data = mapping.Map(offset, 20000, &available, ec);
+    auto expected = std::min<size_t>(20000, content.size() - offset);
+    if (ec || !data || available < expected ||
+        offset + available > content.size() ||
+        memcmp(data, content.data() + offset, available) != 0) {
+      LOG("bad window at %lu", offset);
+      return false;
+    }
+  }
+
+  size_t available = 0;
+  return mapping.Map(content.size(), 1, &available, ec) == nullptr &&
+         available == 0 && !ec;
+}
+
+bool CaseTrackInfoWithoutCache() {
+  // ID3v2.3 tag with title then ID3v1 with track number
+  std::vector<uint8_t> content{'I', 'D', '3', 3, 0, 0, 0, 0, 0, 25,
+                               'T', 'I', 'T', '2', 0, 0, 0, 5,  0, 0,
+                               0,   'l', 'o', 'n', 'g', 0, 0, 0, 0, 0,
+                               0,   0,   0,   0,   0};
+  content.resize(content.size() + 3 * 1024 * 1024, 0x55);
+  std::vector<uint8_t> v1(128, 0);
+  memcpy(v1.data(), "TAGv1 title", 11);
+  v1[126] = 12;
+  content.insert(std::end(content), std::begin(v1), std::end(v1));
+  auto path = CreateFile(content);
+
+  // file doesn't fit in the cache: read through windows
+  auto budget = MappingCache::Instance().Budget();
+  MappingCache::Instance().SetBudget(1024 * 1024);
+  FsTrackProvider provider;
+  auto info = provider.GetTrackInfo("file://" + path);
+  MappingCache::Instance().SetBudget(budget);
+  unlink(path.c_str());
+
+  LOG("title: '%s', track: %u", info.Title().c_str(), info.TrackNumber());
+  return info.Title() == "long" && info.TrackNumber() == 12 &&
+         MappingCache::Instance().CachedSize() == 0;
+}
+
+}  // namespace ip
+
+int main() {
+  if (!ip::CaseSlidingWindow()) {
+    return 1;
+  }
+  if (!ip::CaseTrackInfoWithoutCache()) {
+    return 1;
+  }
+  return 0;
+}